@@ -0,0 +1,30 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void bench_report (const char *benchmark, const char *impl, const char *what, size_t size, unsigned long long n, long long elapsed)
+{
+    double ns_per_op = n ? (double)elapsed / (double)n : 0;
+    double ops_per_s = elapsed > 0 ? (double)n * 1e9 / (double)elapsed : 0;
+    const char *path = getenv("BENCH_JSON");
+    FILE *json;
+
+    printf("%-9s %-9s %-10s %5lu %12.1f ns/op %12.0f ops/s\n", benchmark, impl, what, (unsigned long)size, ns_per_op, ops_per_s);
+
+    if (!path || !*path)
+        return;
+
+    json = fopen(path, "a");
+    if (!json) {
+        perror(path);
+        exit(1);
+    }
+
+    /* None of the names need escaping. */
+    fprintf(json, "{\"benchmark\": \"%s\", \"impl\": \"%s\", \"op\": \"%s\", \"size\": %lu, \"iterations\": %llu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f}\n",
+        benchmark, impl, what, (unsigned long)size, n, ns_per_op, ops_per_s);
+
+    fclose(json);
+}
@@ -0,0 +1,14 @@
+#ifndef __CURVECPR_BENCH_H
+#define __CURVECPR_BENCH_H
+
+#include <string.h>
+
+/* What every benchmark reports through. Each result is printed as a line for
+   people and, if the BENCH_JSON environment variable names a file, appended to it
+   as one JSON object per line; `make bench` gathers those into bench.json. */
+
+/* One result: n operations of what, done by implementation impl at the given size
+   (bytes, or blocks in flight, or 0 if it doesn't apply), took elapsed nanoseconds. */
+void bench_report (const char *benchmark, const char *impl, const char *what, size_t size, unsigned long long n, long long elapsed);
+
+#endif
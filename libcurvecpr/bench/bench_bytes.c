@@ -0,0 +1,111 @@
+#include <curvecpr/bytes.h>
+#include <curvecpr/util.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* Times curvecpr_bytes_copy(), curvecpr_bytes_zero() and curvecpr_bytes_equal()
+   with each kernel the CPU supports, against the original byte-at-a-time loops, at
+   the sizes the library actually uses. */
+
+static const size_t sizes[] = { 8, 16, 32, 96, 256, 1088 };
+
+static const struct {
+    const char *name;
+    enum curvecpr_bytes_kernel kernel;
+} kernels[] = {
+    { "scalar", CURVECPR_BYTES_KERNEL_SCALAR },
+    { "sse2", CURVECPR_BYTES_KERNEL_SSE2 },
+    { "avx2", CURVECPR_BYTES_KERNEL_AVX2 }
+};
+
+/* The original implementations. */
+static void bytewise_copy (void *destination, const void *source, size_t num)
+{
+    volatile char *destination_copier = destination;
+    const char *source_copier = source;
+    while (num > 0) {
+        *destination_copier++ = *source_copier++;
+        --num;
+    }
+}
+
+static void bytewise_zero (void *destination, size_t num)
+{
+    volatile char *destination_copier = destination;
+    while (num > 0) {
+        *destination_copier++ = 0;
+        --num;
+    }
+}
+
+static int bytewise_equal (const void *ptr1, const void *ptr2, size_t num)
+{
+    const volatile unsigned char *ptr1_comparator = ptr1;
+    const unsigned char *ptr2_comparator = ptr2;
+    unsigned char diff = 0;
+    while (num > 0) {
+        diff |= *ptr1_comparator++ ^ *ptr2_comparator++;
+        --num;
+    }
+    return (256 - (unsigned int) diff) >> 8;
+}
+
+static unsigned char a[1088 + 1], b[1088 + 1];
+static volatile int sink;
+
+static void report (const char *impl, const char *op, size_t num, size_t n, long long start, long long end)
+{
+    bench_report("bytes", impl, op, num, n, end - start);
+}
+
+/* Unaligned on purpose; packets rarely start on a nice boundary. */
+static void run (const char *impl, void (*copy)(void *, const void *, size_t), void (*zero)(void *, size_t), int (*equal)(const void *, const void *, size_t))
+{
+    size_t i, j;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        size_t num = sizes[i], n = 100000000 / (num + 32);
+        long long start;
+        int total = 0;
+
+        start = curvecpr_util_nanoseconds();
+        for (j = 0; j < n; ++j)
+            copy(a + 1, b + 1, num);
+        report(impl, "copy", num, n, start, curvecpr_util_nanoseconds());
+
+        start = curvecpr_util_nanoseconds();
+        for (j = 0; j < n; ++j)
+            zero(a + 1, num);
+        report(impl, "zero", num, n, start, curvecpr_util_nanoseconds());
+
+        start = curvecpr_util_nanoseconds();
+        for (j = 0; j < n; ++j)
+            total += equal(a + 1, b + 1, num);
+        report(impl, "equal", num, n, start, curvecpr_util_nanoseconds());
+
+        sink = total;
+    }
+}
+
+int main (void)
+{
+    size_t i;
+
+    memset(b, 0x5a, sizeof(b));
+
+    run("bytewise", bytewise_copy, bytewise_zero, bytewise_equal);
+
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        if (curvecpr_bytes_set_kernel(kernels[i].kernel)) {
+            printf("%-8s unsupported\n", kernels[i].name);
+            continue;
+        }
+
+        run(kernels[i].name, curvecpr_bytes_copy, curvecpr_bytes_zero, curvecpr_bytes_equal);
+    }
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <curvecpr/bytes.h>
+#include <curvecpr/message.h>
+#include <curvecpr/util.h>
+
+#include "bench.h"
+
+#include <string.h>
+
+/* Compares the message header codec against reading and writing each field with
+   curvecpr_bytes_pack_uint*() and curvecpr_bytes_unpack_uint*(), as the messager used
+   to. */
+
+#define N 10000000
+
+static volatile crypto_uint64 sink;
+
+static void fieldwise_pack (unsigned char *destination, const struct curvecpr_message *message)
+{
+    const struct curvecpr_message_range *ranges = message->acknowledging_ranges;
+    int i;
+
+    curvecpr_bytes_pack_uint32(destination, message->id);
+    curvecpr_bytes_pack_uint32(destination + 4, message->acknowledging_id);
+    curvecpr_bytes_pack_uint64(destination + 8, ranges[0].end);
+    curvecpr_bytes_pack_uint32(destination + 16, (crypto_uint32)(ranges[1].start - ranges[0].end));
+    curvecpr_bytes_pack_uint16(destination + 20, (crypto_uint16)(ranges[1].end - ranges[1].start));
+
+    for (i = 2; i < 6; ++i) {
+        curvecpr_bytes_pack_uint16(destination + 14 + 4 * i, (crypto_uint16)(ranges[i].start - ranges[i - 1].end));
+        curvecpr_bytes_pack_uint16(destination + 16 + 4 * i, (crypto_uint16)(ranges[i].end - ranges[i].start));
+    }
+
+    curvecpr_bytes_pack_uint16(destination + 38, message->flags);
+    curvecpr_bytes_pack_uint64(destination + 40, message->offset);
+}
+
+static void fieldwise_unpack (struct curvecpr_message *message, const unsigned char *source)
+{
+    struct curvecpr_message_range *ranges = message->acknowledging_ranges;
+    int i;
+
+    message->id = curvecpr_bytes_unpack_uint32(source);
+    message->acknowledging_id = curvecpr_bytes_unpack_uint32(source + 4);
+    ranges[0].start = 0;
+    ranges[0].end = curvecpr_bytes_unpack_uint64(source + 8);
+    ranges[1].start = ranges[0].end + curvecpr_bytes_unpack_uint32(source + 16);
+    ranges[1].end = ranges[1].start + curvecpr_bytes_unpack_uint16(source + 20);
+
+    for (i = 2; i < 6; ++i) {
+        ranges[i].start = ranges[i - 1].end + curvecpr_bytes_unpack_uint16(source + 14 + 4 * i);
+        ranges[i].end = ranges[i].start + curvecpr_bytes_unpack_uint16(source + 16 + 4 * i);
+    }
+
+    message->flags = curvecpr_bytes_unpack_uint16(source + 38);
+    message->offset = curvecpr_bytes_unpack_uint64(source + 40);
+}
+
+static void run (const char *impl, void (*pack)(unsigned char *, const struct curvecpr_message *), void (*unpack)(struct curvecpr_message *, const unsigned char *))
+{
+    unsigned char wire[CURVECPR_MESSAGE_HEADER + 1];
+    struct curvecpr_message message;
+    long long start;
+    size_t i;
+
+    for (i = 0; i < sizeof(wire); ++i)
+        wire[i] = (unsigned char)(i * 37);
+
+    /* Deliberately unaligned. */
+    start = curvecpr_util_nanoseconds();
+    for (i = 0; i < N; ++i) {
+        wire[1] = (unsigned char)i;
+        unpack(&message, wire + 1);
+        sink = message.acknowledging_ranges[5].end;
+    }
+    bench_report("message", impl, "unpack", CURVECPR_MESSAGE_HEADER, N, curvecpr_util_nanoseconds() - start);
+
+    start = curvecpr_util_nanoseconds();
+    for (i = 0; i < N; ++i) {
+        message.id = (crypto_uint32)i;
+        pack(wire + 1, &message);
+        sink = wire[1];
+    }
+    bench_report("message", impl, "pack", CURVECPR_MESSAGE_HEADER, N, curvecpr_util_nanoseconds() - start);
+}
+
+int main (void)
+{
+    run("fieldwise", fieldwise_pack, fieldwise_unpack);
+    run("codec", curvecpr_message_pack, curvecpr_message_unpack);
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <curvecpr/bytes.h>
+#include <curvecpr/client.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+#include <curvecpr/util.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sodium/crypto_box.h>
+#include <sodium/randombytes.h>
+
+/* Times the packet layer on its own, with nothing but a buffer for a network:
+   hellos answered by curvecpr_server_recv(), whole handshakes from the client's
+   first hello to its first message from the server, and messages sent each way at
+   the smallest, a typical and the largest size. */
+
+#define HELLOS 20000
+#define HANDSHAKES 2000
+#define SENDS 200000
+
+static const size_t sizes[] = { 16, 512, 1088 };
+
+static struct curvecpr_session session;
+static unsigned char have_session = 0;
+
+static unsigned char wire[2048];
+static size_t wire_num = 0;
+static unsigned long long received = 0;
+
+static int t_put_session (struct curvecpr_server *server, const struct curvecpr_session *s, void *priv, struct curvecpr_session **s_stored)
+{
+    curvecpr_bytes_copy(&session, s, sizeof(struct curvecpr_session));
+    have_session = 1;
+
+    *s_stored = &session;
+    return 0;
+}
+
+static int t_get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    if (!have_session || !curvecpr_bytes_equal(session.their_session_pk, their_session_pk, 32))
+        return 1;
+
+    *s_stored = &session;
+    return 0;
+}
+
+static int t_server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_server_recv (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    ++received;
+    return 0;
+}
+
+static int t_server_next_nonce (struct curvecpr_server *server, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+static int t_client_send (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_client_recv (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    ++received;
+    return 0;
+}
+
+static int t_client_next_nonce (struct curvecpr_client *client, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+static void check (int r, const char *what)
+{
+    if (r) {
+        fprintf(stderr, "%s failed (%d)\n", what, r);
+        exit(1);
+    }
+}
+
+/* Runs one handshake, leaving the client negotiated and the server's session in
+   session. */
+static void handshake (struct curvecpr_server *server, struct curvecpr_client *client, const struct curvecpr_client_cf *client_cf, const unsigned char *message)
+{
+    have_session = 0;
+
+    check(curvecpr_client_new(client, client_cf), "client");
+    check(curvecpr_client_connected(client), "hello");
+    check(curvecpr_server_recv(server, NULL, wire, wire_num, NULL), "cookie");
+    check(curvecpr_client_recv(client, wire, wire_num), "cookie receipt");
+    check(curvecpr_client_send(client, message, 16), "initiate");
+    check(curvecpr_server_recv(server, NULL, wire, wire_num, NULL), "initiate receipt");
+    check(curvecpr_server_send(server, &session, NULL, message, 16), "server message");
+    check(curvecpr_client_recv(client, wire, wire_num), "server message receipt");
+
+    if (client->negotiated != CURVECPR_CLIENT_NEGOTIATED)
+        check(-1, "handshake");
+}
+
+int main (void)
+{
+    struct curvecpr_server server;
+    struct curvecpr_server_cf server_cf = {
+        .ops = {
+            .put_session = t_put_session,
+            .get_session = t_get_session,
+            .send = t_server_send,
+            .recv = t_server_recv,
+            .next_nonce = t_server_next_nonce
+        }
+    };
+    struct curvecpr_client client;
+    struct curvecpr_client_cf client_cf = {
+        .ops = {
+            .send = t_client_send,
+            .recv = t_client_recv,
+            .next_nonce = t_client_next_nonce
+        }
+    };
+    static unsigned char message[1088];
+    unsigned char hello[224];
+    size_t hello_num;
+    long long start;
+    size_t i, j;
+
+    crypto_box_keypair(server_cf.my_global_pk, server_cf.my_global_sk);
+    crypto_box_keypair(client_cf.my_global_pk, client_cf.my_global_sk);
+    curvecpr_bytes_copy(client_cf.their_global_pk, server_cf.my_global_pk, 32);
+    curvecpr_util_encode_domain_name(client_cf.their_domain_name, "localhost");
+
+    curvecpr_server_new(&server, &server_cf);
+
+    /* The same hello over and over; servers keep no state for hellos, so each one
+       costs the same as a new client's. */
+    check(curvecpr_client_new(&client, &client_cf), "client");
+    check(curvecpr_client_connected(&client), "hello");
+    curvecpr_bytes_copy(hello, wire, wire_num);
+    hello_num = wire_num;
+    curvecpr_client_destroy(&client);
+
+    start = curvecpr_util_nanoseconds();
+    for (i = 0; i < HELLOS; ++i)
+        check(curvecpr_server_recv(&server, NULL, hello, hello_num, NULL), "cookie");
+    bench_report("packets", "server", "hello", hello_num, HELLOS, curvecpr_util_nanoseconds() - start);
+
+    start = curvecpr_util_nanoseconds();
+    for (i = 0; i < HANDSHAKES; ++i) {
+        handshake(&server, &client, &client_cf, message);
+        if (i + 1 < HANDSHAKES)
+            curvecpr_client_destroy(&client);
+    }
+    bench_report("packets", "both", "handshake", 0, HANDSHAKES, curvecpr_util_nanoseconds() - start);
+
+    /* Messages over the last handshake's session. */
+    for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j) {
+        start = curvecpr_util_nanoseconds();
+        for (i = 0; i < SENDS; ++i)
+            check(curvecpr_server_send(&server, &session, NULL, message, sizes[j]), "server message");
+        bench_report("packets", "server", "send", sizes[j], SENDS, curvecpr_util_nanoseconds() - start);
+
+        start = curvecpr_util_nanoseconds();
+        for (i = 0; i < SENDS; ++i)
+            check(curvecpr_client_send(&client, message, sizes[j]), "client message");
+        bench_report("packets", "client", "send", sizes[j], SENDS, curvecpr_util_nanoseconds() - start);
+    }
+
+    curvecpr_client_destroy(&client);
+
+    return 0;
+}
@@ -0,0 +1,347 @@
+#include <curvecpr/block.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+#include <curvecpr/util.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Compares the built-in queues against the kind of linked-list queues most users
+   write first, with 1k, 10k and 100k blocks in flight. */
+
+/* The list-based baseline. The sendmarkq is kept unordered, so finding the oldest
+   block means walking the whole list. */
+struct list_node {
+    struct curvecpr_block block;
+    unsigned char data[CURVECPR_BLOCK_DATA];
+    struct list_node *prev;
+    struct list_node *next;
+};
+
+struct list {
+    struct list_node *head;
+    struct list_node *tail;
+    size_t len;
+};
+
+struct lists {
+    struct list sendq;
+    struct list sendmarkq;
+    struct list recvmarkq;
+    size_t sendmarkq_blocks;
+    size_t recvmarkq_blocks;
+};
+
+static void list_unlink (struct list *list, struct list_node *node)
+{
+    if (node->prev) node->prev->next = node->next; else list->head = node->next;
+    if (node->next) node->next->prev = node->prev; else list->tail = node->prev;
+    --list->len;
+}
+
+static void list_insert_before (struct list *list, struct list_node *at, struct list_node *node)
+{
+    node->next = at;
+    node->prev = at ? at->prev : list->tail;
+    if (node->prev) node->prev->next = node; else list->head = node;
+    if (at) at->prev = node; else list->tail = node;
+    ++list->len;
+}
+
+static void list_remove_range (struct list *list, unsigned long long start, unsigned long long end)
+{
+    struct list_node *node = list->head;
+
+    while (node) {
+        struct list_node *next = node->next;
+
+        if (node->block.offset >= start && node->block.offset + node->block.data_len <= end) {
+            list_unlink(list, node);
+            free(node);
+        }
+
+        node = next;
+    }
+}
+
+static struct lists *l_lists (struct curvecpr_messager *messager)
+{
+    return messager->cf.priv;
+}
+
+static int l_sendq_head (struct curvecpr_messager *messager, struct curvecpr_block **block_stored)
+{
+    if (!l_lists(messager)->sendq.head)
+        return 1;
+
+    *block_stored = &l_lists(messager)->sendq.head->block;
+    return 0;
+}
+
+static int l_sendq_move_to_sendmarkq (struct curvecpr_messager *messager, const struct curvecpr_block *block, struct curvecpr_block **block_stored)
+{
+    struct lists *lists = l_lists(messager);
+    struct list_node *node = lists->sendq.head;
+
+    if (!node || &node->block != block)
+        return 1;
+
+    list_unlink(&lists->sendq, node);
+    list_insert_before(&lists->sendmarkq, NULL, node);
+    return 0;
+}
+
+static unsigned char l_sendq_is_empty (struct curvecpr_messager *messager)
+{
+    return l_lists(messager)->sendq.head == NULL;
+}
+
+static int l_sendmarkq_head (struct curvecpr_messager *messager, struct curvecpr_block **block_stored)
+{
+    struct list_node *node, *oldest = NULL;
+
+    for (node = l_lists(messager)->sendmarkq.head; node; node = node->next) {
+        if (!oldest || node->block.clock < oldest->block.clock)
+            oldest = node;
+    }
+
+    if (!oldest)
+        return 1;
+
+    *block_stored = &oldest->block;
+    return 0;
+}
+
+static int l_sendmarkq_get (struct curvecpr_messager *messager, crypto_uint32 acknowledging_id, struct curvecpr_block **block_stored)
+{
+    struct list_node *node;
+
+    for (node = l_lists(messager)->sendmarkq.head; node; node = node->next) {
+        if (node->block.id == acknowledging_id) {
+            *block_stored = &node->block;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int l_sendmarkq_remove_range (struct curvecpr_messager *messager, unsigned long long start, unsigned long long end)
+{
+    list_remove_range(&l_lists(messager)->sendmarkq, start, end);
+    return 0;
+}
+
+static unsigned char l_sendmarkq_is_full (struct curvecpr_messager *messager)
+{
+    return l_lists(messager)->sendmarkq.len >= l_lists(messager)->sendmarkq_blocks;
+}
+
+static int l_recvmarkq_put (struct curvecpr_messager *messager, const struct curvecpr_block *block, struct curvecpr_block **block_stored)
+{
+    struct lists *lists = l_lists(messager);
+    struct list_node *at, *node;
+
+    for (at = lists->recvmarkq.head; at && at->block.offset < block->offset; at = at->next) {}
+
+    if (at && at->block.offset == block->offset) {
+        *block_stored = &at->block;
+        return 0;
+    }
+
+    if (lists->recvmarkq.len >= lists->recvmarkq_blocks)
+        return 1;
+
+    node = malloc(sizeof(struct list_node));
+    if (!node)
+        return 1;
+
+    curvecpr_bytes_copy(&node->block, block, sizeof(struct curvecpr_block));
+    curvecpr_bytes_copy(node->data, block->data, block->data_len);
+    node->block.data = node->data;
+    list_insert_before(&lists->recvmarkq, at, node);
+
+    *block_stored = &node->block;
+    return 0;
+}
+
+static int l_recvmarkq_get_nth_unacknowledged (struct curvecpr_messager *messager, unsigned int n, struct curvecpr_block **block_stored)
+{
+    struct list_node *node = l_lists(messager)->recvmarkq.head;
+
+    while (node && n--)
+        node = node->next;
+
+    if (!node)
+        return 1;
+
+    *block_stored = &node->block;
+    return 0;
+}
+
+static unsigned char l_recvmarkq_is_empty (struct curvecpr_messager *messager)
+{
+    return l_lists(messager)->recvmarkq.head == NULL;
+}
+
+static int l_recvmarkq_remove_range (struct curvecpr_messager *messager, unsigned long long start, unsigned long long end)
+{
+    list_remove_range(&l_lists(messager)->recvmarkq, start, end);
+    return 0;
+}
+
+static int l_sendq_put (struct lists *lists, const struct curvecpr_block *block)
+{
+    struct list_node *node = malloc(sizeof(struct list_node));
+    if (!node)
+        return -1;
+
+    curvecpr_bytes_copy(&node->block, block, sizeof(struct curvecpr_block));
+    curvecpr_bytes_copy(node->data, block->data, block->data_len);
+    node->block.data = node->data;
+    list_insert_before(&lists->sendq, NULL, node);
+    return 0;
+}
+
+static void l_free (struct lists *lists)
+{
+    list_remove_range(&lists->sendq, 0, -1ULL);
+    list_remove_range(&lists->sendmarkq, 0, -1ULL);
+    list_remove_range(&lists->recvmarkq, 0, -1ULL);
+}
+
+/* Shared pieces. */
+static int t_send (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
+{
+    return 0;
+}
+
+static void build_ack (unsigned char *buf, crypto_uint32 acknowledging_id, crypto_uint64 acknowledged)
+{
+    curvecpr_bytes_zero(buf, 192);
+    curvecpr_bytes_pack_uint32(buf + 4, acknowledging_id);
+    curvecpr_bytes_pack_uint64(buf + 8, acknowledged);
+}
+
+static void build_data (unsigned char *buf, crypto_uint32 id, crypto_uint64 offset)
+{
+    curvecpr_bytes_zero(buf, 1088);
+    curvecpr_bytes_pack_uint32(buf, id);
+    curvecpr_bytes_pack_uint16(buf + 38, 1024);
+    curvecpr_bytes_pack_uint64(buf + 40, offset);
+}
+
+static void report (const char *impl, const char *phase, size_t n, long long start, long long end)
+{
+    bench_report("queues", impl, phase, n, n, end - start);
+}
+
+static void run (const char *impl, struct curvecpr_messager_cf *cf, size_t n, int (*sendq_put)(void *, const struct curvecpr_block *), void *sendq_priv)
+{
+    struct curvecpr_messager messager;
+    static const unsigned char payload[1024];
+    struct curvecpr_block block = { .eof = CURVECPR_BLOCK_STREAM, .data_len = 1024, .data = payload };
+    unsigned char buf[1088];
+    long long start;
+    size_t i;
+
+    curvecpr_messager_new(&messager, cf, 0);
+
+    /* Nothing should time out and get retransmitted while we're filling up. */
+    messager.chicago.rtt_timeout = 1LL << 50;
+
+    /* Fill the sendq and push everything into flight. */
+    start = curvecpr_util_nanoseconds();
+    for (i = 0; i < n; ++i) {
+        sendq_put(sendq_priv, &block);
+        messager.my_sent_clock = 0;
+        curvecpr_messager_process_sendq(&messager);
+    }
+    report(impl, "send", n, start, curvecpr_util_nanoseconds());
+
+    /* Acknowledge every block in order, one acknowledgment per block. */
+    start = curvecpr_util_nanoseconds();
+    for (i = 0; i < n; ++i) {
+        build_ack(buf, (crypto_uint32)(i + 1), (crypto_uint64)(i + 1) * 1024);
+        curvecpr_messager_recv(&messager, buf, 192);
+    }
+    report(impl, "ack", n, start, curvecpr_util_nanoseconds());
+
+    /* Receive data, reordered within windows of 64 blocks. */
+    start = curvecpr_util_nanoseconds();
+    for (i = 0; i < n; ++i) {
+        size_t j = (i & ~(size_t)63) + 63 - (i & 63);
+        if (j >= n)
+            j = i;
+
+        build_data(buf, (crypto_uint32)(i + 1), (crypto_uint64)j * 1024);
+        curvecpr_messager_recv(&messager, buf, 1088);
+    }
+    report(impl, "recv", n, start, curvecpr_util_nanoseconds());
+}
+
+static int queues_sendq_put (void *priv, const struct curvecpr_block *block)
+{
+    return curvecpr_queues_sendq_put(priv, block);
+}
+
+static int lists_sendq_put (void *priv, const struct curvecpr_block *block)
+{
+    return l_sendq_put(priv, block);
+}
+
+int main (void)
+{
+    static const size_t sizes[] = { 1000, 10000, 100000 };
+    size_t i;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        size_t n = sizes[i];
+
+        {
+            struct lists lists = { .sendmarkq_blocks = n, .recvmarkq_blocks = n };
+            struct curvecpr_messager_cf cf = {
+                .ops = {
+                    .sendq_head = l_sendq_head,
+                    .sendq_move_to_sendmarkq = l_sendq_move_to_sendmarkq,
+                    .sendq_is_empty = l_sendq_is_empty,
+                    .sendmarkq_head = l_sendmarkq_head,
+                    .sendmarkq_get = l_sendmarkq_get,
+                    .sendmarkq_remove_range = l_sendmarkq_remove_range,
+                    .sendmarkq_is_full = l_sendmarkq_is_full,
+                    .recvmarkq_put = l_recvmarkq_put,
+                    .recvmarkq_get_nth_unacknowledged = l_recvmarkq_get_nth_unacknowledged,
+                    .recvmarkq_is_empty = l_recvmarkq_is_empty,
+                    .recvmarkq_remove_range = l_recvmarkq_remove_range,
+                    .send = t_send
+                },
+                .priv = &lists
+            };
+
+            run("list", &cf, n, lists_sendq_put, &lists);
+            l_free(&lists);
+        }
+
+        {
+            struct curvecpr_queues queues;
+            struct curvecpr_queues_cf queues_cf = { .send_blocks = n, .recv_blocks = n };
+            struct curvecpr_messager_cf cf = { .ops = { .send = t_send } };
+
+            if (curvecpr_queues_new(&queues, &queues_cf)) {
+                fprintf(stderr, "could not allocate queues for %lu blocks\n", (unsigned long)n);
+                return 1;
+            }
+
+            curvecpr_queues_configure(&queues, &cf);
+
+            run("queues", &cf, n, queues_sendq_put, &queues);
+            curvecpr_queues_destroy(&queues);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <curvecpr/bytes.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/util.h>
+#include <curvecpr/wheel.h>
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Times the timing wheel with 10k, 100k and 1M messagers on it: rescheduling them
+   (mostly within the same tick, as after each message, and sometimes not), and
+   advancing a millisecond at a time and popping whatever has come due. */
+
+#define TICK 1000000LL
+
+int main (void)
+{
+    static const size_t sizes[] = { 10000, 100000, 1000000 };
+    size_t i, j;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        size_t n = sizes[i];
+        struct curvecpr_messager *messagers = calloc(n, sizeof(struct curvecpr_messager));
+        struct curvecpr_wheel_cf cf = { .tick = TICK };
+        struct curvecpr_wheel wheel;
+        unsigned long long state = 1, popped = 0;
+        long long now, start;
+
+        if (!messagers) {
+            fprintf(stderr, "could not allocate %lu messagers\n", (unsigned long)n);
+            return 1;
+        }
+
+        /* Fault the memory in first, so it isn't timed. */
+        curvecpr_bytes_zero(messagers, n * sizeof(struct curvecpr_messager));
+
+        curvecpr_wheel_new(&wheel, &cf);
+        now = wheel.tick * TICK;
+
+        /* Spread over the next second, as retransmission timeouts would be. */
+        start = curvecpr_util_nanoseconds();
+        for (j = 0; j < n; ++j) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            curvecpr_wheel_schedule(&wheel, &messagers[j], now + (long long)((state >> 33) % 1000000000ULL));
+        }
+        bench_report("wheel", "wheel", "schedule", n, n, curvecpr_util_nanoseconds() - start);
+
+        /* Nine times in ten the timeout hasn't moved by a tick. */
+        start = curvecpr_util_nanoseconds();
+        for (j = 0; j < n; ++j) {
+            struct curvecpr_messager *messager = &messagers[(j * 7919) % n];
+            long long at = messager->timer.tick * TICK;
+
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            if ((state >> 33) % 10 == 0)
+                at += (long long)((state >> 33) % 500000000ULL);
+
+            curvecpr_wheel_schedule(&wheel, messager, at);
+        }
+        bench_report("wheel", "wheel", "reschedule", n, n, curvecpr_util_nanoseconds() - start);
+
+        start = curvecpr_util_nanoseconds();
+        for (j = 0; j < 2000; ++j) {
+            now += TICK;
+            curvecpr_wheel_advance(&wheel, now);
+
+            while (curvecpr_wheel_pop(&wheel))
+                ++popped;
+        }
+        bench_report("wheel", "wheel", "expire", n, popped, curvecpr_util_nanoseconds() - start);
+
+        free(messagers);
+    }
+
+    return 0;
+}
@@ -0,0 +1,311 @@
+#include <curvecpr/bytes.h>
+#include <curvecpr/client.h>
+#include <curvecpr/clients.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+#include <curvecpr/sessions.h>
+#include <curvecpr/util.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <sodium/crypto_box.h>
+#include <sodium/randombytes.h>
+
+/* Runs a server on a loopback UDP socket and connects a pool of clients to it over
+   a handful of sockets. Every client sends messages and waits for each to be
+   echoed back. Prints what the pool saw.
+
+   Usage: loadgen [-c clients] [-s sockets] [-m messages] [-n bytes]
+                  [-i hello interval ms] [-a hello attempts] [-t seconds] */
+
+#define MAX_SOCKETS 64
+
+static struct {
+    crypto_uint32 clients;
+    int sockets;
+    int messages;
+    size_t message_bytes;
+    long long hello_interval;
+    crypto_uint32 hello_attempts;
+    long long timeout;
+} options = { 1000, 4, 4, 512, 250, 5, 30 };
+
+static int server_fd;
+static struct sockaddr_in server_addr;
+static int client_fds[MAX_SOCKETS];
+
+static struct curvecpr_server server;
+static struct curvecpr_sessions sessions;
+static struct curvecpr_clients clients;
+
+static int *echoes;
+static crypto_uint32 finished = 0;
+static unsigned long long messages_echoed = 0;
+static unsigned char message[1088];
+
+static int open_socket (struct sockaddr_in *addr)
+{
+    socklen_t len = sizeof(struct sockaddr_in);
+    int buffer = 4 * 1024 * 1024;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (fd < 0) {
+        perror("socket");
+        exit(1);
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(fd, (struct sockaddr *)addr, len) || getsockname(fd, (struct sockaddr *)addr, &len)) {
+        perror("bind");
+        exit(1);
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    return fd;
+}
+
+static int server_send (struct curvecpr_server *s, struct curvecpr_session *session, void *priv, const unsigned char *buf, size_t num)
+{
+    const struct sockaddr_in *to = priv;
+
+    sendto(server_fd, buf, num, 0, (const struct sockaddr *)to, sizeof(struct sockaddr_in));
+    return 0;
+}
+
+/* Echo everything back. */
+static int server_recv (struct curvecpr_server *s, struct curvecpr_session *session, void *priv, const unsigned char *buf, size_t num)
+{
+    return curvecpr_server_send(s, session, priv, buf, num);
+}
+
+static int server_next_nonce (struct curvecpr_server *s, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+static int clients_send (struct curvecpr_clients *c, crypto_uint32 index, const unsigned char *buf, size_t num)
+{
+    sendto(client_fds[index % (crypto_uint32)options.sockets], buf, num, 0, (const struct sockaddr *)&server_addr, sizeof(server_addr));
+    return 0;
+}
+
+static int clients_recv (struct curvecpr_clients *c, crypto_uint32 index, const unsigned char *buf, size_t num)
+{
+    ++messages_echoed;
+
+    if (++echoes[index] < options.messages)
+        curvecpr_clients_send(c, index, message, options.message_bytes);
+    else if (echoes[index] == options.messages)
+        ++finished;
+
+    return 0;
+}
+
+static void clients_connected (struct curvecpr_clients *c, crypto_uint32 index)
+{
+    /* The first message goes in the initiate, which has less room. */
+    curvecpr_clients_send(c, index, message, options.message_bytes > 640 ? 640 : options.message_bytes);
+}
+
+static void clients_failed (struct curvecpr_clients *c, crypto_uint32 index)
+{
+    ++finished;
+}
+
+static void parse_options (int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:s:m:n:i:a:t:")) != -1) {
+        switch (opt) {
+            case 'c': options.clients = (crypto_uint32)strtoul(optarg, NULL, 10); break;
+            case 's': options.sockets = atoi(optarg); break;
+            case 'm': options.messages = atoi(optarg); break;
+            case 'n': options.message_bytes = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'i': options.hello_interval = atoll(optarg); break;
+            case 'a': options.hello_attempts = (crypto_uint32)strtoul(optarg, NULL, 10); break;
+            case 't': options.timeout = atoll(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-c clients] [-s sockets] [-m messages] [-n bytes] [-i hello interval ms] [-a hello attempts] [-t seconds]\n", argv[0]);
+                exit(2);
+        }
+    }
+
+    if (!options.clients || options.sockets < 1 || options.sockets > MAX_SOCKETS || options.messages < 1 ||
+        options.message_bytes < 16 || options.message_bytes > 1088 || options.message_bytes & 15) {
+        fprintf(stderr, "%s: bad options (messages must be 16 to 1088 bytes, in multiples of 16)\n", argv[0]);
+        exit(2);
+    }
+}
+
+static void drain (int fd, int is_server, long long now)
+{
+    unsigned char buf[2048];
+    struct sockaddr_in from;
+
+    for (;;) {
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+
+        if (n < 0)
+            return;
+
+        if (is_server)
+            curvecpr_server_recv(&server, &from, buf, (size_t)n, NULL);
+        else
+            curvecpr_clients_recv(&clients, buf, (size_t)n, now);
+    }
+}
+
+int main (int argc, char **argv)
+{
+    struct curvecpr_server_cf server_cf = {
+        .ops = {
+            .send = server_send,
+            .recv = server_recv,
+            .next_nonce = server_next_nonce
+        }
+    };
+    struct curvecpr_sessions_cf sessions_cf = { .capacity = 0 };
+    struct curvecpr_client_cf profile_cf = { .my_extension = { 0 } };
+    struct curvecpr_client_profile *profile;
+    struct curvecpr_clients_cf clients_cf = {
+        .ops = {
+            .send = clients_send,
+            .recv = clients_recv,
+            .connected = clients_connected,
+            .failed = clients_failed
+        }
+    };
+    struct pollfd fds[MAX_SOCKETS + 1];
+    long long start, end, deadline, now;
+    crypto_uint32 i;
+    int j;
+
+    parse_options(argc, argv);
+
+    echoes = calloc(options.clients, sizeof(int));
+    if (!echoes)
+        return 1;
+
+    memset(message, 0x5a, sizeof(message));
+
+    /* The server. */
+    server_fd = open_socket(&server_addr);
+
+    crypto_box_keypair(server_cf.my_global_pk, server_cf.my_global_sk);
+
+    sessions_cf.capacity = options.clients;
+    if (curvecpr_sessions_new(&sessions, &sessions_cf))
+        return 1;
+
+    curvecpr_sessions_configure(&sessions, &server_cf);
+    curvecpr_server_new(&server, &server_cf);
+
+    /* The clients. */
+    for (j = 0; j < options.sockets; ++j) {
+        struct sockaddr_in addr;
+
+        client_fds[j] = open_socket(&addr);
+    }
+
+    crypto_box_keypair(profile_cf.my_global_pk, profile_cf.my_global_sk);
+    curvecpr_bytes_copy(profile_cf.their_global_pk, server_cf.my_global_pk, 32);
+    curvecpr_util_encode_domain_name(profile_cf.their_domain_name, "localhost");
+
+    if (curvecpr_client_profile_new(&profile, &profile_cf))
+        return 1;
+
+    clients_cf.clients = options.clients;
+    clients_cf.profile = profile;
+    clients_cf.hello_interval = options.hello_interval * 1000000LL;
+    clients_cf.hello_attempts = options.hello_attempts;
+
+    if (curvecpr_clients_new(&clients, &clients_cf))
+        return 1;
+
+    /* Go. */
+    fds[0].fd = server_fd;
+    fds[0].events = POLLIN;
+    for (j = 0; j < options.sockets; ++j) {
+        fds[j + 1].fd = client_fds[j];
+        fds[j + 1].events = POLLIN;
+    }
+
+    start = curvecpr_util_nanoseconds();
+    deadline = start + options.timeout * 1000000000LL;
+
+    for (i = 0; i < options.clients; ++i) {
+        curvecpr_clients_connect(&clients, i, start);
+
+        /* Let the server keep up. */
+        if (i % 64 == 63)
+            drain(server_fd, 1, start);
+    }
+
+    while (finished < options.clients) {
+        long long next;
+        int timeout = 100;
+
+        now = curvecpr_util_nanoseconds();
+        if (now >= deadline)
+            break;
+
+        next = curvecpr_clients_next_timeout(&clients);
+        if (next >= 0)
+            timeout = next <= now ? 0 : (int)((next - now) / 1000000LL + 1);
+
+        if (poll(fds, (nfds_t)options.sockets + 1, timeout) < 0 && errno != EINTR) {
+            perror("poll");
+            return 1;
+        }
+
+        now = curvecpr_util_nanoseconds();
+
+        for (j = 0; j <= options.sockets; ++j) {
+            if (fds[j].revents & POLLIN)
+                drain(fds[j].fd, j == 0, now);
+        }
+
+        curvecpr_clients_process(&clients, now);
+    }
+
+    end = curvecpr_util_nanoseconds();
+
+    printf("clients          %u over %d sockets, %d x %zu byte messages each\n", options.clients, options.sockets, options.messages, options.message_bytes);
+    printf("connected        %u\n", clients.stats.connected);
+    printf("failed           %u\n", clients.stats.failed);
+    printf("still connecting %u\n", clients.stats.connecting);
+    printf("hellos           %llu (%llu retries)\n", clients.stats.hellos, clients.stats.hello_retries);
+    printf("connect time     %.3f ms average\n", clients.stats.connected ? (double)clients.stats.connect_time / clients.stats.connected / 1e6 : 0.0);
+    printf("packets          %llu sent, %llu received, %llu dropped\n", clients.stats.packets_sent, clients.stats.packets_received, clients.stats.packets_dropped);
+    printf("messages echoed  %llu\n", messages_echoed);
+    printf("elapsed          %.3f s\n", (double)(end - start) / 1e9);
+    printf("handshakes/s     %.0f\n", (double)clients.stats.connected / ((double)(end - start) / 1e9));
+    printf("messages/s       %.0f\n", (double)messages_echoed / ((double)(end - start) / 1e9));
+
+    curvecpr_clients_destroy(&clients);
+    curvecpr_client_profile_unref(profile);
+    curvecpr_sessions_destroy(&sessions);
+    free(echoes);
+
+    return finished == options.clients && !clients.stats.failed ? 0 : 1;
+}
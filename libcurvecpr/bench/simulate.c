@@ -0,0 +1,125 @@
+#include <curvecpr/bbr.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/netsim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Runs one transfer through the network simulator (see curvecpr/netsim.h) and
+   prints how it went. The same options and seed always give the same numbers.
+
+   Usage: simulate [-n bytes] [-d delay ms] [-j jitter ms] [-b bandwidth bytes/s]
+                   [-q queue bytes] [-l loss ppm] [-s seed] [-c chicago|bbr] [-H]
+                   [-t seconds] */
+
+static struct {
+    unsigned long long bytes;
+    long long delay;
+    long long jitter;
+    long long bandwidth;
+    size_t queue_bytes;
+    unsigned int loss;
+    unsigned long long seed;
+    int bbr;
+    int handshake;
+    long long time_limit;
+} options = { 1048576, 50, 0, 1250000, 65536, 0, 1, 0, 0, 600 };
+
+static struct curvecpr_bbr bbr[2];
+
+static void configure (struct curvecpr_netsim *netsim, int side, struct curvecpr_messager_cf *cf)
+{
+    if (options.bbr) {
+        curvecpr_bbr_new(&bbr[side]);
+        curvecpr_bbr_configure(&bbr[side], cf);
+    }
+}
+
+static void parse_options (int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:j:b:q:l:s:c:Ht:")) != -1) {
+        switch (opt) {
+            case 'n': options.bytes = strtoull(optarg, NULL, 10); break;
+            case 'd': options.delay = atoll(optarg); break;
+            case 'j': options.jitter = atoll(optarg); break;
+            case 'b': options.bandwidth = atoll(optarg); break;
+            case 'q': options.queue_bytes = (size_t)strtoul(optarg, NULL, 10); break;
+            case 'l': options.loss = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 's': options.seed = strtoull(optarg, NULL, 10); break;
+            case 'c':
+                if (strcmp(optarg, "bbr") == 0) options.bbr = 1;
+                else if (strcmp(optarg, "chicago") == 0) options.bbr = 0;
+                else goto usage;
+                break;
+            case 'H': options.handshake = 1; break;
+            case 't': options.time_limit = atoll(optarg); break;
+            default:
+                goto usage;
+        }
+    }
+
+    if (options.delay < 0 || options.jitter < 0 || options.bandwidth < 0 || options.loss > 1000000 || options.time_limit < 1) {
+        fprintf(stderr, "%s: bad options (loss is in millionths)\n", argv[0]);
+        exit(2);
+    }
+
+    return;
+
+usage:
+    fprintf(stderr, "usage: %s [-n bytes] [-d delay ms] [-j jitter ms] [-b bandwidth bytes/s] [-q queue bytes] [-l loss ppm] [-s seed] [-c chicago|bbr] [-H] [-t seconds]\n", argv[0]);
+    exit(2);
+}
+
+int main (int argc, char **argv)
+{
+    struct curvecpr_netsim_cf cf;
+    struct curvecpr_netsim netsim;
+    const struct curvecpr_netsim_report *report = &netsim.report;
+    int i, r;
+
+    parse_options(argc, argv);
+
+    curvecpr_bytes_zero(&cf, sizeof(struct curvecpr_netsim_cf));
+
+    for (i = 0; i < 2; ++i) {
+        cf.links[i].delay = options.delay * 1000000LL;
+        cf.links[i].jitter = options.jitter * 1000000LL;
+        cf.links[i].bandwidth = options.bandwidth;
+        cf.links[i].queue_bytes = options.queue_bytes;
+        cf.links[i].loss = options.loss;
+    }
+
+    cf.bytes = options.bytes;
+    cf.time_limit = options.time_limit * 1000000000LL;
+    cf.handshake = (unsigned char)options.handshake;
+    cf.seed = options.seed;
+    cf.ops.configure = configure;
+
+    r = curvecpr_netsim_new(&netsim, &cf);
+    if (r) {
+        fprintf(stderr, "%s: can't set up the simulation (%d)\n", argv[0], r);
+        return 1;
+    }
+
+    r = curvecpr_netsim_run(&netsim);
+
+    printf("path             %lld ms each way, %lld ms jitter, %lld bytes/s, %zu byte queue, %u ppm loss\n", options.delay, options.jitter, options.bandwidth, options.queue_bytes, options.loss);
+    printf("controller       %s%s, seed %llu\n", options.bbr ? "bbr" : "chicago", options.handshake ? " with handshake" : "", options.seed);
+    printf("completed        %s in %.3f s\n", report->completed ? "yes" : "no", (double)report->completion_time / 1e9);
+    if (options.handshake)
+        printf("handshake        %.3f ms\n", (double)report->handshake_time / 1e6);
+    printf("received         %llu bytes (%llu corrupted)\n", (unsigned long long)report->bytes_received, (unsigned long long)report->bytes_corrupted);
+    printf("goodput          %.0f bytes/s\n", report->goodput);
+    printf("blocks           %llu sent, %llu resent (%.2f%%)\n", report->blocks_sent, report->blocks_resent, report->retransmit_ratio * 100);
+    printf("packets          %llu / %llu sent, %llu / %llu lost, %llu / %llu dropped\n", report->packets_sent[0], report->packets_sent[1], report->packets_lost[0], report->packets_lost[1], report->packets_dropped[0], report->packets_dropped[1]);
+    printf("rtt              %.3f / %.3f / %.3f ms min / average / max over %llu samples\n", (double)report->rtt_min / 1e6, (double)report->rtt_average / 1e6, (double)report->rtt_max / 1e6, report->rtt_samples);
+
+    curvecpr_netsim_destroy(&netsim);
+
+    return r ? 1 : 0;
+}
@@ -1,15 +1,30 @@
 #ifndef __CURVECPR_CURVECPR_H
 #define __CURVECPR_CURVECPR_H
 
+#include <curvecpr/admission.h>
+#include <curvecpr/bbr.h>
 #include <curvecpr/block.h>
 #include <curvecpr/bytes.h>
 #include <curvecpr/chicago.h>
 #include <curvecpr/client.h>
+#include <curvecpr/clients.h>
+#include <curvecpr/clock.h>
+#include <curvecpr/handshakes.h>
+#include <curvecpr/keycache.h>
+#include <curvecpr/keypairs.h>
+#include <curvecpr/message.h>
 #include <curvecpr/messager.h>
 #include <curvecpr/packet.h>
+#include <curvecpr/queues.h>
+#include <curvecpr/sendv.h>
 #include <curvecpr/server.h>
 #include <curvecpr/session.h>
+#include <curvecpr/sessions.h>
+#include <curvecpr/shards.h>
+#include <curvecpr/slab.h>
+#include <curvecpr/stream.h>
 #include <curvecpr/trace.h>
 #include <curvecpr/util.h>
+#include <curvecpr/wheel.h>
 
 #endif
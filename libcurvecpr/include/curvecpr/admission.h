@@ -0,0 +1,88 @@
+#ifndef __CURVECPR_ADMISSION_H
+#define __CURVECPR_ADMISSION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "server.h"
+
+#include <sodium/crypto_uint32.h>
+#include <sodium/crypto_uint64.h>
+
+#include <string.h>
+
+/* Admission control for hellos. Answering a hello costs a server far more than
+   sending one costs an attacker, so a server with this configured sheds hellos
+   before doing any cryptography once either a source or the server as a whole is
+   over budget. Other packets are never affected.
+
+   Each source gets a token bucket, kept as a generic cell rate algorithm
+   (GCRA) arrival time. Sources are identified by an opaque tag the integrator
+   derives from the priv argument to curvecpr_server_recv() (usually the peer's
+   address). Tags are hashed with a secret key into a fixed, direct-mapped table;
+   a new source takes over its slot, with a full bucket. */
+
+#define CURVECPR_ADMISSION_TAG 32
+
+struct curvecpr_admission;
+
+struct curvecpr_admission_ops {
+    /* Fill in the tag identifying where the packet came from. The tag is zeroed
+       beforehand. Return nonzero to skip the per-source check for this packet. */
+    int (*source)(struct curvecpr_admission *admission, void *priv, unsigned char tag[CURVECPR_ADMISSION_TAG]);
+};
+
+struct curvecpr_admission_cf {
+    /* Number of per-source buckets. Rounded up to a power of two. */
+    crypto_uint32 sources;
+
+    /* Sustained hellos per second allowed from one source, and how many more than
+       that it can send at once. If rate is 0, there's no per-source limit. */
+    crypto_uint32 source_rate;
+    crypto_uint32 source_burst;
+
+    /* Hellos allowed from all sources together in each slice of slice_length
+       nanoseconds. If 0, there's no global limit. */
+    crypto_uint32 global_budget;
+    long long slice_length;
+
+    struct curvecpr_admission_ops ops;
+
+    void *priv;
+};
+
+struct curvecpr_admission_source {
+    crypto_uint64 hash;
+
+    /* When the source's bucket will next be full. */
+    long long arrival;
+};
+
+struct curvecpr_admission {
+    struct curvecpr_admission_cf cf;
+
+    unsigned char hash_key[16];
+
+    struct curvecpr_admission_source *sources;
+    crypto_uint32 mask;
+
+    long long slice_start;
+    crypto_uint32 slice_used;
+
+    /* Statistics. */
+    unsigned long long admitted;
+    unsigned long long shed_source;
+    unsigned long long shed_global;
+};
+
+int curvecpr_admission_new (struct curvecpr_admission *admission, const struct curvecpr_admission_cf *cf);
+void curvecpr_admission_destroy (struct curvecpr_admission *admission);
+void curvecpr_admission_configure (struct curvecpr_admission *admission, struct curvecpr_server_cf *cf);
+int curvecpr_admission_admit (struct curvecpr_admission *admission, const unsigned char tag[CURVECPR_ADMISSION_TAG], long long now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef __CURVECPR_BBR_H
+#define __CURVECPR_BBR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "messager.h"
+
+#include <sodium/crypto_uint64.h>
+
+/* A congestion controller in the style of BBR, for paths with a large
+   bandwidth-delay product where CurveCP-Chicago's additive increase takes too long
+   to reach the link's rate. Instead of reacting to changes in round-trip time, it
+   keeps a model of the path: the bottleneck's bandwidth, taken as the highest
+   delivery rate seen over the last few round trips, and the lowest round-trip time
+   seen recently. It paces blocks at that bandwidth times a gain. The gain is high
+   during startup, until the bandwidth stops growing, and then low until round trips
+   show the queue that built up has drained. After that it cycles gently above and
+   below 1 to keep probing for more bandwidth. Rates are counted in blocks, not
+   bytes, because blocks are paced one at a time whatever their size. */
+
+/* How many round trips' delivery rates the bandwidth is the highest of. */
+#define CURVECPR_BBR_ROUNDS 10
+
+struct curvecpr_bbr {
+    enum {
+        CURVECPR_BBR_STARTUP,
+        CURVECPR_BBR_DRAIN,
+        CURVECPR_BBR_PROBE_BW
+    } mode;
+
+    /* For the retransmission timeout, as in CurveCP-Chicago. */
+    long long rtt_average;
+    long long rtt_deviation;
+    long long rtt_timeout;
+
+    /* The lowest round-trip time seen since rtt_min_clock. It's forgotten after ten
+       seconds in case the path has changed. */
+    long long rtt_min;
+    long long rtt_min_clock;
+
+    /* Blocks acknowledged so far, and how many there had been when the current round
+       trip began. */
+    crypto_uint64 delivered;
+    crypto_uint64 round_delivered;
+    long long round_clock;
+    unsigned long long rounds;
+
+    /* Delivery rates, in blocks per 256 seconds, of the last few round trips, and the
+       highest of them. */
+    long long bw_samples[CURVECPR_BBR_ROUNDS];
+    long long bw;
+
+    /* Startup ends once the bandwidth has failed to grow by a quarter three round
+       trips running. */
+    long long full_bw;
+    unsigned int full_bw_rounds;
+
+    /* Where we are in the probing gain cycle. */
+    unsigned int cycle;
+
+    /* Nanoseconds between blocks. */
+    long long wr_rate;
+
+    long long ns_last_panic;
+};
+
+void curvecpr_bbr_new (struct curvecpr_bbr *bbr);
+void curvecpr_bbr_configure (struct curvecpr_bbr *bbr, struct curvecpr_messager_cf *cf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,12 +10,37 @@ extern "C" {
 #include <sodium/crypto_uint32.h>
 #include <sodium/crypto_uint64.h>
 
+/* The most data a block can carry. */
+#define CURVECPR_BLOCK_DATA 1024
+
+/* The most pieces a block's data can be gathered from. */
+#define CURVECPR_BLOCK_PIECES 4
+
 enum curvecpr_block_eofflag {
     CURVECPR_BLOCK_STREAM,
     CURVECPR_BLOCK_EOF_FAILURE,
     CURVECPR_BLOCK_EOF_SUCCESS
 };
 
+/* Memory lent to blocks so their data can be sent straight from it instead of
+   being copied into the queues. Payloads are reference counted: each block that
+   points into one holds a reference until it's acknowledged (or its queues are
+   destroyed), and release is called once the last reference is dropped. Whoever
+   creates one starts with the first reference. */
+struct curvecpr_block_payload {
+    void (*release)(struct curvecpr_block_payload *payload);
+
+    /* Accessed atomically. */
+    unsigned int refs;
+
+    void *priv;
+};
+
+struct curvecpr_block_piece {
+    const unsigned char *data;
+    size_t len;
+};
+
 struct curvecpr_block {
     /* This message's ID. */
     crypto_uint32 id;
@@ -29,11 +54,26 @@ struct curvecpr_block {
     /* Is this block an EOF indicator? */
     enum curvecpr_block_eofflag eof;
 
-    /* The actual data. */
+    /* The actual data. The queues keep it wherever suits them. Blocks passed in to the
+       queues (to recvmarkq_put, say) only point at it for the duration of the call,
+       so it has to be copied to be kept. */
     size_t data_len;
-    unsigned char data[1024];
+    const unsigned char *data;
+
+    /* If pieces isn't 0, the data is instead piece[0] through piece[pieces - 1] one
+       after the other, which must add up to data_len. */
+    unsigned int pieces;
+    struct curvecpr_block_piece piece[CURVECPR_BLOCK_PIECES];
+
+    /* If set, data (or the pieces) point into this, and the block holds a reference
+       to it. */
+    struct curvecpr_block_payload *payload;
 };
 
+struct curvecpr_block_payload *curvecpr_block_payload_ref (struct curvecpr_block_payload *payload);
+void curvecpr_block_payload_unref (struct curvecpr_block_payload *payload);
+void curvecpr_block_gather (const struct curvecpr_block *block, unsigned char *destination);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,17 @@ extern "C" {
 #include <sodium/crypto_uint32.h>
 #include <sodium/crypto_uint64.h>
 
+/* Implementations of copy, zero and equal. The best one for the CPU is picked
+   automatically. */
+enum curvecpr_bytes_kernel {
+    CURVECPR_BYTES_KERNEL_SCALAR,
+    CURVECPR_BYTES_KERNEL_SSE2,
+    CURVECPR_BYTES_KERNEL_AVX2
+};
+
+enum curvecpr_bytes_kernel curvecpr_bytes_kernel (void);
+int curvecpr_bytes_set_kernel (enum curvecpr_bytes_kernel kernel);
+
 void curvecpr_bytes_copy (void *destination, const void *source, size_t num);
 void curvecpr_bytes_zero (void *destination, size_t num);
 int curvecpr_bytes_equal (const void *ptr1, const void *ptr2, size_t num);
@@ -5,7 +5,19 @@
 extern "C" {
 #endif
 
+#include "clock.h"
+
+#include <sodium/crypto_uint64.h>
+
+/* Chicago stops speeding up once blocks are this many nanoseconds apart or less.
+   In high-rate mode they can get much closer, sent in bursts (see
+   curvecpr_messager_cf.high_rate). */
+#define CURVECPR_CHICAGO_FLOOR 65535
+#define CURVECPR_CHICAGO_HIGH_RATE_FLOOR 127
+
 struct curvecpr_chicago {
+    /* Where clock comes from (see curvecpr/clock.h). */
+    const struct curvecpr_clock *clock_source;
     long long clock;
 
     long long rtt_latest;
@@ -23,14 +35,20 @@ struct curvecpr_chicago {
     unsigned char rtt_phase;
 
     long long wr_rate;
+    long long wr_rate_floor;
 
     long long ns_last_update;
     long long ns_last_edge;
     long long ns_last_doubling;
     long long ns_last_panic;
+
+    /* If set, the randomness Chicago adds to its rate comes from a generator seeded
+       with this rather than from randombytes(), so runs can be repeated exactly (see
+       curvecpr/netsim.h). */
+    crypto_uint64 random_state;
 };
 
-void curvecpr_chicago_new (struct curvecpr_chicago *chicago);
+void curvecpr_chicago_new (struct curvecpr_chicago *chicago, const struct curvecpr_clock *clock_source);
 void curvecpr_chicago_refresh_clock (struct curvecpr_chicago *chicago);
 void curvecpr_chicago_on_timeout (struct curvecpr_chicago *chicago);
 void curvecpr_chicago_on_recv (struct curvecpr_chicago *chicago, long long ns_sent);
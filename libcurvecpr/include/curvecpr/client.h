@@ -10,6 +10,8 @@ extern "C" {
 #include <string.h>
 
 struct curvecpr_client;
+struct curvecpr_client_profile;
+struct curvecpr_sendv;
 
 struct curvecpr_client_ops {
     int (*send)(struct curvecpr_client *client, const unsigned char *buf, size_t num);
@@ -33,11 +35,59 @@ struct curvecpr_client_cf {
 
     struct curvecpr_client_ops ops;
 
+    /* If set, packets are appended here instead of being passed to ops.send (see
+       curvecpr/sendv.h). */
+    struct curvecpr_sendv *sendv;
+
+    /* If set, the keys, extensions and domain name above are ignored and taken from
+       here instead (see struct curvecpr_client_profile). Otherwise the client makes
+       a profile of its own from them. */
+    struct curvecpr_client_profile *profile;
+
     void *priv;
 };
 
+/* What many clients connecting with the same identity to the same server have in
+   common, including the key shared by the two global keys, so it's only worked
+   out once. Profiles are reference counted: each client using one holds a
+   reference until curvecpr_client_destroy(). Neither the profile nor the clients
+   using it keep a copy of the global secret key. */
+struct curvecpr_client_profile {
+    unsigned char my_extension[16];
+    unsigned char my_global_pk[32];
+
+    unsigned char their_extension[16];
+    unsigned char their_global_pk[32];
+    unsigned char their_domain_name[256];
+
+    /* All that's needed of the global secret key. */
+    unsigned char my_global_their_global_key[32];
+
+    /* Accessed atomically. */
+    unsigned int refs;
+};
+
+/* Bytes that must be writable in front of the buffers passed to
+   curvecpr_client_send_inplace(): room for the initiate packet header, its box and
+   the authenticator. Once the client is negotiated only the last 96 are used. */
+#define CURVECPR_CLIENT_HEADROOM 544
+
+/* Only the parts of the configuration that can differ between clients sharing a
+   profile are kept here; the keys and the domain name are read through the
+   profile. */
 struct curvecpr_client {
-    struct curvecpr_client_cf cf;
+    struct curvecpr_client_ops ops;
+    struct curvecpr_sendv *sendv;
+
+    /* The client holds a reference until curvecpr_client_destroy(). */
+    struct curvecpr_client_profile *profile;
+
+    /* Starts out as the profile's, but may be changed before
+       curvecpr_client_connected() (e.g. to tell apart clients sharing a profile). */
+    unsigned char my_extension[16];
+
+    void *priv;
+
     struct curvecpr_session session;
 
     enum {
@@ -49,10 +99,16 @@ struct curvecpr_client {
     unsigned char negotiated_cookie[96];
 };
 
-void curvecpr_client_new (struct curvecpr_client *client, const struct curvecpr_client_cf *cf);
+int curvecpr_client_profile_new (struct curvecpr_client_profile **profile, const struct curvecpr_client_cf *cf);
+struct curvecpr_client_profile *curvecpr_client_profile_ref (struct curvecpr_client_profile *profile);
+void curvecpr_client_profile_unref (struct curvecpr_client_profile *profile);
+int curvecpr_client_new (struct curvecpr_client *client, const struct curvecpr_client_cf *cf);
+void curvecpr_client_destroy (struct curvecpr_client *client);
 int curvecpr_client_connected (struct curvecpr_client *client);
 int curvecpr_client_recv (struct curvecpr_client *client, const unsigned char *buf, size_t num);
+int curvecpr_client_recv_inplace (struct curvecpr_client *client, unsigned char *buf, size_t num);
 int curvecpr_client_send (struct curvecpr_client *client, const unsigned char *buf, size_t num);
+int curvecpr_client_send_inplace (struct curvecpr_client *client, unsigned char *buf, size_t num);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,126 @@
+#ifndef __CURVECPR_CLIENTS_H
+#define __CURVECPR_CLIENTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "client.h"
+
+#include <sodium/crypto_uint32.h>
+
+#include <string.h>
+
+/* A pool of clients sharing one profile, for driving a server with a very large
+   number of connections from one process (see bench/loadgen.c).
+
+   Clients are numbered from 0. Each one gets its own client extension, which
+   servers echo back in every packet they send it, so a packet arriving on any of
+   the integrator's sockets can be handed to curvecpr_clients_recv() and reach the
+   right client in constant time. Hellos that go unanswered are resent by
+   curvecpr_clients_process() after hello_interval; since every hello waits equally
+   long, the waiting clients form a first-in, first-out queue, and only the ones
+   actually due are looked at. */
+
+struct curvecpr_clients;
+
+struct curvecpr_clients_ops {
+    /* Sends a packet for a client. Which socket to use is up to the integrator. */
+    int (*send)(struct curvecpr_clients *clients, crypto_uint32 index, const unsigned char *buf, size_t num);
+
+    /* Receives a message from the server for a client. Optional. */
+    int (*recv)(struct curvecpr_clients *clients, crypto_uint32 index, const unsigned char *buf, size_t num);
+
+    /* Called when a client's hello has been answered and it can start sending.
+       Optional. */
+    void (*connected)(struct curvecpr_clients *clients, crypto_uint32 index);
+
+    /* Called when a client's hellos have all gone unanswered. Optional. */
+    void (*failed)(struct curvecpr_clients *clients, crypto_uint32 index);
+};
+
+struct curvecpr_clients_cf {
+    /* Number of clients. */
+    crypto_uint32 clients;
+
+    /* Identity and server shared by every client. Each client holds a reference. */
+    struct curvecpr_client_profile *profile;
+
+    /* Nanoseconds to wait for a cookie before resending a hello, and how many hellos
+       to send before giving up. */
+    long long hello_interval;
+    crypto_uint32 hello_attempts;
+
+    struct curvecpr_clients_ops ops;
+
+    void *priv;
+};
+
+enum {
+    CURVECPR_CLIENTS_IDLE,
+    CURVECPR_CLIENTS_HELLO,
+    CURVECPR_CLIENTS_CONNECTED,
+    CURVECPR_CLIENTS_FAILED
+};
+
+struct curvecpr_clients_client {
+    /* Must be first. */
+    struct curvecpr_client client;
+
+    int state;
+    crypto_uint32 attempts;
+    long long connecting_since;
+    long long hello_sent;
+
+    /* Links in the list of clients waiting for a cookie. */
+    crypto_uint32 prev;
+    crypto_uint32 next;
+};
+
+struct curvecpr_clients_stats {
+    crypto_uint32 connecting;
+    crypto_uint32 connected;
+    crypto_uint32 failed;
+
+    unsigned long long hellos;
+    unsigned long long hello_retries;
+
+    /* Total time between first hello and cookie over all connected clients. */
+    long long connect_time;
+
+    unsigned long long packets_sent;
+    unsigned long long bytes_sent;
+    unsigned long long packets_received;
+    unsigned long long bytes_received;
+    unsigned long long packets_dropped;
+};
+
+struct curvecpr_clients {
+    struct curvecpr_clients_cf cf;
+
+    /* Random bytes at the end of every client's extension, so packets meant for
+       someone else are dropped cheaply. */
+    unsigned char extension_tag[12];
+
+    struct curvecpr_clients_client *clients;
+
+    /* Clients waiting for a cookie, oldest hello first. */
+    crypto_uint32 waiting_head;
+    crypto_uint32 waiting_tail;
+
+    struct curvecpr_clients_stats stats;
+};
+
+int curvecpr_clients_new (struct curvecpr_clients *clients, const struct curvecpr_clients_cf *cf);
+void curvecpr_clients_destroy (struct curvecpr_clients *clients);
+int curvecpr_clients_connect (struct curvecpr_clients *clients, crypto_uint32 index, long long now);
+int curvecpr_clients_send (struct curvecpr_clients *clients, crypto_uint32 index, const unsigned char *buf, size_t num);
+int curvecpr_clients_recv (struct curvecpr_clients *clients, const unsigned char *buf, size_t num, long long now);
+void curvecpr_clients_process (struct curvecpr_clients *clients, long long now);
+long long curvecpr_clients_next_timeout (const struct curvecpr_clients *clients);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __CURVECPR_CLOCK_H
+#define __CURVECPR_CLOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Where messagers get the time from. The system clocks are monotonic, so round-trip
+   times can't be thrown off by the wall clock being stepped. An injected clock is
+   never read at all: the event loop sets it, say once per batch of packets, and
+   every messager using it takes the time from there. */
+
+enum curvecpr_clock_source {
+    CURVECPR_CLOCK_MONOTONIC,
+
+    /* Cheaper to read, but only as precise as the kernel's tick (a few
+       milliseconds). Falls back to CURVECPR_CLOCK_MONOTONIC where there's no such
+       thing. */
+    CURVECPR_CLOCK_MONOTONIC_COARSE,
+
+    CURVECPR_CLOCK_INJECTED
+};
+
+struct curvecpr_clock {
+    enum curvecpr_clock_source source;
+
+    /* The time, in nanoseconds, if it's injected. */
+    long long now;
+};
+
+void curvecpr_clock_new (struct curvecpr_clock *clock, enum curvecpr_clock_source source);
+long long curvecpr_clock_now (const struct curvecpr_clock *clock);
+void curvecpr_clock_set (struct curvecpr_clock *clock, long long now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef __CURVECPR_HANDSHAKES_H
+#define __CURVECPR_HANDSHAKES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "packet.h"
+#include "server.h"
+#include "session.h"
+
+#include <string.h>
+
+#include <sodium/crypto_uint64.h>
+
+/* Moves the expensive part of accepting a new client -- opening the cookie, the
+   two key agreements and checking the vouch -- off a server's receive thread.
+
+   With this configured, an initiate packet from an unknown client is copied into a
+   job and curvecpr_server_recv() returns -EINPROGRESS. Worker threads pick jobs up
+   with curvecpr_server_handshakes_work(), and the receive thread later finishes
+   them with curvecpr_server_handshakes_complete(), which registers the session,
+   passes on the enclosed message and calls ops.complete. Only the receive thread
+   ever touches the session table.
+
+   Jobs live in a fixed table whose slots move from free to queued (receive thread)
+   to working to done (a worker) and back to free (receive thread), each step
+   published atomically, so nothing takes a lock. A table belongs to one server.
+   Workers read that server's temporal keys, so it should use shared ones
+   (cf.temporal_keys), which can be refreshed while they run.
+
+   An offloaded initiate's callbacks run long after curvecpr_server_recv() has
+   returned, so they can't be given the caller's priv as it was. If cf.priv_bytes
+   is set, that much of what priv points to (say, the peer's struct sockaddr) is
+   copied into the job, and the callbacks get the copy. Otherwise they get the
+   pointer itself, and what it points to must stay valid until ops.complete has
+   been called for the job. */
+
+/* Most the job can copy of priv: enough for a struct sockaddr_storage. */
+#define CURVECPR_HANDSHAKES_PRIV 128
+
+struct curvecpr_handshakes;
+
+struct curvecpr_handshakes_ops {
+    /* Called on the receive thread when a job is queued, to wake a worker.
+       Optional. */
+    void (*queued)(struct curvecpr_handshakes *handshakes);
+
+    /* Called on a worker thread when a job is done, to wake the receive thread.
+       Optional. */
+    void (*done)(struct curvecpr_handshakes *handshakes);
+
+    /* Called on the receive thread once an offloaded initiate has been handled, with
+       what curvecpr_server_recv() would have returned and the session it belonged
+       to (NULL on failure). Optional. */
+    void (*complete)(struct curvecpr_handshakes *handshakes, struct curvecpr_server *server, struct curvecpr_session *s, void *priv, int result);
+};
+
+struct curvecpr_handshakes_cf {
+    /* Maximum number of initiates in flight. When they're all busy, further new
+       clients are refused with -ENOBUFS. */
+    size_t jobs;
+
+    struct curvecpr_handshakes_ops ops;
+
+    /* How many bytes of the priv passed to curvecpr_server_recv() to keep a copy
+       of, up to CURVECPR_HANDSHAKES_PRIV. */
+    size_t priv_bytes;
+
+    void *priv;
+};
+
+enum {
+    CURVECPR_HANDSHAKES_FREE,
+    CURVECPR_HANDSHAKES_QUEUED,
+    CURVECPR_HANDSHAKES_WORKING,
+    CURVECPR_HANDSHAKES_DONE
+};
+
+struct curvecpr_handshakes_job {
+    /* One of the values above. Accessed atomically. */
+    int state;
+
+    struct curvecpr_server *server;
+    void *priv;
+
+    /* Where priv points, if cf.priv_bytes is set (kept as 64-bit words so it's
+       aligned for a struct sockaddr). */
+    crypto_uint64 priv_copy[CURVECPR_HANDSHAKES_PRIV / 8];
+
+    unsigned char packet[1184];
+    size_t num;
+
+    /* Filled in by the worker: the validation result, the session ready to register
+       and the opened box. */
+    int result;
+    struct curvecpr_session session;
+    unsigned char data[sizeof(struct curvecpr_packet_initiate_box) + 640];
+};
+
+struct curvecpr_handshakes {
+    struct curvecpr_handshakes_cf cf;
+
+    struct curvecpr_handshakes_job *jobs;
+
+    /* Where each kind of thread starts looking. Only hints. */
+    size_t next_free;
+    size_t next_queued;
+    size_t next_done;
+
+    /* Statistics, kept by the receive thread. */
+    unsigned long long queued;
+    unsigned long long refused;
+};
+
+int curvecpr_handshakes_new (struct curvecpr_handshakes *handshakes, const struct curvecpr_handshakes_cf *cf);
+void curvecpr_handshakes_destroy (struct curvecpr_handshakes *handshakes);
+void curvecpr_handshakes_configure (struct curvecpr_handshakes *handshakes, struct curvecpr_server_cf *cf);
+struct curvecpr_handshakes_job *curvecpr_handshakes_reserve (struct curvecpr_handshakes *handshakes);
+void curvecpr_handshakes_submit (struct curvecpr_handshakes *handshakes, struct curvecpr_handshakes_job *job);
+struct curvecpr_handshakes_job *curvecpr_handshakes_claim (struct curvecpr_handshakes *handshakes);
+void curvecpr_handshakes_finish (struct curvecpr_handshakes *handshakes, struct curvecpr_handshakes_job *job);
+struct curvecpr_handshakes_job *curvecpr_handshakes_collect (struct curvecpr_handshakes *handshakes);
+void curvecpr_handshakes_release (struct curvecpr_handshakes *handshakes, struct curvecpr_handshakes_job *job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef __CURVECPR_KEYCACHE_H
+#define __CURVECPR_KEYCACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "server.h"
+
+#include <sodium/crypto_uint32.h>
+
+#include <string.h>
+
+/* A cache of the key a server shares with each client's long-term (global) key, so
+   clients that reconnect often don't cost a key agreement every time. It's a
+   bounded least-recently-used cache split into independently locked shards, so
+   handshake workers (see curvecpr/handshakes.h) and sharded servers can share one.
+   Evicted keys are wiped. A cache belongs to one server identity: every key in it
+   was made with the same global secret key. */
+
+#define CURVECPR_KEYCACHE_CACHE_LINE 64
+
+struct curvecpr_keycache_cf {
+    /* Maximum number of keys, spread evenly over the shards. */
+    crypto_uint32 capacity;
+
+    /* Number of shards. Rounded up to a power of two. */
+    crypto_uint32 shards;
+};
+
+struct curvecpr_keycache_entry {
+    unsigned char their_global_pk[32];
+    unsigned char key[32];
+
+    /* Least-recently-used list (or free list) links, and the next entry in the
+       same bucket. Indexes within the shard. */
+    crypto_uint32 prev;
+    crypto_uint32 next;
+    crypto_uint32 chain;
+};
+
+struct curvecpr_keycache_shard {
+    /* Spin lock. Accessed atomically. */
+    int lock;
+
+    struct curvecpr_keycache_entry *entries;
+    crypto_uint32 *buckets;
+    crypto_uint32 capacity;
+    crypto_uint32 bucket_mask;
+
+    /* Most recently used first. */
+    crypto_uint32 lru_head;
+    crypto_uint32 lru_tail;
+    crypto_uint32 free_head;
+
+    /* Statistics. */
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+
+    unsigned char _pad[CURVECPR_KEYCACHE_CACHE_LINE];
+};
+
+struct curvecpr_keycache {
+    struct curvecpr_keycache_cf cf;
+
+    unsigned char hash_key[16];
+
+    struct curvecpr_keycache_shard *shards;
+    crypto_uint32 shard_mask;
+};
+
+struct curvecpr_keycache_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+};
+
+int curvecpr_keycache_new (struct curvecpr_keycache *keycache, const struct curvecpr_keycache_cf *cf);
+void curvecpr_keycache_destroy (struct curvecpr_keycache *keycache);
+void curvecpr_keycache_configure (struct curvecpr_keycache *keycache, struct curvecpr_server_cf *cf);
+void curvecpr_keycache_beforenm (struct curvecpr_keycache *keycache, unsigned char key[32], const unsigned char their_global_pk[32], const unsigned char my_global_sk[32]);
+void curvecpr_keycache_stats (struct curvecpr_keycache *keycache, struct curvecpr_keycache_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __CURVECPR_KEYPAIRS_H
+#define __CURVECPR_KEYPAIRS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "server.h"
+
+#include <string.h>
+
+/* A pool of session keypairs generated ahead of time, so a server handling a hello
+   doesn't have to generate one on the spot. A background thread keeps the pool
+   topped up with curvecpr_keypairs_fill() while the server's thread takes from it.
+   The pool is a lock-free single-producer, single-consumer ring, so it belongs to
+   one server (one shard). If it's ever empty, the server generates a keypair
+   itself. */
+
+#define CURVECPR_KEYPAIRS_CACHE_LINE 64
+
+struct curvecpr_keypairs;
+
+struct curvecpr_keypairs_ops {
+    /* Called by the server's thread after each take that leaves the pool at or below
+       the low-water mark, including when it was already empty. Use it to wake the
+       thread that fills the pool. Optional. */
+    void (*low)(struct curvecpr_keypairs *keypairs);
+};
+
+struct curvecpr_keypairs_cf {
+    /* Maximum number of keypairs to keep ready. Rounded up to a power of two. */
+    size_t capacity;
+
+    /* Number of keypairs left at or below which ops.low is called. */
+    size_t low_water;
+
+    struct curvecpr_keypairs_ops ops;
+
+    void *priv;
+};
+
+struct curvecpr_keypairs_keypair {
+    unsigned char pk[32];
+    unsigned char sk[32];
+};
+
+struct curvecpr_keypairs {
+    struct curvecpr_keypairs_cf cf;
+
+    /* Written only by the filling thread. Accessed atomically. */
+    size_t head;
+    unsigned char _head_pad[CURVECPR_KEYPAIRS_CACHE_LINE - sizeof(size_t)];
+
+    /* Written only by the server's thread. Accessed atomically. */
+    size_t tail;
+    unsigned char _tail_pad[CURVECPR_KEYPAIRS_CACHE_LINE - sizeof(size_t)];
+
+    struct curvecpr_keypairs_keypair *keypairs;
+    size_t mask;
+
+    /* Statistics, kept by the server's thread. */
+    unsigned long long taken;
+    unsigned long long missed;
+};
+
+int curvecpr_keypairs_new (struct curvecpr_keypairs *keypairs, const struct curvecpr_keypairs_cf *cf);
+void curvecpr_keypairs_destroy (struct curvecpr_keypairs *keypairs);
+void curvecpr_keypairs_configure (struct curvecpr_keypairs *keypairs, struct curvecpr_server_cf *cf);
+size_t curvecpr_keypairs_fill (struct curvecpr_keypairs *keypairs, size_t max);
+size_t curvecpr_keypairs_len (const struct curvecpr_keypairs *keypairs);
+int curvecpr_keypairs_take (struct curvecpr_keypairs *keypairs, unsigned char pk[32], unsigned char sk[32]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
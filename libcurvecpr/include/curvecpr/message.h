@@ -0,0 +1,41 @@
+#ifndef __CURVECPR_MESSAGE_H
+#define __CURVECPR_MESSAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#include <sodium/crypto_uint16.h>
+#include <sodium/crypto_uint32.h>
+#include <sodium/crypto_uint64.h>
+
+/* The header at the front of every messager message, decoded. On the wire the
+   acknowledged ranges are stored as a series of sizes and gaps; here they're absolute
+   stream positions. The first range always starts at 0, and ranges that aren't in
+   use are empty (start == end). */
+
+#define CURVECPR_MESSAGE_HEADER 48
+
+struct curvecpr_message_range {
+    crypto_uint64 start;
+    crypto_uint64 end;
+};
+
+struct curvecpr_message {
+    crypto_uint32 id;
+    crypto_uint32 acknowledging_id;
+    struct curvecpr_message_range acknowledging_ranges[6];
+    crypto_uint16 flags;
+    crypto_uint64 offset;
+};
+
+void curvecpr_message_pack (unsigned char *destination, const struct curvecpr_message *message);
+void curvecpr_message_unpack (struct curvecpr_message *message, const unsigned char *source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,12 +7,19 @@ extern "C" {
 
 #include "block.h"
 #include "chicago.h"
+#include "clock.h"
+#include "message.h"
+#include "wheel.h"
 
 #include <string.h>
 
 #include <sodium/crypto_uint32.h>
 
+struct curvecpr_bbr;
 struct curvecpr_messager;
+struct curvecpr_queues;
+struct curvecpr_sendv;
+struct curvecpr_stream;
 
 struct curvecpr_messager_ops {
     int (*sendq_head)(struct curvecpr_messager *messager, struct curvecpr_block **block_stored);
@@ -31,13 +38,79 @@ struct curvecpr_messager_ops {
     unsigned char (*recvmarkq_is_empty)(struct curvecpr_messager *messager);
     int (*recvmarkq_remove_range)(struct curvecpr_messager *messager, unsigned long long start, unsigned long long end);
 
+    /* Optional. Fills in the first (up to) 6 maximal runs of received data in the
+       recvmarkq that end after offset, in order, and returns how many there are. If
+       set, acknowledgments are built from these instead of by walking every block
+       with recvmarkq_get_nth_unacknowledged. */
+    unsigned int (*recvmarkq_get_ranges)(struct curvecpr_messager *messager, unsigned long long offset, struct curvecpr_message_range ranges[6]);
+
     int (*send)(struct curvecpr_messager *messager, const unsigned char *buf, size_t num);
 
     void (*put_next_timeout)(struct curvecpr_messager *messager, const long long timeout_ns);
 };
 
+/* Congestion control: how fast to send and how long to wait for acknowledgments.
+   Unless all of these are set, CurveCP-Chicago (see curvecpr/chicago.h) is used. */
+struct curvecpr_messager_congestion_ops {
+    /* Called with the block a received message acknowledges. block->clock is when
+       it was last sent, and messager->chicago.clock is now. */
+    void (*on_recv)(struct curvecpr_messager *messager, const struct curvecpr_block *block);
+
+    /* Called when a block is about to be sent again because it wasn't acknowledged
+       in time. */
+    void (*on_timeout)(struct curvecpr_messager *messager);
+
+    /* When the next new block may be sent, given that the last message was sent at
+       messager->my_sent_clock. */
+    long long (*next_send_time)(struct curvecpr_messager *messager);
+
+    /* How long to wait for a block to be acknowledged before sending it again. */
+    long long (*rto)(struct curvecpr_messager *messager);
+};
+
+/* The most blocks sent at once in high-rate mode, by default. */
+#define CURVECPR_MESSAGER_BURST 64
+
 struct curvecpr_messager_cf {
     struct curvecpr_messager_ops ops;
+    struct curvecpr_messager_congestion_ops congestion;
+
+    /* Where the time comes from (see curvecpr/clock.h). If NULL, it's
+       CURVECPR_CLOCK_MONOTONIC. It's read once each time
+       curvecpr_messager_recv(), curvecpr_messager_process_sendq() or
+       curvecpr_messager_next_timeout() is called. */
+    const struct curvecpr_clock *clock;
+
+    /* Storage for the built-in queue implementations, if they're in use (see
+       curvecpr_queues_configure()). */
+    struct curvecpr_queues *queues;
+
+    /* If set, messages are appended here instead of being passed to ops.send (see
+       curvecpr/sendv.h). They're still plaintext, so this must be the messager's
+       own vector, whose flush callback encrypts them, not the one the client or
+       server sends packets through. */
+    struct curvecpr_sendv *sendv;
+
+    /* The byte stream on top of the queues, if it's in use (see
+       curvecpr_stream_configure()). */
+    struct curvecpr_stream *stream;
+
+    /* The state of the BBR-like congestion controller, if it's in use (see
+       curvecpr_bbr_configure()). */
+    struct curvecpr_bbr *bbr;
+
+    /* The timing wheel its timeouts go on, if it's on one (see
+       curvecpr_wheel_configure()). */
+    struct curvecpr_wheel *wheel;
+
+    /* If set, Chicago may keep speeding up until blocks are only
+       CURVECPR_CHICAGO_HIGH_RATE_FLOOR nanoseconds apart, far more often than an
+       event loop can wake up. To make up for that, each call to
+       curvecpr_messager_process_sendq() sends every block that has come due since
+       the last, up to burst of them (CURVECPR_MESSAGER_BURST if 0). This applies
+       whichever congestion controller is in use. */
+    unsigned char high_rate;
+    unsigned int burst;
 
     void *priv;
 };
@@ -45,9 +118,13 @@ struct curvecpr_messager_cf {
 struct curvecpr_messager {
     struct curvecpr_messager_cf cf;
 
-    /* CurveCP-Chicago decongestion algorithm stats. */
+    /* CurveCP-Chicago decongestion algorithm stats. Its clock is the messager's,
+       whichever congestion controller is in use. */
     struct curvecpr_chicago chicago;
 
+    /* Its place on the timing wheel, if it's on one. */
+    struct curvecpr_wheel_timer timer;
+
     /* State tracking (local). */
     crypto_uint32 my_id;
 
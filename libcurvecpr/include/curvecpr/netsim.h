@@ -0,0 +1,184 @@
+#ifndef __CURVECPR_NETSIM_H
+#define __CURVECPR_NETSIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "client.h"
+#include "clock.h"
+#include "messager.h"
+#include "queues.h"
+#include "server.h"
+#include "session.h"
+#include "stream.h"
+
+#include <string.h>
+
+#include <sodium/crypto_uint64.h>
+
+/* A deterministic, discrete-event simulation of one transfer between two messagers
+   over a simulated network, for trying out congestion control and acknowledgment
+   changes before they meet a real one (see bench/simulate.c). Side 0 writes
+   cf.bytes of data into a byte stream (see curvecpr/stream.h) and side 1 reads it
+   back, checking every byte. Packets cross a link in each direction with a
+   propagation delay, random jitter (which reorders them), random loss and a
+   bottleneck of limited bandwidth with a finite queue in front of it. Optionally
+   side 0 is a client and side 1 a server, and the transfer starts with a handshake.
+
+   Time is virtual: both messagers use an injected clock (see curvecpr/clock.h),
+   which jumps straight from one event to the next, so minutes of transfer take
+   milliseconds to simulate. The loss and jitter, nonces, and the randomness
+   Chicago adds to its rate all come from generators seeded with cf.seed, so the
+   same configuration always gives the same result. */
+
+struct curvecpr_netsim;
+
+struct curvecpr_netsim_link {
+    /* One-way propagation delay, in nanoseconds. */
+    long long delay;
+
+    /* Each packet is held up by up to this much more, uniformly at random, so
+       packets can overtake each other. */
+    long long jitter;
+
+    /* Bytes per second through the bottleneck, and how many bytes may be queued
+       waiting for it; packets that don't fit are dropped. 0 means no limit. */
+    long long bandwidth;
+    size_t queue_bytes;
+
+    /* Chance of a packet being lost, in millionths. */
+    unsigned int loss;
+};
+
+struct curvecpr_netsim_ops {
+    /* Called with each side's messager configuration before the messager is
+       created, to choose its congestion controller, say. Optional. */
+    void (*configure)(struct curvecpr_netsim *netsim, int side, struct curvecpr_messager_cf *cf);
+};
+
+struct curvecpr_netsim_cf {
+    /* links[0] carries packets from side 0 to side 1, and links[1] back again. */
+    struct curvecpr_netsim_link links[2];
+
+    /* How much side 0 sends. */
+    crypto_uint64 bytes;
+
+    /* The most virtual time to spend on it, in nanoseconds. If 0, 10 minutes. */
+    long long time_limit;
+
+    /* If set, side 0 is a client and side 1 a server, and messages go boxed. */
+    unsigned char handshake;
+
+    /* For both sides' queues (see curvecpr/queues.h) and streams. If 0, 1024, 1024
+       and 1 MiB respectively. */
+    size_t send_blocks;
+    size_t recv_blocks;
+    size_t recv_bytes;
+
+    crypto_uint64 seed;
+
+    struct curvecpr_netsim_ops ops;
+
+    void *priv;
+};
+
+struct curvecpr_netsim_report {
+    /* Whether side 1 read everything up to the end of the stream, and how long
+       after the start that was (or how long it ran for, if it didn't). */
+    unsigned char completed;
+    long long completion_time;
+
+    /* When side 0's client first heard from the server's messager, if there was a
+       handshake. */
+    long long handshake_time;
+
+    /* Bytes side 1 read, and any that weren't what side 0 wrote. */
+    crypto_uint64 bytes_received;
+    crypto_uint64 bytes_corrupted;
+
+    /* Bytes per second read by side 1 over completion_time. */
+    double goodput;
+
+    /* Side 0's data blocks: sent for the first time, and sent again. */
+    unsigned long long blocks_sent;
+    unsigned long long blocks_resent;
+    double retransmit_ratio;
+
+    /* Packets sent over each link, and how many were lost at random or dropped
+       because the bottleneck's queue was full. */
+    unsigned long long packets_sent[2];
+    unsigned long long packets_lost[2];
+    unsigned long long packets_dropped[2];
+
+    /* Round-trip times, in nanoseconds, as side 0's messager measured them. */
+    unsigned long long rtt_samples;
+    long long rtt_min;
+    long long rtt_average;
+    long long rtt_max;
+};
+
+/* A packet on its way across a link. */
+struct curvecpr_netsim_packet {
+    long long at;
+    unsigned long long seq;
+    int to;
+
+    size_t num;
+    unsigned char buf[1184];
+};
+
+struct curvecpr_netsim {
+    struct curvecpr_netsim_cf cf;
+
+    struct curvecpr_clock clock;
+    long long start;
+
+    struct curvecpr_messager messagers[2];
+    struct curvecpr_queues queues[2];
+    struct curvecpr_stream streams[2];
+
+    /* Side 0's congestion and sendq ops, which we stand in front of to measure. */
+    struct curvecpr_messager_congestion_ops congestion;
+    int (*sendq_move_to_sendmarkq)(struct curvecpr_messager *messager, const struct curvecpr_block *block, struct curvecpr_block **block_stored);
+
+    /* For cf.handshake. */
+    struct curvecpr_client client;
+    struct curvecpr_server server;
+    struct curvecpr_session session;
+    unsigned char have_session;
+
+    /* When each side next wants to run, or -1. */
+    long long wake[2];
+
+    /* Packets in flight, as a min-heap by arrival time (then by when they were
+       sent), and packets not in use. */
+    struct curvecpr_netsim_packet **packets;
+    size_t packets_len;
+    size_t packets_size;
+    struct curvecpr_netsim_packet **spare;
+    size_t spare_len;
+    unsigned long long packets_seq;
+
+    /* When each link's bottleneck is next free. */
+    long long link_free[2];
+
+    crypto_uint64 random_state;
+
+    /* Side 0's progress writing, and side 1's reading. */
+    crypto_uint64 written;
+    unsigned char shutdown;
+    crypto_uint64 read;
+
+    struct curvecpr_netsim_report report;
+};
+
+int curvecpr_netsim_new (struct curvecpr_netsim *netsim, const struct curvecpr_netsim_cf *cf);
+void curvecpr_netsim_destroy (struct curvecpr_netsim *netsim);
+int curvecpr_netsim_run (struct curvecpr_netsim *netsim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
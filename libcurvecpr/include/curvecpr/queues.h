@@ -0,0 +1,168 @@
+#ifndef __CURVECPR_QUEUES_H
+#define __CURVECPR_QUEUES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "block.h"
+#include "messager.h"
+#include "slab.h"
+
+#include <string.h>
+
+#include <sodium/crypto_uint32.h>
+#include <sodium/crypto_uint64.h>
+
+/* Built-in implementations of the messager's queues. A ring buffer backs the sendq,
+   a binary min-heap (by block->clock) with an offset-ordered index and a hash by
+   block->id backs the sendmarkq, and an offset-ordered array backs the recvmarkq,
+   alongside a skip list of the runs of data it holds for building acknowledgments.
+   Blocks are moved between the sendq and the sendmarkq without being copied, and
+   their data is kept in chunks from a slab (see curvecpr/slab.h) just big enough to
+   hold it, unless it's lent to them in a payload (see struct
+   curvecpr_block_payload). */
+
+struct curvecpr_queues_ops {
+    /* Called with each newly received block as it's placed into the recvmarkq. Blocks
+       may arrive out of order (and, if the other side retransmits something we've
+       already acknowledged, more than once), so use block->offset to reassemble the
+       stream. Optional. */
+    void (*recv)(struct curvecpr_messager *messager, const struct curvecpr_block *block);
+};
+
+struct curvecpr_queues_cf {
+    /* Number of blocks that may be waiting to be sent or waiting for acknowledgment
+       at any given time. */
+    size_t send_blocks;
+
+    /* Maximum number of sent blocks waiting for acknowledgment. If 0, this is the same
+       as send_blocks. */
+    size_t sendmarkq_blocks;
+
+    /* Number of received blocks that may be waiting for acknowledgment. */
+    size_t recv_blocks;
+
+    /* Where to keep blocks' data. Share one between queues used from the same thread
+       to pool their memory. If NULL, the queues keep a slab of their own. */
+    struct curvecpr_slab *slab;
+
+    struct curvecpr_queues_ops ops;
+};
+
+enum curvecpr_queues_slot_location {
+    CURVECPR_QUEUES_SLOT_FREE,
+    CURVECPR_QUEUES_SLOT_SENDQ,
+    CURVECPR_QUEUES_SLOT_SENDMARKQ,
+    CURVECPR_QUEUES_SLOT_RECVMARKQ
+};
+
+struct curvecpr_queues_slot {
+    /* Must be first; the messager only ever sees this. */
+    struct curvecpr_block block;
+
+    /* A chunk from the slab that block.data points to, if the block has any data. */
+    unsigned char *storage;
+    size_t storage_bytes;
+
+    enum curvecpr_queues_slot_location location;
+
+    /* Position in the sendmarkq heap. */
+    size_t index;
+
+    /* The ID it's filed under in the sendmarkq's ID hash. block.id changes when the
+       block is retransmitted, and this is what it was. */
+    crypto_uint32 indexed_id;
+};
+
+struct curvecpr_queues_mark {
+    crypto_uint64 offset;
+
+    /* NULL once the block has been acknowledged. */
+    struct curvecpr_queues_slot *slot;
+
+    /* Once it's a hole, how many entries starting here are known to be holes, so
+       runs of them can be stepped over at once. */
+    size_t skip;
+};
+
+#define CURVECPR_QUEUES_RANGE_LEVELS 16
+
+/* A maximal run of received data waiting for acknowledgment: the union of one or more
+   overlapping or adjacent recvmarkq blocks. */
+struct curvecpr_queues_range {
+    crypto_uint64 start;
+    crypto_uint64 end;
+
+    unsigned int levels;
+    struct curvecpr_queues_range *next[CURVECPR_QUEUES_RANGE_LEVELS];
+};
+
+struct curvecpr_queues {
+    struct curvecpr_queues_cf cf;
+
+    /* cf.slab, or own_slab if that isn't set. */
+    struct curvecpr_slab *slab;
+    struct curvecpr_slab own_slab;
+
+    /* Storage shared by the sendq and sendmarkq. */
+    struct curvecpr_queues_slot *send_slots;
+    struct curvecpr_queues_slot **send_free;
+    size_t send_free_len;
+
+    /* Ring buffer. */
+    struct curvecpr_queues_slot **sendq;
+    size_t sendq_head;
+    size_t sendq_len;
+
+    /* Min-heap ordered by block.clock. */
+    struct curvecpr_queues_slot **sendmarkq;
+    size_t sendmarkq_len;
+
+    /* The same blocks in stream order. Blocks enter the sendmarkq in the order they're
+       first sent, which is also offset order, so this is a ring buffer; acknowledged
+       entries stay behind as holes until they reach either end. */
+    struct curvecpr_queues_mark *sendmarkq_marks;
+    size_t sendmarkq_marks_head;
+    size_t sendmarkq_marks_len;
+
+    /* The same blocks again, in an open-addressed hash table by block ID (with linear
+       probing and no tombstones) for finding the one an acknowledgment is for. */
+    struct curvecpr_queues_slot **sendmarkq_ids;
+    size_t sendmarkq_ids_mask;
+
+    /* Storage for the recvmarkq. */
+    struct curvecpr_queues_slot *recv_slots;
+    struct curvecpr_queues_slot **recv_free;
+    size_t recv_free_len;
+
+    /* Ordered by block.offset, occupying [recvmarkq_head, recvmarkq_head +
+       recvmarkq_len). */
+    struct curvecpr_queues_slot **recvmarkq;
+    size_t recvmarkq_head;
+    size_t recvmarkq_len;
+
+    /* The recvmarkq's runs of data as a skip list ordered by start. There's never
+       more than one per block, plus one while a run is being split. */
+    struct curvecpr_queues_range *recv_ranges;
+    struct curvecpr_queues_range **recv_ranges_free;
+    size_t recv_ranges_free_len;
+    struct curvecpr_queues_range recv_ranges_head;
+    crypto_uint32 recv_ranges_seed;
+
+    void *priv;
+};
+
+int curvecpr_queues_new (struct curvecpr_queues *queues, const struct curvecpr_queues_cf *cf);
+void curvecpr_queues_destroy (struct curvecpr_queues *queues);
+void curvecpr_queues_configure (struct curvecpr_queues *queues, struct curvecpr_messager_cf *cf);
+int curvecpr_queues_sendq_put (struct curvecpr_queues *queues, const struct curvecpr_block *block);
+size_t curvecpr_queues_sendq_write (struct curvecpr_queues *queues, const unsigned char *buf, size_t num, size_t block_bytes);
+size_t curvecpr_queues_sendq_lend (struct curvecpr_queues *queues, struct curvecpr_block_payload *payload, const unsigned char *buf, size_t num, size_t block_bytes);
+int curvecpr_queues_sendq_close (struct curvecpr_queues *queues, enum curvecpr_block_eofflag eof);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
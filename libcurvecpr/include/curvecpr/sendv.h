@@ -0,0 +1,74 @@
+#ifndef __CURVECPR_SENDV_H
+#define __CURVECPR_SENDV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+#include <sys/uio.h>
+
+/* A caller-owned vector of outgoing packets. When a server, client or messager is
+   given one, every packet it produces is appended to it instead of being passed to
+   ops.send, and they're handed to ops.flush all at once when the vector fills up,
+   at the end of curvecpr_server_recv_batch(), or when curvecpr_sendv_flush() is
+   called. The iovec array can be pointed to directly from an array of struct
+   mmsghdr for sendmmsg().
+
+   A messager's messages are plaintext that still has to go through
+   curvecpr_client_send() or curvecpr_server_send(), so a messager needs a vector
+   of its own, whose flush callback does that; the client or server can collect
+   the resulting packets in a second vector that goes to the socket.
+
+   Nothing can be appended to a vector while its flush callback runs: pushes fail
+   with -EBUSY and curvecpr_sendv_next() returns NULL. */
+
+/* The largest packet (or messager message) ever appended. */
+#define CURVECPR_SENDV_PACKET 1184
+
+struct curvecpr_sendv;
+
+struct curvecpr_sendv_ops {
+    /* Sends packets. iov[i] is the ith packet, and privs[i] is whatever identifies
+       its destination: the priv argument passed to curvecpr_server_send(), the
+       struct curvecpr_client, or the struct curvecpr_messager. The packets are
+       discarded when this returns, whether or not it succeeds. Return nonzero on
+       failure. */
+    int (*flush)(struct curvecpr_sendv *sendv, const struct iovec *iov, void *const *privs, size_t num);
+};
+
+struct curvecpr_sendv_cf {
+    /* Number of packets to collect before flushing. */
+    size_t packets;
+
+    struct curvecpr_sendv_ops ops;
+
+    void *priv;
+};
+
+struct curvecpr_sendv {
+    struct curvecpr_sendv_cf cf;
+
+    /* Packet storage, CURVECPR_SENDV_PACKET bytes for each packet. */
+    unsigned char *bufs;
+
+    struct iovec *iov;
+    void **privs;
+    size_t len;
+
+    /* Set while ops.flush is looking at the packets. */
+    int flushing;
+};
+
+int curvecpr_sendv_new (struct curvecpr_sendv *sendv, const struct curvecpr_sendv_cf *cf);
+void curvecpr_sendv_destroy (struct curvecpr_sendv *sendv);
+unsigned char *curvecpr_sendv_next (struct curvecpr_sendv *sendv);
+int curvecpr_sendv_push (struct curvecpr_sendv *sendv, const unsigned char *packet, size_t num, void *priv);
+int curvecpr_sendv_flush (struct curvecpr_sendv *sendv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,11 +5,18 @@
 extern "C" {
 #endif
 
+#include "clock.h"
 #include "session.h"
 
 #include <string.h>
 
 struct curvecpr_server;
+struct curvecpr_admission;
+struct curvecpr_handshakes;
+struct curvecpr_keycache;
+struct curvecpr_keypairs;
+struct curvecpr_sendv;
+struct curvecpr_sessions;
 
 struct curvecpr_server_ops {
     int (*put_session)(struct curvecpr_server *server, const struct curvecpr_session *s, void *priv, struct curvecpr_session **s_stored);
@@ -21,6 +28,17 @@ struct curvecpr_server_ops {
     int (*next_nonce)(struct curvecpr_server *server, unsigned char *destination, size_t num);
 };
 
+/* Temporal keys that several servers (e.g. the shards in curvecpr/shards.h) can
+   share. Readers only ever see whole keys: a refresh writes the next slot before
+   publishing it, and a slot isn't reused until two refreshes later. */
+struct curvecpr_server_temporal_keys {
+    unsigned char keys[3][32];
+
+    /* Index of the current key; the previous one is just before it. Accessed
+       atomically. */
+    unsigned int current;
+};
+
 struct curvecpr_server_cf {
     /* Any extensions. */
     unsigned char my_extension[16];
@@ -31,9 +49,65 @@ struct curvecpr_server_cf {
 
     struct curvecpr_server_ops ops;
 
+    /* Storage for the built-in session table, if it's in use (see
+       curvecpr_sessions_configure()). */
+    struct curvecpr_sessions *sessions;
+
+    /* If set, packets are appended here instead of being passed to ops.send (see
+       curvecpr/sendv.h). */
+    struct curvecpr_sendv *sendv;
+
+    /* If set, used instead of the server's own temporal keys. */
+    struct curvecpr_server_temporal_keys *temporal_keys;
+
+    /* If set, hellos take their session keypairs from this pool instead of
+       generating them (see curvecpr/keypairs.h). */
+    struct curvecpr_keypairs *keypairs;
+
+    /* If set, hellos over budget are dropped with -EAGAIN before any cryptography
+       is done (see curvecpr/admission.h). */
+    struct curvecpr_admission *admission;
+
+    /* If set, initiates from new clients are validated on worker threads and
+       curvecpr_server_recv() returns -EINPROGRESS for them (see
+       curvecpr/handshakes.h). */
+    struct curvecpr_handshakes *handshakes;
+
+    /* If set, keys shared with clients' global keys are remembered here (see
+       curvecpr/keycache.h). */
+    struct curvecpr_keycache *keycache;
+
+    /* Where the admission budget gets the time from (see curvecpr/clock.h). If
+       NULL, it's CURVECPR_CLOCK_MONOTONIC. */
+    const struct curvecpr_clock *clock;
+
+    void *priv;
+};
+
+/* Maximum number of packets curvecpr_server_recv_batch() works on at once. Larger
+   batches are split up. Each distinct session in a batch is only looked up once, so
+   pointers returned by a custom get_session() must stay valid until the batch is
+   done: ops.recv must not remove sessions, and put_session() must not evict them.
+   The built-in session table has no such restriction; if it drops any session
+   partway through a batch, the rest of the batch looks its sessions up again. */
+#define CURVECPR_SERVER_BATCH 64
+
+struct curvecpr_server_packet {
+    /* Supplied by the caller. */
+    const unsigned char *buf;
+    size_t num;
     void *priv;
+
+    /* Filled in by curvecpr_server_recv_batch(): what curvecpr_server_recv() would have
+       returned, and the session the packet belonged to. */
+    int result;
+    struct curvecpr_session *s;
 };
 
+/* Bytes that must be writable in front of the buffers passed to the _inplace
+   functions: room for the packet header and authenticator. */
+#define CURVECPR_SERVER_HEADROOM 64
+
 struct curvecpr_server {
     struct curvecpr_server_cf cf;
 
@@ -43,8 +117,15 @@ struct curvecpr_server {
 
 void curvecpr_server_new (struct curvecpr_server *server, const struct curvecpr_server_cf *cf);
 void curvecpr_server_refresh_temporal_keys (struct curvecpr_server *server);
+void curvecpr_server_temporal_keys_new (struct curvecpr_server_temporal_keys *keys);
+void curvecpr_server_temporal_keys_refresh (struct curvecpr_server_temporal_keys *keys);
 int curvecpr_server_recv (struct curvecpr_server *server, void *priv, const unsigned char *buf, size_t num, struct curvecpr_session **s_stored);
+size_t curvecpr_server_recv_batch (struct curvecpr_server *server, struct curvecpr_server_packet *packets, size_t num_packets);
+int curvecpr_server_recv_inplace (struct curvecpr_server *server, void *priv, unsigned char *buf, size_t num, struct curvecpr_session **s_stored);
+size_t curvecpr_server_handshakes_work (struct curvecpr_handshakes *handshakes, size_t max);
+size_t curvecpr_server_handshakes_complete (struct curvecpr_server *server, size_t max);
 int curvecpr_server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num);
+int curvecpr_server_send_inplace (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, unsigned char *buf, size_t num);
 
 #ifdef __cplusplus
 }
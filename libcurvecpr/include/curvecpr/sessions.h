@@ -0,0 +1,111 @@
+#ifndef __CURVECPR_SESSIONS_H
+#define __CURVECPR_SESSIONS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "clock.h"
+#include "server.h"
+#include "session.h"
+
+#include <string.h>
+
+#include <sodium/crypto_uint32.h>
+
+/* A built-in session table for the server. Sessions are found through an
+   open-addressing hash table keyed by a keyed hash (SipHash) of their_session_pk, so
+   remote parties can't pick keys that collide. Each bucket group carries 16 one-byte
+   tags that are compared at once, so most lookups touch a single cache line before
+   the session itself. Sessions are also kept in least-recently-used order so idle
+   ones can be expired in constant time each. */
+
+#define CURVECPR_SESSIONS_GROUP 16
+
+struct curvecpr_sessions;
+
+struct curvecpr_sessions_ops {
+    /* Called after a session is added to the table with the priv argument passed to
+       curvecpr_server_recv(). Optional. */
+    void (*put)(struct curvecpr_sessions *sessions, struct curvecpr_session *s, void *priv);
+
+    /* Called just before a session is dropped from the table, whether because it
+       expired or it was removed. Optional. */
+    void (*remove)(struct curvecpr_sessions *sessions, struct curvecpr_session *s);
+};
+
+struct curvecpr_sessions_cf {
+    /* Maximum number of concurrent sessions. */
+    crypto_uint32 capacity;
+
+    /* Sessions that haven't been looked up for this many nanoseconds are eligible for
+       expiry. If 0, sessions never expire on their own. */
+    long long idle_timeout;
+
+    /* Where the time sessions were last used comes from (see curvecpr/clock.h), and
+       so what the now passed to curvecpr_sessions_expire() should be measured
+       against. If NULL, it's CURVECPR_CLOCK_MONOTONIC. Lookups don't read it
+       themselves; see curvecpr_sessions_refresh_clock(). */
+    const struct curvecpr_clock *clock;
+
+    struct curvecpr_sessions_ops ops;
+
+    void *priv;
+};
+
+struct curvecpr_sessions_entry {
+    struct curvecpr_session session;
+
+    long long last_used;
+
+    /* Least-recently-used list (or free list) links. */
+    crypto_uint32 prev;
+    crypto_uint32 next;
+
+    /* Where this entry's index lives in the table. */
+    crypto_uint32 slot;
+};
+
+struct curvecpr_sessions {
+    struct curvecpr_sessions_cf cf;
+
+    unsigned char hash_key[16];
+
+    /* The table: one tag byte and one entry index for each slot. */
+    unsigned char *tags;
+    crypto_uint32 *indexes;
+    crypto_uint32 groups;
+    crypto_uint32 tombstones;
+
+    /* Session storage. Sessions never move once they're added. */
+    struct curvecpr_sessions_entry *entries;
+    crypto_uint32 len;
+    crypto_uint32 free_head;
+
+    /* Most recently used first. */
+    crypto_uint32 lru_head;
+    crypto_uint32 lru_tail;
+
+    /* The time lookups mark sessions as used at, as of the last
+       curvecpr_sessions_refresh_clock(). */
+    long long now;
+
+    /* Bumped whenever a session is dropped, so anything holding on to session
+       pointers can tell when they might have gone stale. */
+    unsigned long long drops;
+};
+
+int curvecpr_sessions_new (struct curvecpr_sessions *sessions, const struct curvecpr_sessions_cf *cf);
+void curvecpr_sessions_destroy (struct curvecpr_sessions *sessions);
+void curvecpr_sessions_configure (struct curvecpr_sessions *sessions, struct curvecpr_server_cf *cf);
+int curvecpr_sessions_put (struct curvecpr_sessions *sessions, const struct curvecpr_session *s, void *priv, struct curvecpr_session **s_stored);
+int curvecpr_sessions_get (struct curvecpr_sessions *sessions, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored);
+void curvecpr_sessions_refresh_clock (struct curvecpr_sessions *sessions);
+void curvecpr_sessions_remove (struct curvecpr_sessions *sessions, struct curvecpr_session *s);
+crypto_uint32 curvecpr_sessions_expire (struct curvecpr_sessions *sessions, long long now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef __CURVECPR_SHARDS_H
+#define __CURVECPR_SHARDS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "admission.h"
+#include "handshakes.h"
+#include "keypairs.h"
+#include "server.h"
+#include "sessions.h"
+
+#include <sodium/crypto_uint64.h>
+
+#include <string.h>
+
+/* A server split into shards so it can use several cores. Each shard is a complete
+   server with its own part of the session table, and every packet belongs to the
+   shard picked by a keyed hash of its client session key, so a client always lands
+   on the same shard. Temporal keys are shared by all shards.
+
+   One thread (the one reading the socket) calls curvecpr_shards_route(), which
+   copies each packet into its shard's ring. Each shard's thread calls
+   curvecpr_shards_process() with its own index. The rings are single-producer,
+   single-consumer and lock-free, so nothing is shared between shard threads except
+   the temporal keys.
+
+   A packet's priv is handed to the shard's callbacks long after
+   curvecpr_shards_route() returns. If priv_bytes is set, that many bytes of it are
+   copied into the ring along with the packet; otherwise priv must stay valid until
+   the shard has processed the packet. */
+
+#define CURVECPR_SHARDS_PACKET 1184
+#define CURVECPR_SHARDS_PRIV 128
+#define CURVECPR_SHARDS_CACHE_LINE 64
+
+struct curvecpr_shards;
+
+struct curvecpr_shards_cf {
+    /* Number of shards. */
+    unsigned int shards;
+
+    /* Number of packets that can wait for each shard. Rounded up to a power of two. */
+    size_t ring_packets;
+
+    /* Configuration for every shard's server. Callbacks are called from the shard's
+       thread; the server they're given is the first member of its struct
+       curvecpr_shards_shard. sendv, temporal_keys, keypairs, admission and handshakes
+       must not be set. */
+    struct curvecpr_server_cf server;
+
+    /* If capacity is set, each shard gets its own built-in session table with this
+       configuration. Otherwise server.ops.put_session and get_session are used. */
+    struct curvecpr_sessions_cf sessions;
+
+    /* If capacity is set, each shard gets its own keypair pool with this
+       configuration. Whatever fills them must call curvecpr_keypairs_fill() on each
+       shard's pool. */
+    struct curvecpr_keypairs_cf keypairs;
+
+    /* If any limit is set, each shard gets its own hello admission control with
+       this configuration. Budgets apply to each shard separately. */
+    struct curvecpr_admission_cf admission;
+
+    /* If jobs is set, each shard offloads new clients' initiates to its own job
+       table with this configuration. Workers must call
+       curvecpr_server_handshakes_work() on each shard's table;
+       curvecpr_shards_process() completes them. If handshakes.priv_bytes isn't
+       set, it defaults to priv_bytes. */
+    struct curvecpr_handshakes_cf handshakes;
+
+    /* How much of each packet's priv to copy into the ring; at most
+       CURVECPR_SHARDS_PRIV. */
+    size_t priv_bytes;
+
+    void *priv;
+};
+
+struct curvecpr_shards_packet {
+    unsigned char buf[CURVECPR_SHARDS_PACKET];
+    size_t num;
+    void *priv;
+
+    /* Where priv points, if it was copied. */
+    crypto_uint64 priv_copy[CURVECPR_SHARDS_PRIV / 8];
+};
+
+struct curvecpr_shards_ring {
+    /* Written only by the routing thread. Accessed atomically. */
+    size_t head;
+    unsigned char _head_pad[CURVECPR_SHARDS_CACHE_LINE - sizeof(size_t)];
+
+    /* Written only by the shard's thread. Accessed atomically. */
+    size_t tail;
+    unsigned char _tail_pad[CURVECPR_SHARDS_CACHE_LINE - sizeof(size_t)];
+
+    struct curvecpr_shards_packet *packets;
+    size_t mask;
+};
+
+struct curvecpr_shards_shard {
+    /* Must be first. */
+    struct curvecpr_server server;
+
+    struct curvecpr_sessions sessions;
+    struct curvecpr_keypairs keypairs;
+    struct curvecpr_admission admission;
+    struct curvecpr_handshakes handshakes;
+    struct curvecpr_shards_ring ring;
+
+    struct curvecpr_shards *shards;
+    unsigned int index;
+};
+
+struct curvecpr_shards {
+    struct curvecpr_shards_cf cf;
+
+    unsigned char hash_key[16];
+
+    struct curvecpr_server_temporal_keys temporal_keys;
+
+    struct curvecpr_shards_shard *shards;
+};
+
+int curvecpr_shards_new (struct curvecpr_shards *shards, const struct curvecpr_shards_cf *cf);
+void curvecpr_shards_destroy (struct curvecpr_shards *shards);
+unsigned int curvecpr_shards_owner (const struct curvecpr_shards *shards, const unsigned char client_session_pk[32]);
+int curvecpr_shards_route (struct curvecpr_shards *shards, const unsigned char *buf, size_t num, void *priv);
+size_t curvecpr_shards_process (struct curvecpr_shards *shards, unsigned int index, size_t max);
+void curvecpr_shards_refresh_temporal_keys (struct curvecpr_shards *shards);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __CURVECPR_SLAB_H
+#define __CURVECPR_SLAB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <string.h>
+
+/* Storage for block data in a handful of size classes, so a block only takes up about
+   as much memory as it has data. Memory is taken from ops.alloc a page at a time and
+   split into chunks of one class; released chunks go on a free list for their class,
+   and pages are only handed back to ops.free when the slab is destroyed. A slab isn't
+   safe to use from more than one thread at a time, but any number of queues used
+   from one thread can share one. */
+
+/* Chunks are 64, 128, 256, 512 or 1024 bytes. */
+#define CURVECPR_SLAB_CLASSES 5
+#define CURVECPR_SLAB_MINIMUM 64
+
+struct curvecpr_slab;
+
+struct curvecpr_slab_ops {
+    /* Get and release memory for pages. Both optional; malloc() and free() are used if
+       they aren't set. */
+    void *(*alloc)(struct curvecpr_slab *slab, size_t num);
+    void (*free)(struct curvecpr_slab *slab, void *page);
+};
+
+struct curvecpr_slab_cf {
+    /* Bytes in each page. If 0, 16384. At least enough for one of the largest
+       chunks. */
+    size_t page_bytes;
+
+    struct curvecpr_slab_ops ops;
+
+    void *priv;
+};
+
+struct curvecpr_slab {
+    struct curvecpr_slab_cf cf;
+
+    /* Released chunks of each class, linked through their first bytes. */
+    void *chunks[CURVECPR_SLAB_CLASSES];
+
+    /* Pages from ops.alloc, linked the same way. */
+    void *pages;
+
+    /* Bytes taken from ops.alloc, and bytes of chunks handed out. */
+    size_t bytes;
+    size_t bytes_used;
+};
+
+int curvecpr_slab_new (struct curvecpr_slab *slab, const struct curvecpr_slab_cf *cf);
+void curvecpr_slab_destroy (struct curvecpr_slab *slab);
+size_t curvecpr_slab_chunk_bytes (size_t num);
+unsigned char *curvecpr_slab_get (struct curvecpr_slab *slab, size_t num);
+void curvecpr_slab_put (struct curvecpr_slab *slab, unsigned char *chunk, size_t num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
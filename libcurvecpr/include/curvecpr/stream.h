@@ -0,0 +1,63 @@
+#ifndef __CURVECPR_STREAM_H
+#define __CURVECPR_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "block.h"
+#include "messager.h"
+
+#include <string.h>
+
+#include <sodium/crypto_uint64.h>
+
+/* A byte stream on top of a messager using the built-in queues (see
+   curvecpr/queues.h), so the application doesn't have to deal in blocks.
+   curvecpr_messager_write() fills each block in the sendq up to the largest the
+   messager may send before starting another, and keeps topping up the last one until
+   it's sent. Received data is copied into a ring buffer as it arrives, in whatever
+   order, and curvecpr_messager_read() hands it out once everything before it has
+   arrived too. Data that wouldn't fit in the ring yet is dropped without being
+   acknowledged, so the other side sends it again later. */
+
+struct curvecpr_stream_cf {
+    /* Bytes of received data that can be held, including any that arrived ahead of
+       a gap. */
+    size_t recv_bytes;
+};
+
+struct curvecpr_stream {
+    struct curvecpr_stream_cf cf;
+
+    /* Indexed by stream offset, modulo recv_bytes, with a bit for each byte saying
+       whether it's arrived. */
+    unsigned char *recv_ring;
+    unsigned char *recv_present;
+
+    /* The next byte to be read, and the end of what's arrived in order after it. */
+    crypto_uint64 recv_offset;
+    crypto_uint64 recv_contiguous;
+
+    /* How and where the other side's stream ends, once that's arrived. */
+    enum curvecpr_block_eofflag recv_eof;
+    crypto_uint64 recv_eof_offset;
+
+    unsigned char shutdown;
+
+    /* The recvmarkq_put op curvecpr_stream_configure() took the place of. */
+    int (*recvmarkq_put)(struct curvecpr_messager *messager, const struct curvecpr_block *block, struct curvecpr_block **block_stored);
+};
+
+int curvecpr_stream_new (struct curvecpr_stream *stream, const struct curvecpr_stream_cf *cf);
+void curvecpr_stream_destroy (struct curvecpr_stream *stream);
+void curvecpr_stream_configure (struct curvecpr_stream *stream, struct curvecpr_messager_cf *cf);
+int curvecpr_messager_write (struct curvecpr_messager *messager, const unsigned char *buf, size_t num, size_t *written);
+int curvecpr_messager_read (struct curvecpr_messager *messager, unsigned char *buf, size_t num, size_t *num_read);
+int curvecpr_messager_shutdown (struct curvecpr_messager *messager);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
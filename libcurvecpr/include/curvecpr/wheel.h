@@ -0,0 +1,95 @@
+#ifndef __CURVECPR_WHEEL_H
+#define __CURVECPR_WHEEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "clock.h"
+
+#include <string.h>
+
+#include <sodium/crypto_uint64.h>
+
+/* A hierarchical timing wheel for the timeouts of very many messagers, so a server
+   doesn't have to keep its own priority queue over them. Each level has
+   CURVECPR_WHEEL_SLOTS slots, each covering CURVECPR_WHEEL_SLOTS times as many
+   ticks as a slot of the level below; a timeout goes in the lowest level that
+   reaches it, and moves down a level each time the level below comes round to it.
+   Scheduling, rescheduling and removing a messager are all constant time, and
+   rescheduling it for the same tick does nothing at all, which is the usual case
+   as the messager reports its timeout after every message sent and received.
+
+   Messagers put on a wheel with curvecpr_wheel_configure() go onto it as soon as
+   they're created. Then the event loop goes:
+
+       curvecpr_wheel_advance(&wheel, now);
+       while ((messager = curvecpr_wheel_pop(&wheel))) {
+           curvecpr_messager_process_sendq(messager);
+           curvecpr_messager_next_timeout(messager);
+       }
+
+   and sleeps until curvecpr_wheel_next_expiry() or a packet arrives. Timeouts are
+   rounded up to the tick, so messagers come out up to a tick late but never early.
+   A messager must be taken off the wheel with curvecpr_wheel_remove() before it's
+   freed or passed to curvecpr_messager_new() again. */
+
+struct curvecpr_messager;
+struct curvecpr_messager_cf;
+
+#define CURVECPR_WHEEL_LEVELS 6
+#define CURVECPR_WHEEL_SLOTS 64
+
+/* Where a messager is on a wheel. Kept in struct curvecpr_messager. */
+struct curvecpr_wheel_timer {
+    struct curvecpr_wheel_timer *next;
+    struct curvecpr_wheel_timer *prev;
+
+    struct curvecpr_messager *messager;
+
+    /* The tick it's due at, and which list it's on: a slot (level * SLOTS + index),
+       or CURVECPR_WHEEL_LEVELS * CURVECPR_WHEEL_SLOTS for the due list. */
+    long long tick;
+    unsigned int list;
+    unsigned char scheduled;
+};
+
+struct curvecpr_wheel_cf {
+    /* The time, in nanoseconds, each slot of the lowest level covers. If 0, 1
+       millisecond. */
+    long long tick;
+
+    /* Where the time comes from when the wheel is created. Should be the messagers'
+       clock. If NULL, it's CURVECPR_CLOCK_MONOTONIC. */
+    const struct curvecpr_clock *clock;
+};
+
+struct curvecpr_wheel {
+    struct curvecpr_wheel_cf cf;
+
+    /* The next tick advancing will look at; everything before it has been. */
+    long long tick;
+
+    /* The slots of each level (with a bit set in occupied for each that isn't
+       empty), then the messagers that have come due but haven't been popped. */
+    struct curvecpr_wheel_timer *lists[CURVECPR_WHEEL_LEVELS * CURVECPR_WHEEL_SLOTS + 1];
+    crypto_uint64 occupied[CURVECPR_WHEEL_LEVELS];
+
+    /* How many messagers are in the slots, and on the due list. */
+    size_t pending;
+    size_t due;
+};
+
+int curvecpr_wheel_new (struct curvecpr_wheel *wheel, const struct curvecpr_wheel_cf *cf);
+void curvecpr_wheel_configure (struct curvecpr_wheel *wheel, struct curvecpr_messager_cf *cf);
+void curvecpr_wheel_schedule (struct curvecpr_wheel *wheel, struct curvecpr_messager *messager, long long at);
+void curvecpr_wheel_remove (struct curvecpr_wheel *wheel, struct curvecpr_messager *messager);
+size_t curvecpr_wheel_advance (struct curvecpr_wheel *wheel, long long now);
+struct curvecpr_messager *curvecpr_wheel_pop (struct curvecpr_wheel *wheel);
+long long curvecpr_wheel_next_expiry (const struct curvecpr_wheel *wheel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
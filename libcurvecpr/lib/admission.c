@@ -0,0 +1,111 @@
+#include "config.h"
+
+#include <curvecpr/admission.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/server.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sodium/crypto_shorthash.h>
+#include <sodium/crypto_uint32.h>
+#include <sodium/crypto_uint64.h>
+#include <sodium/randombytes.h>
+
+int curvecpr_admission_new (struct curvecpr_admission *admission, const struct curvecpr_admission_cf *cf)
+{
+    crypto_uint32 sources = 1;
+
+    curvecpr_bytes_zero(admission, sizeof(struct curvecpr_admission));
+
+    if (cf)
+        curvecpr_bytes_copy(&admission->cf, cf, sizeof(struct curvecpr_admission_cf));
+
+    if (admission->cf.source_rate && (!admission->cf.sources || admission->cf.sources > 0x80000000U))
+        return -EINVAL;
+
+    if (admission->cf.global_budget && admission->cf.slice_length <= 0)
+        return -EINVAL;
+
+    if (admission->cf.source_rate) {
+        while (sources < admission->cf.sources)
+            sources *= 2;
+
+        admission->sources = calloc(sources, sizeof(struct curvecpr_admission_source));
+        if (!admission->sources)
+            return -ENOMEM;
+
+        admission->mask = sources - 1;
+    }
+
+    randombytes(admission->hash_key, sizeof(admission->hash_key));
+
+    return 0;
+}
+
+void curvecpr_admission_destroy (struct curvecpr_admission *admission)
+{
+    free(admission->sources);
+
+    curvecpr_bytes_zero(admission, sizeof(struct curvecpr_admission));
+}
+
+void curvecpr_admission_configure (struct curvecpr_admission *admission, struct curvecpr_server_cf *cf)
+{
+    cf->admission = admission;
+}
+
+/* Decides whether a hello from the source identified by tag (or from an unknown
+   source, if tag is NULL) should be answered. Returns 0, counting it against the
+   budgets, or -EAGAIN if it should be dropped. */
+int curvecpr_admission_admit (struct curvecpr_admission *admission, const unsigned char tag[CURVECPR_ADMISSION_TAG], long long now)
+{
+    const struct curvecpr_admission_cf *cf = &admission->cf;
+    struct curvecpr_admission_source *source = NULL;
+    crypto_uint64 hash = 0;
+    long long interval = 0;
+    long long arrival = 0;
+
+    /* Per source: admit if the bucket would be no more than burst hellos short of
+       full. Nothing is changed until the global check passes too. */
+    if (tag && cf->source_rate) {
+        unsigned char digest[8];
+
+        crypto_shorthash(digest, tag, CURVECPR_ADMISSION_TAG, admission->hash_key);
+        hash = curvecpr_bytes_unpack_uint64(digest);
+
+        source = &admission->sources[hash & admission->mask];
+        interval = 1000000000LL / cf->source_rate;
+
+        arrival = source->hash == hash && source->arrival > now ? source->arrival : now;
+        if (arrival - now > (long long)cf->source_burst * interval) {
+            ++admission->shed_source;
+            return -EAGAIN;
+        }
+    }
+
+    if (cf->global_budget) {
+        if (now - admission->slice_start >= cf->slice_length || now < admission->slice_start) {
+            admission->slice_start = now;
+            admission->slice_used = 0;
+        }
+
+        if (admission->slice_used >= cf->global_budget) {
+            ++admission->shed_global;
+            return -EAGAIN;
+        }
+
+        ++admission->slice_used;
+    }
+
+    if (source) {
+        source->hash = hash;
+        source->arrival = arrival + interval;
+    }
+
+    ++admission->admitted;
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef __CURVECPR_LIB_ATOMIC_H
+#define __CURVECPR_LIB_ATOMIC_H
+
+/* The atomic operations the library's thread-shared parts (reference counts, spin
+   locks, and state handed between threads) are built on. Not installed. configure
+   checks the compiler has the builtins these use. */
+
+#if defined(HAVE_ATOMIC_BUILTINS) || defined(__GNUC__) || defined(__clang__)
+#define _LOAD_RELAXED(pointer) __atomic_load_n((pointer), __ATOMIC_RELAXED)
+#define _LOAD_ACQUIRE(pointer) __atomic_load_n((pointer), __ATOMIC_ACQUIRE)
+#define _STORE_RELAXED(pointer, value) __atomic_store_n((pointer), (value), __ATOMIC_RELAXED)
+#define _STORE_RELEASE(pointer, value) __atomic_store_n((pointer), (value), __ATOMIC_RELEASE)
+
+/* Sets *pointer to desired if it's *expected; otherwise stores what it was in
+   *expected. Nonzero if it was set. */
+#define _COMPARE_EXCHANGE_ACQUIRE(pointer, expected, desired) \
+    __atomic_compare_exchange_n((pointer), (expected), (desired), 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
+
+/* Reference counts. _UNREF evaluates to how many are left. */
+#define _REF(pointer) ((void)__atomic_add_fetch((pointer), 1, __ATOMIC_RELAXED))
+#define _UNREF(pointer) __atomic_sub_fetch((pointer), 1, __ATOMIC_ACQ_REL)
+
+/* Spin locks on an int that's 0 when unlocked. */
+#define _LOCK(pointer) \
+    do { \
+        while (__atomic_exchange_n((pointer), 1, __ATOMIC_ACQUIRE)) { \
+            while (__atomic_load_n((pointer), __ATOMIC_RELAXED)) \
+                ; \
+        } \
+    } while (0)
+#define _UNLOCK(pointer) __atomic_store_n((pointer), 0, __ATOMIC_RELEASE)
+#else
+#error "libcurvecpr needs the __atomic builtins (GCC 4.7 or Clang 3.1 and later)"
+#endif
+
+#endif
@@ -0,0 +1,186 @@
+#include "config.h"
+
+#include <curvecpr/bbr.h>
+
+#include <curvecpr/block.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/messager.h>
+
+#include <sodium/crypto_uint64.h>
+
+/* Pacing gains, in thousandths. */
+#define _GAIN_STARTUP 2885
+#define _GAIN_DRAIN 347
+
+static const long long _gain_cycle[8] = { 1250, 750, 1000, 1000, 1000, 1000, 1000, 1000 };
+
+static long long _gain (const struct curvecpr_bbr *bbr)
+{
+    switch (bbr->mode) {
+        case CURVECPR_BBR_STARTUP:
+            return _GAIN_STARTUP;
+        case CURVECPR_BBR_DRAIN:
+            return _GAIN_DRAIN;
+        case CURVECPR_BBR_PROBE_BW:
+            return _gain_cycle[bbr->cycle];
+    }
+
+    return 1000;
+}
+
+/* Works out the time between blocks from the model. */
+static void _pace (struct curvecpr_bbr *bbr)
+{
+    if (bbr->bw) {
+        bbr->wr_rate = 256000000000000LL / (_gain(bbr) * bbr->bw);
+    } else if (bbr->rtt_min) {
+        /* Nothing to go on until a round trip is over, so start with ten blocks per
+           round trip. */
+        bbr->wr_rate = bbr->rtt_min / 10;
+    }
+
+    if (bbr->wr_rate < 1)
+        bbr->wr_rate = 1;
+}
+
+static void _end_round (struct curvecpr_bbr *bbr, long long clock)
+{
+    long long sample = (long long)(bbr->delivered - bbr->round_delivered) * 256000000000LL / (clock - bbr->round_clock);
+    unsigned int i;
+
+    bbr->bw_samples[bbr->rounds % CURVECPR_BBR_ROUNDS] = sample;
+    ++bbr->rounds;
+
+    bbr->bw = 0;
+    for (i = 0; i < CURVECPR_BBR_ROUNDS; ++i) {
+        if (bbr->bw_samples[i] > bbr->bw)
+            bbr->bw = bbr->bw_samples[i];
+    }
+
+    bbr->round_delivered = bbr->delivered;
+    bbr->round_clock = clock;
+
+    switch (bbr->mode) {
+        case CURVECPR_BBR_STARTUP:
+            if (bbr->bw >= bbr->full_bw + bbr->full_bw / 4) {
+                bbr->full_bw = bbr->bw;
+                bbr->full_bw_rounds = 0;
+            } else if (++bbr->full_bw_rounds >= 3) {
+                bbr->mode = CURVECPR_BBR_DRAIN;
+            }
+            break;
+
+        case CURVECPR_BBR_DRAIN:
+            break;
+
+        case CURVECPR_BBR_PROBE_BW:
+            bbr->cycle = (bbr->cycle + 1) % 8;
+            break;
+    }
+}
+
+static void _on_recv (struct curvecpr_messager *messager, const struct curvecpr_block *block)
+{
+    struct curvecpr_bbr *bbr = messager->cf.bbr;
+    long long clock = messager->chicago.clock;
+    long long rtt = clock - block->clock;
+    long long rtt_delta;
+
+    if (rtt < 1)
+        rtt = 1;
+
+    ++bbr->delivered;
+
+    /* Jacobson's retransmission timeout calculation. */
+    if (!bbr->rtt_average) {
+        bbr->rtt_average = rtt;
+        bbr->rtt_deviation = rtt / 2;
+    }
+
+    rtt_delta = rtt - bbr->rtt_average;
+    bbr->rtt_average += rtt_delta / 8;
+    if (rtt_delta < 0)
+        rtt_delta = -rtt_delta;
+    rtt_delta -= bbr->rtt_deviation;
+    bbr->rtt_deviation += rtt_delta / 4;
+
+    if (!bbr->rtt_min || rtt <= bbr->rtt_min || clock - bbr->rtt_min_clock > 10000000000LL) {
+        bbr->rtt_min = rtt;
+        bbr->rtt_min_clock = clock;
+    }
+
+    /* Rounds are at least the shortest round trip long, starting from the first
+       acknowledgment. */
+    if (bbr->delivered == 1) {
+        bbr->round_delivered = bbr->delivered;
+        bbr->round_clock = clock;
+    } else if (clock - bbr->round_clock >= bbr->rtt_min) {
+        _end_round(bbr, clock);
+    }
+
+    /* Draining is over once the queue startup left behind is gone: round trips are
+       back down near the shortest. */
+    if (bbr->mode == CURVECPR_BBR_DRAIN && rtt <= bbr->rtt_min + bbr->rtt_min / 4) {
+        bbr->mode = CURVECPR_BBR_PROBE_BW;
+        bbr->cycle = 0;
+    }
+
+    _pace(bbr);
+
+    bbr->rtt_timeout = bbr->rtt_average + 4 * bbr->rtt_deviation + 4 * bbr->wr_rate;
+}
+
+static void _on_timeout (struct curvecpr_messager *messager)
+{
+    struct curvecpr_bbr *bbr = messager->cf.bbr;
+    long long clock = messager->chicago.clock;
+    unsigned int i;
+
+    if (clock <= bbr->ns_last_panic + 4 * bbr->rtt_timeout)
+        return;
+
+    /* Blocks are going missing, so the model is too optimistic. */
+    for (i = 0; i < CURVECPR_BBR_ROUNDS; ++i)
+        bbr->bw_samples[i] /= 2;
+    bbr->bw /= 2;
+
+    if (bbr->mode == CURVECPR_BBR_STARTUP)
+        bbr->mode = CURVECPR_BBR_DRAIN;
+
+    bbr->ns_last_panic = clock;
+
+    _pace(bbr);
+}
+
+static long long _next_send_time (struct curvecpr_messager *messager)
+{
+    return messager->my_sent_clock + messager->cf.bbr->wr_rate;
+}
+
+static long long _rto (struct curvecpr_messager *messager)
+{
+    return messager->cf.bbr->rtt_timeout;
+}
+
+void curvecpr_bbr_new (struct curvecpr_bbr *bbr)
+{
+    curvecpr_bytes_zero(bbr, sizeof(struct curvecpr_bbr));
+
+    bbr->mode = CURVECPR_BBR_STARTUP;
+
+    bbr->rtt_timeout = 1000000000;
+
+    /* Ten blocks a second until there's a round-trip time to go on. */
+    bbr->wr_rate = 100000000;
+}
+
+/* Call before curvecpr_messager_new(). */
+void curvecpr_bbr_configure (struct curvecpr_bbr *bbr, struct curvecpr_messager_cf *cf)
+{
+    cf->congestion.on_recv = _on_recv;
+    cf->congestion.on_timeout = _on_timeout;
+    cf->congestion.next_send_time = _next_send_time;
+    cf->congestion.rto = _rto;
+
+    cf->bbr = bbr;
+}
@@ -0,0 +1,42 @@
+#include "config.h"
+
+#include <curvecpr/block.h>
+
+#include <curvecpr/bytes.h>
+
+#include <string.h>
+
+#include "atomic.h"
+
+struct curvecpr_block_payload *curvecpr_block_payload_ref (struct curvecpr_block_payload *payload)
+{
+    _REF(&payload->refs);
+
+    return payload;
+}
+
+/* Drops a reference, releasing the payload once there are none left. */
+void curvecpr_block_payload_unref (struct curvecpr_block_payload *payload)
+{
+    if (_UNREF(&payload->refs))
+        return;
+
+    if (payload->release)
+        payload->release(payload);
+}
+
+/* Copies a block's data, wherever it's kept, to destination. */
+void curvecpr_block_gather (const struct curvecpr_block *block, unsigned char *destination)
+{
+    unsigned int i;
+
+    if (!block->pieces) {
+        curvecpr_bytes_copy(destination, block->data, block->data_len);
+        return;
+    }
+
+    for (i = 0; i < block->pieces; ++i) {
+        curvecpr_bytes_copy(destination, block->piece[i].data, block->piece[i].len);
+        destination += block->piece[i].len;
+    }
+}
@@ -2,41 +2,276 @@
 
 #include <curvecpr/bytes.h>
 
+#include <errno.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define _HAVE_AVX2 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define _BARRIER(address) __asm__ __volatile__ ("" : : "r"(address) : "memory")
+#else
+#define _BARRIER(address)
+#endif
+
 #include <sodium/crypto_uint16.h>
 #include <sodium/crypto_uint32.h>
 #include <sodium/crypto_uint64.h>
 
-void curvecpr_bytes_copy (void *destination, const void *source, size_t num)
+#include "atomic.h"
+
+/* Every kernel copies front to back, so (as with the original byte loop) it's safe
+   for destination to overlap source as long as it comes first. */
+
+/* Portable kernels, a machine word at a time. memcpy() of a fixed 8 bytes compiles
+   down to a single unaligned load or store. */
+static void _copy_scalar (unsigned char *destination, const unsigned char *source, size_t num)
 {
-    char *destination_copier = destination;
-    const char *source_copier = source;
+    crypto_uint64 word;
+
+    for (; num >= 8; num -= 8, destination += 8, source += 8) {
+        memcpy(&word, source, 8);
+        memcpy(destination, &word, 8);
+    }
+
     while (num > 0) {
-        *destination_copier++ = *source_copier++;
+        *destination++ = *source++;
         --num;
     }
 }
 
-void curvecpr_bytes_zero (void *destination, size_t num)
+static void _zero_scalar (unsigned char *destination, size_t num)
 {
-    char *destination_copier = destination;
+    const crypto_uint64 word = 0;
+
+    for (; num >= 8; num -= 8, destination += 8)
+        memcpy(destination, &word, 8);
+
     while (num > 0) {
-        *destination_copier++ = 0;
+        *destination++ = 0;
         --num;
     }
 }
 
-int curvecpr_bytes_equal (const void *ptr1, const void *ptr2, size_t num)
+/* Returns the bitwise OR of the differences between the buffers. Never exits early. */
+static crypto_uint64 _diff_scalar (const unsigned char *ptr1, const unsigned char *ptr2, size_t num)
 {
-    const unsigned char *ptr1_comparator = ptr1;
-    const unsigned char *ptr2_comparator = ptr2;
-    unsigned char diff = 0;
+    crypto_uint64 diff = 0, word1, word2;
+
+    for (; num >= 8; num -= 8, ptr1 += 8, ptr2 += 8) {
+        memcpy(&word1, ptr1, 8);
+        memcpy(&word2, ptr2, 8);
+        diff |= word1 ^ word2;
+    }
+
     while (num > 0) {
-        diff |= *ptr1_comparator++ ^ *ptr2_comparator++;
+        diff |= (crypto_uint64)(*ptr1++ ^ *ptr2++);
         --num;
     }
-    return (256 - (unsigned int) diff) >> 8;
+
+    return diff;
+}
+
+#ifdef __SSE2__
+static void _copy_sse2 (unsigned char *destination, const unsigned char *source, size_t num)
+{
+    for (; num >= 16; num -= 16, destination += 16, source += 16)
+        _mm_storeu_si128((__m128i *)(void *)destination, _mm_loadu_si128((const __m128i *)(const void *)source));
+
+    _copy_scalar(destination, source, num);
+}
+
+static void _zero_sse2 (unsigned char *destination, size_t num)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; num >= 16; num -= 16, destination += 16)
+        _mm_storeu_si128((__m128i *)(void *)destination, zero);
+
+    _zero_scalar(destination, num);
+}
+
+static crypto_uint64 _diff_sse2 (const unsigned char *ptr1, const unsigned char *ptr2, size_t num)
+{
+    __m128i diff = _mm_setzero_si128();
+    crypto_uint64 lanes[2];
+
+    for (; num >= 16; num -= 16, ptr1 += 16, ptr2 += 16)
+        diff = _mm_or_si128(diff, _mm_xor_si128(_mm_loadu_si128((const __m128i *)(const void *)ptr1), _mm_loadu_si128((const __m128i *)(const void *)ptr2)));
+
+    _mm_storeu_si128((__m128i *)(void *)lanes, diff);
+
+    return lanes[0] | lanes[1] | _diff_scalar(ptr1, ptr2, num);
+}
+#endif
+
+#ifdef _HAVE_AVX2
+__attribute__((target("avx2")))
+static void _copy_avx2 (unsigned char *destination, const unsigned char *source, size_t num)
+{
+    for (; num >= 32; num -= 32, destination += 32, source += 32)
+        _mm256_storeu_si256((__m256i *)(void *)destination, _mm256_loadu_si256((const __m256i *)(const void *)source));
+
+    _copy_sse2(destination, source, num);
+}
+
+__attribute__((target("avx2")))
+static void _zero_avx2 (unsigned char *destination, size_t num)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (; num >= 32; num -= 32, destination += 32)
+        _mm256_storeu_si256((__m256i *)(void *)destination, zero);
+
+    _zero_sse2(destination, num);
+}
+
+__attribute__((target("avx2")))
+static crypto_uint64 _diff_avx2 (const unsigned char *ptr1, const unsigned char *ptr2, size_t num)
+{
+    __m256i diff = _mm256_setzero_si256();
+    crypto_uint64 lanes[4];
+
+    for (; num >= 32; num -= 32, ptr1 += 32, ptr2 += 32)
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(const void *)ptr1), _mm256_loadu_si256((const __m256i *)(const void *)ptr2)));
+
+    _mm256_storeu_si256((__m256i *)(void *)lanes, diff);
+
+    return lanes[0] | lanes[1] | lanes[2] | lanes[3] | _diff_sse2(ptr1, ptr2, num);
+}
+#endif
+
+/* A matching set of kernels. */
+struct _kernels {
+    enum curvecpr_bytes_kernel kernel;
+
+    void (*copy)(unsigned char *, const unsigned char *, size_t);
+    void (*zero)(unsigned char *, size_t);
+    crypto_uint64 (*diff)(const unsigned char *, const unsigned char *, size_t);
+};
+
+static const struct _kernels _scalar_kernels = { CURVECPR_BYTES_KERNEL_SCALAR, _copy_scalar, _zero_scalar, _diff_scalar };
+#ifdef __SSE2__
+static const struct _kernels _sse2_kernels = { CURVECPR_BYTES_KERNEL_SSE2, _copy_sse2, _zero_sse2, _diff_sse2 };
+#endif
+#ifdef _HAVE_AVX2
+static const struct _kernels _avx2_kernels = { CURVECPR_BYTES_KERNEL_AVX2, _copy_avx2, _zero_avx2, _diff_avx2 };
+#endif
+
+/* The set in use, or NULL until the first call that needs one picks the best for
+   this CPU. It's only ever read and written atomically, so threads racing to pick
+   (or a call to curvecpr_bytes_set_kernel()) each see one whole set or another. */
+static const struct _kernels *_active = NULL;
+
+static int _supported (enum curvecpr_bytes_kernel kernel)
+{
+    switch (kernel) {
+        case CURVECPR_BYTES_KERNEL_SCALAR:
+            return 1;
+        case CURVECPR_BYTES_KERNEL_SSE2:
+#ifdef __SSE2__
+            return 1;
+#else
+            return 0;
+#endif
+        case CURVECPR_BYTES_KERNEL_AVX2:
+#ifdef _HAVE_AVX2
+            return __builtin_cpu_supports("avx2");
+#else
+            return 0;
+#endif
+    }
+
+    return 0;
+}
+
+static const struct _kernels *_kernels (void)
+{
+    const struct _kernels *kernels = _LOAD_RELAXED(&_active);
+
+    if (kernels)
+        return kernels;
+
+    if (curvecpr_bytes_set_kernel(CURVECPR_BYTES_KERNEL_AVX2))
+        if (curvecpr_bytes_set_kernel(CURVECPR_BYTES_KERNEL_SSE2))
+            curvecpr_bytes_set_kernel(CURVECPR_BYTES_KERNEL_SCALAR);
+
+    return _LOAD_RELAXED(&_active);
+}
+
+enum curvecpr_bytes_kernel curvecpr_bytes_kernel (void)
+{
+    return _kernels()->kernel;
+}
+
+/* Forces a particular set of kernels, e.g. for benchmarking. Returns -ENOTSUP if
+   this build or CPU can't run them. */
+int curvecpr_bytes_set_kernel (enum curvecpr_bytes_kernel kernel)
+{
+    const struct _kernels *kernels = &_scalar_kernels;
+
+    if (!_supported(kernel))
+        return -ENOTSUP;
+
+    switch (kernel) {
+        case CURVECPR_BYTES_KERNEL_SCALAR:
+            break;
+        case CURVECPR_BYTES_KERNEL_SSE2:
+#ifdef __SSE2__
+            kernels = &_sse2_kernels;
+#endif
+            break;
+        case CURVECPR_BYTES_KERNEL_AVX2:
+#ifdef _HAVE_AVX2
+            kernels = &_avx2_kernels;
+#endif
+            break;
+    }
+
+    _STORE_RELAXED(&_active, kernels);
+
+    return 0;
+}
+
+void curvecpr_bytes_copy (void *destination, const void *source, size_t num)
+{
+    /* Most calls are for nonces and keys, which aren't worth an indirect call. */
+    if (num <= 32)
+        _copy_scalar(destination, source, num);
+    else
+        _kernels()->copy(destination, source, num);
+}
+
+void curvecpr_bytes_zero (void *destination, size_t num)
+{
+    if (num <= 32)
+        _zero_scalar(destination, num);
+    else
+        _kernels()->zero(destination, num);
+
+    /* This is used to wipe keys, so make sure the compiler can't decide the stores
+       are dead and drop them. */
+    _BARRIER(destination);
+}
+
+int curvecpr_bytes_equal (const void *ptr1, const void *ptr2, size_t num)
+{
+    crypto_uint64 diff = num <= 32 ? _diff_scalar(ptr1, ptr2, num) : _kernels()->diff(ptr1, ptr2, num);
+    unsigned int folded;
+
+    /* Fold down to one byte without branching. */
+    diff |= diff >> 32;
+    diff |= diff >> 16;
+    diff |= diff >> 8;
+    folded = (unsigned int)(diff & 0xff);
+
+    return (int)((256 - folded) >> 8);
 }
 
 void curvecpr_bytes_pack_uint16 (unsigned char *destination, crypto_uint16 source)
@@ -3,8 +3,28 @@
 #include <curvecpr/chicago.h>
 
 #include <curvecpr/bytes.h>
+#include <curvecpr/clock.h>
 #include <curvecpr/util.h>
 
+#include <sodium/crypto_uint64.h>
+
+/* Chicago adds a little randomness to its rate now and then. */
+static long long _random_mod_n (struct curvecpr_chicago *chicago, long long n)
+{
+    if (!chicago->random_state)
+        return curvecpr_util_random_mod_n(n);
+
+    if (n <= 1)
+        return 0;
+
+    /* xorshift64* */
+    chicago->random_state ^= chicago->random_state >> 12;
+    chicago->random_state ^= chicago->random_state << 25;
+    chicago->random_state ^= chicago->random_state >> 27;
+
+    return (long long)((chicago->random_state * 2685821657736338717ULL) % (crypto_uint64)n);
+}
+
 static void _try_update_rates (struct curvecpr_chicago *chicago)
 {
     if (chicago->clock - chicago->ns_last_edge < 60000000000LL) {
@@ -15,7 +35,7 @@ static void _try_update_rates (struct curvecpr_chicago *chicago)
             return;
     }
 
-    if (chicago->wr_rate <= 65535)
+    if (chicago->wr_rate <= chicago->wr_rate_floor)
         return;
 
     chicago->wr_rate /= 2;
@@ -70,7 +90,7 @@ static void _update (struct curvecpr_chicago *chicago, long long rtt_ns)
         /* Maybe it's been too long (bad timeout -- 10 seconds)... */
         if (chicago->clock - chicago->ns_last_update > 10000000000LL) {
             chicago->wr_rate = 1000000000;
-            chicago->wr_rate += curvecpr_util_random_mod_n(chicago->wr_rate / 8);
+            chicago->wr_rate += _random_mod_n(chicago, chicago->wr_rate / 8);
         }
 
         chicago->ns_last_update = chicago->clock;
@@ -98,7 +118,7 @@ static void _update (struct curvecpr_chicago *chicago, long long rtt_ns)
             if (chicago->seen_older_high) {
                 chicago->rtt_phase = 1;
                 chicago->ns_last_edge = chicago->clock;
-                chicago->wr_rate += curvecpr_util_random_mod_n(chicago->wr_rate / 4);
+                chicago->wr_rate += _random_mod_n(chicago, chicago->wr_rate / 4);
             }
         } else {
             if (chicago->seen_older_low)
@@ -123,10 +143,12 @@ static void _update_on_timeout (struct curvecpr_chicago *chicago)
     }
 }
 
-void curvecpr_chicago_new (struct curvecpr_chicago *chicago)
+void curvecpr_chicago_new (struct curvecpr_chicago *chicago, const struct curvecpr_clock *clock_source)
 {
     curvecpr_bytes_zero(chicago, sizeof(struct curvecpr_chicago));
 
+    chicago->clock_source = clock_source;
+
     curvecpr_chicago_refresh_clock(chicago);
 
     chicago->rtt_latest = 0;
@@ -144,6 +166,7 @@ void curvecpr_chicago_new (struct curvecpr_chicago *chicago)
     chicago->rtt_phase = 0;
 
     chicago->wr_rate = 1000000000;
+    chicago->wr_rate_floor = CURVECPR_CHICAGO_FLOOR;
 
     chicago->ns_last_update = chicago->clock;
     chicago->ns_last_edge = 0;
@@ -153,7 +176,7 @@ void curvecpr_chicago_new (struct curvecpr_chicago *chicago)
 
 void curvecpr_chicago_refresh_clock (struct curvecpr_chicago *chicago)
 {
-    chicago->clock = curvecpr_util_nanoseconds();
+    chicago->clock = curvecpr_clock_now(chicago->clock_source);
 }
 
 void curvecpr_chicago_on_timeout (struct curvecpr_chicago *chicago)
@@ -4,49 +4,121 @@
 
 #include <curvecpr/bytes.h>
 #include <curvecpr/packet.h>
+#include <curvecpr/sendv.h>
 #include <curvecpr/session.h>
 #include <curvecpr/util.h>
 
+#include <errno.h>
+#include <stdlib.h>
+
 #include <sodium/crypto_box.h>
 
+#include "atomic.h"
+
 static const unsigned char _zeros[128] = { 0 };
 
-void curvecpr_client_new (struct curvecpr_client *client, const struct curvecpr_client_cf *cf)
+/* Makes a profile from the keys, extensions and domain name in cf, with one
+   reference. */
+int curvecpr_client_profile_new (struct curvecpr_client_profile **profile, const struct curvecpr_client_cf *cf)
+{
+    struct curvecpr_client_profile *p = malloc(sizeof(struct curvecpr_client_profile));
+
+    if (!p)
+        return -ENOMEM;
+
+    curvecpr_bytes_copy(p->my_extension, cf->my_extension, 16);
+    curvecpr_bytes_copy(p->my_global_pk, cf->my_global_pk, 32);
+    curvecpr_bytes_copy(p->their_extension, cf->their_extension, 16);
+    curvecpr_bytes_copy(p->their_global_pk, cf->their_global_pk, 32);
+    curvecpr_bytes_copy(p->their_domain_name, cf->their_domain_name, 256);
+
+    crypto_box_beforenm(p->my_global_their_global_key, p->their_global_pk, cf->my_global_sk);
+
+    p->refs = 1;
+
+    *profile = p;
+
+    return 0;
+}
+
+struct curvecpr_client_profile *curvecpr_client_profile_ref (struct curvecpr_client_profile *profile)
+{
+    _REF(&profile->refs);
+
+    return profile;
+}
+
+/* Drops a reference, wiping and freeing the profile once there are none left. */
+void curvecpr_client_profile_unref (struct curvecpr_client_profile *profile)
+{
+    if (_UNREF(&profile->refs))
+        return;
+
+    curvecpr_bytes_zero(profile, sizeof(struct curvecpr_client_profile));
+    free(profile);
+}
+
+/* Returns -ENOMEM if cf has no profile and one can't be made for the client. */
+int curvecpr_client_new (struct curvecpr_client *client, const struct curvecpr_client_cf *cf)
 {
     curvecpr_bytes_zero(client, sizeof(struct curvecpr_client));
 
     /* Copy in the configuration. */
-    if (cf)
-        curvecpr_bytes_copy(&client->cf, cf, sizeof(struct curvecpr_client_cf));
+    curvecpr_bytes_copy(&client->ops, &cf->ops, sizeof(struct curvecpr_client_ops));
+    client->sendv = cf->sendv;
+    client->priv = cf->priv;
+
+    /* Everything else comes from the profile. */
+    if (cf->profile) {
+        client->profile = curvecpr_client_profile_ref(cf->profile);
+    } else {
+        int r = curvecpr_client_profile_new(&client->profile, cf);
+
+        if (r)
+            return r;
+    }
+
+    curvecpr_bytes_copy(client->my_extension, client->profile->my_extension, 16);
 
     /* Initialize session. */
     curvecpr_session_new(&client->session);
 
     client->negotiated = CURVECPR_CLIENT_PENDING;
+
+    return 0;
+}
+
+/* Releases the client's profile, if it has one, and wipes its keys. */
+void curvecpr_client_destroy (struct curvecpr_client *client)
+{
+    if (client->profile)
+        curvecpr_client_profile_unref(client->profile);
+
+    curvecpr_bytes_zero(client, sizeof(struct curvecpr_client));
 }
 
 int curvecpr_client_connected (struct curvecpr_client *client)
 {
-    struct curvecpr_client_cf *cf = &client->cf;
+    const struct curvecpr_client_profile *profile = client->profile;
     struct curvecpr_session *s = &client->session;
     struct curvecpr_packet_hello p;
 
     /* Copy some data into the session. */
-    curvecpr_bytes_copy(s->their_extension, cf->their_extension, 16);
-    curvecpr_bytes_copy(s->their_global_pk, cf->their_global_pk, 32);
+    curvecpr_bytes_copy(s->their_extension, profile->their_extension, 16);
+    curvecpr_bytes_copy(s->their_global_pk, profile->their_global_pk, 32);
 
     /* Generate keys. */
     s->my_session_nonce = curvecpr_util_random_mod_n(281474976710656LL);
     crypto_box_keypair(s->my_session_pk, s->my_session_sk);
     crypto_box_beforenm(s->my_session_their_global_key, s->their_global_pk, s->my_session_sk);
-    crypto_box_beforenm(s->my_global_their_global_key, s->their_global_pk, cf->my_global_sk);
+    curvecpr_bytes_copy(s->my_global_their_global_key, profile->my_global_their_global_key, 32);
 
     /* Packet identifier. */
     curvecpr_bytes_copy(p.id, "QvnQ5XlH", 8);
 
     /* Extensions. */
     curvecpr_bytes_copy(p.server_extension, s->their_extension, 16);
-    curvecpr_bytes_copy(p.client_extension, cf->my_extension, 16);
+    curvecpr_bytes_copy(p.client_extension, client->my_extension, 16);
 
     /* The client's session-specific public key. */
     curvecpr_bytes_copy(p.client_session_pk, s->my_session_pk, 32);
@@ -70,7 +142,11 @@ int curvecpr_client_connected (struct curvecpr_client *client)
         curvecpr_bytes_copy(p.box, data + 16, 80);
     }
 
-    cf->ops.send(client, (const unsigned char *)&p, sizeof(struct curvecpr_packet_hello));
+    if (client->sendv) {
+        curvecpr_sendv_push(client->sendv, (const unsigned char *)&p, sizeof(struct curvecpr_packet_hello), client);
+    } else {
+        client->ops.send(client, (const unsigned char *)&p, sizeof(struct curvecpr_packet_hello));
+    }
 
     return 0;
 }
@@ -14,7 +14,6 @@
 
 static int _handle_cookie (struct curvecpr_client *client, const struct curvecpr_packet_cookie *p)
 {
-    const struct curvecpr_client_cf *cf = &client->cf;
     struct curvecpr_session *s = &client->session;
 
     unsigned char nonce[24];
@@ -47,7 +46,7 @@ static int _handle_cookie (struct curvecpr_client *client, const struct curvecpr
 
     /* Encrypt the vouch and store it into the box. */
     curvecpr_bytes_copy(nonce, "CurveCPV", 8);
-    if (cf->ops.next_nonce(client, nonce + 8, 16))
+    if (client->ops.next_nonce(client, nonce + 8, 16))
         return -EINVAL;
 
     crypto_box_afternm(client->negotiated_vouch, client->negotiated_vouch, 64, nonce, s->my_global_their_global_key);
@@ -61,13 +60,15 @@ static int _handle_cookie (struct curvecpr_client *client, const struct curvecpr
     return 0;
 }
 
-static int _handle_server_message (struct curvecpr_client *client, const struct curvecpr_packet_server_message *p, const unsigned char *buf, size_t num)
+/* If inplace is set, it's a writable alias of buf and the box is opened right there;
+   otherwise it's copied out first. */
+static int _handle_server_message (struct curvecpr_client *client, const struct curvecpr_packet_server_message *p, const unsigned char *buf, size_t num, unsigned char *inplace)
 {
-    const struct curvecpr_client_cf *cf = &client->cf;
     struct curvecpr_session *s = &client->session;
 
     unsigned char nonce[24];
-    unsigned char data[1120];
+    unsigned char data_local[1104];
+    unsigned char *data = inplace ? inplace : data_local;
 
     crypto_uint64 unpacked_nonce = curvecpr_bytes_unpack_uint64(p->nonce);
     if (client->negotiated == CURVECPR_CLIENT_NEGOTIATED && unpacked_nonce <= s->their_session_nonce)
@@ -76,10 +77,10 @@ static int _handle_server_message (struct curvecpr_client *client, const struct
     curvecpr_bytes_copy(nonce, "CurveCP-server-M", 16);
     curvecpr_bytes_copy(nonce + 16, p->nonce, 8);
 
-    curvecpr_bytes_zero(data, 16);
-    curvecpr_bytes_copy(data + 16, buf, num);
+    if (!inplace)
+        curvecpr_bytes_copy(data, buf, num);
 
-    if (crypto_box_open_afternm(data, data, num + 16, nonce, s->my_session_their_session_key))
+    if (crypto_box_open_detached_afternm(data + 16, data + 16, data, num - 16, nonce, s->my_session_their_session_key))
         return -EINVAL;
 
     if (client->negotiated == CURVECPR_CLIENT_INITIATING) {
@@ -93,15 +94,14 @@ static int _handle_server_message (struct curvecpr_client *client, const struct
 
     s->their_session_nonce = unpacked_nonce;
 
-    if (cf->ops.recv(client, data + 32, num - 16))
+    if (client->ops.recv(client, data + 16, num - 16))
         return -EINVAL;
 
     return 0;
 }
 
-int curvecpr_client_recv (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+static int _recv (struct curvecpr_client *client, const unsigned char *buf, size_t num, unsigned char *inplace)
 {
-    const struct curvecpr_client_cf *cf = &client->cf;
     const struct curvecpr_session *s = &client->session;
 
     if (client->negotiated == CURVECPR_CLIENT_PENDING) {
@@ -113,7 +113,7 @@ int curvecpr_client_recv (struct curvecpr_client *client, const unsigned char *b
 
         p = (const struct curvecpr_packet_cookie *)buf;
 
-        if (!(curvecpr_bytes_equal(p->id, "RL3aNMXK", 8) & curvecpr_bytes_equal(p->client_extension, cf->my_extension, 16) & curvecpr_bytes_equal(p->server_extension, s->their_extension, 16)))
+        if (!(curvecpr_bytes_equal(p->id, "RL3aNMXK", 8) & curvecpr_bytes_equal(p->client_extension, client->my_extension, 16) & curvecpr_bytes_equal(p->server_extension, s->their_extension, 16)))
             return -EINVAL;
 
         return _handle_cookie(client, p);
@@ -126,13 +126,26 @@ int curvecpr_client_recv (struct curvecpr_client *client, const unsigned char *b
 
         p = (const struct curvecpr_packet_server_message *)buf;
 
-        if (!(curvecpr_bytes_equal(p->id, "RL3aNMXM", 8) & curvecpr_bytes_equal(p->client_extension, cf->my_extension, 16) & curvecpr_bytes_equal(p->server_extension, s->their_extension, 16)))
+        if (!(curvecpr_bytes_equal(p->id, "RL3aNMXM", 8) & curvecpr_bytes_equal(p->client_extension, client->my_extension, 16) & curvecpr_bytes_equal(p->server_extension, s->their_extension, 16)))
             return -EINVAL;
 
         return _handle_server_message(client, p,
             buf + sizeof(struct curvecpr_packet_server_message),
-            num - sizeof(struct curvecpr_packet_server_message));
+            num - sizeof(struct curvecpr_packet_server_message),
+            inplace ? inplace + sizeof(struct curvecpr_packet_server_message) : NULL);
     }
 
     return -EINVAL;
 }
+
+int curvecpr_client_recv (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    return _recv(client, buf, num, NULL);
+}
+
+/* Like curvecpr_client_recv(), but decrypts messages in place; ops.recv is given a
+   pointer into buf. */
+int curvecpr_client_recv_inplace (struct curvecpr_client *client, unsigned char *buf, size_t num)
+{
+    return _recv(client, buf, num, buf);
+}
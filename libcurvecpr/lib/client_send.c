@@ -5,101 +5,114 @@
 #include <curvecpr/bytes.h>
 #include <curvecpr/session.h>
 #include <curvecpr/packet.h>
+#include <curvecpr/sendv.h>
 
 #include <string.h>
 #include <errno.h>
 
 #include <sodium/crypto_box.h>
 
-static int _do_initiate (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+/* Room for the client message header and authenticator. */
+#define _MESSAGE_HEADROOM (sizeof(struct curvecpr_packet_client_message) + 16)
+
+static int _send (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    if (client->sendv)
+        return curvecpr_sendv_push(client->sendv, buf, num, client);
+
+    return client->ops.send(client, buf, num);
+}
+
+/* Like _do_client_message(), the message is encrypted where it is, and the rest of
+   the packet is built in the headroom in front of it. */
+static int _do_initiate (struct curvecpr_client *client, unsigned char *buf, size_t num)
 {
-    const struct curvecpr_client_cf *cf = &client->cf;
+    const struct curvecpr_client_profile *profile = client->profile;
     struct curvecpr_session *s = &client->session;
 
     unsigned char nonce[24];
 
-    unsigned char raw_p[sizeof(struct curvecpr_packet_initiate) + 1008];
-    unsigned char raw_p_box[sizeof(struct curvecpr_packet_initiate_box) + 640];
+    /* The box (less its leading zero bytes) goes immediately before the message,
+       with the authenticator and the packet header in front of that. */
+    unsigned char *box = buf - (sizeof(struct curvecpr_packet_initiate_box) - 32);
+    unsigned char *raw_p = box - 16 - sizeof(struct curvecpr_packet_initiate);
 
     struct curvecpr_packet_initiate *p = (struct curvecpr_packet_initiate *)raw_p;
-    struct curvecpr_packet_initiate_box *p_box = (struct curvecpr_packet_initiate_box *)raw_p_box;
+    struct curvecpr_packet_initiate_box *p_box = (struct curvecpr_packet_initiate_box *)(box - 32);
 
     /* Build out the box. */
-    curvecpr_bytes_zero(p_box->_, 32);
-    curvecpr_bytes_copy(p_box->client_global_pk, cf->my_global_pk, 32);
+    curvecpr_bytes_copy(p_box->client_global_pk, profile->my_global_pk, 32);
     curvecpr_bytes_copy(p_box->nonce, client->negotiated_vouch, 16);
     curvecpr_bytes_copy(p_box->vouch, client->negotiated_vouch + 16, 48);
-    curvecpr_bytes_copy(p_box->server_domain_name, cf->their_domain_name, 256);
+    curvecpr_bytes_copy(p_box->server_domain_name, profile->their_domain_name, 256);
 
-    /* Copy in the message. */
-    curvecpr_bytes_copy(raw_p_box + sizeof(struct curvecpr_packet_initiate_box), buf, num);
-
-    /* Encrypt the message. */
+    /* Encrypt the box and the message. */
     curvecpr_bytes_copy(nonce, "CurveCP-client-I", 16);
     curvecpr_session_next_nonce(s, nonce + 16);
 
-    crypto_box_afternm(raw_p_box, raw_p_box, sizeof(struct curvecpr_packet_initiate_box) + num, nonce, s->my_session_their_session_key);
+    crypto_box_detached_afternm(box, box - 16, box, (sizeof(struct curvecpr_packet_initiate_box) - 32) + num, nonce, s->my_session_their_session_key);
 
     /* Build out the packet. */
     curvecpr_bytes_copy(p->id, "QvnQ5XlI", 8);
     curvecpr_bytes_copy(p->server_extension, s->their_extension, 16);
-    curvecpr_bytes_copy(p->client_extension, cf->my_extension, 16);
+    curvecpr_bytes_copy(p->client_extension, client->my_extension, 16);
     curvecpr_bytes_copy(p->client_session_pk, s->my_session_pk, 32);
     curvecpr_bytes_copy(p->cookie, client->negotiated_cookie, 96);
     curvecpr_bytes_copy(p->nonce, nonce + 16, 8);
 
-    /* Copy in the box. */
-    curvecpr_bytes_copy(raw_p + sizeof(struct curvecpr_packet_initiate), raw_p_box + 16, sizeof(struct curvecpr_packet_initiate_box) - 16 + num);
-
     /* Send it out! */
-    if (cf->ops.send(client, raw_p, sizeof(struct curvecpr_packet_initiate) + (sizeof(struct curvecpr_packet_initiate_box) - 16) + num))
+    if (_send(client, raw_p, CURVECPR_CLIENT_HEADROOM + num))
         return -EINVAL;
 
     return 0;
 }
 
-static int _do_client_message (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+static int _do_client_message (struct curvecpr_client *client, unsigned char *buf, size_t num)
 {
-    const struct curvecpr_client_cf *cf = &client->cf;
     struct curvecpr_session *s = &client->session;
 
     unsigned char nonce[24];
-    unsigned char p_raw[sizeof(struct curvecpr_packet_client_message) + 1104];
-    unsigned char data[1120];
+    unsigned char *p_raw = buf - _MESSAGE_HEADROOM;
 
-    struct curvecpr_packet_client_message *p;
-
-    if (num < 16 || num > 1088 || num & 15)
-        return -EMSGSIZE;
+    struct curvecpr_packet_client_message *p = (struct curvecpr_packet_client_message *)p_raw;
 
     /* Build the box. */
     curvecpr_bytes_copy(nonce, "CurveCP-client-M", 16);
     curvecpr_session_next_nonce(s, nonce + 16);
 
-    curvecpr_bytes_zero(data, 32);
-    curvecpr_bytes_copy(data + 32, buf, num);
-
-    crypto_box_afternm(data, data, num + 32, nonce, s->my_session_their_session_key);
+    crypto_box_detached_afternm(buf, buf - 16, buf, num, nonce, s->my_session_their_session_key);
 
     /* Build the rest of the packet. */
-    p = (struct curvecpr_packet_client_message *)p_raw;
-
     curvecpr_bytes_copy(p->id, "QvnQ5XlM", 8);
     curvecpr_bytes_copy(p->server_extension, s->their_extension, 16);
-    curvecpr_bytes_copy(p->client_extension, cf->my_extension, 16);
+    curvecpr_bytes_copy(p->client_extension, client->my_extension, 16);
     curvecpr_bytes_copy(p->client_session_pk, s->my_session_pk, 32);
     curvecpr_bytes_copy(p->nonce, nonce + 16, 8);
 
-    curvecpr_bytes_copy(p_raw + sizeof(struct curvecpr_packet_client_message), data + 16, num + 16);
-
     /* Fire away! */
-    if (cf->ops.send(client, p_raw, sizeof(struct curvecpr_packet_client_message) + 16 + num))
+    if (_send(client, p_raw, _MESSAGE_HEADROOM + num))
         return -EINVAL;
 
     return 0;
 }
 
 int curvecpr_client_send (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    unsigned char p_local[CURVECPR_SENDV_PACKET];
+
+    /* When batching, build the packet right where it'll be sent from. */
+    unsigned char *p_raw = client->sendv ? curvecpr_sendv_next(client->sendv) : p_local;
+    size_t headroom = client->negotiated == CURVECPR_CLIENT_INITIATING ? CURVECPR_CLIENT_HEADROOM : _MESSAGE_HEADROOM;
+
+    if (num > CURVECPR_SENDV_PACKET - headroom)
+        return -EMSGSIZE;
+
+    curvecpr_bytes_copy(p_raw + headroom, buf, num);
+
+    return curvecpr_client_send_inplace(client, p_raw + headroom, num);
+}
+
+int curvecpr_client_send_inplace (struct curvecpr_client *client, unsigned char *buf, size_t num)
 {
     if (client->negotiated == CURVECPR_CLIENT_NEGOTIATED) {
         if (num < 16 || num > 1088 || num & 15)
@@ -0,0 +1,291 @@
+#include "config.h"
+
+#include <curvecpr/clients.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/client.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sodium/crypto_uint32.h>
+#include <sodium/randombytes.h>
+
+#define _NONE 0xffffffffU
+
+static struct curvecpr_clients_client *_entry (struct curvecpr_client *client)
+{
+    return (struct curvecpr_clients_client *)client;
+}
+
+static crypto_uint32 _index (struct curvecpr_client *client)
+{
+    struct curvecpr_clients *clients = client->priv;
+
+    return (crypto_uint32)(_entry(client) - clients->clients);
+}
+
+static int _send (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    struct curvecpr_clients *clients = client->priv;
+
+    ++clients->stats.packets_sent;
+    clients->stats.bytes_sent += num;
+
+    return clients->cf.ops.send(clients, _index(client), buf, num);
+}
+
+static int _recv (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    struct curvecpr_clients *clients = client->priv;
+
+    if (clients->cf.ops.recv)
+        return clients->cf.ops.recv(clients, _index(client), buf, num);
+
+    return 0;
+}
+
+static int _next_nonce (struct curvecpr_client *client, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+
+    return 0;
+}
+
+static void _waiting_unlink (struct curvecpr_clients *clients, crypto_uint32 index)
+{
+    struct curvecpr_clients_client *c = &clients->clients[index];
+
+    if (c->prev != _NONE)
+        clients->clients[c->prev].next = c->next;
+    else
+        clients->waiting_head = c->next;
+
+    if (c->next != _NONE)
+        clients->clients[c->next].prev = c->prev;
+    else
+        clients->waiting_tail = c->prev;
+
+    c->prev = c->next = _NONE;
+}
+
+static void _waiting_append (struct curvecpr_clients *clients, crypto_uint32 index)
+{
+    struct curvecpr_clients_client *c = &clients->clients[index];
+
+    c->prev = clients->waiting_tail;
+    c->next = _NONE;
+
+    if (clients->waiting_tail != _NONE)
+        clients->clients[clients->waiting_tail].next = index;
+    else
+        clients->waiting_head = index;
+
+    clients->waiting_tail = index;
+}
+
+/* Sets a client up from scratch, with an extension naming it. */
+static void _reset (struct curvecpr_clients *clients, crypto_uint32 index)
+{
+    struct curvecpr_clients_client *c = &clients->clients[index];
+    struct curvecpr_client_cf cf;
+
+    curvecpr_bytes_zero(&cf, sizeof(struct curvecpr_client_cf));
+    cf.ops.send = _send;
+    cf.ops.recv = _recv;
+    cf.ops.next_nonce = _next_nonce;
+    cf.profile = clients->cf.profile;
+    cf.priv = clients;
+
+    if (c->client.profile)
+        curvecpr_client_destroy(&c->client);
+
+    curvecpr_client_new(&c->client, &cf);
+
+    curvecpr_bytes_pack_uint32(c->client.my_extension, index);
+    curvecpr_bytes_copy(c->client.my_extension + 4, clients->extension_tag, 12);
+}
+
+static void _hello (struct curvecpr_clients *clients, crypto_uint32 index, long long now)
+{
+    struct curvecpr_clients_client *c = &clients->clients[index];
+
+    ++c->attempts;
+    c->hello_sent = now;
+    _waiting_append(clients, index);
+
+    ++clients->stats.hellos;
+
+    curvecpr_client_connected(&c->client);
+}
+
+int curvecpr_clients_new (struct curvecpr_clients *clients, const struct curvecpr_clients_cf *cf)
+{
+    crypto_uint32 i;
+
+    curvecpr_bytes_zero(clients, sizeof(struct curvecpr_clients));
+
+    if (cf)
+        curvecpr_bytes_copy(&clients->cf, cf, sizeof(struct curvecpr_clients_cf));
+
+    if (!clients->cf.clients || clients->cf.clients >= _NONE || !clients->cf.profile || !clients->cf.ops.send || clients->cf.hello_interval <= 0 || !clients->cf.hello_attempts)
+        return -EINVAL;
+
+    clients->clients = calloc(clients->cf.clients, sizeof(struct curvecpr_clients_client));
+    if (!clients->clients)
+        return -ENOMEM;
+
+    randombytes(clients->extension_tag, sizeof(clients->extension_tag));
+
+    clients->waiting_head = _NONE;
+    clients->waiting_tail = _NONE;
+
+    for (i = 0; i < clients->cf.clients; ++i) {
+        clients->clients[i].state = CURVECPR_CLIENTS_IDLE;
+        clients->clients[i].prev = _NONE;
+        clients->clients[i].next = _NONE;
+
+        _reset(clients, i);
+    }
+
+    return 0;
+}
+
+void curvecpr_clients_destroy (struct curvecpr_clients *clients)
+{
+    crypto_uint32 i;
+
+    if (clients->clients) {
+        for (i = 0; i < clients->cf.clients; ++i)
+            curvecpr_client_destroy(&clients->clients[i].client);
+    }
+
+    free(clients->clients);
+
+    curvecpr_bytes_zero(clients, sizeof(struct curvecpr_clients));
+}
+
+/* Starts (or restarts) a client's handshake by sending a hello. Returns -EALREADY if
+   it's still waiting for a cookie. */
+int curvecpr_clients_connect (struct curvecpr_clients *clients, crypto_uint32 index, long long now)
+{
+    struct curvecpr_clients_client *c;
+
+    if (index >= clients->cf.clients)
+        return -EINVAL;
+
+    c = &clients->clients[index];
+
+    if (c->state == CURVECPR_CLIENTS_HELLO)
+        return -EALREADY;
+    else if (c->state == CURVECPR_CLIENTS_CONNECTED)
+        --clients->stats.connected;
+    else if (c->state == CURVECPR_CLIENTS_FAILED)
+        --clients->stats.failed;
+
+    if (c->state != CURVECPR_CLIENTS_IDLE)
+        _reset(clients, index);
+
+    c->state = CURVECPR_CLIENTS_HELLO;
+    c->attempts = 0;
+    c->connecting_since = now;
+    ++clients->stats.connecting;
+
+    _hello(clients, index, now);
+
+    return 0;
+}
+
+/* Sends data from a connected client. */
+int curvecpr_clients_send (struct curvecpr_clients *clients, crypto_uint32 index, const unsigned char *buf, size_t num)
+{
+    if (index >= clients->cf.clients)
+        return -EINVAL;
+
+    if (clients->clients[index].state != CURVECPR_CLIENTS_CONNECTED)
+        return -ENOTCONN;
+
+    return curvecpr_client_send(&clients->clients[index].client, buf, num);
+}
+
+/* Hands a packet from any of the pool's sockets to the client it's meant for. */
+int curvecpr_clients_recv (struct curvecpr_clients *clients, const unsigned char *buf, size_t num, long long now)
+{
+    struct curvecpr_clients_client *c;
+    crypto_uint32 index;
+    int result;
+
+    /* Cookies and server messages both carry our extension in the same place. */
+    if (num < 24)
+        goto drop;
+
+    index = curvecpr_bytes_unpack_uint32(buf + 8);
+    if (index >= clients->cf.clients || !curvecpr_bytes_equal(buf + 12, clients->extension_tag, 12))
+        goto drop;
+
+    c = &clients->clients[index];
+    if (c->state != CURVECPR_CLIENTS_HELLO && c->state != CURVECPR_CLIENTS_CONNECTED)
+        goto drop;
+
+    result = curvecpr_client_recv(&c->client, buf, num);
+    if (result)
+        goto drop;
+
+    ++clients->stats.packets_received;
+    clients->stats.bytes_received += num;
+
+    if (c->state == CURVECPR_CLIENTS_HELLO && c->client.negotiated != CURVECPR_CLIENT_PENDING) {
+        _waiting_unlink(clients, index);
+
+        c->state = CURVECPR_CLIENTS_CONNECTED;
+        --clients->stats.connecting;
+        ++clients->stats.connected;
+        clients->stats.connect_time += now - c->connecting_since;
+
+        if (clients->cf.ops.connected)
+            clients->cf.ops.connected(clients, index);
+    }
+
+    return 0;
+
+drop:
+    ++clients->stats.packets_dropped;
+    return -EINVAL;
+}
+
+/* Resends hellos that have gone unanswered for hello_interval, and gives up on
+   clients that are out of attempts. */
+void curvecpr_clients_process (struct curvecpr_clients *clients, long long now)
+{
+    while (clients->waiting_head != _NONE) {
+        crypto_uint32 index = clients->waiting_head;
+        struct curvecpr_clients_client *c = &clients->clients[index];
+
+        if (c->hello_sent + clients->cf.hello_interval > now)
+            break;
+
+        _waiting_unlink(clients, index);
+
+        if (c->attempts >= clients->cf.hello_attempts) {
+            c->state = CURVECPR_CLIENTS_FAILED;
+            --clients->stats.connecting;
+            ++clients->stats.failed;
+
+            if (clients->cf.ops.failed)
+                clients->cf.ops.failed(clients, index);
+        } else {
+            ++clients->stats.hello_retries;
+            _hello(clients, index, now);
+        }
+    }
+}
+
+/* When curvecpr_clients_process() next has something to do, or -1 if never. */
+long long curvecpr_clients_next_timeout (const struct curvecpr_clients *clients)
+{
+    if (clients->waiting_head == _NONE)
+        return -1;
+
+    return clients->clients[clients->waiting_head].hello_sent + clients->cf.hello_interval;
+}
@@ -0,0 +1,66 @@
+#include "config.h"
+
+#include <curvecpr/clock.h>
+
+#include <curvecpr/bytes.h>
+
+#include <time.h>
+#ifdef HAVE_HOST_GET_CLOCK_SERVICE
+#include <mach/mach_time.h>
+#endif
+
+static long long _monotonic (int coarse)
+{
+#ifdef HAVE_HOST_GET_CLOCK_SERVICE
+    static mach_timebase_info_data_t timebase;
+
+    if (!timebase.denom)
+        mach_timebase_info(&timebase);
+
+    return (long long)(mach_absolute_time() * timebase.numer / timebase.denom);
+#else
+    struct timespec t;
+    clockid_t id = CLOCK_MONOTONIC;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+    if (coarse)
+        id = CLOCK_MONOTONIC_COARSE;
+#endif
+
+    if (clock_gettime(id, &t) != 0)
+        return -1;
+
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+#endif
+}
+
+void curvecpr_clock_new (struct curvecpr_clock *clock, enum curvecpr_clock_source source)
+{
+    curvecpr_bytes_zero(clock, sizeof(struct curvecpr_clock));
+
+    clock->source = source;
+}
+
+/* Returns the time in nanoseconds from some fixed point. A NULL clock is
+   CURVECPR_CLOCK_MONOTONIC. */
+long long curvecpr_clock_now (const struct curvecpr_clock *clock)
+{
+    if (!clock)
+        return _monotonic(0);
+
+    switch (clock->source) {
+        case CURVECPR_CLOCK_MONOTONIC:
+            return _monotonic(0);
+        case CURVECPR_CLOCK_MONOTONIC_COARSE:
+            return _monotonic(1);
+        case CURVECPR_CLOCK_INJECTED:
+            return clock->now;
+    }
+
+    return _monotonic(0);
+}
+
+void curvecpr_clock_set (struct curvecpr_clock *clock, long long now)
+{
+    clock->now = now;
+}
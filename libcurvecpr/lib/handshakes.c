@@ -0,0 +1,125 @@
+#include "config.h"
+
+#include <curvecpr/handshakes.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/server.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomic.h"
+
+int curvecpr_handshakes_new (struct curvecpr_handshakes *handshakes, const struct curvecpr_handshakes_cf *cf)
+{
+    curvecpr_bytes_zero(handshakes, sizeof(struct curvecpr_handshakes));
+
+    if (cf)
+        curvecpr_bytes_copy(&handshakes->cf, cf, sizeof(struct curvecpr_handshakes_cf));
+
+    if (!handshakes->cf.jobs || handshakes->cf.priv_bytes > CURVECPR_HANDSHAKES_PRIV)
+        return -EINVAL;
+
+    /* Every job starts out free. */
+    handshakes->jobs = calloc(handshakes->cf.jobs, sizeof(struct curvecpr_handshakes_job));
+    if (!handshakes->jobs)
+        return -ENOMEM;
+
+    return 0;
+}
+
+void curvecpr_handshakes_destroy (struct curvecpr_handshakes *handshakes)
+{
+    if (handshakes->jobs)
+        curvecpr_bytes_zero(handshakes->jobs, handshakes->cf.jobs * sizeof(struct curvecpr_handshakes_job));
+
+    free(handshakes->jobs);
+
+    curvecpr_bytes_zero(handshakes, sizeof(struct curvecpr_handshakes));
+}
+
+void curvecpr_handshakes_configure (struct curvecpr_handshakes *handshakes, struct curvecpr_server_cf *cf)
+{
+    cf->handshakes = handshakes;
+}
+
+/* Looks for a job in state from, starting at *next, and returns it (moved to state
+   to, if from and to differ) or NULL. */
+static struct curvecpr_handshakes_job *_find (struct curvecpr_handshakes *handshakes, size_t *next, int from, int to)
+{
+    size_t start = _LOAD_RELAXED(next);
+    size_t i;
+
+    for (i = 0; i < handshakes->cf.jobs; ++i) {
+        size_t index = (start + i) % handshakes->cf.jobs;
+        struct curvecpr_handshakes_job *job = &handshakes->jobs[index];
+        int state = _LOAD_ACQUIRE(&job->state);
+
+        if (state != from)
+            continue;
+
+        /* Several workers may race for the same job. */
+        if (from != to && !_COMPARE_EXCHANGE_ACQUIRE(&job->state, &state, to))
+            continue;
+
+        _STORE_RELAXED(next, (index + 1) % handshakes->cf.jobs);
+        return job;
+    }
+
+    return NULL;
+}
+
+/* Receive thread: returns a free job to fill in, or NULL if they're all busy. */
+struct curvecpr_handshakes_job *curvecpr_handshakes_reserve (struct curvecpr_handshakes *handshakes)
+{
+    struct curvecpr_handshakes_job *job = _find(handshakes, &handshakes->next_free, CURVECPR_HANDSHAKES_FREE, CURVECPR_HANDSHAKES_FREE);
+
+    if (job)
+        ++handshakes->queued;
+    else
+        ++handshakes->refused;
+
+    return job;
+}
+
+/* Receive thread: hands a reserved job to the workers. */
+void curvecpr_handshakes_submit (struct curvecpr_handshakes *handshakes, struct curvecpr_handshakes_job *job)
+{
+    _STORE_RELEASE(&job->state, CURVECPR_HANDSHAKES_QUEUED);
+
+    if (handshakes->cf.ops.queued)
+        handshakes->cf.ops.queued(handshakes);
+}
+
+/* Worker: takes a queued job, or returns NULL if there aren't any. */
+struct curvecpr_handshakes_job *curvecpr_handshakes_claim (struct curvecpr_handshakes *handshakes)
+{
+    return _find(handshakes, &handshakes->next_queued, CURVECPR_HANDSHAKES_QUEUED, CURVECPR_HANDSHAKES_WORKING);
+}
+
+/* Worker: hands a claimed job back to the receive thread. */
+void curvecpr_handshakes_finish (struct curvecpr_handshakes *handshakes, struct curvecpr_handshakes_job *job)
+{
+    _STORE_RELEASE(&job->state, CURVECPR_HANDSHAKES_DONE);
+
+    if (handshakes->cf.ops.done)
+        handshakes->cf.ops.done(handshakes);
+}
+
+/* Receive thread: returns a finished job, or NULL if there aren't any. */
+struct curvecpr_handshakes_job *curvecpr_handshakes_collect (struct curvecpr_handshakes *handshakes)
+{
+    return _find(handshakes, &handshakes->next_done, CURVECPR_HANDSHAKES_DONE, CURVECPR_HANDSHAKES_DONE);
+}
+
+/* Receive thread: wipes a collected job and makes it free again. */
+void curvecpr_handshakes_release (struct curvecpr_handshakes *handshakes, struct curvecpr_handshakes_job *job)
+{
+    curvecpr_bytes_zero(&job->session, sizeof(struct curvecpr_session));
+    curvecpr_bytes_zero(job->data, sizeof(job->data));
+    curvecpr_bytes_zero(job->priv_copy, sizeof(job->priv_copy));
+    job->priv = NULL;
+
+    _STORE_RELEASE(&job->state, CURVECPR_HANDSHAKES_FREE);
+}
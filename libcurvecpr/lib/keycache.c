@@ -0,0 +1,260 @@
+#include "config.h"
+
+#include <curvecpr/keycache.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/server.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sodium/crypto_box.h>
+#include <sodium/crypto_shorthash.h>
+#include <sodium/crypto_uint32.h>
+#include <sodium/crypto_uint64.h>
+#include <sodium/randombytes.h>
+
+#include "atomic.h"
+
+#define _NONE 0xffffffffU
+
+static void _lock (struct curvecpr_keycache_shard *shard)
+{
+    _LOCK(&shard->lock);
+}
+
+static void _unlock (struct curvecpr_keycache_shard *shard)
+{
+    _UNLOCK(&shard->lock);
+}
+
+static void _lru_unlink (struct curvecpr_keycache_shard *shard, crypto_uint32 i)
+{
+    struct curvecpr_keycache_entry *e = &shard->entries[i];
+
+    if (e->prev != _NONE)
+        shard->entries[e->prev].next = e->next;
+    else
+        shard->lru_head = e->next;
+
+    if (e->next != _NONE)
+        shard->entries[e->next].prev = e->prev;
+    else
+        shard->lru_tail = e->prev;
+}
+
+static void _lru_push (struct curvecpr_keycache_shard *shard, crypto_uint32 i)
+{
+    struct curvecpr_keycache_entry *e = &shard->entries[i];
+
+    e->prev = _NONE;
+    e->next = shard->lru_head;
+
+    if (shard->lru_head != _NONE)
+        shard->entries[shard->lru_head].prev = i;
+    else
+        shard->lru_tail = i;
+
+    shard->lru_head = i;
+}
+
+/* Returns the link pointing at the entry for their_global_pk, or at _NONE at the
+   end of its bucket if there isn't one. */
+static crypto_uint32 *_find (struct curvecpr_keycache_shard *shard, crypto_uint64 hash, const unsigned char *their_global_pk)
+{
+    crypto_uint32 *link = &shard->buckets[hash & shard->bucket_mask];
+
+    while (*link != _NONE && !curvecpr_bytes_equal(shard->entries[*link].their_global_pk, their_global_pk, 32))
+        link = &shard->entries[*link].chain;
+
+    return link;
+}
+
+static void _evict (struct curvecpr_keycache *keycache, struct curvecpr_keycache_shard *shard)
+{
+    crypto_uint32 i = shard->lru_tail;
+    struct curvecpr_keycache_entry *e = &shard->entries[i];
+    unsigned char digest[8];
+
+    crypto_shorthash(digest, e->their_global_pk, 32, keycache->hash_key);
+    *_find(shard, curvecpr_bytes_unpack_uint64(digest), e->their_global_pk) = e->chain;
+
+    _lru_unlink(shard, i);
+
+    curvecpr_bytes_zero(e, sizeof(struct curvecpr_keycache_entry));
+    e->next = shard->free_head;
+    shard->free_head = i;
+
+    ++shard->evictions;
+}
+
+int curvecpr_keycache_new (struct curvecpr_keycache *keycache, const struct curvecpr_keycache_cf *cf)
+{
+    crypto_uint32 shards = 1;
+    crypto_uint32 i, j;
+
+    curvecpr_bytes_zero(keycache, sizeof(struct curvecpr_keycache));
+
+    if (cf)
+        curvecpr_bytes_copy(&keycache->cf, cf, sizeof(struct curvecpr_keycache_cf));
+
+    if (!keycache->cf.shards || keycache->cf.shards > 0x10000U)
+        return -EINVAL;
+
+    while (shards < keycache->cf.shards)
+        shards *= 2;
+
+    if (keycache->cf.capacity < shards || keycache->cf.capacity >= _NONE)
+        return -EINVAL;
+
+    keycache->shards = calloc(shards, sizeof(struct curvecpr_keycache_shard));
+    if (!keycache->shards)
+        return -ENOMEM;
+
+    keycache->shard_mask = shards - 1;
+
+    for (i = 0; i < shards; ++i) {
+        struct curvecpr_keycache_shard *shard = &keycache->shards[i];
+        crypto_uint32 buckets = 1;
+
+        shard->capacity = keycache->cf.capacity / shards + (i < keycache->cf.capacity % shards);
+
+        while (buckets < shard->capacity)
+            buckets *= 2;
+
+        shard->entries = calloc(shard->capacity, sizeof(struct curvecpr_keycache_entry));
+        shard->buckets = malloc(buckets * sizeof(crypto_uint32));
+
+        if (!shard->entries || !shard->buckets) {
+            curvecpr_keycache_destroy(keycache);
+            return -ENOMEM;
+        }
+
+        shard->bucket_mask = buckets - 1;
+        for (j = 0; j < buckets; ++j)
+            shard->buckets[j] = _NONE;
+
+        for (j = 0; j < shard->capacity; ++j)
+            shard->entries[j].next = j + 1 < shard->capacity ? j + 1 : _NONE;
+
+        shard->free_head = 0;
+        shard->lru_head = _NONE;
+        shard->lru_tail = _NONE;
+    }
+
+    randombytes(keycache->hash_key, sizeof(keycache->hash_key));
+
+    return 0;
+}
+
+void curvecpr_keycache_destroy (struct curvecpr_keycache *keycache)
+{
+    crypto_uint32 i;
+
+    if (keycache->shards) {
+        for (i = 0; i <= keycache->shard_mask; ++i) {
+            struct curvecpr_keycache_shard *shard = &keycache->shards[i];
+
+            if (shard->entries)
+                curvecpr_bytes_zero(shard->entries, shard->capacity * sizeof(struct curvecpr_keycache_entry));
+
+            free(shard->entries);
+            free(shard->buckets);
+        }
+    }
+
+    free(keycache->shards);
+
+    curvecpr_bytes_zero(keycache, sizeof(struct curvecpr_keycache));
+}
+
+void curvecpr_keycache_configure (struct curvecpr_keycache *keycache, struct curvecpr_server_cf *cf)
+{
+    cf->keycache = keycache;
+}
+
+/* Like crypto_box_beforenm(), but remembers the result. Safe to call from any
+   number of threads. */
+void curvecpr_keycache_beforenm (struct curvecpr_keycache *keycache, unsigned char key[32], const unsigned char their_global_pk[32], const unsigned char my_global_sk[32])
+{
+    unsigned char digest[8];
+    crypto_uint64 hash;
+    struct curvecpr_keycache_shard *shard;
+    crypto_uint32 *link;
+
+    crypto_shorthash(digest, their_global_pk, 32, keycache->hash_key);
+    hash = curvecpr_bytes_unpack_uint64(digest);
+    shard = &keycache->shards[(hash >> 32) & keycache->shard_mask];
+
+    _lock(shard);
+
+    link = _find(shard, hash, their_global_pk);
+    if (*link != _NONE) {
+        crypto_uint32 i = *link;
+
+        curvecpr_bytes_copy(key, shard->entries[i].key, 32);
+
+        _lru_unlink(shard, i);
+        _lru_push(shard, i);
+
+        ++shard->hits;
+
+        _unlock(shard);
+        return;
+    }
+
+    ++shard->misses;
+
+    _unlock(shard);
+
+    /* Don't hold the lock over the expensive part. */
+    crypto_box_beforenm(key, their_global_pk, my_global_sk);
+
+    _lock(shard);
+
+    /* Someone else may have added it meanwhile. */
+    link = _find(shard, hash, their_global_pk);
+    if (*link == _NONE) {
+        struct curvecpr_keycache_entry *e;
+        crypto_uint32 i;
+
+        if (shard->free_head == _NONE)
+            _evict(keycache, shard);
+
+        i = shard->free_head;
+        e = &shard->entries[i];
+        shard->free_head = e->next;
+
+        curvecpr_bytes_copy(e->their_global_pk, their_global_pk, 32);
+        curvecpr_bytes_copy(e->key, key, 32);
+
+        /* Eviction may have changed the bucket, so look for the end again. */
+        e->chain = _NONE;
+        *_find(shard, hash, their_global_pk) = i;
+
+        _lru_push(shard, i);
+    }
+
+    _unlock(shard);
+}
+
+/* Adds up the statistics of every shard. */
+void curvecpr_keycache_stats (struct curvecpr_keycache *keycache, struct curvecpr_keycache_stats *stats)
+{
+    crypto_uint32 i;
+
+    curvecpr_bytes_zero(stats, sizeof(struct curvecpr_keycache_stats));
+
+    for (i = 0; i <= keycache->shard_mask; ++i) {
+        struct curvecpr_keycache_shard *shard = &keycache->shards[i];
+
+        _lock(shard);
+
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+
+        _unlock(shard);
+    }
+}
@@ -0,0 +1,109 @@
+#include "config.h"
+
+#include <curvecpr/keypairs.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/server.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sodium/crypto_box.h>
+
+#include "atomic.h"
+
+int curvecpr_keypairs_new (struct curvecpr_keypairs *keypairs, const struct curvecpr_keypairs_cf *cf)
+{
+    size_t capacity = 1;
+
+    curvecpr_bytes_zero(keypairs, sizeof(struct curvecpr_keypairs));
+
+    if (cf)
+        curvecpr_bytes_copy(&keypairs->cf, cf, sizeof(struct curvecpr_keypairs_cf));
+
+    if (!keypairs->cf.capacity || keypairs->cf.low_water >= keypairs->cf.capacity)
+        return -EINVAL;
+
+    while (capacity < keypairs->cf.capacity)
+        capacity *= 2;
+
+    keypairs->keypairs = calloc(capacity, sizeof(struct curvecpr_keypairs_keypair));
+    if (!keypairs->keypairs)
+        return -ENOMEM;
+
+    keypairs->mask = capacity - 1;
+
+    return 0;
+}
+
+void curvecpr_keypairs_destroy (struct curvecpr_keypairs *keypairs)
+{
+    if (keypairs->keypairs)
+        curvecpr_bytes_zero(keypairs->keypairs, (keypairs->mask + 1) * sizeof(struct curvecpr_keypairs_keypair));
+
+    free(keypairs->keypairs);
+
+    curvecpr_bytes_zero(keypairs, sizeof(struct curvecpr_keypairs));
+}
+
+void curvecpr_keypairs_configure (struct curvecpr_keypairs *keypairs, struct curvecpr_server_cf *cf)
+{
+    cf->keypairs = keypairs;
+}
+
+/* Call from the filling thread only. Generates up to max keypairs, stopping when
+   the pool is full, and returns how many were added. */
+size_t curvecpr_keypairs_fill (struct curvecpr_keypairs *keypairs, size_t max)
+{
+    size_t head = _LOAD_RELAXED(&keypairs->head);
+    size_t added = 0;
+
+    while (added < max && head - _LOAD_ACQUIRE(&keypairs->tail) <= keypairs->mask) {
+        struct curvecpr_keypairs_keypair *keypair = &keypairs->keypairs[head & keypairs->mask];
+
+        crypto_box_keypair(keypair->pk, keypair->sk);
+
+        _STORE_RELEASE(&keypairs->head, ++head);
+        ++added;
+    }
+
+    return added;
+}
+
+/* Number of keypairs ready. Only a snapshot if the other thread is busy. */
+size_t curvecpr_keypairs_len (const struct curvecpr_keypairs *keypairs)
+{
+    return _LOAD_ACQUIRE(&keypairs->head) - _LOAD_ACQUIRE(&keypairs->tail);
+}
+
+/* Call from the server's thread only. Returns -EAGAIN if the pool is empty. */
+int curvecpr_keypairs_take (struct curvecpr_keypairs *keypairs, unsigned char pk[32], unsigned char sk[32])
+{
+    size_t tail = _LOAD_RELAXED(&keypairs->tail);
+    size_t remaining = _LOAD_ACQUIRE(&keypairs->head) - tail;
+    int result = -EAGAIN;
+
+    if (remaining) {
+        struct curvecpr_keypairs_keypair *keypair = &keypairs->keypairs[tail & keypairs->mask];
+
+        curvecpr_bytes_copy(pk, keypair->pk, 32);
+        curvecpr_bytes_copy(sk, keypair->sk, 32);
+
+        /* Don't leave the secret key behind. */
+        curvecpr_bytes_zero(keypair, sizeof(struct curvecpr_keypairs_keypair));
+
+        _STORE_RELEASE(&keypairs->tail, tail + 1);
+
+        ++keypairs->taken;
+        --remaining;
+        result = 0;
+    } else {
+        ++keypairs->missed;
+    }
+
+    if (remaining <= keypairs->cf.low_water && keypairs->cf.ops.low)
+        keypairs->cf.ops.low(keypairs);
+
+    return result;
+}
@@ -0,0 +1,131 @@
+#include "config.h"
+
+#include <curvecpr/message.h>
+
+#include <curvecpr/bytes.h>
+
+#include <string.h>
+
+#include <sodium/crypto_uint16.h>
+#include <sodium/crypto_uint32.h>
+#include <sodium/crypto_uint64.h>
+
+/* Wire layout:
+
+    0  id                           4
+    4  acknowledging id             4
+    8  range 1 size                 8
+   16  gap between ranges 1 and 2   4
+   20  range 2 size                 2
+   22  gap, size for ranges 3-6     2 each
+   38  flags                        2
+   40  offset                       8 */
+
+/* Fixed-size memcpy() compiles to a single unaligned load or store, so on
+   little-endian machines the fields can be moved directly. */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define _MESSAGE_NATIVE_LE 1
+#endif
+
+static crypto_uint16 _load16 (const unsigned char *source)
+{
+#ifdef _MESSAGE_NATIVE_LE
+    crypto_uint16 value;
+    memcpy(&value, source, 2);
+    return value;
+#else
+    return curvecpr_bytes_unpack_uint16(source);
+#endif
+}
+
+static crypto_uint32 _load32 (const unsigned char *source)
+{
+#ifdef _MESSAGE_NATIVE_LE
+    crypto_uint32 value;
+    memcpy(&value, source, 4);
+    return value;
+#else
+    return curvecpr_bytes_unpack_uint32(source);
+#endif
+}
+
+static crypto_uint64 _load64 (const unsigned char *source)
+{
+#ifdef _MESSAGE_NATIVE_LE
+    crypto_uint64 value;
+    memcpy(&value, source, 8);
+    return value;
+#else
+    return curvecpr_bytes_unpack_uint64(source);
+#endif
+}
+
+static void _store16 (unsigned char *destination, crypto_uint16 value)
+{
+#ifdef _MESSAGE_NATIVE_LE
+    memcpy(destination, &value, 2);
+#else
+    curvecpr_bytes_pack_uint16(destination, value);
+#endif
+}
+
+static void _store32 (unsigned char *destination, crypto_uint32 value)
+{
+#ifdef _MESSAGE_NATIVE_LE
+    memcpy(destination, &value, 4);
+#else
+    curvecpr_bytes_pack_uint32(destination, value);
+#endif
+}
+
+static void _store64 (unsigned char *destination, crypto_uint64 value)
+{
+#ifdef _MESSAGE_NATIVE_LE
+    memcpy(destination, &value, 8);
+#else
+    curvecpr_bytes_pack_uint64(destination, value);
+#endif
+}
+
+void curvecpr_message_pack (unsigned char *destination, const struct curvecpr_message *message)
+{
+    const struct curvecpr_message_range *ranges = message->acknowledging_ranges;
+    int i;
+
+    _store32(destination, message->id);
+    _store32(destination + 4, message->acknowledging_id);
+
+    _store64(destination + 8, ranges[0].end);
+    _store32(destination + 16, (crypto_uint32)(ranges[1].start - ranges[0].end));
+    _store16(destination + 20, (crypto_uint16)(ranges[1].end - ranges[1].start));
+
+    for (i = 2; i < 6; ++i) {
+        _store16(destination + 14 + 4 * i, (crypto_uint16)(ranges[i].start - ranges[i - 1].end));
+        _store16(destination + 16 + 4 * i, (crypto_uint16)(ranges[i].end - ranges[i].start));
+    }
+
+    _store16(destination + 38, message->flags);
+    _store64(destination + 40, message->offset);
+}
+
+void curvecpr_message_unpack (struct curvecpr_message *message, const unsigned char *source)
+{
+    struct curvecpr_message_range *ranges = message->acknowledging_ranges;
+    int i;
+
+    message->id = _load32(source);
+    message->acknowledging_id = _load32(source + 4);
+
+    ranges[0].start = 0;
+    ranges[0].end = _load64(source + 8);
+    ranges[1].start = ranges[0].end + _load32(source + 16);
+    ranges[1].end = ranges[1].start + _load16(source + 20);
+
+    for (i = 2; i < 6; ++i) {
+        ranges[i].start = ranges[i - 1].end + _load16(source + 14 + 4 * i);
+        ranges[i].end = ranges[i].start + _load16(source + 16 + 4 * i);
+    }
+
+    message->flags = _load16(source + 38);
+    message->offset = _load64(source + 40);
+}
@@ -5,6 +5,8 @@
 #include <curvecpr/block.h>
 #include <curvecpr/bytes.h>
 #include <curvecpr/chicago.h>
+#include <curvecpr/message.h>
+#include <curvecpr/sendv.h>
 #include <curvecpr/trace.h>
 
 #include <errno.h>
@@ -20,25 +22,8 @@
 
 #define _STOP (_STOP_SUCCESS + _STOP_FAILURE)
 
-/* This is the wire format for a message. It's only used internally here. */
-struct _message {
-    unsigned char id[4];
-    unsigned char acknowledging_id[4];
-    unsigned char acknowledging_range_1_size[8];
-    unsigned char acknowledging_range_12_gap[4];
-    unsigned char acknowledging_range_2_size[2];
-    unsigned char acknowledging_range_23_gap[2];
-    unsigned char acknowledging_range_3_size[2];
-    unsigned char acknowledging_range_34_gap[2];
-    unsigned char acknowledging_range_4_size[2];
-    unsigned char acknowledging_range_45_gap[2];
-    unsigned char acknowledging_range_5_size[2];
-    unsigned char acknowledging_range_56_gap[2];
-    unsigned char acknowledging_range_6_size[2];
-    unsigned char flags[2];
-    unsigned char offset[8];
-    /* Data follows. */
-};
+static int _process_sendq (struct curvecpr_messager *messager);
+static long long _next_timeout (struct curvecpr_messager *messager);
 
 static crypto_uint32 _next_id (struct curvecpr_messager *messager)
 {
@@ -48,6 +33,26 @@ static crypto_uint32 _next_id (struct curvecpr_messager *messager)
     return messager->my_id;
 }
 
+static void _chicago_on_recv (struct curvecpr_messager *messager, const struct curvecpr_block *block)
+{
+    curvecpr_chicago_on_recv(&messager->chicago, block->clock);
+}
+
+static void _chicago_on_timeout (struct curvecpr_messager *messager)
+{
+    curvecpr_chicago_on_timeout(&messager->chicago);
+}
+
+static long long _chicago_next_send_time (struct curvecpr_messager *messager)
+{
+    return messager->my_sent_clock + messager->chicago.wr_rate;
+}
+
+static long long _chicago_rto (struct curvecpr_messager *messager)
+{
+    return messager->chicago.rtt_timeout;
+}
+
 void curvecpr_messager_new (struct curvecpr_messager *messager, const struct curvecpr_messager_cf *cf, unsigned char client)
 {
     curvecpr_bytes_zero(messager, sizeof(struct curvecpr_messager));
@@ -56,22 +61,33 @@ void curvecpr_messager_new (struct curvecpr_messager *messager, const struct cur
     if (cf)
         curvecpr_bytes_copy(&messager->cf, cf, sizeof(struct curvecpr_messager_cf));
 
-    /* Initialize congestion handling. */
-    curvecpr_chicago_new(&messager->chicago);
+    /* Initialize congestion handling. The Chicago stats hold the clock even if
+       another controller is in use. */
+    curvecpr_chicago_new(&messager->chicago, messager->cf.clock);
+
+    if (messager->cf.high_rate)
+        messager->chicago.wr_rate_floor = CURVECPR_CHICAGO_HIGH_RATE_FLOOR;
+
+    if (!messager->cf.congestion.on_recv || !messager->cf.congestion.on_timeout || !messager->cf.congestion.next_send_time || !messager->cf.congestion.rto) {
+        messager->cf.congestion.on_recv = _chicago_on_recv;
+        messager->cf.congestion.on_timeout = _chicago_on_timeout;
+        messager->cf.congestion.next_send_time = _chicago_next_send_time;
+        messager->cf.congestion.rto = _chicago_rto;
+    }
 
     /* If we're in client mode, initiate packets have a maximum size of 512 bytes.
        Otherwise, we're in server mode, and we can start at 1024. */
     messager->my_maximum_send_bytes = client ? 512 : 1024;
 
     /* Fire off initial timeout notification. */
-    curvecpr_messager_next_timeout(messager);
+    _next_timeout(messager);
 }
 
 int curvecpr_messager_recv (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
 {
     const struct curvecpr_messager_cf *cf = &messager->cf;
 
-    const struct _message *message;
+    struct curvecpr_message message;
     const unsigned char *data;
 
     crypto_uint32 id, acknowledging_id;
@@ -83,11 +99,11 @@ int curvecpr_messager_recv (struct curvecpr_messager *messager, const unsigned c
 
     curvecpr_chicago_refresh_clock(&messager->chicago);
 
-    message = (const struct _message *)buf;
-    data = buf + sizeof(struct _message);
+    curvecpr_message_unpack(&message, buf);
+    data = buf + CURVECPR_MESSAGE_HEADER;
 
-    id = curvecpr_bytes_unpack_uint32(message->id);
-    acknowledging_id = curvecpr_bytes_unpack_uint32(message->acknowledging_id);
+    id = message.id;
+    acknowledging_id = message.acknowledging_id;
 
     /* Update decongestion. */
     if (acknowledging_id) {
@@ -98,54 +114,26 @@ int curvecpr_messager_recv (struct curvecpr_messager *messager, const unsigned c
                consequence is we can't use it for timing data. */
         } else {
             if (block->clock)
-                curvecpr_chicago_on_recv(&messager->chicago, block->clock);
+                cf->congestion.on_recv(messager, block);
         }
     }
 
     /* Try acknowledging ranges. */
     {
-        unsigned long long start, end;
+        int i;
 
-        /* Range 1. */
-        start = 0;
-        end = curvecpr_bytes_unpack_uint64(message->acknowledging_range_1_size);
-        if (start - end > 0) {
-            cf->ops.sendmarkq_remove_range(messager, start, end);
+        for (i = 0; i < 6; ++i) {
+            unsigned long long start = message.acknowledging_ranges[i].start;
+            unsigned long long end = message.acknowledging_ranges[i].end;
 
-            /* If we're at EOF, see if we can move to a final state. */
-            if (messager->my_eof && end >= messager->my_sent_bytes)
-                messager->my_final = 1;
-        }
+            if (start - end > 0) {
+                cf->ops.sendmarkq_remove_range(messager, start, end);
 
-        /* Range 2. */
-        start = end + (unsigned long long)curvecpr_bytes_unpack_uint32(message->acknowledging_range_12_gap);
-        end = start + (unsigned long long)curvecpr_bytes_unpack_uint16(message->acknowledging_range_2_size);
-        if (start - end > 0)
-            cf->ops.sendmarkq_remove_range(messager, start, end);
-
-        /* Range 3. */
-        start = end + (unsigned long long)curvecpr_bytes_unpack_uint16(message->acknowledging_range_23_gap);
-        end = start + (unsigned long long)curvecpr_bytes_unpack_uint16(message->acknowledging_range_3_size);
-        if (start - end > 0)
-            cf->ops.sendmarkq_remove_range(messager, start, end);
-
-        /* Range 4. */
-        start = end + (unsigned long long)curvecpr_bytes_unpack_uint16(message->acknowledging_range_34_gap);
-        end = start + (unsigned long long)curvecpr_bytes_unpack_uint16(message->acknowledging_range_4_size);
-        if (start - end > 0)
-            cf->ops.sendmarkq_remove_range(messager, start, end);
-
-        /* Range 5. */
-        start = end + (unsigned long long)curvecpr_bytes_unpack_uint16(message->acknowledging_range_45_gap);
-        end = start + (unsigned long long)curvecpr_bytes_unpack_uint16(message->acknowledging_range_5_size);
-        if (start - end > 0)
-            cf->ops.sendmarkq_remove_range(messager, start, end);
-
-        /* Range 6. */
-        start = end + (unsigned long long)curvecpr_bytes_unpack_uint16(message->acknowledging_range_56_gap);
-        end = start + (unsigned long long)curvecpr_bytes_unpack_uint16(message->acknowledging_range_6_size);
-        if (start - end > 0)
-            cf->ops.sendmarkq_remove_range(messager, start, end);
+                /* If we're at EOF, see if we can move to a final state. */
+                if (i == 0 && messager->my_eof && end >= messager->my_sent_bytes)
+                    messager->my_final = 1;
+            }
+        }
     }
 
     /* Read size and flags and dispatch data to delegate. */
@@ -153,12 +141,12 @@ int curvecpr_messager_recv (struct curvecpr_messager *messager, const unsigned c
         struct curvecpr_block block, *stored_block;
         curvecpr_bytes_zero(&block, sizeof(struct curvecpr_block));
 
-        unsigned short flags = curvecpr_bytes_unpack_uint16(message->flags);
+        unsigned short flags = message.flags;
         unsigned short stop = flags & _STOP;
         block.data_len = flags - stop;
 
         /* Sanity check. */
-        if (block.data_len > 1024 || num < sizeof(struct _message) + block.data_len)
+        if (block.data_len > CURVECPR_BLOCK_DATA || num < CURVECPR_MESSAGE_HEADER + block.data_len)
             return -EINVAL;
 
         /* Copy over flags. This might be the last item we'll ever receive. */
@@ -166,7 +154,7 @@ int curvecpr_messager_recv (struct curvecpr_messager *messager, const unsigned c
         else if (stop & _STOP_SUCCESS) block.eof = CURVECPR_BLOCK_EOF_SUCCESS;
 
         /* Range insertion point. */
-        block.offset = curvecpr_bytes_unpack_uint64(message->offset);
+        block.offset = message.offset;
 
         if (messager->their_eof && block.offset > messager->their_total_bytes)
             /* Ooh, naughty. Shouldn't be trying to send more data. */
@@ -176,9 +164,9 @@ int curvecpr_messager_recv (struct curvecpr_messager *messager, const unsigned c
            (no more initiates). */
         messager->my_maximum_send_bytes = 1024;
 
-        /* Copy data into the block. Because we zero-pad the message, we want to copy
-           only the last bytes. */
-        curvecpr_bytes_copy(block.data, data + (num - sizeof(struct _message) - block.data_len), block.data_len);
+        /* Point the block at its data, which is at the very end of the message because
+           we zero-pad at the front. The recvmarkq copies it if it keeps it. */
+        block.data = data + (num - CURVECPR_MESSAGE_HEADER - block.data_len);
 
         /* Should we enqueue this block? Only if it isn't a pure acknowledgment. */
         if (id) {
@@ -202,7 +190,7 @@ int curvecpr_messager_recv (struct curvecpr_messager *messager, const unsigned c
     }
 
     /* Update timeout (if callback defined). */
-    curvecpr_messager_next_timeout(messager);
+    _next_timeout(messager);
 
     /* Update acknowledgment information (but only if this isn't a pure
        acknowledgment). */
@@ -215,7 +203,7 @@ int curvecpr_messager_recv (struct curvecpr_messager *messager, const unsigned c
 
         /* We might have just filled up the outgoing acknowledgment (recvmark) queue, so
            go ahead and process outgoing messages. */
-        r = curvecpr_messager_process_sendq(messager);
+        r = _process_sendq(messager);
 
         if (r && r != -EAGAIN)
             /* XXX: Is this really the behavior we want? */
@@ -229,8 +217,11 @@ static int _send_block (struct curvecpr_messager *messager, struct curvecpr_bloc
 {
     const struct curvecpr_messager_cf *cf = &messager->cf;
 
-    unsigned char data[1088];
-    struct _message *message = (struct _message *)data;
+    unsigned char data_local[1088];
+
+    /* When batching, build the message right where it'll be sent from. */
+    unsigned char *data = cf->sendv ? curvecpr_sendv_next(cf->sendv) : data_local;
+    struct curvecpr_message message;
 
     size_t num;
 
@@ -240,63 +231,90 @@ static int _send_block (struct curvecpr_messager *messager, struct curvecpr_bloc
 
     /* NB: It is perfectly acceptable for block to be null in this function. */
 
+    /* Mid-flush; the push will fail, but don't build over what's being sent. */
+    if (!data)
+        data = data_local;
+
     /* Verify block length is acceptable. */
     if (block && block->data_len > messager->my_maximum_send_bytes)
         return -EINVAL;
 
     /* How long should this message be? */
-    num = sizeof(struct _message) + (block ? block->data_len : 0);
+    num = CURVECPR_MESSAGE_HEADER + (block ? block->data_len : 0);
     if (num <= 192) num = 192;
     else if (num <= 320) num = 320;
     else if (num <= 576) num = 576;
     else if (num <= 1088) num = 1088;
 
-    curvecpr_bytes_zero(data, num);
+    curvecpr_bytes_zero(&message, sizeof(struct curvecpr_message));
 
     /* Write message ID unless this is purely an acknowledgment. */
-    if (block) {
-        id = _next_id(messager);
-        curvecpr_bytes_pack_uint32(message->id, id);
-    }
+    if (block)
+        id = message.id = _next_id(messager);
 
     /* Write decongestion (message ID) acknowledgment. */
-    if (messager->their_sent_id)
-        curvecpr_bytes_pack_uint32(message->acknowledging_id, messager->their_sent_id);
+    message.acknowledging_id = messager->their_sent_id;
 
     /* Write range acknowledgments. */
     {
         struct curvecpr_block *received_block = NULL;
-        int block_num = 0, i = 0;
+        struct curvecpr_message_range received_ranges[6];
+        unsigned int block_num = 0, received_ranges_num = 0;
+        int i = 0;
 
         crypto_uint64 check = messager->their_contiguous_sent_bytes;
         unsigned long long maximum_gap = UINT32_MAX;
 
+        /* If the recvmarkq can tell us its runs of data directly, only the first few
+           are looked at, however much else has been received out of order. */
+        if (cf->ops.recvmarkq_get_ranges) {
+            received_ranges_num = cf->ops.recvmarkq_get_ranges(messager, check, received_ranges);
+
+            /* Everything waiting is below what we've already acknowledged. */
+            if (!received_ranges_num && !cf->ops.recvmarkq_is_empty(messager)) {
+                acknowledgment_ranges[0].exists = 1;
+                acknowledgment_ranges[0].end = check;
+            }
+        }
+
         for (;;) {
-            if (cf->ops.recvmarkq_get_nth_unacknowledged(messager, block_num++, &received_block))
-                break;
+            crypto_uint64 received_start, received_end;
+
+            if (cf->ops.recvmarkq_get_ranges) {
+                if (block_num == received_ranges_num)
+                    break;
+
+                received_start = received_ranges[block_num].start;
+                received_end = received_ranges[block_num].end;
+                ++block_num;
+            } else {
+                if (cf->ops.recvmarkq_get_nth_unacknowledged(messager, block_num++, &received_block))
+                    break;
+
+                received_start = received_block->offset;
+                received_end = received_block->offset + received_block->data_len;
+            }
 
             acknowledgment_ranges[i].exists = 1;
 
-            if (received_block->offset > check) {
+            if (received_start > check) {
                 acknowledgment_ranges[i].end = check;
 
                 if (!(i < 5))
                     /* Can't fit any more acknowledgments in this message. */
                     break;
-                else if (received_block->offset - check > maximum_gap)
+                else if (received_start - check > maximum_gap)
                     /* Gap is too large... need more packets! */
                     break;
 
                 i++;
                 acknowledgment_ranges[i].exists = 1;
-                acknowledgment_ranges[i].start = received_block->offset;
-                acknowledgment_ranges[i].end = received_block->offset + received_block->data_len;
+                acknowledgment_ranges[i].start = received_start;
+                acknowledgment_ranges[i].end = received_end;
 
                 maximum_gap = UINT16_MAX;
             } else {
-                crypto_uint64 received_block_end = received_block->offset + received_block->data_len;
-
-                acknowledgment_ranges[i].end = check > received_block_end ? check : received_block_end;
+                acknowledgment_ranges[i].end = check > received_end ? check : received_end;
             }
 
             check = acknowledgment_ranges[i].end;
@@ -312,33 +330,18 @@ static int _send_block (struct curvecpr_messager *messager, struct curvecpr_bloc
                 /* Include their EOF in the range size (total stream size). */
                 ++acknowledgment_ranges[0].end;
             }
-
-            curvecpr_bytes_pack_uint64(message->acknowledging_range_1_size, (crypto_uint64)acknowledgment_ranges[0].end);
         }
 
-        if (acknowledgment_ranges[1].exists) {
-            curvecpr_bytes_pack_uint32(message->acknowledging_range_12_gap, (crypto_uint32)(acknowledgment_ranges[1].start - acknowledgment_ranges[0].end));
-            curvecpr_bytes_pack_uint16(message->acknowledging_range_2_size, (crypto_uint16)(acknowledgment_ranges[1].end - acknowledgment_ranges[1].start));
-        }
-
-        if (acknowledgment_ranges[2].exists) {
-            curvecpr_bytes_pack_uint16(message->acknowledging_range_23_gap, (crypto_uint16)(acknowledgment_ranges[2].start - acknowledgment_ranges[1].end));
-            curvecpr_bytes_pack_uint16(message->acknowledging_range_3_size, (crypto_uint16)(acknowledgment_ranges[2].end - acknowledgment_ranges[2].start));
-        }
-
-        if (acknowledgment_ranges[3].exists) {
-            curvecpr_bytes_pack_uint16(message->acknowledging_range_34_gap, (crypto_uint16)(acknowledgment_ranges[3].start - acknowledgment_ranges[2].end));
-            curvecpr_bytes_pack_uint16(message->acknowledging_range_4_size, (crypto_uint16)(acknowledgment_ranges[3].end - acknowledgment_ranges[3].start));
-        }
-
-        if (acknowledgment_ranges[4].exists) {
-            curvecpr_bytes_pack_uint16(message->acknowledging_range_45_gap, (crypto_uint16)(acknowledgment_ranges[4].start - acknowledgment_ranges[3].end));
-            curvecpr_bytes_pack_uint16(message->acknowledging_range_5_size, (crypto_uint16)(acknowledgment_ranges[4].end - acknowledgment_ranges[4].start));
-        }
-
-        if (acknowledgment_ranges[5].exists) {
-            curvecpr_bytes_pack_uint16(message->acknowledging_range_56_gap, (crypto_uint16)(acknowledgment_ranges[5].start - acknowledgment_ranges[4].end));
-            curvecpr_bytes_pack_uint16(message->acknowledging_range_6_size, (crypto_uint16)(acknowledgment_ranges[5].end - acknowledgment_ranges[5].start));
+        /* Write them all out. Ranges we aren't using are left empty at the end of the
+           previous one. */
+        for (i = 0; i < 6; ++i) {
+            if (acknowledgment_ranges[i].exists) {
+                message.acknowledging_ranges[i].start = acknowledgment_ranges[i].start;
+                message.acknowledging_ranges[i].end = acknowledgment_ranges[i].end;
+            } else if (i > 0) {
+                message.acknowledging_ranges[i].start = message.acknowledging_ranges[i - 1].end;
+                message.acknowledging_ranges[i].end = message.acknowledging_ranges[i - 1].end;
+            }
         }
     }
 
@@ -349,26 +352,37 @@ static int _send_block (struct curvecpr_messager *messager, struct curvecpr_bloc
         if (block->eof == CURVECPR_BLOCK_EOF_FAILURE) flags |= _STOP_FAILURE;
         else if (block->eof == CURVECPR_BLOCK_EOF_SUCCESS) flags |= _STOP_SUCCESS;
 
-        curvecpr_bytes_pack_uint16(message->flags, flags);
+        message.flags = flags;
 
         /* Write block position. */
         if (block->clock) {
             /* Block has already been sent. */
-            curvecpr_bytes_pack_uint64(message->offset, block->offset);
+            message.offset = block->offset;
         } else {
             /* Block hasn't been sent yet; give it the next available offset. */
-            curvecpr_bytes_pack_uint64(message->offset, messager->my_sent_bytes);
+            message.offset = messager->my_sent_bytes;
         }
-
-        /* Copy the block into the message. */
-        curvecpr_bytes_copy(data + num - block->data_len, block->data, block->data_len);
     } else if (!messager->their_sent_id && !acknowledgment_ranges[0].exists) {
         /* We have absolutely nothing to send... */
         return -EAGAIN;
     }
 
-    if (cf->ops.send(messager, data, num))
+    /* Write out the message: header, zero padding, then the block's data (if any). */
+    curvecpr_message_pack(data, &message);
+
+    if (block) {
+        curvecpr_bytes_zero(data + CURVECPR_MESSAGE_HEADER, num - CURVECPR_MESSAGE_HEADER - block->data_len);
+        curvecpr_block_gather(block, data + num - block->data_len);
+    } else {
+        curvecpr_bytes_zero(data + CURVECPR_MESSAGE_HEADER, num - CURVECPR_MESSAGE_HEADER);
+    }
+
+    if (cf->sendv) {
+        if (curvecpr_sendv_push(cf->sendv, data, num, messager))
+            return -EINVAL;
+    } else if (cf->ops.send(messager, data, num)) {
         return -EINVAL;
+    }
 
     if (block) {
         /* We only want to move the message to the pending-acknowledgment queue if this
@@ -392,7 +406,7 @@ static int _send_block (struct curvecpr_messager *messager, struct curvecpr_bloc
         } else {
             /* This is a retransmission, meaning we didn't receive an acknowledgment in
                quite some time. */
-            curvecpr_chicago_on_timeout(&messager->chicago);
+            cf->congestion.on_timeout(messager);
         }
 
         if (cf->ops.sendq_move_to_sendmarkq(messager, block, NULL)) {
@@ -426,20 +440,108 @@ static int _send_block (struct curvecpr_messager *messager, struct curvecpr_bloc
     messager->their_sent_id = 0;
 
     /* Update timeout (if callback defined). */
-    curvecpr_messager_next_timeout(messager);
+    _next_timeout(messager);
 
     return 0;
 }
 
-int curvecpr_messager_process_sendq (struct curvecpr_messager *messager)
+/* Picks the block to send next, if any: one that needs to be resent, or else (if
+   bytes is set) a new one. */
+static struct curvecpr_block *_next_block (struct curvecpr_messager *messager, unsigned char bytes)
+{
+    const struct curvecpr_messager_cf *cf = &messager->cf;
+
+    struct curvecpr_block *block = NULL;
+
+    /* Maybe we have a block that needs to be resent? */
+    if (cf->ops.sendmarkq_head(messager, &block)) {
+        /* No block to send here. */
+        CURVECPR_TRACE_DEBUG("no messages in the sendmarkq");
+    } else {
+        long long rto = cf->congestion.rto(messager);
+
+        if (messager->chicago.clock >= block->clock + rto) {
+            /* Timeout! Resend this block. */
+            CURVECPR_TRACE_DEBUG("resending block(%p) with block->clock(%lld) + rto(%lld) = %lld", block, block->clock, rto, block->clock + rto);
+            return block;
+        }
+    }
+
+    /* Do we have a new block that we can send instead? (If we're at EOF, we won't even
+       bother checking). */
+    if (bytes && !messager->my_eof) {
+        if (cf->ops.sendq_head(messager, &block)) {
+            /* No block to send here, either. */
+            CURVECPR_TRACE_DEBUG("no messages in the sendq");
+        } else {
+            /* New block! */
+            CURVECPR_TRACE_DEBUG("sending block(%p)", block);
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+/* In high-rate mode, sends every block that's come due since the last one was sent,
+   up to a burst's worth, starting with block. The send clock then moves on by one
+   interval per block rather than to now, so the average rate holds however late
+   we're called. */
+static int _send_burst (struct curvecpr_messager *messager, struct curvecpr_block *block, long long next_send_time)
+{
+    const struct curvecpr_messager_cf *cf = &messager->cf;
+
+    long long clock = messager->chicago.clock;
+    long long interval = next_send_time - messager->my_sent_clock;
+    long long start = messager->my_sent_clock;
+    long long burst = cf->burst ? cf->burst : CURVECPR_MESSAGER_BURST;
+    long long due, sent = 0;
+    int r;
+
+    if (interval < 1)
+        interval = 1;
+
+    /* Don't save up for more than one burst. */
+    if (start < clock - burst * interval)
+        start = clock - burst * interval;
+
+    due = (clock - start) / interval;
+    if (due > burst)
+        due = burst;
+
+    for (;;) {
+        r = _send_block(messager, block);
+        if (r)
+            break;
+
+        if (++sent >= due || cf->ops.sendmarkq_is_full(messager))
+            break;
+
+        block = _next_block(messager, 1);
+        if (!block)
+            break;
+    }
+
+    if (!sent)
+        return r;
+
+    messager->my_sent_clock = start + sent * interval;
+
+    /* Each block sent reported a timeout assuming it was sent on time. */
+    _next_timeout(messager);
+
+    return 0;
+}
+
+/* Neither of these read the clock; they go by whenever it was last read. */
+static int _process_sendq (struct curvecpr_messager *messager)
 {
     const struct curvecpr_messager_cf *cf = &messager->cf;
     struct curvecpr_chicago *chicago = &messager->chicago;
 
     unsigned char acknowledge = 0, bytes = 0;
     struct curvecpr_block *block = NULL;
-
-    curvecpr_chicago_refresh_clock(chicago);
+    long long next_send_time = cf->congestion.next_send_time(messager);
 
     /* Should we send a block? */
     if (!cf->ops.recvmarkq_is_empty(messager)) {
@@ -449,8 +551,8 @@ int curvecpr_messager_process_sendq (struct curvecpr_messager *messager)
         acknowledge = 1;
     }
 
-    CURVECPR_TRACE_DEBUG("testing chicago->clock(%lld) >= messager->my_sent_clock(%lld) + chicago->wr_rate(%d)", chicago->clock, messager->my_sent_clock, chicago->wr_rate);
-    if (chicago->clock >= messager->my_sent_clock + chicago->wr_rate) {
+    CURVECPR_TRACE_DEBUG("testing chicago->clock(%lld) >= next_send_time(%lld)", chicago->clock, next_send_time);
+    if (chicago->clock >= next_send_time) {
         /* Clock time is up! */
         CURVECPR_TRACE_DEBUG("clock is expired: sending messages");
         bytes = 1;
@@ -465,37 +567,20 @@ int curvecpr_messager_process_sendq (struct curvecpr_messager *messager)
     if (!acknowledge && !bytes)
         return -EAGAIN;
 
-    /* OK, we should. Maybe we have a block that needs to be resent? */
-    if (cf->ops.sendmarkq_head(messager, &block)) {
-        /* No block to send here. */
-        CURVECPR_TRACE_DEBUG("no messages in the sendmarkq");
-    } else {
-        if (chicago->clock >= block->clock + chicago->rtt_timeout) {
-            /* Timeout! Resend this block. */
-            CURVECPR_TRACE_DEBUG("resending block(%p) with block->clock(%lld) + chicago->rtt_timeout(%d) = %lld", block, block->clock, chicago->rtt_timeout, block->clock + chicago->rtt_timeout);
-            return _send_block(messager, block);
-        }
-    }
+    block = _next_block(messager, bytes);
 
-    /* Do we have a new block that we can send instead? (If we're at EOF, we won't even
-       bother checking). */
-    if (bytes && !messager->my_eof) {
-        if (cf->ops.sendq_head(messager, &block)) {
-            /* No block to send here, either. */
-            CURVECPR_TRACE_DEBUG("no messages in the sendq");
-        } else {
-            /* New block! */
-            CURVECPR_TRACE_DEBUG("sending block(%p)", block);
-            return _send_block(messager, block);
-        }
-    }
+    if (block && bytes && cf->high_rate)
+        return _send_burst(messager, block, next_send_time);
+
+    if (block)
+        return _send_block(messager, block);
 
     /* We've got nothing, so just send acknowledgments. */
     CURVECPR_TRACE_DEBUG("sending acknowledgments");
     return _send_block(messager, NULL);
 }
 
-long long curvecpr_messager_next_timeout (struct curvecpr_messager *messager)
+static long long _next_timeout (struct curvecpr_messager *messager)
 {
     const struct curvecpr_messager_cf *cf = &messager->cf;
     struct curvecpr_chicago *chicago = &messager->chicago;
@@ -503,13 +588,12 @@ long long curvecpr_messager_next_timeout (struct curvecpr_messager *messager)
     struct curvecpr_block *block = NULL;
 
     long long at, timeout;
+    long long next_send_time = cf->congestion.next_send_time(messager);
 
     /* If we have anything to be written, we wouldn't spin at all, so don't include an
        adjustment in the timeout for it in that case. */
     int would_spin = 1;
 
-    curvecpr_chicago_refresh_clock(chicago);
-
     at = chicago->clock + 60000000000LL; /* 60 seconds. */
     CURVECPR_TRACE_DEBUG("checking next timeout (chicago->clock: %lld)", chicago->clock);
 
@@ -523,10 +607,9 @@ long long curvecpr_messager_next_timeout (struct curvecpr_messager *messager)
             would_spin = 0;
 
             /* Write at the write rate. */
-            if (at > messager->my_sent_clock + chicago->wr_rate) {
-                at = messager->my_sent_clock + chicago->wr_rate;
-                CURVECPR_TRACE_DEBUG("sendq is not empty: set timer to messager->my_sent_clock(%lld) + chicago->wr_rate(%d): %lld",
-                    messager->my_sent_clock, chicago->wr_rate, at);
+            if (at > next_send_time) {
+                at = next_send_time;
+                CURVECPR_TRACE_DEBUG("sendq is not empty: set timer to next_send_time: %lld", at);
             }
         }
     }
@@ -536,21 +619,23 @@ long long curvecpr_messager_next_timeout (struct curvecpr_messager *messager)
         CURVECPR_TRACE_DEBUG("sendmarkq is empty");
         /* No earliest block. */
     } else {
-        CURVECPR_TRACE_DEBUG("sendmarkq is not empty (head block->clock: %lld, chicago->rtt_timeout: %d)", block->clock, chicago->rtt_timeout);
+        long long rto = cf->congestion.rto(messager);
+
+        CURVECPR_TRACE_DEBUG("sendmarkq is not empty (head block->clock: %lld, rto: %lld)", block->clock, rto);
 
         would_spin = 0;
 
-        if (at > block->clock + chicago->rtt_timeout) {
-            at = block->clock + chicago->rtt_timeout;
-            CURVECPR_TRACE_DEBUG("sendmarkq is not empty: set timer to block->clock + chicago->rtt_timeout: %lld", at);
+        if (at > block->clock + rto) {
+            at = block->clock + rto;
+            CURVECPR_TRACE_DEBUG("sendmarkq is not empty: set timer to block->clock + rto: %lld", at);
         }
 
-        /* Writing faster than wr_rate does not make sense and will cause spinning. BUT, if
-           there is something to acknowledge, block might still be resent. */
-        if (cf->ops.recvmarkq_is_empty(messager) && at < messager->my_sent_clock + chicago->wr_rate) {
-            at = messager->my_sent_clock + chicago->wr_rate;
-            CURVECPR_TRACE_DEBUG("sendmarkq is not empty: recvmarkq is empty: set timer to messager->my_sent_clock(%lld) + chicago->wr_rate(%d): %lld",
-                messager->my_sent_clock, chicago->wr_rate, at);
+        /* Writing faster than the send rate does not make sense and will cause
+           spinning. BUT, if there is something to acknowledge, block might still be
+           resent. */
+        if (cf->ops.recvmarkq_is_empty(messager) && at < next_send_time) {
+            at = next_send_time;
+            CURVECPR_TRACE_DEBUG("sendmarkq is not empty: recvmarkq is empty: set timer to next_send_time: %lld", at);
         }
     }
 
@@ -568,3 +653,17 @@ long long curvecpr_messager_next_timeout (struct curvecpr_messager *messager)
 
     return timeout;
 }
+
+int curvecpr_messager_process_sendq (struct curvecpr_messager *messager)
+{
+    curvecpr_chicago_refresh_clock(&messager->chicago);
+
+    return _process_sendq(messager);
+}
+
+long long curvecpr_messager_next_timeout (struct curvecpr_messager *messager)
+{
+    curvecpr_chicago_refresh_clock(&messager->chicago);
+
+    return _next_timeout(messager);
+}
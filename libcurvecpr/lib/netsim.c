@@ -0,0 +1,601 @@
+#include "config.h"
+
+#include <curvecpr/netsim.h>
+
+#include <curvecpr/block.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/client.h>
+#include <curvecpr/clock.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+#include <curvecpr/stream.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sodium/crypto_box.h>
+#include <sodium/crypto_uint64.h>
+
+/* Virtual time starts here rather than at 0, which Chicago takes to mean never. */
+#define _EPOCH 1000000000000LL
+
+/* How long a client waits for a cookie before sending another hello. */
+#define _HELLO_INTERVAL 1000000000LL
+
+/* xorshift64* */
+static crypto_uint64 _random (crypto_uint64 *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 2685821657736338717ULL;
+}
+
+static long long _random_mod_n (struct curvecpr_netsim *netsim, long long n)
+{
+    if (n <= 1)
+        return 0;
+
+    return (long long)(_random(&netsim->random_state) % (crypto_uint64)n);
+}
+
+/* What side 0 writes at each offset, so side 1 can check it. */
+static unsigned char _pattern (crypto_uint64 offset)
+{
+    return (unsigned char)((offset ^ (offset >> 8) ^ (offset >> 16)) * 131);
+}
+
+static int _side (struct curvecpr_netsim *netsim, const struct curvecpr_messager *messager)
+{
+    return messager == &netsim->messagers[0] ? 0 : 1;
+}
+
+/* Heap maintenance for the packets in flight. */
+static int _before (const struct curvecpr_netsim_packet *a, const struct curvecpr_netsim_packet *b)
+{
+    return a->at < b->at || (a->at == b->at && a->seq < b->seq);
+}
+
+static void _packets_push (struct curvecpr_netsim *netsim, struct curvecpr_netsim_packet *packet)
+{
+    size_t i = netsim->packets_len++;
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+
+        if (!_before(packet, netsim->packets[parent]))
+            break;
+
+        netsim->packets[i] = netsim->packets[parent];
+        i = parent;
+    }
+
+    netsim->packets[i] = packet;
+}
+
+static struct curvecpr_netsim_packet *_packets_pop (struct curvecpr_netsim *netsim)
+{
+    struct curvecpr_netsim_packet *top = netsim->packets[0];
+    struct curvecpr_netsim_packet *last = netsim->packets[--netsim->packets_len];
+    size_t i = 0;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+
+        if (child >= netsim->packets_len)
+            break;
+        if (child + 1 < netsim->packets_len && _before(netsim->packets[child + 1], netsim->packets[child]))
+            ++child;
+        if (!_before(netsim->packets[child], last))
+            break;
+
+        netsim->packets[i] = netsim->packets[child];
+        i = child;
+    }
+
+    if (netsim->packets_len)
+        netsim->packets[i] = last;
+
+    return top;
+}
+
+/* Puts a packet on the link from side to the other side, if it survives. */
+static int _transmit (struct curvecpr_netsim *netsim, int side, const unsigned char *buf, size_t num)
+{
+    const struct curvecpr_netsim_link *link = &netsim->cf.links[side];
+    struct curvecpr_netsim_packet *packet;
+    long long now = netsim->clock.now;
+    long long departure = now;
+
+    if (num > sizeof(packet->buf))
+        return -EMSGSIZE;
+
+    ++netsim->report.packets_sent[side];
+
+    if (link->loss && _random_mod_n(netsim, 1000000) < link->loss) {
+        ++netsim->report.packets_lost[side];
+        return 0;
+    }
+
+    if (link->bandwidth) {
+        long long start = netsim->link_free[side] > now ? netsim->link_free[side] : now;
+
+        /* What's queued is whatever the bottleneck hasn't got to yet. */
+        if (link->queue_bytes && (start - now) * link->bandwidth / 1000000000LL + (long long)num > (long long)link->queue_bytes) {
+            ++netsim->report.packets_dropped[side];
+            return 0;
+        }
+
+        departure = start + (long long)num * 1000000000LL / link->bandwidth;
+        netsim->link_free[side] = departure;
+    }
+
+    if (netsim->spare_len) {
+        packet = netsim->spare[--netsim->spare_len];
+    } else {
+        if (netsim->packets_len == netsim->packets_size) {
+            size_t size = netsim->packets_size ? 2 * netsim->packets_size : 256;
+            struct curvecpr_netsim_packet **packets = realloc(netsim->packets, size * sizeof(struct curvecpr_netsim_packet *));
+            struct curvecpr_netsim_packet **spare = realloc(netsim->spare, size * sizeof(struct curvecpr_netsim_packet *));
+
+            if (packets)
+                netsim->packets = packets;
+            if (spare)
+                netsim->spare = spare;
+            if (!packets || !spare)
+                return -ENOMEM;
+
+            netsim->packets_size = size;
+        }
+
+        packet = malloc(sizeof(struct curvecpr_netsim_packet));
+        if (!packet)
+            return -ENOMEM;
+    }
+
+    packet->at = departure + link->delay + _random_mod_n(netsim, link->jitter + 1);
+    packet->seq = netsim->packets_seq++;
+    packet->to = !side;
+    packet->num = num;
+    curvecpr_bytes_copy(packet->buf, buf, num);
+
+    _packets_push(netsim, packet);
+
+    return 0;
+}
+
+/* Messager ops. */
+static int _messager_send (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
+{
+    struct curvecpr_netsim *netsim = messager->cf.priv;
+    int side = _side(netsim, messager);
+
+    if (!netsim->cf.handshake)
+        return _transmit(netsim, side, buf, num);
+
+    if (side == 0)
+        return curvecpr_client_send(&netsim->client, buf, num);
+
+    if (!netsim->have_session)
+        return -ENOTCONN;
+
+    return curvecpr_server_send(&netsim->server, &netsim->session, NULL, buf, num);
+}
+
+static void _messager_put_next_timeout (struct curvecpr_messager *messager, const long long timeout_ns)
+{
+    struct curvecpr_netsim *netsim = messager->cf.priv;
+
+    netsim->wake[_side(netsim, messager)] = netsim->clock.now + timeout_ns;
+}
+
+/* Side 0's congestion control and sendq, watched on their way past. */
+static void _on_recv (struct curvecpr_messager *messager, const struct curvecpr_block *block)
+{
+    struct curvecpr_netsim *netsim = messager->cf.priv;
+    struct curvecpr_netsim_report *report = &netsim->report;
+    long long rtt = netsim->clock.now - block->clock;
+
+    if (!report->rtt_samples || rtt < report->rtt_min)
+        report->rtt_min = rtt;
+    if (rtt > report->rtt_max)
+        report->rtt_max = rtt;
+
+    /* A running mean. */
+    ++report->rtt_samples;
+    report->rtt_average += (rtt - report->rtt_average) / (long long)report->rtt_samples;
+
+    netsim->congestion.on_recv(messager, block);
+}
+
+static void _on_timeout (struct curvecpr_messager *messager)
+{
+    struct curvecpr_netsim *netsim = messager->cf.priv;
+
+    ++netsim->report.blocks_resent;
+
+    netsim->congestion.on_timeout(messager);
+}
+
+static long long _next_send_time (struct curvecpr_messager *messager)
+{
+    struct curvecpr_netsim *netsim = messager->cf.priv;
+
+    return netsim->congestion.next_send_time(messager);
+}
+
+static long long _rto (struct curvecpr_messager *messager)
+{
+    struct curvecpr_netsim *netsim = messager->cf.priv;
+
+    return netsim->congestion.rto(messager);
+}
+
+static int _sendq_move_to_sendmarkq (struct curvecpr_messager *messager, const struct curvecpr_block *block, struct curvecpr_block **block_stored)
+{
+    struct curvecpr_netsim *netsim = messager->cf.priv;
+    int r = netsim->sendq_move_to_sendmarkq(messager, block, block_stored);
+
+    if (!r)
+        ++netsim->report.blocks_sent;
+
+    return r;
+}
+
+/* Client and server ops, for cf.handshake. */
+static int _client_send (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    return _transmit(client->priv, 0, buf, num);
+}
+
+static int _client_recv (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    struct curvecpr_netsim *netsim = client->priv;
+
+    if (!netsim->report.handshake_time)
+        netsim->report.handshake_time = netsim->clock.now - netsim->start;
+
+    return curvecpr_messager_recv(&netsim->messagers[0], buf, num);
+}
+
+static int _client_next_nonce (struct curvecpr_client *client, unsigned char *destination, size_t num)
+{
+    struct curvecpr_netsim *netsim = client->priv;
+    size_t i;
+
+    for (i = 0; i < num; ++i)
+        destination[i] = (unsigned char)_random(&netsim->random_state);
+
+    return 0;
+}
+
+static int _server_put_session (struct curvecpr_server *server, const struct curvecpr_session *s, void *priv, struct curvecpr_session **s_stored)
+{
+    struct curvecpr_netsim *netsim = server->cf.priv;
+
+    curvecpr_bytes_copy(&netsim->session, s, sizeof(struct curvecpr_session));
+    netsim->have_session = 1;
+
+    *s_stored = &netsim->session;
+    return 0;
+}
+
+static int _server_get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    struct curvecpr_netsim *netsim = server->cf.priv;
+
+    if (!netsim->have_session || !curvecpr_bytes_equal(netsim->session.their_session_pk, their_session_pk, 32))
+        return 1;
+
+    *s_stored = &netsim->session;
+    return 0;
+}
+
+static int _server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    return _transmit(server->cf.priv, 1, buf, num);
+}
+
+static int _server_recv (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    struct curvecpr_netsim *netsim = server->cf.priv;
+
+    return curvecpr_messager_recv(&netsim->messagers[1], buf, num);
+}
+
+static int _server_next_nonce (struct curvecpr_server *server, unsigned char *destination, size_t num)
+{
+    struct curvecpr_netsim *netsim = server->cf.priv;
+    size_t i;
+
+    for (i = 0; i < num; ++i)
+        destination[i] = (unsigned char)_random(&netsim->random_state);
+
+    return 0;
+}
+
+int curvecpr_netsim_new (struct curvecpr_netsim *netsim, const struct curvecpr_netsim_cf *cf)
+{
+    struct curvecpr_queues_cf queues_cf;
+    struct curvecpr_stream_cf stream_cf;
+    int side, r;
+
+    curvecpr_bytes_zero(netsim, sizeof(struct curvecpr_netsim));
+
+    if (cf)
+        curvecpr_bytes_copy(&netsim->cf, cf, sizeof(struct curvecpr_netsim_cf));
+
+    if (!netsim->cf.time_limit)
+        netsim->cf.time_limit = 600000000000LL;
+    if (!netsim->cf.send_blocks)
+        netsim->cf.send_blocks = 1024;
+    if (!netsim->cf.recv_blocks)
+        netsim->cf.recv_blocks = 1024;
+    if (!netsim->cf.recv_bytes)
+        netsim->cf.recv_bytes = 1048576;
+
+    netsim->random_state = netsim->cf.seed * 2 + 1;
+
+    netsim->start = _EPOCH;
+    curvecpr_clock_new(&netsim->clock, CURVECPR_CLOCK_INJECTED);
+    curvecpr_clock_set(&netsim->clock, netsim->start);
+
+    curvecpr_bytes_zero(&queues_cf, sizeof(struct curvecpr_queues_cf));
+    queues_cf.send_blocks = netsim->cf.send_blocks;
+    queues_cf.recv_blocks = netsim->cf.recv_blocks;
+
+    curvecpr_bytes_zero(&stream_cf, sizeof(struct curvecpr_stream_cf));
+    stream_cf.recv_bytes = netsim->cf.recv_bytes;
+
+    for (side = 0; side < 2; ++side) {
+        struct curvecpr_messager_cf messager_cf;
+
+        r = curvecpr_queues_new(&netsim->queues[side], &queues_cf);
+        if (!r)
+            r = curvecpr_stream_new(&netsim->streams[side], &stream_cf);
+        if (r) {
+            curvecpr_netsim_destroy(netsim);
+            return r;
+        }
+
+        curvecpr_bytes_zero(&messager_cf, sizeof(struct curvecpr_messager_cf));
+        messager_cf.ops.send = _messager_send;
+        messager_cf.ops.put_next_timeout = _messager_put_next_timeout;
+        messager_cf.clock = &netsim->clock;
+        messager_cf.priv = netsim;
+
+        curvecpr_queues_configure(&netsim->queues[side], &messager_cf);
+        curvecpr_stream_configure(&netsim->streams[side], &messager_cf);
+
+        if (netsim->cf.ops.configure)
+            netsim->cf.ops.configure(netsim, side, &messager_cf);
+
+        netsim->wake[side] = -1;
+        curvecpr_messager_new(&netsim->messagers[side], &messager_cf, netsim->cf.handshake && side == 0);
+        netsim->messagers[side].chicago.random_state = _random(&netsim->random_state) | 1;
+    }
+
+    /* Watch side 0 on its way to the network. */
+    netsim->congestion = netsim->messagers[0].cf.congestion;
+    netsim->messagers[0].cf.congestion.on_recv = _on_recv;
+    netsim->messagers[0].cf.congestion.on_timeout = _on_timeout;
+    netsim->messagers[0].cf.congestion.next_send_time = _next_send_time;
+    netsim->messagers[0].cf.congestion.rto = _rto;
+
+    netsim->sendq_move_to_sendmarkq = netsim->messagers[0].cf.ops.sendq_move_to_sendmarkq;
+    netsim->messagers[0].cf.ops.sendq_move_to_sendmarkq = _sendq_move_to_sendmarkq;
+
+    if (netsim->cf.handshake) {
+        struct curvecpr_server_cf server_cf;
+        struct curvecpr_client_cf client_cf;
+
+        curvecpr_bytes_zero(&server_cf, sizeof(struct curvecpr_server_cf));
+        server_cf.ops.put_session = _server_put_session;
+        server_cf.ops.get_session = _server_get_session;
+        server_cf.ops.send = _server_send;
+        server_cf.ops.recv = _server_recv;
+        server_cf.ops.next_nonce = _server_next_nonce;
+        server_cf.priv = netsim;
+        crypto_box_keypair(server_cf.my_global_pk, server_cf.my_global_sk);
+
+        curvecpr_bytes_zero(&client_cf, sizeof(struct curvecpr_client_cf));
+        client_cf.ops.send = _client_send;
+        client_cf.ops.recv = _client_recv;
+        client_cf.ops.next_nonce = _client_next_nonce;
+        client_cf.priv = netsim;
+        crypto_box_keypair(client_cf.my_global_pk, client_cf.my_global_sk);
+        curvecpr_bytes_copy(client_cf.their_global_pk, server_cf.my_global_pk, 32);
+
+        curvecpr_server_new(&netsim->server, &server_cf);
+        r = curvecpr_client_new(&netsim->client, &client_cf);
+
+        curvecpr_bytes_zero(server_cf.my_global_sk, 32);
+        curvecpr_bytes_zero(client_cf.my_global_sk, 32);
+
+        if (r) {
+            curvecpr_netsim_destroy(netsim);
+            return r;
+        }
+
+        /* The client says hello first thing. */
+        netsim->wake[0] = netsim->start;
+    }
+
+    return 0;
+}
+
+void curvecpr_netsim_destroy (struct curvecpr_netsim *netsim)
+{
+    size_t i;
+    int side;
+
+    for (i = 0; i < netsim->packets_len; ++i)
+        free(netsim->packets[i]);
+    for (i = 0; i < netsim->spare_len; ++i)
+        free(netsim->spare[i]);
+    free(netsim->packets);
+    free(netsim->spare);
+
+    for (side = 0; side < 2; ++side) {
+        curvecpr_stream_destroy(&netsim->streams[side]);
+        curvecpr_queues_destroy(&netsim->queues[side]);
+    }
+
+    if (netsim->cf.handshake)
+        curvecpr_client_destroy(&netsim->client);
+
+    curvecpr_bytes_zero(netsim, sizeof(struct curvecpr_netsim));
+}
+
+/* Lets side 0 write as much as it can, and side 1 read as much as there is. */
+static void _pump (struct curvecpr_netsim *netsim)
+{
+    struct curvecpr_netsim_report *report = &netsim->report;
+    unsigned char buf[4096];
+    size_t num, i;
+    int r;
+
+    while (netsim->written < netsim->cf.bytes) {
+        num = netsim->cf.bytes - netsim->written < sizeof(buf) ? (size_t)(netsim->cf.bytes - netsim->written) : sizeof(buf);
+
+        for (i = 0; i < num; ++i)
+            buf[i] = _pattern(netsim->written + i);
+
+        if (curvecpr_messager_write(&netsim->messagers[0], buf, num, &num))
+            break;
+
+        netsim->written += num;
+    }
+
+    if (netsim->written == netsim->cf.bytes && !netsim->shutdown && !curvecpr_messager_shutdown(&netsim->messagers[0]))
+        netsim->shutdown = 1;
+
+    for (;;) {
+        r = curvecpr_messager_read(&netsim->messagers[1], buf, sizeof(buf), &num);
+        if (r)
+            break;
+
+        if (!num) {
+            /* The end of the stream. */
+            report->completed = 1;
+            break;
+        }
+
+        for (i = 0; i < num; ++i) {
+            if (buf[i] != _pattern(netsim->read + i))
+                ++report->bytes_corrupted;
+        }
+
+        netsim->read += num;
+    }
+
+    report->bytes_received = netsim->read;
+}
+
+static void _run_side (struct curvecpr_netsim *netsim, int side)
+{
+    struct curvecpr_messager *messager = &netsim->messagers[side];
+    int i;
+
+    netsim->wake[side] = -1;
+
+    if (netsim->cf.handshake && side == 0 && netsim->client.negotiated == CURVECPR_CLIENT_PENDING) {
+        curvecpr_client_connected(&netsim->client);
+        netsim->wake[0] = netsim->clock.now + _HELLO_INTERVAL;
+        return;
+    }
+
+    for (i = 0; i < CURVECPR_MESSAGER_BURST; ++i) {
+        if (curvecpr_messager_process_sendq(messager))
+            break;
+    }
+
+    curvecpr_messager_next_timeout(messager);
+
+    /* Nothing happened and yet it wants to run again right away; an event loop
+       couldn't wake up any sooner than a microsecond either. */
+    if (!i && netsim->wake[side] <= netsim->clock.now)
+        netsim->wake[side] = netsim->clock.now + 1000;
+}
+
+/* Runs the transfer until side 1 has read all of it, or the time limit. Returns 0
+   if it completed and -ETIMEDOUT if not; netsim->report says how it went. */
+int curvecpr_netsim_run (struct curvecpr_netsim *netsim)
+{
+    struct curvecpr_netsim_report *report = &netsim->report;
+    long long limit = netsim->start + netsim->cf.time_limit;
+    int side, r;
+
+    _pump(netsim);
+
+    for (side = 0; side < 2; ++side) {
+        if (!netsim->cf.handshake)
+            curvecpr_messager_next_timeout(&netsim->messagers[side]);
+    }
+
+    while (!report->completed) {
+        long long at = -1;
+        int next = -1;
+
+        if (netsim->packets_len) {
+            at = netsim->packets[0]->at;
+            next = 2;
+        }
+
+        for (side = 0; side < 2; ++side) {
+            /* The server's messager has nothing to do until there's a session. */
+            if (netsim->cf.handshake && side == 1 && !netsim->have_session)
+                continue;
+
+            if (netsim->wake[side] >= 0 && (at < 0 || netsim->wake[side] < at)) {
+                at = netsim->wake[side];
+                next = side;
+            }
+        }
+
+        if (at < 0 || at > limit)
+            break;
+
+        if (at > netsim->clock.now)
+            curvecpr_clock_set(&netsim->clock, at);
+
+        if (next == 2) {
+            struct curvecpr_netsim_packet *packet = _packets_pop(netsim);
+
+            if (!netsim->cf.handshake)
+                curvecpr_messager_recv(&netsim->messagers[packet->to], packet->buf, packet->num);
+            else if (packet->to == 1)
+                curvecpr_server_recv(&netsim->server, NULL, packet->buf, packet->num, NULL);
+            else if (!curvecpr_client_recv(&netsim->client, packet->buf, packet->num) && netsim->wake[0] > netsim->clock.now && netsim->client.negotiated == CURVECPR_CLIENT_INITIATING && !netsim->messagers[0].my_sent_clock)
+                /* The cookie's arrived, so the client can start sending. */
+                netsim->wake[0] = netsim->clock.now;
+
+            netsim->spare[netsim->spare_len++] = packet;
+        } else {
+            _run_side(netsim, next);
+        }
+
+        _pump(netsim);
+
+        for (side = 0; side < 2; ++side) {
+            if (!netsim->cf.handshake || (side == 0 ? netsim->client.negotiated != CURVECPR_CLIENT_PENDING : netsim->have_session))
+                curvecpr_messager_next_timeout(&netsim->messagers[side]);
+        }
+    }
+
+    report->completion_time = (report->completed ? netsim->clock.now : limit) - netsim->start;
+
+    if (report->completion_time > 0)
+        report->goodput = (double)report->bytes_received * 1000000000.0 / (double)report->completion_time;
+
+    if (report->blocks_sent + report->blocks_resent)
+        report->retransmit_ratio = (double)report->blocks_resent / (double)(report->blocks_sent + report->blocks_resent);
+
+    r = report->completed ? 0 : -ETIMEDOUT;
+
+    return r;
+}
@@ -0,0 +1,960 @@
+#include "config.h"
+
+#include <curvecpr/queues.h>
+
+#include <curvecpr/block.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/message.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/slab.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sodium/crypto_uint32.h>
+#include <sodium/crypto_uint64.h>
+#include <sodium/randombytes.h>
+
+static struct curvecpr_queues_slot *_send_slot (struct curvecpr_queues *queues, const struct curvecpr_block *block)
+{
+    /* Blocks handed to the messager are always the first member of a slot, so we can
+       recover the slot (and make sure it's actually one of ours). */
+    const struct curvecpr_queues_slot *slot = (const struct curvecpr_queues_slot *)block;
+
+    if (slot < queues->send_slots || slot >= queues->send_slots + queues->cf.send_blocks)
+        return NULL;
+
+    return &queues->send_slots[slot - queues->send_slots];
+}
+
+/* Gives a slot room for num bytes of data, keeping what it already has. */
+static int _slot_reserve (struct curvecpr_queues *queues, struct curvecpr_queues_slot *slot, size_t num)
+{
+    unsigned char *storage;
+
+    if (num <= slot->storage_bytes)
+        return 0;
+
+    storage = curvecpr_slab_get(queues->slab, num);
+    if (!storage)
+        return -ENOMEM;
+
+    if (slot->storage) {
+        curvecpr_bytes_copy(storage, slot->storage, slot->block.data_len);
+        curvecpr_slab_put(queues->slab, slot->storage, slot->storage_bytes);
+    }
+
+    slot->storage = storage;
+    slot->storage_bytes = curvecpr_slab_chunk_bytes(num);
+    slot->block.data = storage;
+
+    return 0;
+}
+
+static void _slot_release (struct curvecpr_queues *queues, struct curvecpr_queues_slot *slot)
+{
+    if (slot->storage)
+        curvecpr_slab_put(queues->slab, slot->storage, slot->storage_bytes);
+
+    if (slot->block.payload)
+        curvecpr_block_payload_unref(slot->block.payload);
+
+    slot->storage = NULL;
+    slot->storage_bytes = 0;
+    slot->block.data = NULL;
+    slot->block.pieces = 0;
+    slot->block.payload = NULL;
+}
+
+/* Heap maintenance for the sendmarkq. */
+static void _heap_set (struct curvecpr_queues *queues, size_t i, struct curvecpr_queues_slot *slot)
+{
+    queues->sendmarkq[i] = slot;
+    slot->index = i;
+}
+
+static void _heap_up (struct curvecpr_queues *queues, size_t i)
+{
+    struct curvecpr_queues_slot *slot = queues->sendmarkq[i];
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+
+        if (queues->sendmarkq[parent]->block.clock <= slot->block.clock)
+            break;
+
+        _heap_set(queues, i, queues->sendmarkq[parent]);
+        i = parent;
+    }
+
+    _heap_set(queues, i, slot);
+}
+
+static void _heap_down (struct curvecpr_queues *queues, size_t i)
+{
+    struct curvecpr_queues_slot *slot = queues->sendmarkq[i];
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+
+        if (child >= queues->sendmarkq_len)
+            break;
+        if (child + 1 < queues->sendmarkq_len && queues->sendmarkq[child + 1]->block.clock < queues->sendmarkq[child]->block.clock)
+            ++child;
+
+        if (slot->block.clock <= queues->sendmarkq[child]->block.clock)
+            break;
+
+        _heap_set(queues, i, queues->sendmarkq[child]);
+        i = child;
+    }
+
+    _heap_set(queues, i, slot);
+}
+
+static void _heap_remove (struct curvecpr_queues *queues, size_t i)
+{
+    struct curvecpr_queues_slot *last = queues->sendmarkq[--queues->sendmarkq_len];
+
+    if (i == queues->sendmarkq_len)
+        return;
+
+    _heap_set(queues, i, last);
+    _heap_up(queues, i);
+    _heap_down(queues, last->index);
+}
+
+/* The offset index for the sendmarkq. Positions are relative to
+   sendmarkq_marks_head. */
+static struct curvecpr_queues_mark *_mark (struct curvecpr_queues *queues, size_t i)
+{
+    return &queues->sendmarkq_marks[(queues->sendmarkq_marks_head + i) % queues->cf.send_blocks];
+}
+
+static size_t _marks_search (struct curvecpr_queues *queues, crypto_uint64 offset)
+{
+    size_t low = 0, high = queues->sendmarkq_marks_len;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (_mark(queues, middle)->offset < offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/* The position of the first block still in the sendmarkq at or after position i,
+   or sendmarkq_marks_len if there isn't one. Runs of holes it steps over are
+   remembered, so they're only walked once. */
+static size_t _marks_next (struct curvecpr_queues *queues, size_t i)
+{
+    size_t next = i;
+
+    while (next < queues->sendmarkq_marks_len && !_mark(queues, next)->slot)
+        next += _mark(queues, next)->skip;
+
+    if (next > queues->sendmarkq_marks_len)
+        next = queues->sendmarkq_marks_len;
+
+    while (i < next) {
+        struct curvecpr_queues_mark *mark = _mark(queues, i);
+        size_t skip = mark->skip;
+
+        mark->skip = next - i;
+        i += skip;
+    }
+
+    return next;
+}
+
+static void _marks_push (struct curvecpr_queues *queues, struct curvecpr_queues_slot *slot)
+{
+    struct curvecpr_queues_mark *mark;
+
+    if (queues->sendmarkq_marks_len == queues->cf.send_blocks) {
+        /* Out of room, so there must be holes in the middle; squeeze them out. */
+        size_t i, kept = 0;
+
+        for (i = 0; i < queues->sendmarkq_marks_len; ++i) {
+            if (_mark(queues, i)->slot)
+                *_mark(queues, kept++) = *_mark(queues, i);
+        }
+
+        queues->sendmarkq_marks_len = kept;
+    }
+
+    mark = _mark(queues, queues->sendmarkq_marks_len++);
+    mark->offset = slot->block.offset;
+    mark->slot = slot;
+    mark->skip = 1;
+}
+
+/* The ID hash for the sendmarkq. IDs are handed out in sequence, so a multiplicative
+   hash spreads them well enough. */
+static size_t _ids_home (struct curvecpr_queues *queues, crypto_uint32 id)
+{
+    return (size_t)(crypto_uint32)(id * 2654435761U) & queues->sendmarkq_ids_mask;
+}
+
+static void _ids_insert (struct curvecpr_queues *queues, struct curvecpr_queues_slot *slot)
+{
+    size_t i = _ids_home(queues, slot->block.id);
+
+    while (queues->sendmarkq_ids[i])
+        i = (i + 1) & queues->sendmarkq_ids_mask;
+
+    queues->sendmarkq_ids[i] = slot;
+    slot->indexed_id = slot->block.id;
+}
+
+static void _ids_remove (struct curvecpr_queues *queues, struct curvecpr_queues_slot *slot)
+{
+    size_t hole = _ids_home(queues, slot->indexed_id), i;
+
+    while (queues->sendmarkq_ids[hole] != slot)
+        hole = (hole + 1) & queues->sendmarkq_ids_mask;
+
+    queues->sendmarkq_ids[hole] = NULL;
+
+    /* Pull back anything further along the run that can't be found past the hole
+       any more. */
+    for (i = (hole + 1) & queues->sendmarkq_ids_mask; queues->sendmarkq_ids[i]; i = (i + 1) & queues->sendmarkq_ids_mask) {
+        size_t home = _ids_home(queues, queues->sendmarkq_ids[i]->indexed_id);
+
+        if (hole <= i ? (hole < home && home <= i) : (hole < home || home <= i))
+            continue;
+
+        queues->sendmarkq_ids[hole] = queues->sendmarkq_ids[i];
+        queues->sendmarkq_ids[i] = NULL;
+        hole = i;
+    }
+}
+
+/* Binary search for the first recvmarkq position whose block offset is at least
+   offset. The result is relative to recvmarkq_head. */
+static size_t _recvmarkq_search (struct curvecpr_queues *queues, crypto_uint64 offset)
+{
+    struct curvecpr_queues_slot **recvmarkq = queues->recvmarkq + queues->recvmarkq_head;
+    size_t low = 0, high = queues->recvmarkq_len;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (recvmarkq[middle]->block.offset < offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/* Picks a height for a new range: each level is half as likely as the one below. */
+static unsigned int _ranges_levels (struct curvecpr_queues *queues)
+{
+    crypto_uint32 x = queues->recv_ranges_seed;
+    unsigned int levels = 1;
+
+    /* xorshift32. */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    queues->recv_ranges_seed = x;
+
+    while (levels < CURVECPR_QUEUES_RANGE_LEVELS && (x & 1)) {
+        ++levels;
+        x >>= 1;
+    }
+
+    return levels;
+}
+
+/* Finds the last range starting before offset (or at it, if inclusive), filling in
+   the last such range at every level. May return the list head. */
+static struct curvecpr_queues_range *_ranges_search (struct curvecpr_queues *queues, crypto_uint64 offset, int inclusive, struct curvecpr_queues_range **update)
+{
+    struct curvecpr_queues_range *range = &queues->recv_ranges_head;
+    int level;
+
+    for (level = CURVECPR_QUEUES_RANGE_LEVELS - 1; level >= 0; --level) {
+        struct curvecpr_queues_range *next;
+
+        while ((next = range->next[level]) && (next->start < offset || (inclusive && next->start == offset)))
+            range = next;
+
+        update[level] = range;
+    }
+
+    return range;
+}
+
+/* Links a new range in after update, which then points at it. */
+static struct curvecpr_queues_range *_ranges_insert (struct curvecpr_queues *queues, crypto_uint64 start, crypto_uint64 end, struct curvecpr_queues_range **update)
+{
+    struct curvecpr_queues_range *range = queues->recv_ranges_free[--queues->recv_ranges_free_len];
+    unsigned int level;
+
+    range->start = start;
+    range->end = end;
+    range->levels = _ranges_levels(queues);
+
+    for (level = 0; level < range->levels; ++level) {
+        range->next[level] = update[level]->next[level];
+        update[level]->next[level] = range;
+        update[level] = range;
+    }
+
+    return range;
+}
+
+static void _ranges_unlink (struct curvecpr_queues *queues, struct curvecpr_queues_range *range, struct curvecpr_queues_range **update)
+{
+    unsigned int level;
+
+    for (level = 0; level < range->levels; ++level) {
+        if (update[level]->next[level] == range)
+            update[level]->next[level] = range->next[level];
+    }
+
+    queues->recv_ranges_free[queues->recv_ranges_free_len++] = range;
+}
+
+/* Adds [start, end) to the runs of received data, merging it with any it touches. */
+static void _ranges_add (struct curvecpr_queues *queues, crypto_uint64 start, crypto_uint64 end)
+{
+    struct curvecpr_queues_range *update[CURVECPR_QUEUES_RANGE_LEVELS];
+    struct curvecpr_queues_range *range, *next;
+
+    range = _ranges_search(queues, start, 1, update);
+    if (range != &queues->recv_ranges_head && range->end >= start) {
+        if (range->end < end)
+            range->end = end;
+    } else {
+        range = _ranges_insert(queues, start, end, update);
+    }
+
+    /* Everything in update up to range's height is now range itself, so it's the
+       predecessor of whatever follows it at those levels. */
+    while ((next = range->next[0]) && next->start <= range->end) {
+        if (range->end < next->end)
+            range->end = next->end;
+
+        _ranges_unlink(queues, next, update);
+    }
+}
+
+/* Takes [start, end) out of the runs of received data. */
+static void _ranges_remove (struct curvecpr_queues *queues, crypto_uint64 start, crypto_uint64 end)
+{
+    struct curvecpr_queues_range *update[CURVECPR_QUEUES_RANGE_LEVELS];
+    struct curvecpr_queues_range *range, *next;
+
+    if (start >= end)
+        return;
+
+    range = _ranges_search(queues, start, 0, update);
+    if (range != &queues->recv_ranges_head && range->end > start) {
+        crypto_uint64 range_end = range->end;
+
+        range->end = start;
+
+        if (range_end > end) {
+            /* It was in the middle of this one, so that's all. */
+            _ranges_insert(queues, end, range_end, update);
+            return;
+        }
+    }
+
+    while ((next = range->next[0]) && next->start < end) {
+        if (next->end > end) {
+            next->start = end;
+            break;
+        }
+
+        _ranges_unlink(queues, next, update);
+    }
+}
+
+static int _sendq_head (struct curvecpr_messager *messager, struct curvecpr_block **block_stored)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+
+    if (!queues->sendq_len)
+        return 1;
+
+    *block_stored = &queues->sendq[queues->sendq_head]->block;
+
+    return 0;
+}
+
+static int _sendq_move_to_sendmarkq (struct curvecpr_messager *messager, const struct curvecpr_block *block, struct curvecpr_block **block_stored)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+    struct curvecpr_queues_slot *slot = _send_slot(queues, block);
+
+    if (!slot)
+        return 1;
+
+    if (slot->location == CURVECPR_QUEUES_SLOT_SENDMARKQ) {
+        /* This is a retransmission. The block is already where it should be, but its
+           clock moved forward, so it needs to be pushed back down the heap, and it was
+           sent under a new ID. */
+        _heap_down(queues, slot->index);
+
+        if (slot->indexed_id != slot->block.id) {
+            _ids_remove(queues, slot);
+            _ids_insert(queues, slot);
+        }
+
+        return 1;
+    }
+
+    if (slot->location != CURVECPR_QUEUES_SLOT_SENDQ || queues->sendq[queues->sendq_head] != slot)
+        return 1;
+
+    queues->sendq_head = (queues->sendq_head + 1) % queues->cf.send_blocks;
+    --queues->sendq_len;
+
+    slot->location = CURVECPR_QUEUES_SLOT_SENDMARKQ;
+    _heap_set(queues, queues->sendmarkq_len++, slot);
+    _heap_up(queues, slot->index);
+    _marks_push(queues, slot);
+    _ids_insert(queues, slot);
+
+    if (block_stored)
+        *block_stored = &slot->block;
+
+    return 0;
+}
+
+static unsigned char _sendq_is_empty (struct curvecpr_messager *messager)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+
+    return queues->sendq_len == 0;
+}
+
+static int _sendmarkq_head (struct curvecpr_messager *messager, struct curvecpr_block **block_stored)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+
+    if (!queues->sendmarkq_len)
+        return 1;
+
+    *block_stored = &queues->sendmarkq[0]->block;
+
+    return 0;
+}
+
+static int _sendmarkq_get (struct curvecpr_messager *messager, crypto_uint32 acknowledging_id, struct curvecpr_block **block_stored)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+    size_t i;
+
+    for (i = _ids_home(queues, acknowledging_id); queues->sendmarkq_ids[i]; i = (i + 1) & queues->sendmarkq_ids_mask) {
+        if (queues->sendmarkq_ids[i]->indexed_id == acknowledging_id) {
+            *block_stored = &queues->sendmarkq_ids[i]->block;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int _sendmarkq_remove_range (struct curvecpr_messager *messager, unsigned long long start, unsigned long long end)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+    size_t i;
+
+    /* Ranges are acknowledged over and over until they're contiguous with the start
+       of the stream, so step over what's already been removed from them. */
+    for (i = _marks_next(queues, _marks_search(queues, start)); i < queues->sendmarkq_marks_len; i = _marks_next(queues, i + 1)) {
+        struct curvecpr_queues_mark *mark = _mark(queues, i);
+        struct curvecpr_queues_slot *slot = mark->slot;
+
+        if (mark->offset >= end)
+            break;
+
+        if (slot->block.offset + slot->block.data_len > end)
+            continue;
+
+        _heap_remove(queues, slot->index);
+        _ids_remove(queues, slot);
+        _slot_release(queues, slot);
+
+        slot->location = CURVECPR_QUEUES_SLOT_FREE;
+        queues->send_free[queues->send_free_len++] = slot;
+
+        mark->slot = NULL;
+        mark->skip = 1;
+    }
+
+    /* Trim holes off both ends of the index. */
+    i = _marks_next(queues, 0);
+    queues->sendmarkq_marks_head = (queues->sendmarkq_marks_head + i) % queues->cf.send_blocks;
+    queues->sendmarkq_marks_len -= i;
+    while (queues->sendmarkq_marks_len && !_mark(queues, queues->sendmarkq_marks_len - 1)->slot)
+        --queues->sendmarkq_marks_len;
+
+    return 0;
+}
+
+static unsigned char _sendmarkq_is_full (struct curvecpr_messager *messager)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+
+    return queues->sendmarkq_len >= queues->cf.sendmarkq_blocks;
+}
+
+static int _recvmarkq_put (struct curvecpr_messager *messager, const struct curvecpr_block *block, struct curvecpr_block **block_stored)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+    struct curvecpr_queues_slot *slot;
+    size_t position;
+
+    position = _recvmarkq_search(queues, block->offset);
+    if (position < queues->recvmarkq_len) {
+        slot = queues->recvmarkq[queues->recvmarkq_head + position];
+
+        if (slot->block.offset == block->offset) {
+            /* Duplicate; we're already waiting to acknowledge this one. */
+            *block_stored = &slot->block;
+            return 0;
+        }
+    }
+
+    if (!queues->recv_free_len)
+        return 1;
+
+    slot = queues->recv_free[queues->recv_free_len - 1];
+    slot->block.data_len = 0;
+
+    if (block->data_len && _slot_reserve(queues, slot, block->data_len))
+        return 1;
+
+    --queues->recv_free_len;
+    slot->location = CURVECPR_QUEUES_SLOT_RECVMARKQ;
+
+    slot->block.id = block->id;
+    slot->block.clock = block->clock;
+    slot->block.offset = block->offset;
+    slot->block.eof = block->eof;
+    slot->block.data_len = block->data_len;
+    curvecpr_bytes_copy(slot->storage, block->data, block->data_len);
+
+    /* Make room at the end of the array if we've drifted all the way over. */
+    if (queues->recvmarkq_head + queues->recvmarkq_len == queues->cf.recv_blocks) {
+        memmove(queues->recvmarkq, queues->recvmarkq + queues->recvmarkq_head, queues->recvmarkq_len * sizeof(struct curvecpr_queues_slot *));
+        queues->recvmarkq_head = 0;
+    }
+
+    {
+        struct curvecpr_queues_slot **recvmarkq = queues->recvmarkq + queues->recvmarkq_head;
+
+        memmove(recvmarkq + position + 1, recvmarkq + position, (queues->recvmarkq_len - position) * sizeof(struct curvecpr_queues_slot *));
+        recvmarkq[position] = slot;
+        ++queues->recvmarkq_len;
+    }
+
+    _ranges_add(queues, block->offset, block->offset + block->data_len);
+
+    /* Hand the data off, unless it's entirely something we've already acknowledged. */
+    if (queues->cf.ops.recv && (block->offset + block->data_len > messager->their_contiguous_sent_bytes || block->eof != CURVECPR_BLOCK_STREAM))
+        queues->cf.ops.recv(messager, &slot->block);
+
+    *block_stored = &slot->block;
+
+    return 0;
+}
+
+static int _recvmarkq_get_nth_unacknowledged (struct curvecpr_messager *messager, unsigned int n, struct curvecpr_block **block_stored)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+
+    if (n >= queues->recvmarkq_len)
+        return 1;
+
+    *block_stored = &queues->recvmarkq[queues->recvmarkq_head + n]->block;
+
+    return 0;
+}
+
+static unsigned char _recvmarkq_is_empty (struct curvecpr_messager *messager)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+
+    return queues->recvmarkq_len == 0;
+}
+
+static int _recvmarkq_remove_range (struct curvecpr_messager *messager, unsigned long long start, unsigned long long end)
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+    struct curvecpr_queues_slot **recvmarkq = queues->recvmarkq + queues->recvmarkq_head;
+    size_t first, i, kept;
+
+    /* Everything we can remove is packed together starting at the first block at or
+       after start. */
+    first = _recvmarkq_search(queues, start);
+
+    /* Blocks that only partly overlap the range stay, so their data is put back once
+       it's been taken out. The acknowledged ranges the messager removes are made of
+       whole blocks, so normally there aren't any. Blocks from a stream don't overlap
+       each other, so only the one just before start can reach into the range. */
+    _ranges_remove(queues, start, end);
+
+    if (first > 0 && recvmarkq[first - 1]->block.offset + recvmarkq[first - 1]->block.data_len > start)
+        _ranges_add(queues, recvmarkq[first - 1]->block.offset, recvmarkq[first - 1]->block.offset + recvmarkq[first - 1]->block.data_len);
+
+    for (i = first, kept = first; i < queues->recvmarkq_len && recvmarkq[i]->block.offset < end; ++i) {
+        struct curvecpr_queues_slot *slot = recvmarkq[i];
+
+        if (slot->block.offset + slot->block.data_len <= end) {
+            _slot_release(queues, slot);
+
+            slot->location = CURVECPR_QUEUES_SLOT_FREE;
+            queues->recv_free[queues->recv_free_len++] = slot;
+        } else {
+            _ranges_add(queues, slot->block.offset, slot->block.offset + slot->block.data_len);
+            recvmarkq[kept++] = slot;
+        }
+    }
+
+    /* An empty block (an EOF) right at the end of the range stays too. */
+    if (i < queues->recvmarkq_len && recvmarkq[i]->block.offset == end && !recvmarkq[i]->block.data_len)
+        _ranges_add(queues, end, end);
+
+    if (i == kept)
+        return 0;
+
+    if (first == 0 && kept == 0) {
+        /* Common case: acknowledging from the front. */
+        queues->recvmarkq_head += i;
+    } else {
+        memmove(recvmarkq + kept, recvmarkq + i, (queues->recvmarkq_len - i) * sizeof(struct curvecpr_queues_slot *));
+    }
+
+    queues->recvmarkq_len -= i - kept;
+    if (!queues->recvmarkq_len)
+        queues->recvmarkq_head = 0;
+
+    return 0;
+}
+
+static unsigned int _recvmarkq_get_ranges (struct curvecpr_messager *messager, unsigned long long offset, struct curvecpr_message_range ranges[6])
+{
+    struct curvecpr_queues *queues = messager->cf.queues;
+    struct curvecpr_queues_range *update[CURVECPR_QUEUES_RANGE_LEVELS];
+    struct curvecpr_queues_range *range;
+    unsigned int n;
+
+    range = _ranges_search(queues, offset, 1, update);
+    if (range == &queues->recv_ranges_head || range->end <= offset)
+        range = range->next[0];
+
+    for (n = 0; range && n < 6; range = range->next[0], ++n) {
+        ranges[n].start = range->start;
+        ranges[n].end = range->end;
+    }
+
+    return n;
+}
+
+int curvecpr_queues_new (struct curvecpr_queues *queues, const struct curvecpr_queues_cf *cf)
+{
+    size_t i;
+
+    curvecpr_bytes_zero(queues, sizeof(struct curvecpr_queues));
+
+    if (cf)
+        curvecpr_bytes_copy(&queues->cf, cf, sizeof(struct curvecpr_queues_cf));
+
+    if (!queues->cf.send_blocks || !queues->cf.recv_blocks)
+        return -EINVAL;
+
+    if (!queues->cf.sendmarkq_blocks || queues->cf.sendmarkq_blocks > queues->cf.send_blocks)
+        queues->cf.sendmarkq_blocks = queues->cf.send_blocks;
+
+    if (queues->cf.slab) {
+        queues->slab = queues->cf.slab;
+    } else {
+        /* Small pages, since these are just for one messager. */
+        struct curvecpr_slab_cf slab_cf = { .page_bytes = 4096 };
+
+        if (curvecpr_slab_new(&queues->own_slab, &slab_cf))
+            return -EINVAL;
+
+        queues->slab = &queues->own_slab;
+    }
+
+    queues->send_slots = calloc(queues->cf.send_blocks, sizeof(struct curvecpr_queues_slot));
+    queues->send_free = calloc(queues->cf.send_blocks, sizeof(struct curvecpr_queues_slot *));
+    queues->sendq = calloc(queues->cf.send_blocks, sizeof(struct curvecpr_queues_slot *));
+    queues->sendmarkq = calloc(queues->cf.send_blocks, sizeof(struct curvecpr_queues_slot *));
+    queues->sendmarkq_marks = calloc(queues->cf.send_blocks, sizeof(struct curvecpr_queues_mark));
+
+    /* Kept at most half full, so probe runs stay short. */
+    queues->sendmarkq_ids_mask = 1;
+    while (queues->sendmarkq_ids_mask < 2 * queues->cf.send_blocks)
+        queues->sendmarkq_ids_mask <<= 1;
+    queues->sendmarkq_ids = calloc(queues->sendmarkq_ids_mask, sizeof(struct curvecpr_queues_slot *));
+    --queues->sendmarkq_ids_mask;
+
+    queues->recv_slots = calloc(queues->cf.recv_blocks, sizeof(struct curvecpr_queues_slot));
+    queues->recv_free = calloc(queues->cf.recv_blocks, sizeof(struct curvecpr_queues_slot *));
+    queues->recvmarkq = calloc(queues->cf.recv_blocks, sizeof(struct curvecpr_queues_slot *));
+    queues->recv_ranges = calloc(queues->cf.recv_blocks + 1, sizeof(struct curvecpr_queues_range));
+    queues->recv_ranges_free = calloc(queues->cf.recv_blocks + 1, sizeof(struct curvecpr_queues_range *));
+
+    if (!queues->send_slots || !queues->send_free || !queues->sendq || !queues->sendmarkq || !queues->sendmarkq_marks || !queues->sendmarkq_ids ||
+        !queues->recv_slots || !queues->recv_free || !queues->recvmarkq || !queues->recv_ranges || !queues->recv_ranges_free) {
+        curvecpr_queues_destroy(queues);
+        return -ENOMEM;
+    }
+
+    /* Hand out the lowest slots first. */
+    for (i = 0; i < queues->cf.send_blocks; ++i)
+        queues->send_free[i] = &queues->send_slots[queues->cf.send_blocks - i - 1];
+    queues->send_free_len = queues->cf.send_blocks;
+
+    for (i = 0; i < queues->cf.recv_blocks; ++i)
+        queues->recv_free[i] = &queues->recv_slots[queues->cf.recv_blocks - i - 1];
+    queues->recv_free_len = queues->cf.recv_blocks;
+
+    for (i = 0; i <= queues->cf.recv_blocks; ++i)
+        queues->recv_ranges_free[i] = &queues->recv_ranges[i];
+    queues->recv_ranges_free_len = queues->cf.recv_blocks + 1;
+
+    queues->recv_ranges_head.levels = CURVECPR_QUEUES_RANGE_LEVELS;
+
+    /* Range heights don't need to be unpredictable, just not chosen by the other side. */
+    randombytes((unsigned char *)&queues->recv_ranges_seed, sizeof(queues->recv_ranges_seed));
+    queues->recv_ranges_seed |= 1;
+
+    return 0;
+}
+
+void curvecpr_queues_destroy (struct curvecpr_queues *queues)
+{
+    size_t i;
+
+    /* Give data back to a shared slab. */
+    if (queues->send_slots) {
+        for (i = 0; i < queues->cf.send_blocks; ++i)
+            _slot_release(queues, &queues->send_slots[i]);
+    }
+    if (queues->recv_slots) {
+        for (i = 0; i < queues->cf.recv_blocks; ++i)
+            _slot_release(queues, &queues->recv_slots[i]);
+    }
+
+    if (queues->slab == &queues->own_slab)
+        curvecpr_slab_destroy(&queues->own_slab);
+
+    free(queues->send_slots);
+    free(queues->send_free);
+    free(queues->sendq);
+    free(queues->sendmarkq);
+    free(queues->sendmarkq_marks);
+    free(queues->sendmarkq_ids);
+    free(queues->recv_slots);
+    free(queues->recv_free);
+    free(queues->recvmarkq);
+    free(queues->recv_ranges);
+    free(queues->recv_ranges_free);
+
+    curvecpr_bytes_zero(queues, sizeof(struct curvecpr_queues));
+}
+
+void curvecpr_queues_configure (struct curvecpr_queues *queues, struct curvecpr_messager_cf *cf)
+{
+    cf->ops.sendq_head = _sendq_head;
+    cf->ops.sendq_move_to_sendmarkq = _sendq_move_to_sendmarkq;
+    cf->ops.sendq_is_empty = _sendq_is_empty;
+
+    cf->ops.sendmarkq_head = _sendmarkq_head;
+    cf->ops.sendmarkq_get = _sendmarkq_get;
+    cf->ops.sendmarkq_remove_range = _sendmarkq_remove_range;
+    cf->ops.sendmarkq_is_full = _sendmarkq_is_full;
+
+    cf->ops.recvmarkq_put = _recvmarkq_put;
+    cf->ops.recvmarkq_get_nth_unacknowledged = _recvmarkq_get_nth_unacknowledged;
+    cf->ops.recvmarkq_is_empty = _recvmarkq_is_empty;
+    cf->ops.recvmarkq_remove_range = _recvmarkq_remove_range;
+    cf->ops.recvmarkq_get_ranges = _recvmarkq_get_ranges;
+
+    cf->queues = queues;
+}
+
+/* Queues a copy of block to be sent. If the block has a payload, its data isn't
+   copied: the queues take a reference to the payload instead and send straight from
+   it, dropping the reference once the block is acknowledged. */
+int curvecpr_queues_sendq_put (struct curvecpr_queues *queues, const struct curvecpr_block *block)
+{
+    struct curvecpr_queues_slot *slot;
+    size_t num = 0;
+    unsigned int i;
+
+    if (block->data_len > CURVECPR_BLOCK_DATA || block->pieces > CURVECPR_BLOCK_PIECES)
+        return -EINVAL;
+
+    for (i = 0; i < block->pieces; ++i)
+        num += block->piece[i].len;
+
+    if (block->pieces && num != block->data_len)
+        return -EINVAL;
+
+    if (!queues->send_free_len || queues->sendq_len == queues->cf.send_blocks)
+        return -ENOBUFS;
+
+    slot = queues->send_free[queues->send_free_len - 1];
+    slot->block.data_len = 0;
+
+    if (!block->payload && block->data_len && _slot_reserve(queues, slot, block->data_len))
+        return -ENOMEM;
+
+    --queues->send_free_len;
+    slot->location = CURVECPR_QUEUES_SLOT_SENDQ;
+
+    /* The messager fills in the ID, clock and offset when the block is sent. */
+    slot->block.id = 0;
+    slot->block.clock = 0;
+    slot->block.offset = 0;
+    slot->block.eof = block->eof;
+    slot->block.data_len = block->data_len;
+
+    if (block->payload) {
+        slot->block.data = block->data;
+        slot->block.pieces = block->pieces;
+        curvecpr_bytes_copy(slot->block.piece, block->piece, block->pieces * sizeof(struct curvecpr_block_piece));
+        slot->block.payload = curvecpr_block_payload_ref(block->payload);
+    } else {
+        curvecpr_block_gather(block, slot->storage);
+    }
+
+    queues->sendq[(queues->sendq_head + queues->sendq_len) % queues->cf.send_blocks] = slot;
+    ++queues->sendq_len;
+
+    return 0;
+}
+
+/* Blocks that are still in the sendq haven't been sent, so they can still be added
+   to. */
+static struct curvecpr_queues_slot *_sendq_tail (struct curvecpr_queues *queues)
+{
+    if (!queues->sendq_len)
+        return NULL;
+
+    return queues->sendq[(queues->sendq_head + queues->sendq_len - 1) % queues->cf.send_blocks];
+}
+
+/* Appends stream data to the sendq, filling up the last block waiting there before
+   starting new ones of up to block_bytes each. Returns how much fit. */
+size_t curvecpr_queues_sendq_write (struct curvecpr_queues *queues, const unsigned char *buf, size_t num, size_t block_bytes)
+{
+    struct curvecpr_queues_slot *slot = _sendq_tail(queues);
+    size_t written = 0;
+
+    if (block_bytes > CURVECPR_BLOCK_DATA)
+        block_bytes = CURVECPR_BLOCK_DATA;
+
+    if (slot && slot->block.eof != CURVECPR_BLOCK_STREAM)
+        return 0;
+
+    while (written < num) {
+        size_t n;
+
+        /* Blocks sent from a payload can't be added to. */
+        if (!slot || slot->block.payload || slot->block.data_len >= block_bytes) {
+            if (!queues->send_free_len || queues->sendq_len == queues->cf.send_blocks)
+                break;
+
+            slot = queues->send_free[queues->send_free_len - 1];
+            slot->block.data_len = 0;
+
+            n = block_bytes < num - written ? block_bytes : num - written;
+            if (_slot_reserve(queues, slot, n))
+                break;
+
+            --queues->send_free_len;
+            slot->location = CURVECPR_QUEUES_SLOT_SENDQ;
+
+            slot->block.id = 0;
+            slot->block.clock = 0;
+            slot->block.offset = 0;
+            slot->block.eof = CURVECPR_BLOCK_STREAM;
+
+            queues->sendq[(queues->sendq_head + queues->sendq_len) % queues->cf.send_blocks] = slot;
+            ++queues->sendq_len;
+        }
+
+        n = block_bytes - slot->block.data_len;
+        if (n > num - written)
+            n = num - written;
+
+        /* Only take as much room as this write needs; the block moves up to a bigger
+           chunk if it's topped up later. */
+        if (_slot_reserve(queues, slot, slot->block.data_len + n))
+            break;
+
+        curvecpr_bytes_copy(slot->storage + slot->block.data_len, buf + written, n);
+        slot->block.data_len += n;
+        written += n;
+    }
+
+    return written;
+}
+
+/* Appends stream data to the sendq in new blocks of up to block_bytes each that are
+   sent straight from buf, which must lie within payload, instead of being copied.
+   Returns how much fit. */
+size_t curvecpr_queues_sendq_lend (struct curvecpr_queues *queues, struct curvecpr_block_payload *payload, const unsigned char *buf, size_t num, size_t block_bytes)
+{
+    struct curvecpr_queues_slot *slot = _sendq_tail(queues);
+    struct curvecpr_block block;
+    size_t written = 0;
+
+    if (block_bytes > CURVECPR_BLOCK_DATA)
+        block_bytes = CURVECPR_BLOCK_DATA;
+
+    if (slot && slot->block.eof != CURVECPR_BLOCK_STREAM)
+        return 0;
+
+    curvecpr_bytes_zero(&block, sizeof(struct curvecpr_block));
+    block.eof = CURVECPR_BLOCK_STREAM;
+    block.payload = payload;
+
+    while (written < num) {
+        block.data = buf + written;
+        block.data_len = block_bytes < num - written ? block_bytes : num - written;
+
+        if (curvecpr_queues_sendq_put(queues, &block))
+            break;
+
+        written += block.data_len;
+    }
+
+    return written;
+}
+
+/* Ends the stream, marking the last block waiting in the sendq if there is one. */
+int curvecpr_queues_sendq_close (struct curvecpr_queues *queues, enum curvecpr_block_eofflag eof)
+{
+    struct curvecpr_queues_slot *slot = _sendq_tail(queues);
+    struct curvecpr_block block;
+
+    if (slot && slot->block.eof == CURVECPR_BLOCK_STREAM) {
+        /* Send it along with the last of the data. */
+        slot->block.eof = eof;
+        return 0;
+    }
+
+    curvecpr_bytes_zero(&block, sizeof(struct curvecpr_block));
+    block.eof = eof;
+
+    return curvecpr_queues_sendq_put(queues, &block);
+}
@@ -0,0 +1,108 @@
+#include "config.h"
+
+#include <curvecpr/sendv.h>
+
+#include <curvecpr/bytes.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+int curvecpr_sendv_new (struct curvecpr_sendv *sendv, const struct curvecpr_sendv_cf *cf)
+{
+    curvecpr_bytes_zero(sendv, sizeof(struct curvecpr_sendv));
+
+    if (cf)
+        curvecpr_bytes_copy(&sendv->cf, cf, sizeof(struct curvecpr_sendv_cf));
+
+    if (!sendv->cf.packets || !sendv->cf.ops.flush)
+        return -EINVAL;
+
+    sendv->bufs = malloc(sendv->cf.packets * CURVECPR_SENDV_PACKET);
+    sendv->iov = calloc(sendv->cf.packets, sizeof(struct iovec));
+    sendv->privs = calloc(sendv->cf.packets, sizeof(void *));
+
+    if (!sendv->bufs || !sendv->iov || !sendv->privs) {
+        curvecpr_sendv_destroy(sendv);
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void curvecpr_sendv_destroy (struct curvecpr_sendv *sendv)
+{
+    if (sendv->bufs)
+        curvecpr_bytes_zero(sendv->bufs, sendv->cf.packets * CURVECPR_SENDV_PACKET);
+
+    free(sendv->bufs);
+    free(sendv->iov);
+    free(sendv->privs);
+
+    curvecpr_bytes_zero(sendv, sizeof(struct curvecpr_sendv));
+}
+
+/* Returns the CURVECPR_SENDV_PACKET bytes where the next packet should be built.
+   There's always room, because the vector is flushed as soon as it fills, except
+   during a flush, when this returns NULL. */
+unsigned char *curvecpr_sendv_next (struct curvecpr_sendv *sendv)
+{
+    if (sendv->flushing)
+        return NULL;
+
+    return sendv->bufs + sendv->len * CURVECPR_SENDV_PACKET;
+}
+
+/* Appends a packet, flushing if that fills the vector. Packets built anywhere inside
+   the CURVECPR_SENDV_PACKET bytes at curvecpr_sendv_next() are used where they are;
+   anything else is copied in. */
+int curvecpr_sendv_push (struct curvecpr_sendv *sendv, const unsigned char *packet, size_t num, void *priv)
+{
+    unsigned char *next = curvecpr_sendv_next(sendv);
+
+    /* The flush callback is still reading the packets we'd overwrite. */
+    if (!next)
+        return -EBUSY;
+
+    if (num > CURVECPR_SENDV_PACKET)
+        return -EMSGSIZE;
+
+    if (packet >= next && packet + num <= next + CURVECPR_SENDV_PACKET) {
+        sendv->iov[sendv->len].iov_base = next + (packet - next);
+    } else {
+        curvecpr_bytes_copy(next, packet, num);
+        sendv->iov[sendv->len].iov_base = next;
+    }
+
+    sendv->iov[sendv->len].iov_len = num;
+    sendv->privs[sendv->len] = priv;
+
+    if (++sendv->len == sendv->cf.packets)
+        return curvecpr_sendv_flush(sendv);
+
+    return 0;
+}
+
+/* Returns -EBUSY if called from the vector's own flush callback. */
+int curvecpr_sendv_flush (struct curvecpr_sendv *sendv)
+{
+    int result;
+
+    if (sendv->flushing)
+        return -EBUSY;
+
+    if (!sendv->len)
+        return 0;
+
+    sendv->flushing = 1;
+    result = sendv->cf.ops.flush(sendv, sendv->iov, (void *const *)sendv->privs, sendv->len);
+    sendv->flushing = 0;
+
+    /* Only now are the slots free again. */
+    sendv->len = 0;
+
+    if (result)
+        return -EINVAL;
+
+    return 0;
+}
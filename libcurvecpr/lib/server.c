@@ -6,6 +6,8 @@
 
 #include <sodium/randombytes.h>
 
+#include "atomic.h"
+
 void curvecpr_server_new (struct curvecpr_server *server, const struct curvecpr_server_cf *cf)
 {
     curvecpr_bytes_zero(server, sizeof(struct curvecpr_server));
@@ -24,3 +26,20 @@ void curvecpr_server_refresh_temporal_keys (struct curvecpr_server *server)
     curvecpr_bytes_copy(server->my_last_temporal_key, server->my_temporal_key, sizeof(server->my_last_temporal_key));
     randombytes(server->my_temporal_key, sizeof(server->my_temporal_key));
 }
+
+void curvecpr_server_temporal_keys_new (struct curvecpr_server_temporal_keys *keys)
+{
+    curvecpr_bytes_zero(keys, sizeof(struct curvecpr_server_temporal_keys));
+
+    randombytes(keys->keys[0], sizeof(keys->keys[0]));
+    randombytes(keys->keys[2], sizeof(keys->keys[2]));
+}
+
+/* Only one thread should refresh at a time, but any number may be reading. */
+void curvecpr_server_temporal_keys_refresh (struct curvecpr_server_temporal_keys *keys)
+{
+    unsigned int next = (_LOAD_RELAXED(&keys->current) + 1) % 3;
+
+    randombytes(keys->keys[next], sizeof(keys->keys[next]));
+    _STORE_RELEASE(&keys->current, next);
+}
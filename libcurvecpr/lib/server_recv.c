@@ -2,9 +2,16 @@
 
 #include <curvecpr/server.h>
 
+#include <curvecpr/admission.h>
 #include <curvecpr/bytes.h>
+#include <curvecpr/clock.h>
+#include <curvecpr/handshakes.h>
+#include <curvecpr/keycache.h>
+#include <curvecpr/keypairs.h>
 #include <curvecpr/session.h>
 #include <curvecpr/packet.h>
+#include <curvecpr/sendv.h>
+#include <curvecpr/sessions.h>
 
 #include <errno.h>
 #include <string.h>
@@ -12,6 +19,44 @@
 #include <sodium/crypto_box.h>
 #include <sodium/crypto_secretbox.h>
 
+#include "atomic.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define _PREFETCH(address) __builtin_prefetch(address)
+#else
+#define _PREFETCH(address)
+#endif
+
+/* Returns the current temporal key, and the previous one through last_key. */
+static const unsigned char *_temporal_keys (const struct curvecpr_server *server, const unsigned char **last_key)
+{
+    const struct curvecpr_server_temporal_keys *keys = server->cf.temporal_keys;
+
+    if (keys) {
+        unsigned int current = _LOAD_ACQUIRE(&keys->current);
+
+        *last_key = keys->keys[(current + 2) % 3];
+        return keys->keys[current];
+    }
+
+    *last_key = server->my_last_temporal_key;
+    return server->my_temporal_key;
+}
+
+static int _admit (struct curvecpr_server *server, void *priv)
+{
+    struct curvecpr_admission *admission = server->cf.admission;
+    unsigned char tag[CURVECPR_ADMISSION_TAG];
+    int known = 0;
+
+    curvecpr_bytes_zero(tag, sizeof(tag));
+
+    if (admission->cf.ops.source)
+        known = !admission->cf.ops.source(admission, priv, tag);
+
+    return curvecpr_admission_admit(admission, known ? tag : NULL, curvecpr_clock_now(server->cf.clock));
+}
+
 static int _handle_hello (struct curvecpr_server *server, void *priv, const struct curvecpr_packet_hello *p)
 {
     const struct curvecpr_server_cf *cf = &server->cf;
@@ -21,6 +66,10 @@ static int _handle_hello (struct curvecpr_server *server, void *priv, const stru
     unsigned char nonce[24];
     unsigned char data[96] = { 0 };
 
+    /* Shed load before spending any time on it. */
+    if (cf->admission && _admit(server, priv))
+        return -EAGAIN;
+
     /* Dummy initialization. */
     curvecpr_session_new(&s);
 
@@ -35,13 +84,15 @@ static int _handle_hello (struct curvecpr_server *server, void *priv, const stru
     if (crypto_box_open_afternm(data, data, 96, nonce, s.my_global_their_session_key))
         return -EINVAL;
 
-    /* Set up session keys. */
-    crypto_box_keypair(s.my_session_pk, s.my_session_sk);
+    /* Set up session keys, from the pool if there's one ready. */
+    if (!cf->keypairs || curvecpr_keypairs_take(cf->keypairs, s.my_session_pk, s.my_session_sk))
+        crypto_box_keypair(s.my_session_pk, s.my_session_sk);
 
     /* Prepare to send a cookie packet. */
     {
         struct curvecpr_packet_cookie po;
         struct curvecpr_packet_cookie_box po_box;
+        const unsigned char *last_temporal_key;
 
         curvecpr_bytes_zero(po_box._, 32);
         curvecpr_bytes_copy(po_box.server_session_pk, s.my_session_pk, 32);
@@ -56,7 +107,7 @@ static int _handle_hello (struct curvecpr_server *server, void *priv, const stru
         if (cf->ops.next_nonce(server, nonce + 8, 16))
             return -EINVAL;
 
-        crypto_secretbox(po_box.cookie, po_box.cookie, 96, nonce, server->my_temporal_key);
+        crypto_secretbox(po_box.cookie, po_box.cookie, 96, nonce, _temporal_keys(server, &last_temporal_key));
         curvecpr_bytes_copy(po_box.cookie, nonce + 8, 16);
 
         /* Now encrypt the whole box. */
@@ -71,129 +122,188 @@ static int _handle_hello (struct curvecpr_server *server, void *priv, const stru
         curvecpr_bytes_copy(po.nonce, nonce + 8, 16);
         curvecpr_bytes_copy(po.box, (const unsigned char *)&po_box + 16, 144);
 
-        if (cf->ops.send(server, &s, priv, (const unsigned char *)&po, sizeof(struct curvecpr_packet_cookie)))
+        if (cf->sendv) {
+            if (curvecpr_sendv_push(cf->sendv, (const unsigned char *)&po, sizeof(struct curvecpr_packet_cookie), priv))
+                return -EINVAL;
+        } else if (cf->ops.send(server, &s, priv, (const unsigned char *)&po, sizeof(struct curvecpr_packet_cookie))) {
             return -EINVAL;
+        }
     }
 
     return 0;
 }
 
-static int _handle_initiate (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const struct curvecpr_packet_initiate *p, const unsigned char *buf, size_t num, struct curvecpr_session **s_stored)
+/* Checks a new client's initiate packet: the cookie, the box and the vouch. On
+   success s_new is ready to be registered and data holds the opened box. Only reads
+   the server's configuration and temporal keys, so it can run on a worker thread. */
+static int _open_initiate (const struct curvecpr_server *server, struct curvecpr_session *s_new, unsigned char *data, const struct curvecpr_packet_initiate *p, const unsigned char *buf, size_t num)
 {
     const struct curvecpr_server_cf *cf = &server->cf;
 
     unsigned char nonce[24];
-    unsigned char data[sizeof(struct curvecpr_packet_initiate_box) + 640];
+    const struct curvecpr_packet_initiate_box *p_box;
+    const unsigned char *temporal_key, *last_temporal_key;
 
-    if (s != NULL) {
-        /* Update existing client. */
-        crypto_uint64 unpacked_nonce = curvecpr_bytes_unpack_uint64(p->nonce);
-        if (unpacked_nonce <= s->their_session_nonce)
-            return -EINVAL;
+    curvecpr_bytes_copy(nonce, "minute-k", 8);
+    curvecpr_bytes_copy(nonce + 8, p->cookie, 16);
 
-        curvecpr_bytes_copy(nonce, "CurveCP-client-I", 16);
-        curvecpr_bytes_copy(nonce + 16, p->nonce, 8);
+    /* We can reuse data; the cookie will fit into it. */
+    curvecpr_bytes_zero(data, 16);
+    curvecpr_bytes_copy(data + 16, p->cookie + 16, 80);
 
+    /* Validate cookie. */
+    temporal_key = _temporal_keys(server, &last_temporal_key);
+    if (crypto_secretbox_open(data, data, 96, nonce, temporal_key)) {
         curvecpr_bytes_zero(data, 16);
-        curvecpr_bytes_copy(data + 16, buf, num);
-
-        if (crypto_box_open_afternm(data, data, num + 16, nonce, s->my_session_their_session_key))
+        curvecpr_bytes_copy(data + 16, p->cookie + 16, 80);
+        if (crypto_secretbox_open(data, data, 96, nonce, last_temporal_key))
             return -EINVAL;
+    }
 
-        s->their_session_nonce = unpacked_nonce;
+    if (!curvecpr_bytes_equal(p->client_session_pk, data + 32, 32))
+        return -EINVAL;
 
-        if (cf->ops.recv(server, s, priv, data + sizeof(struct curvecpr_packet_initiate_box), num + 16 - sizeof(struct curvecpr_packet_initiate_box)))
-            return -EINVAL;
+    /* Cookie is valid; set up keys. */
+    curvecpr_session_new(s_new);
 
-        return 0;
-    } else {
-        struct curvecpr_session s_new, *s_new_stored;
-        const struct curvecpr_packet_initiate_box *p_box;
+    curvecpr_bytes_copy(s_new->their_session_pk, data + 32, 32);
+    curvecpr_bytes_copy(s_new->my_session_sk, data + 64, 32);
 
-        /* Register new client. */
-        curvecpr_bytes_copy(nonce, "minute-k", 8);
-        curvecpr_bytes_copy(nonce + 8, p->cookie, 16);
+    crypto_box_beforenm(s_new->my_session_their_session_key, s_new->their_session_pk, s_new->my_session_sk);
 
-        /* We can reuse data; the cookie will fit into it. */
-        curvecpr_bytes_zero(data, 16);
-        curvecpr_bytes_copy(data + 16, p->cookie + 16, 80);
+    curvecpr_bytes_copy(nonce, "CurveCP-client-I", 16);
+    curvecpr_bytes_copy(nonce + 16, p->nonce, 8);
 
-        /* Validate cookie. */
-        if (crypto_secretbox_open(data, data, 96, nonce, server->my_temporal_key)) {
-            curvecpr_bytes_zero(data, 16);
-            curvecpr_bytes_copy(data + 16, p->cookie + 16, 80);
-            if (crypto_secretbox_open(data, data, 96, nonce, server->my_last_temporal_key))
-                return -EINVAL;
-        }
+    curvecpr_bytes_zero(data, 16);
+    curvecpr_bytes_copy(data + 16, buf, num);
 
-        if (!curvecpr_bytes_equal(p->client_session_pk, data + 32, 32))
-            return -EINVAL;
+    if (crypto_box_open_afternm(data, data, num + 16, nonce, s_new->my_session_their_session_key))
+        return -EINVAL;
 
-        /* Cookie is valid; set up keys. */
-        curvecpr_session_new(&s_new);
+    p_box = (const struct curvecpr_packet_initiate_box *)data;
 
-        curvecpr_bytes_copy(s_new.their_session_pk, data + 32, 32);
-        curvecpr_bytes_copy(s_new.my_session_sk, data + 64, 32);
+    /* Attempt to validate this client. */
+    {
+        unsigned char vouch[64];
 
-        crypto_box_beforenm(s_new.my_session_their_session_key, s_new.their_session_pk, s_new.my_session_sk);
+        curvecpr_bytes_copy(s_new->their_global_pk, p_box->client_global_pk, 32);
+        if (cf->keycache)
+            curvecpr_keycache_beforenm(cf->keycache, s_new->my_global_their_global_key, s_new->their_global_pk, cf->my_global_sk);
+        else
+            crypto_box_beforenm(s_new->my_global_their_global_key, s_new->their_global_pk, cf->my_global_sk);
 
-        curvecpr_bytes_copy(nonce, "CurveCP-client-I", 16);
-        curvecpr_bytes_copy(nonce + 16, p->nonce, 8);
+        curvecpr_bytes_copy(nonce, "CurveCPV", 8);
+        curvecpr_bytes_copy(nonce + 8, p_box->nonce, 16);
 
-        curvecpr_bytes_zero(data, 16);
-        curvecpr_bytes_copy(data + 16, buf, num);
+        curvecpr_bytes_zero(vouch, 16);
+        curvecpr_bytes_copy(vouch + 16, p_box->vouch, 48);
 
-        if (crypto_box_open_afternm(data, data, num + 16, nonce, s_new.my_session_their_session_key))
+        if (crypto_box_afternm(vouch, vouch, 64, nonce, s_new->my_global_their_global_key))
             return -EINVAL;
 
-        p_box = (struct curvecpr_packet_initiate_box *)data;
+        if (!curvecpr_bytes_equal(vouch + 32, s_new->their_session_pk, 32))
+            return -EINVAL;
+    }
 
-        /* Attempt to validate this client. */
-        {
-            unsigned char vouch[64];
+    s_new->their_session_nonce = curvecpr_bytes_unpack_uint64(p->nonce);
+    curvecpr_bytes_copy(s_new->their_extension, p->client_extension, 16);
+    curvecpr_bytes_copy(s_new->my_domain_name, p_box->server_domain_name, 256);
 
-            curvecpr_bytes_copy(s_new.their_global_pk, p_box->client_global_pk, 32);
-            crypto_box_beforenm(s_new.my_global_their_global_key, s_new.their_global_pk, cf->my_global_sk);
+    return 0;
+}
 
-            curvecpr_bytes_copy(nonce, "CurveCPV", 8);
-            curvecpr_bytes_copy(nonce + 8, p_box->nonce, 16);
+/* Submits a client checked by _open_initiate() for registration, then passes on the
+   message that came with it. */
+static int _register (struct curvecpr_server *server, const struct curvecpr_session *s_new, void *priv, const unsigned char *data, size_t num, struct curvecpr_session **s_stored)
+{
+    const struct curvecpr_server_cf *cf = &server->cf;
+    struct curvecpr_session *s_new_stored;
 
-            curvecpr_bytes_zero(vouch, 16);
-            curvecpr_bytes_copy(vouch + 16, p_box->vouch, 48);
+    if (cf->ops.put_session(server, s_new, priv, &s_new_stored))
+        return -EINVAL; /* This can fail for a variety of reasons that are up to
+                           the delegate to determine, but two typical ones will be
+                           too many connections or an invalid domain name. */
 
-            if (crypto_box_afternm(vouch, vouch, 64, nonce, s_new.my_global_their_global_key))
-                return -EINVAL;
+    /* Now the session is registered; we can send the encapsulated message. */
+    if (cf->ops.recv(server, s_new_stored, priv, data + sizeof(struct curvecpr_packet_initiate_box), num + 16 - sizeof(struct curvecpr_packet_initiate_box)))
+        return -EINVAL;
 
-            if (!curvecpr_bytes_equal(vouch + 32, s_new.their_session_pk, 32))
-                return -EINVAL;
-        }
+    if (s_stored)
+        *s_stored = s_new_stored;
+
+    return 0;
+}
 
-        /* All good, we can go ahead and submit the client for registration. */
-        s_new.their_session_nonce = curvecpr_bytes_unpack_uint64(p->nonce);
-        curvecpr_bytes_copy(s_new.my_domain_name, p_box->server_domain_name, 256);
+static int _handle_initiate (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const struct curvecpr_packet_initiate *p, const unsigned char *buf, size_t num, struct curvecpr_session **s_stored)
+{
+    const struct curvecpr_server_cf *cf = &server->cf;
 
-        if (cf->ops.put_session(server, &s_new, priv, &s_new_stored))
-            return -EINVAL; /* This can fail for a variety of reasons that are up to
-                               the delegate to determine, but two typical ones will be
-                               too many connections or an invalid domain name. */
+    unsigned char nonce[24];
+    unsigned char data[sizeof(struct curvecpr_packet_initiate_box) + 640];
 
-        /* Now the session is registered; we can send the encapsulated message. */
-        if (cf->ops.recv(server, s_new_stored, priv, data + sizeof(struct curvecpr_packet_initiate_box), num + 16 - sizeof(struct curvecpr_packet_initiate_box)))
+    if (s != NULL) {
+        /* Update existing client. */
+        crypto_uint64 unpacked_nonce = curvecpr_bytes_unpack_uint64(p->nonce);
+        if (unpacked_nonce <= s->their_session_nonce)
+            return -EINVAL;
+
+        curvecpr_bytes_copy(nonce, "CurveCP-client-I", 16);
+        curvecpr_bytes_copy(nonce + 16, p->nonce, 8);
+
+        curvecpr_bytes_zero(data, 16);
+        curvecpr_bytes_copy(data + 16, buf, num);
+
+        if (crypto_box_open_afternm(data, data, num + 16, nonce, s->my_session_their_session_key))
             return -EINVAL;
 
-        if (s_stored)
-            *s_stored = s_new_stored;
+        s->their_session_nonce = unpacked_nonce;
+
+        if (cf->ops.recv(server, s, priv, data + sizeof(struct curvecpr_packet_initiate_box), num + 16 - sizeof(struct curvecpr_packet_initiate_box)))
+            return -EINVAL;
 
         return 0;
+    } else if (cf->handshakes) {
+        /* Register new client, later. */
+        struct curvecpr_handshakes_job *job = curvecpr_handshakes_reserve(cf->handshakes);
+        if (!job)
+            return -ENOBUFS;
+
+        job->server = server;
+        job->priv = priv;
+
+        /* The caller's priv may not outlive this call. */
+        if (priv && cf->handshakes->cf.priv_bytes) {
+            curvecpr_bytes_copy(job->priv_copy, priv, cf->handshakes->cf.priv_bytes);
+            job->priv = job->priv_copy;
+        }
+        job->num = sizeof(struct curvecpr_packet_initiate) + num;
+        curvecpr_bytes_copy(job->packet, p, job->num);
+
+        curvecpr_handshakes_submit(cf->handshakes, job);
+
+        return -EINPROGRESS;
+    } else {
+        struct curvecpr_session s_new;
+        int result;
+
+        /* Register new client. */
+        result = _open_initiate(server, &s_new, data, p, buf, num);
+        if (result)
+            return result;
+
+        return _register(server, &s_new, priv, data, num, s_stored);
     }
 }
 
-static int _handle_client_message (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const struct curvecpr_packet_client_message *p, const unsigned char *buf, size_t num)
+/* If inplace is set, it's a writable alias of buf and the box is opened right there;
+   otherwise it's copied out first. */
+static int _handle_client_message (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const struct curvecpr_packet_client_message *p, const unsigned char *buf, size_t num, unsigned char *inplace)
 {
     const struct curvecpr_server_cf *cf = &server->cf;
 
     unsigned char nonce[24];
-    unsigned char data[1120];
+    unsigned char data_local[1104];
+    unsigned char *data = inplace ? inplace : data_local;
 
     crypto_uint64 unpacked_nonce = curvecpr_bytes_unpack_uint64(p->nonce);
     if (unpacked_nonce <= s->their_session_nonce)
@@ -202,21 +312,23 @@ static int _handle_client_message (struct curvecpr_server *server, struct curvec
     curvecpr_bytes_copy(nonce, "CurveCP-client-M", 16);
     curvecpr_bytes_copy(nonce + 16, p->nonce, 8);
 
-    curvecpr_bytes_zero(data, 16);
-    curvecpr_bytes_copy(data + 16, buf, num);
+    if (!inplace)
+        curvecpr_bytes_copy(data, buf, num);
 
-    if (crypto_box_open_afternm(data, data, num + 16, nonce, s->my_session_their_session_key))
+    if (crypto_box_open_detached_afternm(data + 16, data + 16, data, num - 16, nonce, s->my_session_their_session_key))
         return -EINVAL;
 
     s->their_session_nonce = unpacked_nonce;
 
-    if (cf->ops.recv(server, s, priv, data + 32, num - 16))
+    if (cf->ops.recv(server, s, priv, data + 16, num - 16))
         return -EINVAL;
 
     return 0;
 }
 
-int curvecpr_server_recv (struct curvecpr_server *server, void *priv, const unsigned char *buf, size_t num, struct curvecpr_session **s_stored)
+/* Checks the parts of the packet common to every type, and returns the type ('H', 'I'
+   or 'M') if it's something we might be able to handle. */
+static int _classify (const struct curvecpr_server *server, const unsigned char *buf, size_t num)
 {
     const struct curvecpr_server_cf *cf = &server->cf;
 
@@ -231,55 +343,277 @@ int curvecpr_server_recv (struct curvecpr_server *server, void *priv, const unsi
         return -EINVAL;
 
     if (p->id[7] == 'H') {
-        /* Hello packet. */
         if (num != sizeof(struct curvecpr_packet_hello))
             return -EINVAL;
-
-        return _handle_hello(server, priv, (const struct curvecpr_packet_hello *)buf);
     } else if (p->id[7] == 'I') {
-        /* Initiate packet. */
-        struct curvecpr_session *s = NULL;
-        const struct curvecpr_packet_initiate *p_initiate;
-
         if (num < 560)
             return -EINVAL;
+    } else if (p->id[7] == 'M') {
+        if (num < 112)
+            return -EINVAL;
+    } else {
+        return -EINVAL;
+    }
 
-        p_initiate = (const struct curvecpr_packet_initiate *)buf;
+    return p->id[7];
+}
+
+/* Handles an Initiate or Message packet once we've looked up its session (which may
+   be NULL). Messages are decrypted in place if inplace (a writable alias of buf) is
+   given. */
+static int _dispatch (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, int type, const unsigned char *buf, size_t num, unsigned char *inplace, struct curvecpr_session **s_stored)
+{
+    if (type == 'I') {
+        struct curvecpr_session *s_return = NULL;
+        int result = _handle_initiate(server, s, priv, (const struct curvecpr_packet_initiate *)buf, buf + sizeof(struct curvecpr_packet_initiate), num - sizeof(struct curvecpr_packet_initiate), &s_return);
 
-        /* Try to get session. */
-        cf->ops.get_session(server, p_initiate->client_session_pk, &s);
+        if (result == 0 && s_stored)
+            *s_stored = s ? s : s_return;
 
-        {
-            struct curvecpr_session *s_return = NULL;
-            int result = _handle_initiate(server, s, priv, p_initiate, buf + sizeof(struct curvecpr_packet_initiate), num - sizeof(struct curvecpr_packet_initiate), &s_return);
+        return result;
+    } else {
+        int result;
 
-            if (result == 0 && s_stored)
-                *s_stored = s_return;
+        if (s == NULL)
+            return -EINVAL;
 
-            return result;
+        result = _handle_client_message(server, s, priv, (const struct curvecpr_packet_client_message *)buf, buf + sizeof(struct curvecpr_packet_client_message), num - sizeof(struct curvecpr_packet_client_message), inplace ? inplace + sizeof(struct curvecpr_packet_client_message) : NULL);
+
+        if (result == 0 && s_stored)
+            *s_stored = s;
+
+        return result;
+    }
+}
+
+static int _recv (struct curvecpr_server *server, void *priv, const unsigned char *buf, size_t num, unsigned char *inplace, struct curvecpr_session **s_stored)
+{
+    const struct curvecpr_server_cf *cf = &server->cf;
+
+    struct curvecpr_session *s = NULL;
+    int type = _classify(server, buf, num);
+
+    if (type < 0)
+        return type;
+
+    if (type == 'H')
+        return _handle_hello(server, priv, (const struct curvecpr_packet_hello *)buf);
+
+    if (cf->sessions)
+        curvecpr_sessions_refresh_clock(cf->sessions);
+
+    /* Initiate and Message packets both need the session, if there is one. The
+       client session key is in the same place in both. */
+    if (cf->ops.get_session(server, ((const struct curvecpr_packet_client_message *)buf)->client_session_pk, &s))
+        s = NULL;
+
+    return _dispatch(server, s, priv, type, buf, num, inplace, s_stored);
+}
+
+int curvecpr_server_recv (struct curvecpr_server *server, void *priv, const unsigned char *buf, size_t num, struct curvecpr_session **s_stored)
+{
+    return _recv(server, priv, buf, num, NULL, s_stored);
+}
+
+/* Like curvecpr_server_recv(), but decrypts messages in place; ops.recv is given a
+   pointer into buf. */
+int curvecpr_server_recv_inplace (struct curvecpr_server *server, void *priv, unsigned char *buf, size_t num, struct curvecpr_session **s_stored)
+{
+    return _recv(server, priv, buf, num, buf, s_stored);
+}
+
+static const unsigned char *_session_pk (const struct curvecpr_server_packet *packet)
+{
+    return ((const struct curvecpr_packet_client_message *)packet->buf)->client_session_pk;
+}
+
+/* How many sessions the built-in table has dropped. Always 0 for custom tables. */
+static unsigned long long _drops (const struct curvecpr_server *server)
+{
+    return server->cf.sessions ? server->cf.sessions->drops : 0;
+}
+
+static size_t _recv_batch (struct curvecpr_server *server, struct curvecpr_server_packet *packets, size_t num_packets)
+{
+    const struct curvecpr_server_cf *cf = &server->cf;
+
+    unsigned char order[CURVECPR_SERVER_BATCH];
+    unsigned char group_ends[CURVECPR_SERVER_BATCH];
+    struct curvecpr_session *group_sessions[CURVECPR_SERVER_BATCH];
+    size_t num_order = 0, num_groups = 0, handled = 0;
+    unsigned long long drops;
+    size_t i, j;
+
+    /* Validate everything, and get hellos (which have no session) out of the way. */
+    for (i = 0; i < num_packets; ++i) {
+        struct curvecpr_server_packet *packet = &packets[i];
+
+        packet->s = NULL;
+        packet->result = _classify(server, packet->buf, packet->num);
+
+        if (packet->result == 'H') {
+            packet->result = _handle_hello(server, packet->priv, (const struct curvecpr_packet_hello *)packet->buf);
+            if (packet->result == 0)
+                ++handled;
+        } else if (packet->result > 0) {
+            /* Insertion sort by session key. It's stable, so packets for the same
+               session keep their relative order (which matters for nonces). */
+            for (j = num_order; j > 0 && memcmp(_session_pk(&packets[order[j - 1]]), _session_pk(packet), 32) > 0; --j)
+                order[j] = order[j - 1];
+
+            order[j] = (unsigned char)i;
+            ++num_order;
         }
-    } else if (p->id[7] == 'M') {
-        /* Client message packet. */
+    }
+
+    /* Look up each distinct session once, and start pulling the session state into
+       cache while we look up the rest. */
+    for (i = 0; i < num_order; i = group_ends[num_groups++]) {
+        const unsigned char *session_pk = _session_pk(&packets[order[i]]);
         struct curvecpr_session *s = NULL;
-        const struct curvecpr_packet_client_message *p_message;
 
-        if (num < 112)
-            return -EINVAL;
+        for (j = i + 1; j < num_order && memcmp(_session_pk(&packets[order[j]]), session_pk, 32) == 0; ++j) {}
+        group_ends[num_groups] = (unsigned char)j;
 
-        p_message = (const struct curvecpr_packet_client_message *)buf;
+        if (cf->ops.get_session(server, session_pk, &s))
+            s = NULL;
 
-        if (cf->ops.get_session(server, p_message->client_session_pk, &s))
-            return -EINVAL;
+        if (s) {
+            _PREFETCH(s->my_session_their_session_key);
+            _PREFETCH(&s->their_session_nonce);
+        }
+
+        group_sessions[num_groups] = s;
+    }
 
-        {
-            int result = _handle_client_message(server, s, priv, p_message, buf + sizeof(struct curvecpr_packet_client_message), num - sizeof(struct curvecpr_packet_client_message));
+    /* Now actually do the work. */
+    drops = _drops(server);
 
-            if (result == 0 && s_stored)
-                *s_stored = s;
+    for (i = 0, j = 0; i < num_groups; ++i) {
+        struct curvecpr_session *s = group_sessions[i];
+        unsigned long long s_drops = drops;
 
-            return result;
+        for (; j < group_ends[i]; ++j) {
+            struct curvecpr_server_packet *packet = &packets[order[j]];
+
+            /* A callback (or making room for a new session) may have dropped this
+               one since we looked it up. */
+            if (_drops(server) != s_drops) {
+                s_drops = _drops(server);
+
+                if (cf->ops.get_session(server, _session_pk(packet), &s))
+                    s = NULL;
+            }
+
+            packet->result = _dispatch(server, s, packet->priv, packet->result, packet->buf, packet->num, NULL, &packet->s);
+
+            if (packet->result == 0) {
+                /* An initiate may have just registered this session. */
+                s = packet->s;
+                ++handled;
+            }
         }
     }
 
-    return -EINVAL;
+    return handled;
+}
+
+size_t curvecpr_server_recv_batch (struct curvecpr_server *server, struct curvecpr_server_packet *packets, size_t num_packets)
+{
+    size_t handled = 0;
+
+    /* Every lookup in the batch happens at the same time, as far as the session
+       table is concerned. */
+    if (server->cf.sessions)
+        curvecpr_sessions_refresh_clock(server->cf.sessions);
+
+    while (num_packets > 0) {
+        size_t num = num_packets < CURVECPR_SERVER_BATCH ? num_packets : CURVECPR_SERVER_BATCH;
+
+        handled += _recv_batch(server, packets, num);
+
+        packets += num;
+        num_packets -= num;
+    }
+
+    /* Send out any cookies and replies generated along the way. */
+    if (server->cf.sendv)
+        curvecpr_sendv_flush(server->cf.sendv);
+
+    return handled;
+}
+
+/* Called by worker threads: validates up to max offloaded initiates (see
+   curvecpr/handshakes.h) and returns how many there were. */
+size_t curvecpr_server_handshakes_work (struct curvecpr_handshakes *handshakes, size_t max)
+{
+    size_t worked = 0;
+
+    while (worked < max) {
+        struct curvecpr_handshakes_job *job = curvecpr_handshakes_claim(handshakes);
+        const struct curvecpr_packet_initiate *p;
+
+        if (!job)
+            break;
+
+        p = (const struct curvecpr_packet_initiate *)job->packet;
+        job->result = _open_initiate(job->server, &job->session, job->data, p, job->packet + sizeof(struct curvecpr_packet_initiate), job->num - sizeof(struct curvecpr_packet_initiate));
+
+        curvecpr_handshakes_finish(handshakes, job);
+        ++worked;
+    }
+
+    return worked;
+}
+
+/* Called by the receive thread: registers up to max clients whose initiates the
+   workers have finished with, and returns how many jobs were completed. */
+size_t curvecpr_server_handshakes_complete (struct curvecpr_server *server, size_t max)
+{
+    const struct curvecpr_server_cf *cf = &server->cf;
+    struct curvecpr_handshakes *handshakes = cf->handshakes;
+    size_t completed = 0;
+
+    if (!handshakes)
+        return 0;
+
+    while (completed < max) {
+        struct curvecpr_handshakes_job *job = curvecpr_handshakes_collect(handshakes);
+        struct curvecpr_session *s = NULL;
+        size_t num;
+        int result;
+
+        if (!job)
+            break;
+
+        num = job->num - sizeof(struct curvecpr_packet_initiate);
+        result = job->result;
+
+        if (result == 0) {
+            if (cf->ops.get_session(server, job->session.their_session_pk, &s)) {
+                s = NULL;
+                result = _register(server, &job->session, job->priv, job->data, num, &s);
+            } else if (job->session.their_session_nonce <= s->their_session_nonce) {
+                /* The client got in while this was queued, and this initiate is
+                   stale. */
+                result = -EINVAL;
+            } else {
+                s->their_session_nonce = job->session.their_session_nonce;
+
+                if (cf->ops.recv(server, s, job->priv, job->data + sizeof(struct curvecpr_packet_initiate_box), num + 16 - sizeof(struct curvecpr_packet_initiate_box)))
+                    result = -EINVAL;
+            }
+        }
+
+        if (handshakes->cf.ops.complete)
+            handshakes->cf.ops.complete(handshakes, server, result == 0 ? s : NULL, job->priv, result);
+
+        curvecpr_handshakes_release(handshakes, job);
+        ++completed;
+    }
+
+    if (cf->sendv)
+        curvecpr_sendv_flush(cf->sendv);
+
+    return completed;
 }
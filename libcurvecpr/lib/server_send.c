@@ -4,6 +4,7 @@
 
 #include <curvecpr/bytes.h>
 #include <curvecpr/packet.h>
+#include <curvecpr/sendv.h>
 #include <curvecpr/session.h>
 
 #include <errno.h>
@@ -11,41 +12,65 @@
 
 #include <sodium/crypto_box.h>
 
-int curvecpr_server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+/* Encrypts the num bytes following the headroom at p_raw in place, then fills in
+   the headroom, so the whole packet ends up at p_raw without any copying. */
+static int _send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, unsigned char *p_raw, size_t num)
 {
     const struct curvecpr_server_cf *cf = &server->cf;
 
     unsigned char nonce[24];
-    unsigned char p_raw[sizeof(struct curvecpr_packet_server_message) + 1104];
-    unsigned char data[1120];
-
-    struct curvecpr_packet_server_message *p;
+    unsigned char *data = p_raw + CURVECPR_SERVER_HEADROOM;
 
-    if (num < 16 || num > 1088 || num & 15)
-        return -EMSGSIZE;
+    struct curvecpr_packet_server_message *p = (struct curvecpr_packet_server_message *)p_raw;
 
     /* Build the box. */
     curvecpr_bytes_copy(nonce, "CurveCP-server-M", 16);
     curvecpr_session_next_nonce(s, nonce + 16);
 
-    curvecpr_bytes_zero(data, 32);
-    curvecpr_bytes_copy(data + 32, buf, num);
-
-    crypto_box_afternm(data, data, num + 32, nonce, s->my_session_their_session_key);
+    crypto_box_detached_afternm(data, data - 16, data, num, nonce, s->my_session_their_session_key);
 
     /* Build the rest of the packet. */
-    p = (struct curvecpr_packet_server_message *)p_raw;
-
     curvecpr_bytes_copy(p->id, "RL3aNMXM", 8);
     curvecpr_bytes_copy(p->client_extension, s->their_extension, 16);
     curvecpr_bytes_copy(p->server_extension, cf->my_extension, 16);
     curvecpr_bytes_copy(p->nonce, nonce + 16, 8);
 
-    curvecpr_bytes_copy(p_raw + sizeof(struct curvecpr_packet_server_message), data + 16, num + 16);
-
     /* Fire away! */
-    if (cf->ops.send(server, s, priv, p_raw, sizeof(struct curvecpr_packet_server_message) + num + 16))
+    if (cf->sendv) {
+        if (curvecpr_sendv_push(cf->sendv, p_raw, CURVECPR_SERVER_HEADROOM + num, priv))
+            return -EINVAL;
+    } else if (cf->ops.send(server, s, priv, p_raw, CURVECPR_SERVER_HEADROOM + num)) {
         return -EINVAL;
+    }
 
     return 0;
 }
+
+int curvecpr_server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    const struct curvecpr_server_cf *cf = &server->cf;
+
+    unsigned char p_local[CURVECPR_SERVER_HEADROOM + 1088];
+
+    /* When batching, build the packet right where it'll be sent from. */
+    unsigned char *p_raw = cf->sendv ? curvecpr_sendv_next(cf->sendv) : p_local;
+
+    if (num < 16 || num > 1088 || num & 15)
+        return -EMSGSIZE;
+
+    /* Mid-flush; the push will fail, but don't build over what's being sent. */
+    if (!p_raw)
+        p_raw = p_local;
+
+    curvecpr_bytes_copy(p_raw + CURVECPR_SERVER_HEADROOM, buf, num);
+
+    return _send(server, s, priv, p_raw, num);
+}
+
+int curvecpr_server_send_inplace (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, unsigned char *buf, size_t num)
+{
+    if (num < 16 || num > 1088 || num & 15)
+        return -EMSGSIZE;
+
+    return _send(server, s, priv, buf - CURVECPR_SERVER_HEADROOM, num);
+}
@@ -0,0 +1,380 @@
+#include "config.h"
+
+#include <curvecpr/sessions.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/clock.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <sodium/crypto_shorthash.h>
+#include <sodium/crypto_uint32.h>
+#include <sodium/crypto_uint64.h>
+#include <sodium/randombytes.h>
+
+/* Tags for slots that don't hold a session. Live slots use the low 7 bits of the
+   hash, so they never have the high bit set. */
+#define _TAG_EMPTY 0x80
+#define _TAG_DELETED 0xfe
+
+#define _NONE 0xffffffffU
+
+static crypto_uint64 _hash (const struct curvecpr_sessions *sessions, const unsigned char *their_session_pk)
+{
+    unsigned char hash[8];
+
+    crypto_shorthash(hash, their_session_pk, 32, sessions->hash_key);
+
+    return curvecpr_bytes_unpack_uint64(hash);
+}
+
+/* Returns a bit mask of the slots in the group whose tag is tag. */
+static unsigned int _match (const unsigned char *group, unsigned char tag)
+{
+#ifdef __SSE2__
+    __m128i tags = _mm_loadu_si128((const __m128i *)(const void *)group);
+
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8((char)tag)));
+#else
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < CURVECPR_SESSIONS_GROUP; ++i)
+        mask |= (unsigned int)(group[i] == tag) << i;
+
+    return mask;
+#endif
+}
+
+static unsigned int _match_free (const unsigned char *group)
+{
+#ifdef __SSE2__
+    __m128i tags = _mm_loadu_si128((const __m128i *)(const void *)group);
+
+    /* Both free tags have the high bit set. */
+    return (unsigned int)_mm_movemask_epi8(tags);
+#else
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < CURVECPR_SESSIONS_GROUP; ++i)
+        mask |= (unsigned int)(group[i] >> 7) << i;
+
+    return mask;
+#endif
+}
+
+static int _lowest_bit (unsigned int mask)
+{
+    int i = 0;
+
+    while (!(mask & 1)) {
+        mask >>= 1;
+        ++i;
+    }
+
+    return i;
+}
+
+static crypto_uint32 _entry_index (const struct curvecpr_sessions *sessions, const struct curvecpr_session *s)
+{
+    /* Sessions are the first member of their entries. */
+    return (crypto_uint32)((const struct curvecpr_sessions_entry *)(const void *)s - sessions->entries);
+}
+
+/* Least-recently-used list maintenance. */
+static void _lru_unlink (struct curvecpr_sessions *sessions, crypto_uint32 i)
+{
+    struct curvecpr_sessions_entry *e = &sessions->entries[i];
+
+    if (e->prev != _NONE) sessions->entries[e->prev].next = e->next; else sessions->lru_head = e->next;
+    if (e->next != _NONE) sessions->entries[e->next].prev = e->prev; else sessions->lru_tail = e->prev;
+}
+
+static void _lru_push (struct curvecpr_sessions *sessions, crypto_uint32 i)
+{
+    struct curvecpr_sessions_entry *e = &sessions->entries[i];
+
+    e->prev = _NONE;
+    e->next = sessions->lru_head;
+
+    if (sessions->lru_head != _NONE) sessions->entries[sessions->lru_head].prev = i; else sessions->lru_tail = i;
+    sessions->lru_head = i;
+}
+
+/* Finds the slot holding the session for their_session_pk, or returns _NONE. */
+static crypto_uint32 _find (const struct curvecpr_sessions *sessions, const unsigned char *their_session_pk, crypto_uint64 hash)
+{
+    unsigned char tag = hash & 0x7f;
+    crypto_uint32 group = (crypto_uint32)(hash >> 7) & (sessions->groups - 1);
+    crypto_uint32 probe;
+
+    for (probe = 0; probe < sessions->groups; ++probe) {
+        const unsigned char *tags = sessions->tags + (size_t)group * CURVECPR_SESSIONS_GROUP;
+        unsigned int mask = _match(tags, tag);
+
+        while (mask) {
+            crypto_uint32 slot = group * CURVECPR_SESSIONS_GROUP + _lowest_bit(mask);
+            const struct curvecpr_sessions_entry *e = &sessions->entries[sessions->indexes[slot]];
+
+            if (curvecpr_bytes_equal(e->session.their_session_pk, their_session_pk, 32))
+                return slot;
+
+            mask &= mask - 1;
+        }
+
+        /* An empty slot ends the probe sequence. */
+        if (_match(tags, _TAG_EMPTY))
+            break;
+
+        /* Triangular probing visits every group when the group count is a power of
+           two. */
+        group = (group + probe + 1) & (sessions->groups - 1);
+    }
+
+    return _NONE;
+}
+
+static void _insert (struct curvecpr_sessions *sessions, crypto_uint32 i, crypto_uint64 hash)
+{
+    crypto_uint32 group = (crypto_uint32)(hash >> 7) & (sessions->groups - 1);
+    crypto_uint32 probe;
+
+    for (probe = 0; probe < sessions->groups; ++probe) {
+        unsigned char *tags = sessions->tags + (size_t)group * CURVECPR_SESSIONS_GROUP;
+        unsigned int mask = _match_free(tags);
+
+        if (mask) {
+            crypto_uint32 slot = group * CURVECPR_SESSIONS_GROUP + _lowest_bit(mask);
+
+            if (sessions->tags[slot] == _TAG_DELETED)
+                --sessions->tombstones;
+
+            sessions->tags[slot] = hash & 0x7f;
+            sessions->indexes[slot] = i;
+            sessions->entries[i].slot = slot;
+            return;
+        }
+
+        group = (group + probe + 1) & (sessions->groups - 1);
+    }
+}
+
+static void _rebuild (struct curvecpr_sessions *sessions)
+{
+    crypto_uint32 i;
+
+    /* Clear out tombstones by reinserting everything. Only the table is rebuilt; the
+       sessions themselves stay put. */
+    memset(sessions->tags, _TAG_EMPTY, (size_t)sessions->groups * CURVECPR_SESSIONS_GROUP);
+    sessions->tombstones = 0;
+
+    for (i = sessions->lru_head; i != _NONE; i = sessions->entries[i].next)
+        _insert(sessions, i, _hash(sessions, sessions->entries[i].session.their_session_pk));
+}
+
+static void _drop (struct curvecpr_sessions *sessions, crypto_uint32 i)
+{
+    struct curvecpr_sessions_entry *e = &sessions->entries[i];
+    crypto_uint32 slot = e->slot;
+    const unsigned char *tags = sessions->tags + (slot - slot % CURVECPR_SESSIONS_GROUP);
+
+    if (sessions->cf.ops.remove)
+        sessions->cf.ops.remove(sessions, &e->session);
+
+    /* If this group still has an empty slot, no probe sequence ever continued past it,
+       so the slot can go straight back to being empty. */
+    if (_match(tags, _TAG_EMPTY)) {
+        sessions->tags[slot] = _TAG_EMPTY;
+    } else {
+        sessions->tags[slot] = _TAG_DELETED;
+        ++sessions->tombstones;
+    }
+
+    _lru_unlink(sessions, i);
+
+    /* Don't leave keys lying around. */
+    curvecpr_bytes_zero(e, sizeof(struct curvecpr_sessions_entry));
+
+    e->next = sessions->free_head;
+    sessions->free_head = i;
+    --sessions->len;
+    ++sessions->drops;
+}
+
+static int _put_session (struct curvecpr_server *server, const struct curvecpr_session *s, void *priv, struct curvecpr_session **s_stored)
+{
+    return curvecpr_sessions_put(server->cf.sessions, s, priv, s_stored);
+}
+
+static int _get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    return curvecpr_sessions_get(server->cf.sessions, their_session_pk, s_stored);
+}
+
+int curvecpr_sessions_new (struct curvecpr_sessions *sessions, const struct curvecpr_sessions_cf *cf)
+{
+    crypto_uint32 i;
+    unsigned long long slots;
+
+    curvecpr_bytes_zero(sessions, sizeof(struct curvecpr_sessions));
+
+    if (cf)
+        curvecpr_bytes_copy(&sessions->cf, cf, sizeof(struct curvecpr_sessions_cf));
+
+    if (!sessions->cf.capacity || sessions->cf.capacity >= _NONE)
+        return -EINVAL;
+
+    /* Keep the table at most 7/8 full. */
+    slots = (unsigned long long)sessions->cf.capacity * 8 / 7 + 1;
+    sessions->groups = 1;
+    while ((unsigned long long)sessions->groups * CURVECPR_SESSIONS_GROUP < slots)
+        sessions->groups *= 2;
+
+    sessions->tags = malloc((size_t)sessions->groups * CURVECPR_SESSIONS_GROUP);
+    sessions->indexes = calloc((size_t)sessions->groups * CURVECPR_SESSIONS_GROUP, sizeof(crypto_uint32));
+    sessions->entries = calloc(sessions->cf.capacity, sizeof(struct curvecpr_sessions_entry));
+
+    if (!sessions->tags || !sessions->indexes || !sessions->entries) {
+        curvecpr_sessions_destroy(sessions);
+        return -ENOMEM;
+    }
+
+    memset(sessions->tags, _TAG_EMPTY, (size_t)sessions->groups * CURVECPR_SESSIONS_GROUP);
+
+    for (i = 0; i < sessions->cf.capacity; ++i)
+        sessions->entries[i].next = i + 1 < sessions->cf.capacity ? i + 1 : _NONE;
+    sessions->free_head = 0;
+
+    sessions->lru_head = _NONE;
+    sessions->lru_tail = _NONE;
+
+    randombytes(sessions->hash_key, sizeof(sessions->hash_key));
+
+    return 0;
+}
+
+void curvecpr_sessions_destroy (struct curvecpr_sessions *sessions)
+{
+    if (sessions->entries) {
+        while (sessions->lru_head != _NONE)
+            _drop(sessions, sessions->lru_head);
+    }
+
+    free(sessions->tags);
+    free(sessions->indexes);
+    free(sessions->entries);
+
+    curvecpr_bytes_zero(sessions, sizeof(struct curvecpr_sessions));
+}
+
+void curvecpr_sessions_configure (struct curvecpr_sessions *sessions, struct curvecpr_server_cf *cf)
+{
+    cf->ops.put_session = _put_session;
+    cf->ops.get_session = _get_session;
+
+    cf->sessions = sessions;
+}
+
+int curvecpr_sessions_put (struct curvecpr_sessions *sessions, const struct curvecpr_session *s, void *priv, struct curvecpr_session **s_stored)
+{
+    crypto_uint64 hash = _hash(sessions, s->their_session_pk);
+    struct curvecpr_sessions_entry *e;
+    crypto_uint32 i;
+
+    if (_find(sessions, s->their_session_pk, hash) != _NONE)
+        return -EEXIST;
+
+    /* Puts are rare enough (one per handshake) to read the clock themselves. */
+    curvecpr_sessions_refresh_clock(sessions);
+
+    if (sessions->len == sessions->cf.capacity) {
+        /* Try to make room by getting rid of the least recently used session. */
+        if (!curvecpr_sessions_expire(sessions, sessions->now))
+            return -ENOBUFS;
+    }
+
+    if ((unsigned long long)sessions->len + sessions->tombstones + 1 > (unsigned long long)sessions->groups * CURVECPR_SESSIONS_GROUP * 7 / 8)
+        _rebuild(sessions);
+
+    i = sessions->free_head;
+    e = &sessions->entries[i];
+    sessions->free_head = e->next;
+    ++sessions->len;
+
+    curvecpr_bytes_copy(&e->session, s, sizeof(struct curvecpr_session));
+    e->last_used = sessions->now;
+
+    _insert(sessions, i, hash);
+    _lru_push(sessions, i);
+
+    if (sessions->cf.ops.put)
+        sessions->cf.ops.put(sessions, &e->session, priv);
+
+    if (s_stored)
+        *s_stored = &e->session;
+
+    return 0;
+}
+
+int curvecpr_sessions_get (struct curvecpr_sessions *sessions, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    crypto_uint32 slot = _find(sessions, their_session_pk, _hash(sessions, their_session_pk));
+    crypto_uint32 i;
+
+    if (slot == _NONE)
+        return -ENOENT;
+
+    i = sessions->indexes[slot];
+
+    if (sessions->cf.idle_timeout) {
+        sessions->entries[i].last_used = sessions->now;
+
+        if (sessions->lru_head != i) {
+            _lru_unlink(sessions, i);
+            _lru_push(sessions, i);
+        }
+    }
+
+    *s_stored = &sessions->entries[i].session;
+
+    return 0;
+}
+
+/* Reads the clock for the lookups that follow, so a batch of them reads it only
+   once. The server calls this for each curvecpr_server_recv() or
+   curvecpr_server_recv_batch(); anything else looking sessions up should call it
+   too. */
+void curvecpr_sessions_refresh_clock (struct curvecpr_sessions *sessions)
+{
+    if (sessions->cf.idle_timeout)
+        sessions->now = curvecpr_clock_now(sessions->cf.clock);
+}
+
+void curvecpr_sessions_remove (struct curvecpr_sessions *sessions, struct curvecpr_session *s)
+{
+    _drop(sessions, _entry_index(sessions, s));
+}
+
+crypto_uint32 curvecpr_sessions_expire (struct curvecpr_sessions *sessions, long long now)
+{
+    crypto_uint32 expired = 0;
+
+    if (!sessions->cf.idle_timeout)
+        return 0;
+
+    while (sessions->lru_tail != _NONE && sessions->entries[sessions->lru_tail].last_used + sessions->cf.idle_timeout <= now) {
+        _drop(sessions, sessions->lru_tail);
+        ++expired;
+    }
+
+    return expired;
+}
@@ -0,0 +1,239 @@
+#include "config.h"
+
+#include <curvecpr/shards.h>
+
+#include <curvecpr/admission.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/handshakes.h>
+#include <curvecpr/keypairs.h>
+#include <curvecpr/packet.h>
+#include <curvecpr/server.h>
+#include <curvecpr/sessions.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sodium/crypto_shorthash.h>
+#include <sodium/randombytes.h>
+
+#include "atomic.h"
+
+int curvecpr_shards_new (struct curvecpr_shards *shards, const struct curvecpr_shards_cf *cf)
+{
+    size_t ring_packets = 1;
+    unsigned int i;
+
+    curvecpr_bytes_zero(shards, sizeof(struct curvecpr_shards));
+
+    if (cf)
+        curvecpr_bytes_copy(&shards->cf, cf, sizeof(struct curvecpr_shards_cf));
+
+    if (!shards->cf.shards || !shards->cf.ring_packets || shards->cf.server.sendv || shards->cf.server.temporal_keys || shards->cf.server.keypairs || shards->cf.server.admission || shards->cf.server.handshakes || shards->cf.priv_bytes > CURVECPR_SHARDS_PRIV)
+        return -EINVAL;
+
+    /* Ring slots are reused once processed, so offloaded initiates need their own
+       copies. */
+    if (!shards->cf.handshakes.priv_bytes)
+        shards->cf.handshakes.priv_bytes = shards->cf.priv_bytes;
+
+    while (ring_packets < shards->cf.ring_packets)
+        ring_packets *= 2;
+
+    shards->shards = calloc(shards->cf.shards, sizeof(struct curvecpr_shards_shard));
+    if (!shards->shards)
+        return -ENOMEM;
+
+    randombytes(shards->hash_key, sizeof(shards->hash_key));
+    curvecpr_server_temporal_keys_new(&shards->temporal_keys);
+
+    for (i = 0; i < shards->cf.shards; ++i) {
+        struct curvecpr_shards_shard *shard = &shards->shards[i];
+        struct curvecpr_server_cf server_cf;
+
+        shard->shards = shards;
+        shard->index = i;
+
+        shard->ring.packets = calloc(ring_packets, sizeof(struct curvecpr_shards_packet));
+        shard->ring.mask = ring_packets - 1;
+
+        if (!shard->ring.packets) {
+            curvecpr_shards_destroy(shards);
+            return -ENOMEM;
+        }
+
+        curvecpr_bytes_copy(&server_cf, &shards->cf.server, sizeof(struct curvecpr_server_cf));
+        server_cf.temporal_keys = &shards->temporal_keys;
+
+        if (shards->cf.sessions.capacity) {
+            int result = curvecpr_sessions_new(&shard->sessions, &shards->cf.sessions);
+
+            if (result) {
+                curvecpr_shards_destroy(shards);
+                return result;
+            }
+
+            curvecpr_sessions_configure(&shard->sessions, &server_cf);
+        }
+
+        if (shards->cf.keypairs.capacity) {
+            int result = curvecpr_keypairs_new(&shard->keypairs, &shards->cf.keypairs);
+
+            if (result) {
+                curvecpr_shards_destroy(shards);
+                return result;
+            }
+
+            curvecpr_keypairs_configure(&shard->keypairs, &server_cf);
+        }
+
+        if (shards->cf.admission.source_rate || shards->cf.admission.global_budget) {
+            int result = curvecpr_admission_new(&shard->admission, &shards->cf.admission);
+
+            if (result) {
+                curvecpr_shards_destroy(shards);
+                return result;
+            }
+
+            curvecpr_admission_configure(&shard->admission, &server_cf);
+        }
+
+        if (shards->cf.handshakes.jobs) {
+            int result = curvecpr_handshakes_new(&shard->handshakes, &shards->cf.handshakes);
+
+            if (result) {
+                curvecpr_shards_destroy(shards);
+                return result;
+            }
+
+            curvecpr_handshakes_configure(&shard->handshakes, &server_cf);
+        }
+
+        curvecpr_server_new(&shard->server, &server_cf);
+    }
+
+    return 0;
+}
+
+void curvecpr_shards_destroy (struct curvecpr_shards *shards)
+{
+    unsigned int i;
+
+    if (shards->shards) {
+        for (i = 0; i < shards->cf.shards; ++i) {
+            struct curvecpr_shards_shard *shard = &shards->shards[i];
+
+            if (shard->sessions.entries)
+                curvecpr_sessions_destroy(&shard->sessions);
+
+            if (shard->keypairs.keypairs)
+                curvecpr_keypairs_destroy(&shard->keypairs);
+
+            curvecpr_admission_destroy(&shard->admission);
+
+            if (shard->handshakes.jobs)
+                curvecpr_handshakes_destroy(&shard->handshakes);
+
+            if (shard->ring.packets)
+                curvecpr_bytes_zero(shard->ring.packets, (shard->ring.mask + 1) * sizeof(struct curvecpr_shards_packet));
+
+            free(shard->ring.packets);
+        }
+
+        curvecpr_bytes_zero(shards->shards, shards->cf.shards * sizeof(struct curvecpr_shards_shard));
+    }
+
+    free(shards->shards);
+
+    curvecpr_bytes_zero(shards, sizeof(struct curvecpr_shards));
+}
+
+unsigned int curvecpr_shards_owner (const struct curvecpr_shards *shards, const unsigned char client_session_pk[32])
+{
+    unsigned char hash[8];
+
+    crypto_shorthash(hash, client_session_pk, 32, shards->hash_key);
+
+    return (unsigned int)(curvecpr_bytes_unpack_uint64(hash) % shards->cf.shards);
+}
+
+/* Call from a single thread only. Returns -ENOBUFS (and drops the packet) if the
+   owning shard is too far behind. */
+int curvecpr_shards_route (struct curvecpr_shards *shards, const unsigned char *buf, size_t num, void *priv)
+{
+    struct curvecpr_shards_ring *ring;
+    struct curvecpr_shards_packet *packet;
+    size_t head;
+
+    /* Every packet a server receives carries the client's session key in the same
+       place. Anything too short to hold it can't be valid anyway. */
+    if (num < 80 || num > CURVECPR_SHARDS_PACKET)
+        return -EINVAL;
+
+    ring = &shards->shards[curvecpr_shards_owner(shards, ((const struct curvecpr_packet_hello *)buf)->client_session_pk)].ring;
+
+    head = _LOAD_RELAXED(&ring->head);
+    if (head - _LOAD_ACQUIRE(&ring->tail) > ring->mask)
+        return -ENOBUFS;
+
+    packet = &ring->packets[head & ring->mask];
+    curvecpr_bytes_copy(packet->buf, buf, num);
+    packet->num = num;
+    packet->priv = priv;
+
+    if (priv && shards->cf.priv_bytes) {
+        curvecpr_bytes_copy(packet->priv_copy, priv, shards->cf.priv_bytes);
+        packet->priv = packet->priv_copy;
+    }
+
+    _STORE_RELEASE(&ring->head, head + 1);
+
+    return 0;
+}
+
+/* Call only from the thread that owns shard index. Handles up to max waiting
+   packets and returns how many there were. Also completes up to max offloaded
+   handshakes, if the shards have them. */
+size_t curvecpr_shards_process (struct curvecpr_shards *shards, unsigned int index, size_t max)
+{
+    struct curvecpr_shards_shard *shard = &shards->shards[index];
+    struct curvecpr_shards_ring *ring = &shard->ring;
+    struct curvecpr_server_packet batch[CURVECPR_SERVER_BATCH];
+    size_t tail = _LOAD_RELAXED(&ring->tail);
+    size_t available = _LOAD_ACQUIRE(&ring->head) - tail;
+    size_t processed = 0;
+
+    /* Register any clients whose initiates were offloaded first, so packets that
+       follow them find their sessions. */
+    curvecpr_server_handshakes_complete(&shard->server, max);
+
+    if (available > max)
+        available = max;
+
+    while (processed < available) {
+        size_t num = available - processed < CURVECPR_SERVER_BATCH ? available - processed : CURVECPR_SERVER_BATCH;
+        size_t i;
+
+        for (i = 0; i < num; ++i) {
+            struct curvecpr_shards_packet *packet = &ring->packets[(tail + processed + i) & ring->mask];
+
+            batch[i].buf = packet->buf;
+            batch[i].num = packet->num;
+            batch[i].priv = packet->priv;
+        }
+
+        curvecpr_server_recv_batch(&shard->server, batch, num);
+
+        /* Hand the slots back to the router. */
+        processed += num;
+        _STORE_RELEASE(&ring->tail, tail + processed);
+    }
+
+    return processed;
+}
+
+/* Call from one thread at a time; shards may keep processing meanwhile. */
+void curvecpr_shards_refresh_temporal_keys (struct curvecpr_shards *shards)
+{
+    curvecpr_server_temporal_keys_refresh(&shards->temporal_keys);
+}
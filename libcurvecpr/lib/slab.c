@@ -0,0 +1,128 @@
+#include "config.h"
+
+#include <curvecpr/slab.h>
+
+#include <curvecpr/bytes.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Room at the front of each page for linking it to the next, keeping chunks
+   aligned. */
+#define _PAGE_HEADER CURVECPR_SLAB_MINIMUM
+
+static unsigned int _class (size_t num)
+{
+    unsigned int class = 0;
+
+    while ((size_t)CURVECPR_SLAB_MINIMUM << class < num)
+        ++class;
+
+    return class;
+}
+
+static void *_alloc (struct curvecpr_slab *slab, size_t num)
+{
+    if (slab->cf.ops.alloc)
+        return slab->cf.ops.alloc(slab, num);
+
+    return malloc(num);
+}
+
+static void _free (struct curvecpr_slab *slab, void *page)
+{
+    if (slab->cf.ops.free)
+        slab->cf.ops.free(slab, page);
+    else
+        free(page);
+}
+
+/* Splits a new page into chunks of a class. */
+static int _refill (struct curvecpr_slab *slab, unsigned int class)
+{
+    size_t chunk_bytes = (size_t)CURVECPR_SLAB_MINIMUM << class;
+    unsigned char *page = _alloc(slab, slab->cf.page_bytes);
+    size_t at;
+
+    if (!page)
+        return -ENOMEM;
+
+    *(void **)(void *)page = slab->pages;
+    slab->pages = page;
+    slab->bytes += slab->cf.page_bytes;
+
+    for (at = _PAGE_HEADER; at + chunk_bytes <= slab->cf.page_bytes; at += chunk_bytes) {
+        *(void **)(void *)(page + at) = slab->chunks[class];
+        slab->chunks[class] = page + at;
+    }
+
+    return 0;
+}
+
+int curvecpr_slab_new (struct curvecpr_slab *slab, const struct curvecpr_slab_cf *cf)
+{
+    curvecpr_bytes_zero(slab, sizeof(struct curvecpr_slab));
+
+    if (cf)
+        curvecpr_bytes_copy(&slab->cf, cf, sizeof(struct curvecpr_slab_cf));
+
+    if (!slab->cf.page_bytes)
+        slab->cf.page_bytes = 16384;
+
+    if (slab->cf.page_bytes < _PAGE_HEADER + ((size_t)CURVECPR_SLAB_MINIMUM << (CURVECPR_SLAB_CLASSES - 1)))
+        return -EINVAL;
+
+    return 0;
+}
+
+void curvecpr_slab_destroy (struct curvecpr_slab *slab)
+{
+    while (slab->pages) {
+        void *page = slab->pages;
+
+        slab->pages = *(void **)page;
+
+        /* The chunks held queued plaintext. */
+        curvecpr_bytes_zero(page, slab->cf.page_bytes);
+        _free(slab, page);
+    }
+
+    curvecpr_bytes_zero(slab, sizeof(struct curvecpr_slab));
+}
+
+/* How big a chunk holding num bytes is. */
+size_t curvecpr_slab_chunk_bytes (size_t num)
+{
+    return (size_t)CURVECPR_SLAB_MINIMUM << _class(num);
+}
+
+/* Returns a chunk with room for num bytes, or NULL if num is more than the largest
+   chunk or there's no memory. */
+unsigned char *curvecpr_slab_get (struct curvecpr_slab *slab, size_t num)
+{
+    unsigned int class = _class(num);
+    void *chunk;
+
+    if (class >= CURVECPR_SLAB_CLASSES)
+        return NULL;
+
+    if (!slab->chunks[class] && _refill(slab, class))
+        return NULL;
+
+    chunk = slab->chunks[class];
+    slab->chunks[class] = *(void **)chunk;
+    slab->bytes_used += (size_t)CURVECPR_SLAB_MINIMUM << class;
+
+    return chunk;
+}
+
+/* Releases a chunk; num is what it was asked for with. */
+void curvecpr_slab_put (struct curvecpr_slab *slab, unsigned char *chunk, size_t num)
+{
+    unsigned int class = _class(num);
+
+    *(void **)(void *)chunk = slab->chunks[class];
+    slab->chunks[class] = chunk;
+    slab->bytes_used -= (size_t)CURVECPR_SLAB_MINIMUM << class;
+}
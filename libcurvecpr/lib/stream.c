@@ -0,0 +1,235 @@
+#include "config.h"
+
+#include <curvecpr/stream.h>
+
+#include <curvecpr/block.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sodium/crypto_uint64.h>
+
+/* Copies stream data into or out of the ring starting at offset, wrapping around its
+   end if need be. */
+static void _ring_put (struct curvecpr_stream *stream, crypto_uint64 offset, const unsigned char *buf, size_t num)
+{
+    size_t at = (size_t)(offset % stream->cf.recv_bytes);
+    size_t first = stream->cf.recv_bytes - at < num ? stream->cf.recv_bytes - at : num;
+
+    curvecpr_bytes_copy(stream->recv_ring + at, buf, first);
+    curvecpr_bytes_copy(stream->recv_ring, buf + first, num - first);
+}
+
+static void _ring_get (struct curvecpr_stream *stream, crypto_uint64 offset, unsigned char *buf, size_t num)
+{
+    size_t at = (size_t)(offset % stream->cf.recv_bytes);
+    size_t first = stream->cf.recv_bytes - at < num ? stream->cf.recv_bytes - at : num;
+
+    curvecpr_bytes_copy(buf, stream->recv_ring + at, first);
+    curvecpr_bytes_copy(buf + first, stream->recv_ring, num - first);
+}
+
+/* Sets or clears the presence bits for [start, end) of the ring, which mustn't wrap
+   around its end. */
+static void _present_mark (struct curvecpr_stream *stream, size_t start, size_t end, unsigned char present)
+{
+    unsigned char *bits = stream->recv_present;
+
+    for (; start < end && (start & 7); ++start) {
+        if (present) bits[start >> 3] |= (unsigned char)(1 << (start & 7));
+        else bits[start >> 3] &= (unsigned char)~(1 << (start & 7));
+    }
+
+    for (; end - start >= 8; start += 8)
+        bits[start >> 3] = present ? 0xff : 0;
+
+    for (; start < end; ++start) {
+        if (present) bits[start >> 3] |= (unsigned char)(1 << (start & 7));
+        else bits[start >> 3] &= (unsigned char)~(1 << (start & 7));
+    }
+}
+
+static void _present (struct curvecpr_stream *stream, crypto_uint64 offset, size_t num, unsigned char present)
+{
+    size_t at = (size_t)(offset % stream->cf.recv_bytes);
+    size_t first = stream->cf.recv_bytes - at < num ? stream->cf.recv_bytes - at : num;
+
+    _present_mark(stream, at, at + first, present);
+    _present_mark(stream, 0, num - first, present);
+}
+
+/* Moves recv_contiguous up past whatever has arrived right after it. */
+static void _advance (struct curvecpr_stream *stream)
+{
+    const unsigned char *bits = stream->recv_present;
+    crypto_uint64 limit = stream->recv_offset + stream->cf.recv_bytes;
+
+    while (stream->recv_contiguous < limit) {
+        size_t at = (size_t)(stream->recv_contiguous % stream->cf.recv_bytes);
+
+        if (!(at & 7) && stream->cf.recv_bytes - at >= 8 && limit - stream->recv_contiguous >= 8 && bits[at >> 3] == 0xff) {
+            stream->recv_contiguous += 8;
+        } else if (bits[at >> 3] & (1 << (at & 7))) {
+            ++stream->recv_contiguous;
+        } else {
+            break;
+        }
+    }
+}
+
+static int _recvmarkq_put (struct curvecpr_messager *messager, const struct curvecpr_block *block, struct curvecpr_block **block_stored)
+{
+    struct curvecpr_stream *stream = messager->cf.stream;
+    crypto_uint64 start = block->offset;
+    crypto_uint64 end = block->offset + block->data_len;
+    int r;
+
+    /* Refuse what there isn't room for yet; it won't be acknowledged, so it'll be sent
+       again. */
+    if (end > stream->recv_offset + stream->cf.recv_bytes)
+        return 1;
+
+    r = stream->recvmarkq_put(messager, block, block_stored);
+    if (r)
+        return r;
+
+    /* Anything already read is only being acknowledged again. */
+    if (start < stream->recv_offset)
+        start = stream->recv_offset;
+
+    if (start < end) {
+        _ring_put(stream, start, block->data + (start - block->offset), (size_t)(end - start));
+        _present(stream, start, (size_t)(end - start), 1);
+
+        if (start <= stream->recv_contiguous)
+            _advance(stream);
+    }
+
+    if (block->eof != CURVECPR_BLOCK_STREAM) {
+        stream->recv_eof = block->eof;
+        stream->recv_eof_offset = end;
+    }
+
+    return 0;
+}
+
+int curvecpr_stream_new (struct curvecpr_stream *stream, const struct curvecpr_stream_cf *cf)
+{
+    curvecpr_bytes_zero(stream, sizeof(struct curvecpr_stream));
+
+    if (cf)
+        curvecpr_bytes_copy(&stream->cf, cf, sizeof(struct curvecpr_stream_cf));
+
+    if (!stream->cf.recv_bytes)
+        return -EINVAL;
+
+    stream->recv_ring = malloc(stream->cf.recv_bytes);
+    stream->recv_present = calloc((stream->cf.recv_bytes + 7) / 8, 1);
+
+    if (!stream->recv_ring || !stream->recv_present) {
+        curvecpr_stream_destroy(stream);
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void curvecpr_stream_destroy (struct curvecpr_stream *stream)
+{
+    if (stream->recv_ring)
+        curvecpr_bytes_zero(stream->recv_ring, stream->cf.recv_bytes);
+
+    free(stream->recv_ring);
+    free(stream->recv_present);
+
+    curvecpr_bytes_zero(stream, sizeof(struct curvecpr_stream));
+}
+
+/* Call after curvecpr_queues_configure(); received blocks go through the stream on
+   their way into the queues' recvmarkq. */
+void curvecpr_stream_configure (struct curvecpr_stream *stream, struct curvecpr_messager_cf *cf)
+{
+    stream->recvmarkq_put = cf->ops.recvmarkq_put;
+    cf->ops.recvmarkq_put = _recvmarkq_put;
+
+    cf->stream = stream;
+}
+
+/* Queues up as much of buf as there's room for in the sendq, and sets written to how
+   much that was. Returns -EAGAIN if none of it fit. */
+int curvecpr_messager_write (struct curvecpr_messager *messager, const unsigned char *buf, size_t num, size_t *written)
+{
+    const struct curvecpr_messager_cf *cf = &messager->cf;
+
+    *written = 0;
+
+    if (!cf->stream || !cf->queues)
+        return -EINVAL;
+
+    if (cf->stream->shutdown)
+        return -EPIPE;
+
+    *written = curvecpr_queues_sendq_write(cf->queues, buf, num, messager->my_maximum_send_bytes);
+
+    if (num && !*written)
+        return -EAGAIN;
+
+    return 0;
+}
+
+/* Copies out as much received data as is ready, up to num bytes, and sets num_read to
+   how much that was. At the end of the stream num_read is 0, as with read(2), unless
+   the other side ended it with a failure, in which case this returns -ECONNRESET.
+   Returns -EAGAIN if nothing is ready yet. */
+int curvecpr_messager_read (struct curvecpr_messager *messager, unsigned char *buf, size_t num, size_t *num_read)
+{
+    struct curvecpr_stream *stream = messager->cf.stream;
+
+    *num_read = 0;
+
+    if (!stream)
+        return -EINVAL;
+
+    if (stream->recv_contiguous > stream->recv_offset) {
+        crypto_uint64 ready = stream->recv_contiguous - stream->recv_offset;
+        size_t n = ready < num ? (size_t)ready : num;
+
+        _ring_get(stream, stream->recv_offset, buf, n);
+        _present(stream, stream->recv_offset, n, 0);
+        stream->recv_offset += n;
+
+        *num_read = n;
+        return 0;
+    }
+
+    if (stream->recv_eof != CURVECPR_BLOCK_STREAM && stream->recv_offset >= stream->recv_eof_offset)
+        return stream->recv_eof == CURVECPR_BLOCK_EOF_FAILURE ? -ECONNRESET : 0;
+
+    return -EAGAIN;
+}
+
+/* Ends our side of the stream once everything written so far has been sent. Returns
+   -ENOBUFS if there's no room in the sendq to say so; try again later. */
+int curvecpr_messager_shutdown (struct curvecpr_messager *messager)
+{
+    const struct curvecpr_messager_cf *cf = &messager->cf;
+    int r;
+
+    if (!cf->stream || !cf->queues)
+        return -EINVAL;
+
+    if (cf->stream->shutdown)
+        return 0;
+
+    r = curvecpr_queues_sendq_close(cf->queues, CURVECPR_BLOCK_EOF_SUCCESS);
+    if (r)
+        return r;
+
+    cf->stream->shutdown = 1;
+
+    return 0;
+}
@@ -0,0 +1,298 @@
+#include "config.h"
+
+#include <curvecpr/wheel.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/clock.h>
+#include <curvecpr/messager.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include <sodium/crypto_uint64.h>
+
+#define _BITS 6
+#define _DUE (CURVECPR_WHEEL_LEVELS * CURVECPR_WHEEL_SLOTS)
+
+/* Index of the lowest set bit of a nonzero word. */
+#if defined(__GNUC__) || defined(__clang__)
+#define _LOWEST(bits) __builtin_ctzll(bits)
+#else
+static int _lowest (crypto_uint64 bits)
+{
+    int i = 0;
+
+    while (!(bits & 1)) {
+        bits >>= 1;
+        ++i;
+    }
+
+    return i;
+}
+
+#define _LOWEST(bits) _lowest(bits)
+#endif
+
+static void _unlink (struct curvecpr_wheel *wheel, struct curvecpr_wheel_timer *timer)
+{
+    if (timer->prev)
+        timer->prev->next = timer->next;
+    else
+        wheel->lists[timer->list] = timer->next;
+
+    if (timer->next)
+        timer->next->prev = timer->prev;
+
+    if (timer->list == _DUE) {
+        --wheel->due;
+    } else {
+        --wheel->pending;
+
+        if (!wheel->lists[timer->list])
+            wheel->occupied[timer->list / CURVECPR_WHEEL_SLOTS] &= ~(1ULL << (timer->list % CURVECPR_WHEEL_SLOTS));
+    }
+
+    timer->next = timer->prev = NULL;
+    timer->scheduled = 0;
+}
+
+static void _link (struct curvecpr_wheel *wheel, struct curvecpr_wheel_timer *timer, unsigned int list)
+{
+    timer->list = list;
+    timer->prev = NULL;
+    timer->next = wheel->lists[list];
+
+    if (timer->next)
+        timer->next->prev = timer;
+
+    wheel->lists[list] = timer;
+    timer->scheduled = 1;
+
+    if (list == _DUE) {
+        ++wheel->due;
+    } else {
+        ++wheel->pending;
+        wheel->occupied[list / CURVECPR_WHEEL_SLOTS] |= 1ULL << (list % CURVECPR_WHEEL_SLOTS);
+    }
+}
+
+/* Puts a timer in the lowest level that reaches its tick, which mustn't be before
+   wheel->tick. */
+static void _place (struct curvecpr_wheel *wheel, struct curvecpr_wheel_timer *timer)
+{
+    long long tick = timer->tick;
+    crypto_uint64 delta = (crypto_uint64)(tick - wheel->tick);
+    unsigned int level = 0;
+
+    while (level < CURVECPR_WHEEL_LEVELS - 1 && delta >> (_BITS * (level + 1)))
+        ++level;
+
+    /* Further off than the whole wheel reaches: park it in the furthest slot, and
+       it'll be placed again when that comes round. */
+    if (delta >> (_BITS * CURVECPR_WHEEL_LEVELS))
+        tick = wheel->tick + (1LL << (_BITS * CURVECPR_WHEEL_LEVELS)) - 1;
+
+    _link(wheel, timer, level * CURVECPR_WHEEL_SLOTS + (unsigned int)((tick >> (_BITS * level)) & (CURVECPR_WHEEL_SLOTS - 1)));
+}
+
+/* Moves the timers in a slot down to the levels below, now that it's come round. */
+static void _cascade (struct curvecpr_wheel *wheel, unsigned int list)
+{
+    struct curvecpr_wheel_timer *timer = wheel->lists[list];
+
+    while (timer) {
+        struct curvecpr_wheel_timer *next = timer->next;
+
+        _unlink(wheel, timer);
+        _place(wheel, timer);
+
+        timer = next;
+    }
+}
+
+/* The earliest tick at or after wheel->tick at which a slot with anything in it comes
+   round, or -1 if they're all empty. */
+static long long _next_tick (const struct curvecpr_wheel *wheel)
+{
+    long long earliest = -1;
+    unsigned int level;
+
+    for (level = 0; level < CURVECPR_WHEEL_LEVELS; ++level) {
+        crypto_uint64 occupied = wheel->occupied[level];
+        long long round = wheel->tick >> (_BITS * level);
+        unsigned int index = (unsigned int)(round & (CURVECPR_WHEEL_SLOTS - 1));
+        long long tick;
+
+        if (!occupied)
+            continue;
+
+        /* The slot this level is at only comes down again on its next round, unless
+           that's about to start. */
+        if (level && (wheel->tick & ((1LL << (_BITS * level)) - 1)))
+            occupied &= ~(1ULL << index);
+
+        if (!occupied) {
+            tick = (round + CURVECPR_WHEEL_SLOTS) << (_BITS * level);
+        } else {
+            crypto_uint64 rotated = index ? occupied >> index | occupied << (CURVECPR_WHEEL_SLOTS - index) : occupied;
+
+            tick = (round + _LOWEST(rotated)) << (_BITS * level);
+        }
+
+        if (tick < wheel->tick)
+            tick = wheel->tick;
+
+        if (earliest < 0 || tick < earliest)
+            earliest = tick;
+    }
+
+    return earliest;
+}
+
+static void _put_next_timeout (struct curvecpr_messager *messager, const long long timeout_ns)
+{
+    curvecpr_wheel_schedule(messager->cf.wheel, messager, messager->chicago.clock + timeout_ns);
+}
+
+int curvecpr_wheel_new (struct curvecpr_wheel *wheel, const struct curvecpr_wheel_cf *cf)
+{
+    curvecpr_bytes_zero(wheel, sizeof(struct curvecpr_wheel));
+
+    if (cf)
+        curvecpr_bytes_copy(&wheel->cf, cf, sizeof(struct curvecpr_wheel_cf));
+
+    if (wheel->cf.tick < 0)
+        return -EINVAL;
+
+    if (!wheel->cf.tick)
+        wheel->cf.tick = 1000000;
+
+    wheel->tick = curvecpr_clock_now(wheel->cf.clock) / wheel->cf.tick;
+
+    return 0;
+}
+
+/* Call before curvecpr_messager_new(); the messager's timeouts go on the wheel
+   instead of to ops.put_next_timeout. */
+void curvecpr_wheel_configure (struct curvecpr_wheel *wheel, struct curvecpr_messager_cf *cf)
+{
+    cf->ops.put_next_timeout = _put_next_timeout;
+
+    cf->wheel = wheel;
+}
+
+/* Schedules the messager to come due at the given time, in place of whenever it was
+   going to before. Times already past come due the next time the wheel advances. */
+void curvecpr_wheel_schedule (struct curvecpr_wheel *wheel, struct curvecpr_messager *messager, long long at)
+{
+    struct curvecpr_wheel_timer *timer = &messager->timer;
+    long long tick = at / wheel->cf.tick + (at % wheel->cf.tick > 0);
+
+    if (tick < wheel->tick)
+        tick = wheel->tick;
+
+    /* The usual case: its timeout has moved, but not by a whole tick. */
+    if (timer->scheduled && timer->list != _DUE && timer->tick == tick)
+        return;
+
+    if (timer->scheduled)
+        _unlink(wheel, timer);
+
+    timer->messager = messager;
+    timer->tick = tick;
+
+    _place(wheel, timer);
+}
+
+void curvecpr_wheel_remove (struct curvecpr_wheel *wheel, struct curvecpr_messager *messager)
+{
+    if (messager->timer.scheduled)
+        _unlink(wheel, &messager->timer);
+}
+
+/* Moves every messager due by now onto the due list, and returns how many are on
+   it. Rescheduling or removing a messager takes it off again. */
+size_t curvecpr_wheel_advance (struct curvecpr_wheel *wheel, long long now)
+{
+    long long target = now / wheel->cf.tick;
+
+    while (wheel->tick <= target) {
+        unsigned int index = (unsigned int)(wheel->tick & (CURVECPR_WHEEL_SLOTS - 1));
+        struct curvecpr_wheel_timer *timer;
+        crypto_uint64 later;
+        long long next;
+
+        if (!wheel->pending) {
+            wheel->tick = target + 1;
+            break;
+        }
+
+        /* At the start of each round of a level, the slot of the level above that
+           covers it comes down. */
+        if (!index) {
+            unsigned int level;
+
+            for (level = 1; level < CURVECPR_WHEEL_LEVELS; ++level) {
+                _cascade(wheel, level * CURVECPR_WHEEL_SLOTS + (unsigned int)((wheel->tick >> (_BITS * level)) & (CURVECPR_WHEEL_SLOTS - 1)));
+
+                if ((wheel->tick >> (_BITS * level)) & (CURVECPR_WHEEL_SLOTS - 1))
+                    break;
+            }
+        }
+
+        timer = wheel->lists[index];
+        while (timer) {
+            struct curvecpr_wheel_timer *next_timer = timer->next;
+
+            _unlink(wheel, timer);
+            _link(wheel, timer, _DUE);
+
+            timer = next_timer;
+        }
+
+        /* Skip straight to the next occupied slot of this round or, once there are
+           none, to wherever the next slot with anything in it comes round, so a
+           wheel holding only far-off messagers isn't walked a round at a time. */
+        later = index == CURVECPR_WHEEL_SLOTS - 1 ? 0 : wheel->occupied[0] >> (index + 1) << (index + 1);
+        if (later) {
+            next = (wheel->tick & ~(long long)(CURVECPR_WHEEL_SLOTS - 1)) + _LOWEST(later);
+        } else {
+            wheel->tick = (wheel->tick | (CURVECPR_WHEEL_SLOTS - 1)) + 1;
+            next = _next_tick(wheel);
+            if (next < 0)
+                next = target + 1;
+        }
+
+        wheel->tick = next < target + 1 ? next : target + 1;
+    }
+
+    return wheel->due;
+}
+
+/* Takes the next messager off the due list, or returns NULL if there are none. */
+struct curvecpr_messager *curvecpr_wheel_pop (struct curvecpr_wheel *wheel)
+{
+    struct curvecpr_wheel_timer *timer = wheel->lists[_DUE];
+
+    if (!timer)
+        return NULL;
+
+    _unlink(wheel, timer);
+
+    return timer->messager;
+}
+
+/* Returns the earliest time advancing might find a messager due (possibly sooner
+   than one actually is, for those still in the upper levels), or -1 if the wheel is
+   empty. */
+long long curvecpr_wheel_next_expiry (const struct curvecpr_wheel *wheel)
+{
+    long long tick;
+
+    if (wheel->due)
+        return (wheel->tick - 1) * wheel->cf.tick;
+
+    tick = _next_tick(wheel);
+
+    return tick < 0 ? -1 : tick * wheel->cf.tick;
+}
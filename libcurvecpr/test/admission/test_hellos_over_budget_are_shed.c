@@ -0,0 +1,95 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/admission.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/packet.h>
+#include <curvecpr/server.h>
+
+#include <errno.h>
+
+static int get_session_calls = 0;
+
+static int t_source (struct curvecpr_admission *admission, void *priv, unsigned char tag[CURVECPR_ADMISSION_TAG])
+{
+    tag[0] = *(const unsigned char *)priv;
+    return 0;
+}
+
+static int t_get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    ++get_session_calls;
+    return 1;
+}
+
+START_TEST (test_hellos_over_budget_are_shed)
+{
+    struct curvecpr_admission admission;
+    struct curvecpr_admission_cf admission_cf = {
+        .sources = 16,
+        .source_rate = 10,
+        .source_burst = 1,
+        .global_budget = 3,
+        .slice_length = 1000000000LL,
+        .ops = {
+            .source = t_source
+        }
+    };
+    struct curvecpr_server server;
+    struct curvecpr_server_cf server_cf = {
+        .ops = {
+            .get_session = t_get_session
+        }
+    };
+    unsigned char a[CURVECPR_ADMISSION_TAG] = { 1 };
+    unsigned char b[CURVECPR_ADMISSION_TAG] = { 2 };
+    unsigned char hello[224];
+    unsigned char message[128];
+    unsigned char source = 7;
+
+    fail_unless(curvecpr_admission_new(&admission, &admission_cf) == 0);
+
+    /* One source gets its burst, then one hello per 100 ms. */
+    fail_unless(curvecpr_admission_admit(&admission, a, 0) == 0);
+    fail_unless(curvecpr_admission_admit(&admission, a, 0) == 0);
+    fail_unless(curvecpr_admission_admit(&admission, a, 0) == -EAGAIN);
+    fail_unless(admission.shed_source == 1);
+
+    /* Another source isn't held back by it, until the slice's budget runs out. */
+    fail_unless(curvecpr_admission_admit(&admission, b, 0) == 0);
+    fail_unless(curvecpr_admission_admit(&admission, b, 0) == -EAGAIN);
+    fail_unless(admission.shed_global == 1);
+
+    /* Refused hellos don't use up the source's bucket. */
+    fail_unless(curvecpr_admission_admit(&admission, a, 100000000LL) == -EAGAIN);
+    fail_unless(admission.shed_global == 2);
+    fail_unless(curvecpr_admission_admit(&admission, a, 1000000000LL) == 0);
+    fail_unless(admission.admitted == 4);
+
+    curvecpr_admission_destroy(&admission);
+
+    /* Through a server: a flood of bogus hellos from one source is shed instead of
+       failing decryption, and messages still get through. */
+    admission_cf.global_budget = 0;
+    fail_unless(curvecpr_admission_new(&admission, &admission_cf) == 0);
+    curvecpr_admission_configure(&admission, &server_cf);
+    curvecpr_server_new(&server, &server_cf);
+
+    curvecpr_bytes_zero(hello, sizeof(hello));
+    curvecpr_bytes_copy(hello, "QvnQ5XlH", 8);
+    curvecpr_bytes_zero(message, sizeof(message));
+    curvecpr_bytes_copy(message, "QvnQ5XlM", 8);
+
+    fail_unless(curvecpr_server_recv(&server, &source, hello, sizeof(hello), NULL) == -EINVAL);
+    fail_unless(curvecpr_server_recv(&server, &source, hello, sizeof(hello), NULL) == -EINVAL);
+    fail_unless(curvecpr_server_recv(&server, &source, hello, sizeof(hello), NULL) == -EAGAIN);
+    fail_unless(admission.shed_source == 1);
+
+    curvecpr_server_recv(&server, &source, message, sizeof(message), NULL);
+    fail_unless(get_session_calls == 1);
+
+    curvecpr_admission_destroy(&admission);
+}
+END_TEST
+
+RUN_TEST (test_hellos_over_budget_are_shed)
@@ -0,0 +1,75 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bbr.h>
+#include <curvecpr/block.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/messager.h>
+
+/* A path with a 100 ms round trip through a bottleneck that passes a block every
+   100 us, simulated on a virtual clock. */
+#define RTT 100000000LL
+#define SERVICE 100000LL
+#define SECONDS 30
+
+#define INFLIGHT 65536
+
+static long long sent_clock[INFLIGHT];
+static long long acked_clock[INFLIGHT];
+
+START_TEST (test_paces_to_bottleneck)
+{
+    struct curvecpr_bbr bbr;
+    struct curvecpr_messager messager;
+    struct curvecpr_block block;
+    long long clock = 0, bottleneck = 0, end = SECONDS * 1000000000LL;
+    unsigned long long head = 0, tail = 0, sent = 0;
+
+    curvecpr_bytes_zero(&messager, sizeof(struct curvecpr_messager));
+    curvecpr_bytes_zero(&block, sizeof(struct curvecpr_block));
+
+    curvecpr_bbr_new(&bbr);
+    curvecpr_bbr_configure(&bbr, &messager.cf);
+
+    while (clock < end) {
+        long long next_send_time = messager.cf.congestion.next_send_time(&messager);
+
+        if (head < tail && acked_clock[head % INFLIGHT] <= next_send_time) {
+            /* An acknowledgment arrives. */
+            clock = acked_clock[head % INFLIGHT];
+            messager.chicago.clock = clock;
+
+            block.clock = sent_clock[head % INFLIGHT];
+            messager.cf.congestion.on_recv(&messager, &block);
+            ++head;
+        } else {
+            /* There's always more to send. */
+            fail_unless(tail - head < INFLIGHT);
+
+            clock = next_send_time > clock ? next_send_time : clock;
+            messager.chicago.clock = clock;
+            messager.my_sent_clock = clock;
+
+            bottleneck = (bottleneck > clock ? bottleneck : clock) + SERVICE;
+            sent_clock[tail % INFLIGHT] = clock;
+            acked_clock[tail % INFLIGHT] = bottleneck + RTT;
+            ++tail;
+            ++sent;
+        }
+    }
+
+    /* It's found the bottleneck's rate, and is sending at about that. */
+    fail_unless(bbr.mode == CURVECPR_BBR_PROBE_BW);
+    fail_unless(bbr.bw > 9000 * 256 && bbr.bw < 11000 * 256);
+    fail_unless(bbr.wr_rate > SERVICE * 3 / 4 && bbr.wr_rate < SERVICE * 3 / 2);
+    fail_unless(bbr.rtt_min >= RTT && bbr.rtt_min < RTT + RTT / 10);
+
+    /* Most of the time was spent at full speed: startup took seconds, not minutes. */
+    fail_unless(sent > (SECONDS - 3) * (1000000000LL / SERVICE));
+
+    /* And there isn't a standing queue of more than a round trip's worth. */
+    fail_unless(tail - head < 2 * (RTT / SERVICE) + 100);
+}
+END_TEST
+
+RUN_TEST (test_paces_to_bottleneck)
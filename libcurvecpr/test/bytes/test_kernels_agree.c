@@ -0,0 +1,66 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+
+static const enum curvecpr_bytes_kernel kernels[] = {
+    CURVECPR_BYTES_KERNEL_SCALAR,
+    CURVECPR_BYTES_KERNEL_SSE2,
+    CURVECPR_BYTES_KERNEL_AVX2
+};
+
+START_TEST (test_kernels_agree)
+{
+    unsigned char source[1200], destination[1200], other[1200];
+    size_t k, num, offset, i;
+
+    for (i = 0; i < sizeof(source); ++i)
+        source[i] = (unsigned char)(i * 131 + 7);
+
+    fail_unless(curvecpr_bytes_set_kernel(CURVECPR_BYTES_KERNEL_SCALAR) == 0);
+
+    for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        if (curvecpr_bytes_set_kernel(kernels[k]))
+            continue;
+
+        fail_unless(curvecpr_bytes_kernel() == kernels[k]);
+
+        for (num = 0; num <= 1120; num += num < 70 ? 1 : 37) {
+            for (offset = 0; offset < 4; ++offset) {
+                /* Copy touches exactly the bytes it's asked to. */
+                memset(destination, 0xaa, sizeof(destination));
+                curvecpr_bytes_copy(destination + offset, source + 3, num);
+
+                fail_unless(memcmp(destination + offset, source + 3, num) == 0);
+                for (i = 0; i < offset; ++i)
+                    fail_unless(destination[i] == 0xaa);
+                for (i = offset + num; i < sizeof(destination); ++i)
+                    fail_unless(destination[i] == 0xaa);
+
+                /* So does zero. */
+                curvecpr_bytes_zero(destination + offset, num);
+
+                for (i = 0; i < sizeof(destination); ++i)
+                    fail_unless(destination[i] == (i >= offset && i < offset + num ? 0 : 0xaa));
+
+                /* Equal notices a difference anywhere. */
+                memcpy(other + offset, source + 1, num);
+                fail_unless(curvecpr_bytes_equal(other + offset, source + 1, num) == 1);
+
+                for (i = 0; i < num; i += num / 5 + 1) {
+                    other[offset + i] ^= 0x10;
+                    fail_unless(curvecpr_bytes_equal(other + offset, source + 1, num) == 0);
+                    other[offset + i] ^= 0x10;
+                }
+
+                if (num > 0) {
+                    other[offset + num - 1] ^= 0x80;
+                    fail_unless(curvecpr_bytes_equal(other + offset, source + 1, num) == 0);
+                }
+            }
+        }
+    }
+}
+END_TEST
+
+RUN_TEST (test_kernels_agree)
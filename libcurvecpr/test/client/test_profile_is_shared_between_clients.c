@@ -0,0 +1,141 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/client.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+#include <curvecpr/util.h>
+
+#include <sodium/crypto_box.h>
+#include <sodium/randombytes.h>
+
+static unsigned char wire[1184];
+static size_t wire_num = 0;
+
+static int put_session_calls = 0;
+static unsigned char registered_domain_name[256];
+static unsigned char registered_global_pk[32];
+
+static int t_put_session (struct curvecpr_server *server, const struct curvecpr_session *s, void *priv, struct curvecpr_session **s_stored)
+{
+    static struct curvecpr_session stored;
+
+    curvecpr_bytes_copy(&stored, s, sizeof(struct curvecpr_session));
+    curvecpr_bytes_copy(registered_domain_name, s->my_domain_name, 256);
+    curvecpr_bytes_copy(registered_global_pk, s->their_global_pk, 32);
+    ++put_session_calls;
+
+    *s_stored = &stored;
+    return 0;
+}
+
+static int t_get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    return 1;
+}
+
+static int t_server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_server_recv (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    return 0;
+}
+
+static int t_server_next_nonce (struct curvecpr_server *server, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+static int t_client_send (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_client_next_nonce (struct curvecpr_client *client, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+START_TEST (test_profile_is_shared_between_clients)
+{
+    struct curvecpr_server server;
+    struct curvecpr_server_cf server_cf = {
+        .ops = {
+            .put_session = t_put_session,
+            .get_session = t_get_session,
+            .send = t_server_send,
+            .recv = t_server_recv,
+            .next_nonce = t_server_next_nonce
+        }
+    };
+    struct curvecpr_client_cf profile_cf = { .my_extension = { 0 } };
+    struct curvecpr_client_profile *profile;
+    struct curvecpr_client clients[2];
+    struct curvecpr_client_cf client_cf = {
+        .ops = {
+            .send = t_client_send,
+            .next_nonce = t_client_next_nonce
+        }
+    };
+    unsigned char expected[32];
+    unsigned char message[16] = { 0 };
+    int i;
+
+    crypto_box_keypair(server_cf.my_global_pk, server_cf.my_global_sk);
+    curvecpr_server_new(&server, &server_cf);
+
+    crypto_box_keypair(profile_cf.my_global_pk, profile_cf.my_global_sk);
+    curvecpr_bytes_copy(profile_cf.their_global_pk, server_cf.my_global_pk, 32);
+    fail_unless(curvecpr_util_encode_domain_name(profile_cf.their_domain_name, "example.com"));
+
+    fail_unless(curvecpr_client_profile_new(&profile, &profile_cf) == 0);
+    crypto_box_beforenm(expected, server_cf.my_global_pk, profile_cf.my_global_sk);
+    fail_unless(curvecpr_bytes_equal(profile->my_global_their_global_key, expected, 32));
+
+    client_cf.profile = profile;
+
+    /* The keys and the domain name aren't copied into each client, so a client is
+       smaller than the configuration it's made from. */
+    fail_unless(sizeof(struct curvecpr_client) - sizeof(struct curvecpr_session) < sizeof(struct curvecpr_client_cf));
+
+    for (i = 0; i < 2; ++i) {
+        fail_unless(curvecpr_client_new(&clients[i], &client_cf) == 0);
+
+        /* Everything but the secret key is read through the profile. */
+        fail_unless(clients[i].profile == profile);
+        fail_unless(curvecpr_bytes_equal(clients[i].my_extension, profile->my_extension, 16));
+
+        /* And the handshake still works all the way through. */
+        fail_unless(curvecpr_client_connected(&clients[i]) == 0);
+        fail_unless(curvecpr_bytes_equal(clients[i].session.my_global_their_global_key, expected, 32));
+        fail_unless(curvecpr_server_recv(&server, NULL, wire, wire_num, NULL) == 0);
+        fail_unless(curvecpr_client_recv(&clients[i], wire, wire_num) == 0);
+        fail_unless(curvecpr_client_send(&clients[i], message, sizeof(message)) == 0);
+        fail_unless(curvecpr_server_recv(&server, NULL, wire, wire_num, NULL) == 0);
+    }
+
+    fail_unless(put_session_calls == 2);
+    fail_unless(curvecpr_bytes_equal(registered_domain_name, profile_cf.their_domain_name, 256));
+    fail_unless(curvecpr_bytes_equal(registered_global_pk, profile_cf.my_global_pk, 32));
+
+    /* Each client holds a reference until it's destroyed. */
+    fail_unless(profile->refs == 3);
+    curvecpr_client_destroy(&clients[0]);
+    curvecpr_client_destroy(&clients[1]);
+    fail_unless(profile->refs == 1);
+
+    curvecpr_client_profile_unref(profile);
+}
+END_TEST
+
+RUN_TEST (test_profile_is_shared_between_clients)
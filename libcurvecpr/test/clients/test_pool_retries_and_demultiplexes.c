@@ -0,0 +1,207 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/client.h>
+#include <curvecpr/clients.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+
+#include <errno.h>
+
+#include <sodium/crypto_box.h>
+#include <sodium/randombytes.h>
+
+/* Packets in flight between the pool and the server, delivered one at a time. */
+static struct {
+    unsigned char buf[1184];
+    size_t num;
+    int to_server;
+} queue[16];
+static int queue_len = 0;
+
+static struct curvecpr_session sessions[3];
+static int num_sessions = 0;
+
+static int hellos[3];
+static int echoes[3];
+static int connected[3];
+static int gave_up[3];
+
+static void enqueue (const unsigned char *buf, size_t num, int to_server)
+{
+    fail_unless(queue_len < 16);
+
+    curvecpr_bytes_copy(queue[queue_len].buf, buf, num);
+    queue[queue_len].num = num;
+    queue[queue_len].to_server = to_server;
+    ++queue_len;
+}
+
+static int t_put_session (struct curvecpr_server *server, const struct curvecpr_session *s, void *priv, struct curvecpr_session **s_stored)
+{
+    curvecpr_bytes_copy(&sessions[num_sessions], s, sizeof(struct curvecpr_session));
+    *s_stored = &sessions[num_sessions++];
+    return 0;
+}
+
+static int t_get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    int i;
+
+    for (i = 0; i < num_sessions; ++i) {
+        if (curvecpr_bytes_equal(sessions[i].their_session_pk, their_session_pk, 32)) {
+            *s_stored = &sessions[i];
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int t_server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    enqueue(buf, num, 0);
+    return 0;
+}
+
+static int t_server_recv (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    return curvecpr_server_send(server, s, priv, buf, num);
+}
+
+static int t_server_next_nonce (struct curvecpr_server *server, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+static int t_send (struct curvecpr_clients *clients, crypto_uint32 index, const unsigned char *buf, size_t num)
+{
+    /* Client 1 loses its first hello; client 2 loses them all. */
+    if (buf[7] == 'H' && (index == 2 || (index == 1 && hellos[1]++ == 0)))
+        return 0;
+
+    enqueue(buf, num, 1);
+    return 0;
+}
+
+static int t_recv (struct curvecpr_clients *clients, crypto_uint32 index, const unsigned char *buf, size_t num)
+{
+    ++echoes[index];
+    return 0;
+}
+
+static void t_connected (struct curvecpr_clients *clients, crypto_uint32 index)
+{
+    unsigned char message[32] = { 0 };
+
+    ++connected[index];
+    fail_unless(curvecpr_clients_send(clients, index, message, sizeof(message)) == 0);
+}
+
+static void t_failed (struct curvecpr_clients *clients, crypto_uint32 index)
+{
+    ++gave_up[index];
+}
+
+static void deliver (struct curvecpr_server *server, struct curvecpr_clients *clients, long long now)
+{
+    while (queue_len > 0) {
+        unsigned char buf[1184];
+        size_t num = queue[0].num;
+        int to_server = queue[0].to_server;
+
+        curvecpr_bytes_copy(buf, queue[0].buf, num);
+        memmove(&queue[0], &queue[1], (size_t)(queue_len - 1) * sizeof(queue[0]));
+        --queue_len;
+
+        if (to_server)
+            curvecpr_server_recv(server, NULL, buf, num, NULL);
+        else
+            fail_unless(curvecpr_clients_recv(clients, buf, num, now) == 0);
+    }
+}
+
+START_TEST (test_pool_retries_and_demultiplexes)
+{
+    struct curvecpr_server server;
+    struct curvecpr_server_cf server_cf = {
+        .ops = {
+            .put_session = t_put_session,
+            .get_session = t_get_session,
+            .send = t_server_send,
+            .recv = t_server_recv,
+            .next_nonce = t_server_next_nonce
+        }
+    };
+    struct curvecpr_client_cf profile_cf = { .my_extension = { 0 } };
+    struct curvecpr_client_profile *profile;
+    struct curvecpr_clients clients;
+    struct curvecpr_clients_cf cf = {
+        .clients = 3,
+        .hello_interval = 100,
+        .hello_attempts = 2,
+        .ops = {
+            .send = t_send,
+            .recv = t_recv,
+            .connected = t_connected,
+            .failed = t_failed
+        }
+    };
+    unsigned char stray[64];
+    crypto_uint32 i;
+
+    crypto_box_keypair(server_cf.my_global_pk, server_cf.my_global_sk);
+    curvecpr_server_new(&server, &server_cf);
+
+    crypto_box_keypair(profile_cf.my_global_pk, profile_cf.my_global_sk);
+    curvecpr_bytes_copy(profile_cf.their_global_pk, server_cf.my_global_pk, 32);
+    fail_unless(curvecpr_client_profile_new(&profile, &profile_cf) == 0);
+
+    cf.profile = profile;
+    fail_unless(curvecpr_clients_new(&clients, &cf) == 0);
+    curvecpr_client_profile_unref(profile);
+
+    for (i = 0; i < 3; ++i)
+        fail_unless(curvecpr_clients_connect(&clients, i, 0) == 0);
+    fail_unless(curvecpr_clients_connect(&clients, 1, 0) == -EALREADY);
+
+    /* Only client 0 hears back at first, and its echo comes back to it. */
+    deliver(&server, &clients, 10);
+    fail_unless(connected[0] == 1 && connected[1] == 0 && connected[2] == 0);
+    fail_unless(echoes[0] == 1);
+    fail_unless(clients.stats.connect_time == 10);
+    fail_unless(curvecpr_clients_next_timeout(&clients) == 100);
+
+    /* Nothing is due yet. */
+    curvecpr_clients_process(&clients, 99);
+    fail_unless(clients.stats.hello_retries == 0);
+
+    /* Both hellos are resent; client 1's gets through this time. */
+    curvecpr_clients_process(&clients, 100);
+    fail_unless(clients.stats.hello_retries == 2);
+    deliver(&server, &clients, 150);
+    fail_unless(connected[1] == 1 && echoes[1] == 1);
+
+    /* Client 2 runs out of attempts. */
+    curvecpr_clients_process(&clients, 200);
+    fail_unless(gave_up[2] == 1);
+    fail_unless(curvecpr_clients_next_timeout(&clients) == -1);
+    fail_unless(curvecpr_clients_send(&clients, 2, stray, 32) == -ENOTCONN);
+
+    fail_unless(clients.stats.connected == 2);
+    fail_unless(clients.stats.failed == 1);
+    fail_unless(clients.stats.connecting == 0);
+    fail_unless(clients.stats.hellos == 5);
+
+    /* Packets that aren't for any of our clients are dropped. */
+    curvecpr_bytes_zero(stray, sizeof(stray));
+    fail_unless(curvecpr_clients_recv(&clients, stray, sizeof(stray), 300) == -EINVAL);
+    fail_unless(clients.stats.packets_dropped == 1);
+
+    curvecpr_clients_destroy(&clients);
+}
+END_TEST
+
+RUN_TEST (test_pool_retries_and_demultiplexes)
@@ -0,0 +1,94 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <errno.h>
+
+#include <curvecpr/clock.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+
+static int sent = 0;
+
+static int t_send (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
+{
+    ++sent;
+    return 0;
+}
+
+static const unsigned char payload[100];
+
+START_TEST (test_injected_clock_drives_messager)
+{
+    struct curvecpr_clock clock;
+    struct curvecpr_messager messager;
+    struct curvecpr_messager_cf cf = {
+        .ops = {
+            .send = t_send
+        },
+        .clock = &clock
+    };
+    struct curvecpr_queues queues;
+    struct curvecpr_queues_cf queues_cf = {
+        .send_blocks = 4,
+        .recv_blocks = 4
+    };
+    struct curvecpr_block block = {
+        .eof = CURVECPR_BLOCK_STREAM,
+        .data_len = 100,
+        .data = payload
+    };
+    struct curvecpr_block *head;
+    long long now, then;
+
+    /* The system clocks only go forward. */
+    curvecpr_clock_new(&clock, CURVECPR_CLOCK_MONOTONIC);
+    now = curvecpr_clock_now(&clock);
+    fail_unless(now > 0);
+    fail_unless(curvecpr_clock_now(&clock) >= now);
+    fail_unless(curvecpr_clock_now(NULL) >= now);
+
+    curvecpr_clock_new(&clock, CURVECPR_CLOCK_MONOTONIC_COARSE);
+    fail_unless(curvecpr_clock_now(&clock) > 0);
+
+    /* An injected clock is whatever it's set to. */
+    curvecpr_clock_new(&clock, CURVECPR_CLOCK_INJECTED);
+    curvecpr_clock_set(&clock, 1000000000000LL);
+    fail_unless(curvecpr_clock_now(&clock) == 1000000000000LL);
+
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+
+    curvecpr_messager_new(&messager, &cf, 0);
+    fail_unless(messager.chicago.clock == 1000000000000LL);
+
+    fail_unless(curvecpr_queues_sendq_put(&queues, &block) == 0);
+
+    /* The first block goes out at once and is stamped with the injected time. */
+    curvecpr_clock_set(&clock, 1000000000000LL + 5);
+    fail_unless(curvecpr_messager_process_sendq(&messager) == 0);
+    fail_unless(sent == 1);
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &head) == 0);
+    fail_unless(head->clock == 1000000000000LL + 5);
+
+    /* Nothing more is due until the retransmission timeout, which is measured from
+       the injected time too. */
+    fail_unless(curvecpr_messager_next_timeout(&messager) == messager.chicago.rtt_timeout);
+    fail_unless(curvecpr_messager_process_sendq(&messager) == -EAGAIN);
+
+    then = 1000000000000LL + 5 + messager.chicago.rtt_timeout;
+    curvecpr_clock_set(&clock, then - 1);
+    fail_unless(curvecpr_messager_next_timeout(&messager) == 1);
+    fail_unless(curvecpr_messager_process_sendq(&messager) == -EAGAIN);
+    fail_unless(sent == 1);
+
+    curvecpr_clock_set(&clock, then);
+    fail_unless(curvecpr_messager_process_sendq(&messager) == 0);
+    fail_unless(sent == 2);
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &head) == 0);
+    fail_unless(head->clock == then);
+
+    curvecpr_queues_destroy(&queues);
+}
+END_TEST
+
+RUN_TEST (test_injected_clock_drives_messager)
@@ -0,0 +1,207 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/client.h>
+#include <curvecpr/handshakes.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+
+#include <errno.h>
+
+#include <sodium/crypto_box.h>
+#include <sodium/randombytes.h>
+
+static struct curvecpr_session stored;
+static int stored_num = 0;
+
+static unsigned char wire[1184];
+static size_t wire_num = 0;
+
+static unsigned char received[1088];
+static size_t received_num = 0;
+
+static struct curvecpr_session *completed_s = NULL;
+static int completed_result = 1;
+static unsigned char completed_peer[16];
+static int queued_calls = 0, done_calls = 0;
+
+static int t_put_session (struct curvecpr_server *server, const struct curvecpr_session *s, void *priv, struct curvecpr_session **s_stored)
+{
+    curvecpr_bytes_copy(&stored, s, sizeof(struct curvecpr_session));
+    ++stored_num;
+
+    *s_stored = &stored;
+    return 0;
+}
+
+static int t_get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    if (!stored_num || !curvecpr_bytes_equal(stored.their_session_pk, their_session_pk, 32))
+        return 1;
+
+    *s_stored = &stored;
+    return 0;
+}
+
+static int t_server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_server_recv (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(received, buf, num);
+    received_num = num;
+    return 0;
+}
+
+static int t_server_next_nonce (struct curvecpr_server *server, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+static int t_client_send (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_client_next_nonce (struct curvecpr_client *client, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+static void t_queued (struct curvecpr_handshakes *handshakes)
+{
+    ++queued_calls;
+}
+
+static void t_done (struct curvecpr_handshakes *handshakes)
+{
+    ++done_calls;
+}
+
+static void t_complete (struct curvecpr_handshakes *handshakes, struct curvecpr_server *server, struct curvecpr_session *s, void *priv, int result)
+{
+    completed_s = s;
+    completed_result = result;
+
+    if (priv)
+        curvecpr_bytes_copy(completed_peer, priv, sizeof(completed_peer));
+    else
+        curvecpr_bytes_zero(completed_peer, sizeof(completed_peer));
+}
+
+static void initiate (struct curvecpr_server *server, struct curvecpr_client *client, const struct curvecpr_client_cf *client_cf, const unsigned char *message, size_t num)
+{
+    fail_unless(curvecpr_client_new(client, client_cf) == 0);
+    fail_unless(curvecpr_client_connected(client) == 0);
+    fail_unless(curvecpr_server_recv(server, NULL, wire, wire_num, NULL) == 0);
+    fail_unless(curvecpr_client_recv(client, wire, wire_num) == 0);
+    fail_unless(curvecpr_client_send(client, message, num) == 0);
+}
+
+START_TEST (test_initiate_completes_after_work)
+{
+    struct curvecpr_handshakes handshakes;
+    struct curvecpr_handshakes_cf handshakes_cf = {
+        .jobs = 1,
+        .priv_bytes = 16,
+        .ops = {
+            .queued = t_queued,
+            .done = t_done,
+            .complete = t_complete
+        }
+    };
+    struct curvecpr_server server;
+    struct curvecpr_server_cf server_cf = {
+        .ops = {
+            .put_session = t_put_session,
+            .get_session = t_get_session,
+            .send = t_server_send,
+            .recv = t_server_recv,
+            .next_nonce = t_server_next_nonce
+        }
+    };
+    struct curvecpr_client client, other;
+    struct curvecpr_client_cf client_cf = {
+        .ops = {
+            .send = t_client_send,
+            .next_nonce = t_client_next_nonce
+        }
+    };
+    unsigned char other_wire[1184];
+    size_t other_wire_num;
+    unsigned char message[64];
+    unsigned char peer[16];
+
+    curvecpr_bytes_zero(message, sizeof(message));
+    curvecpr_bytes_copy(message, "hello, server", 13);
+
+    fail_unless(curvecpr_handshakes_new(&handshakes, &handshakes_cf) == 0);
+
+    crypto_box_keypair(server_cf.my_global_pk, server_cf.my_global_sk);
+    curvecpr_handshakes_configure(&handshakes, &server_cf);
+    curvecpr_server_new(&server, &server_cf);
+
+    crypto_box_keypair(client_cf.my_global_pk, client_cf.my_global_sk);
+    curvecpr_bytes_copy(client_cf.their_global_pk, server_cf.my_global_pk, 32);
+
+    /* Another client's initiate, for later. */
+    initiate(&server, &other, &client_cf, message, sizeof(message));
+    curvecpr_bytes_copy(other_wire, wire, wire_num);
+    other_wire_num = wire_num;
+
+    /* The initiate is queued, and nothing is registered yet. The caller's priv
+       (here, where the packet came from) is gone as soon as the call returns. */
+    initiate(&server, &client, &client_cf, message, sizeof(message));
+    curvecpr_bytes_copy(peer, "192.0.2.1:12345", sizeof(peer));
+    fail_unless(curvecpr_server_recv(&server, peer, wire, wire_num, NULL) == -EINPROGRESS);
+    curvecpr_bytes_zero(peer, sizeof(peer));
+    fail_unless(queued_calls == 1);
+    fail_unless(stored_num == 0);
+    fail_unless(curvecpr_server_handshakes_complete(&server, 16) == 0);
+
+    /* There's only room for one. */
+    fail_unless(curvecpr_server_recv(&server, NULL, other_wire, other_wire_num, NULL) == -ENOBUFS);
+    fail_unless(handshakes.refused == 1);
+
+    /* A worker validates it; the receive thread registers it. */
+    fail_unless(curvecpr_server_handshakes_work(&handshakes, 16) == 1);
+    fail_unless(done_calls == 1);
+    fail_unless(stored_num == 0);
+
+    fail_unless(curvecpr_server_handshakes_complete(&server, 16) == 1);
+    fail_unless(stored_num == 1);
+    fail_unless(completed_result == 0);
+    fail_unless(completed_s == &stored);
+    fail_unless(curvecpr_bytes_equal(completed_peer, "192.0.2.1:12345", sizeof(completed_peer)));
+    fail_unless(curvecpr_bytes_equal(stored.their_session_pk, client.session.my_session_pk, 32));
+    fail_unless(received_num == sizeof(message) && curvecpr_bytes_equal(received, message, sizeof(message)));
+
+    /* The client is known now, so its next initiate is handled right away. */
+    fail_unless(curvecpr_client_send(&client, message, sizeof(message)) == 0);
+    fail_unless(curvecpr_server_recv(&server, NULL, wire, wire_num, NULL) == 0);
+
+    /* Bad initiates fail on the worker and are reported on completion. */
+    other_wire[200] ^= 1;
+    fail_unless(curvecpr_server_recv(&server, NULL, other_wire, other_wire_num, NULL) == -EINPROGRESS);
+    fail_unless(curvecpr_server_handshakes_work(&handshakes, 16) == 1);
+    fail_unless(curvecpr_server_handshakes_complete(&server, 16) == 1);
+    fail_unless(completed_result == -EINVAL);
+    fail_unless(completed_s == NULL);
+    fail_unless(stored_num == 1);
+
+    curvecpr_client_destroy(&client);
+    curvecpr_client_destroy(&other);
+    curvecpr_handshakes_destroy(&handshakes);
+}
+END_TEST
+
+RUN_TEST (test_initiate_completes_after_work)
@@ -0,0 +1,76 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/keycache.h>
+
+#include <errno.h>
+
+#include <sodium/crypto_box.h>
+
+START_TEST (test_beforenm_caches_and_evicts)
+{
+    struct curvecpr_keycache keycache;
+    struct curvecpr_keycache_cf cf = { .capacity = 2, .shards = 1 };
+    struct curvecpr_keycache_stats stats;
+    unsigned char my_pk[32], my_sk[32];
+    unsigned char pks[3][32], sk[32];
+    unsigned char key[32], expected[32];
+    int i;
+
+    crypto_box_keypair(my_pk, my_sk);
+    for (i = 0; i < 3; ++i)
+        crypto_box_keypair(pks[i], sk);
+
+    fail_unless(curvecpr_keycache_new(&keycache, &cf) == 0);
+
+    /* Misses compute the key; hits return the same one. */
+    curvecpr_keycache_beforenm(&keycache, key, pks[0], my_sk);
+    crypto_box_beforenm(expected, pks[0], my_sk);
+    fail_unless(curvecpr_bytes_equal(key, expected, 32));
+
+    curvecpr_keycache_beforenm(&keycache, key, pks[1], my_sk);
+    curvecpr_bytes_zero(key, 32);
+    curvecpr_keycache_beforenm(&keycache, key, pks[0], my_sk);
+    fail_unless(curvecpr_bytes_equal(key, expected, 32));
+
+    curvecpr_keycache_stats(&keycache, &stats);
+    fail_unless(stats.hits == 1 && stats.misses == 2 && stats.evictions == 0);
+
+    /* A third key pushes out the least recently used one, and wipes it. */
+    curvecpr_keycache_beforenm(&keycache, key, pks[2], my_sk);
+    curvecpr_keycache_beforenm(&keycache, key, pks[0], my_sk);
+    curvecpr_keycache_beforenm(&keycache, key, pks[1], my_sk);
+    crypto_box_beforenm(expected, pks[1], my_sk);
+    fail_unless(curvecpr_bytes_equal(key, expected, 32));
+
+    curvecpr_keycache_stats(&keycache, &stats);
+    fail_unless(stats.hits == 2 && stats.misses == 4 && stats.evictions == 2);
+
+    curvecpr_keycache_destroy(&keycache);
+
+    /* Shards split the capacity between them. */
+    cf.capacity = 5;
+    cf.shards = 3;
+    fail_unless(curvecpr_keycache_new(&keycache, &cf) == 0);
+    fail_unless(keycache.shard_mask == 3);
+    fail_unless(keycache.shards[0].capacity == 2 && keycache.shards[3].capacity == 1);
+
+    for (i = 0; i < 3; ++i) {
+        curvecpr_keycache_beforenm(&keycache, key, pks[i], my_sk);
+        curvecpr_keycache_beforenm(&keycache, key, pks[i], my_sk);
+        crypto_box_beforenm(expected, pks[i], my_sk);
+        fail_unless(curvecpr_bytes_equal(key, expected, 32));
+    }
+
+    curvecpr_keycache_stats(&keycache, &stats);
+    fail_unless(stats.hits + stats.misses == 6);
+
+    curvecpr_keycache_destroy(&keycache);
+
+    cf.capacity = 2;
+    fail_unless(curvecpr_keycache_new(&keycache, &cf) == -EINVAL);
+}
+END_TEST
+
+RUN_TEST (test_beforenm_caches_and_evicts)
@@ -0,0 +1,122 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/client.h>
+#include <curvecpr/keypairs.h>
+#include <curvecpr/server.h>
+
+#include <errno.h>
+
+#include <sodium/crypto_box.h>
+#include <sodium/randombytes.h>
+
+static unsigned char wire[1184];
+static size_t wire_num = 0;
+static int low_calls = 0;
+
+static void t_low (struct curvecpr_keypairs *keypairs)
+{
+    ++low_calls;
+}
+
+static int t_server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_server_next_nonce (struct curvecpr_server *server, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+static int t_client_send (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_client_next_nonce (struct curvecpr_client *client, unsigned char *destination, size_t num)
+{
+    randombytes(destination, num);
+    return 0;
+}
+
+START_TEST (test_hello_takes_pooled_keypair)
+{
+    struct curvecpr_keypairs keypairs;
+    struct curvecpr_keypairs_cf keypairs_cf = {
+        .capacity = 3,
+        .low_water = 2,
+        .ops = {
+            .low = t_low
+        }
+    };
+    struct curvecpr_server server;
+    struct curvecpr_server_cf server_cf = {
+        .ops = {
+            .send = t_server_send,
+            .next_nonce = t_server_next_nonce
+        }
+    };
+    struct curvecpr_client client;
+    struct curvecpr_client_cf client_cf = {
+        .ops = {
+            .send = t_client_send,
+            .next_nonce = t_client_next_nonce
+        }
+    };
+    unsigned char pooled_pk[32];
+    unsigned char pk[32], sk[32];
+
+    fail_unless(curvecpr_keypairs_new(&keypairs, &keypairs_cf) == 0);
+
+    /* Rounded up to 4, and filling stops when it's full. */
+    fail_unless(curvecpr_keypairs_fill(&keypairs, 1) == 1);
+    fail_unless(curvecpr_keypairs_fill(&keypairs, 100) == 3);
+    fail_unless(curvecpr_keypairs_len(&keypairs) == 4);
+    curvecpr_bytes_copy(pooled_pk, keypairs.keypairs[0].pk, 32);
+
+    crypto_box_keypair(server_cf.my_global_pk, server_cf.my_global_sk);
+    curvecpr_keypairs_configure(&keypairs, &server_cf);
+    curvecpr_server_new(&server, &server_cf);
+
+    crypto_box_keypair(client_cf.my_global_pk, client_cf.my_global_sk);
+    curvecpr_bytes_copy(client_cf.their_global_pk, server_cf.my_global_pk, 32);
+    fail_unless(curvecpr_client_new(&client, &client_cf) == 0);
+
+    /* The cookie carries the first pooled key, and the client can read it. */
+    fail_unless(curvecpr_client_connected(&client) == 0);
+    fail_unless(curvecpr_server_recv(&server, NULL, wire, wire_num, NULL) == 0);
+    fail_unless(curvecpr_client_recv(&client, wire, wire_num) == 0);
+    fail_unless(curvecpr_bytes_equal(client.session.their_session_pk, pooled_pk, 32));
+
+    fail_unless(keypairs.taken == 1);
+    fail_unless(low_calls == 0);
+
+    /* Dropping to the low-water mark asks for more. */
+    fail_unless(curvecpr_keypairs_take(&keypairs, pk, sk) == 0);
+    fail_unless(low_calls == 1);
+    fail_unless(curvecpr_keypairs_take(&keypairs, pk, sk) == 0);
+    fail_unless(curvecpr_keypairs_take(&keypairs, pk, sk) == 0);
+    fail_unless(curvecpr_keypairs_take(&keypairs, pk, sk) == -EAGAIN);
+    fail_unless(keypairs.missed == 1);
+
+    /* With the pool empty, hellos still get answered. */
+    curvecpr_client_destroy(&client);
+    fail_unless(curvecpr_client_new(&client, &client_cf) == 0);
+    fail_unless(curvecpr_client_connected(&client) == 0);
+    fail_unless(curvecpr_server_recv(&server, NULL, wire, wire_num, NULL) == 0);
+    fail_unless(curvecpr_client_recv(&client, wire, wire_num) == 0);
+    fail_unless(keypairs.missed == 2);
+
+    curvecpr_client_destroy(&client);
+    curvecpr_keypairs_destroy(&keypairs);
+}
+END_TEST
+
+RUN_TEST (test_hello_takes_pooled_keypair)
@@ -0,0 +1,66 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/message.h>
+
+static crypto_uint64 state = 0x9e3779b97f4a7c15ULL;
+
+static crypto_uint64 next (void)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+START_TEST (test_pack_unpack_round_trips)
+{
+    unsigned char wire[CURVECPR_MESSAGE_HEADER + 2], packed[CURVECPR_MESSAGE_HEADER + 2];
+    struct curvecpr_message message;
+    int n, i;
+
+    for (n = 0; n < 100000; ++n) {
+        unsigned long long end;
+
+        for (i = 0; i < (int)sizeof(wire); ++i)
+            wire[i] = (unsigned char)next();
+
+        /* Half the time, leave the later ranges empty like a real sender would. */
+        if (n & 1)
+            curvecpr_bytes_zero(wire + 20 + 4 * (int)(next() % 5), 4);
+
+        curvecpr_message_unpack(&message, wire + 1);
+
+        /* Decoding agrees with reading each field by hand. */
+        fail_unless(message.id == curvecpr_bytes_unpack_uint32(wire + 1));
+        fail_unless(message.acknowledging_id == curvecpr_bytes_unpack_uint32(wire + 5));
+        fail_unless(message.flags == curvecpr_bytes_unpack_uint16(wire + 39));
+        fail_unless(message.offset == curvecpr_bytes_unpack_uint64(wire + 41));
+
+        end = curvecpr_bytes_unpack_uint64(wire + 9);
+        fail_unless(message.acknowledging_ranges[0].start == 0);
+        fail_unless(message.acknowledging_ranges[0].end == end);
+
+        fail_unless(message.acknowledging_ranges[1].start == end + curvecpr_bytes_unpack_uint32(wire + 17));
+        end = message.acknowledging_ranges[1].start + curvecpr_bytes_unpack_uint16(wire + 21);
+        fail_unless(message.acknowledging_ranges[1].end == end);
+
+        for (i = 2; i < 6; ++i) {
+            fail_unless(message.acknowledging_ranges[i].start == end + curvecpr_bytes_unpack_uint16(wire + 15 + 4 * i));
+            end = message.acknowledging_ranges[i].start + curvecpr_bytes_unpack_uint16(wire + 17 + 4 * i);
+            fail_unless(message.acknowledging_ranges[i].end == end);
+        }
+
+        /* And encoding it again gives back exactly the same bytes, without touching
+           anything around them. */
+        packed[0] = packed[CURVECPR_MESSAGE_HEADER + 1] = 0xa5;
+        curvecpr_message_pack(packed + 1, &message);
+
+        fail_unless(memcmp(packed + 1, wire + 1, CURVECPR_MESSAGE_HEADER) == 0);
+        fail_unless(packed[0] == 0xa5 && packed[CURVECPR_MESSAGE_HEADER + 1] == 0xa5);
+    }
+}
+END_TEST
+
+RUN_TEST (test_pack_unpack_round_trips)
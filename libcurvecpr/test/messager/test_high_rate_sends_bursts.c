@@ -0,0 +1,91 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+
+static int sent = 0;
+
+static int t_send (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
+{
+    ++sent;
+    return 0;
+}
+
+static const unsigned char payload[100];
+
+START_TEST (test_high_rate_sends_bursts)
+{
+    struct curvecpr_messager messager;
+    struct curvecpr_messager_cf cf = {
+        .ops = {
+            .send = t_send
+        },
+        .high_rate = 1,
+        .burst = 8
+    };
+    struct curvecpr_queues queues;
+    struct curvecpr_queues_cf queues_cf = {
+        .send_blocks = 32,
+        .sendmarkq_blocks = 12,
+        .recv_blocks = 4
+    };
+    struct curvecpr_block block = {
+        .eof = CURVECPR_BLOCK_STREAM,
+        .data_len = 100,
+        .data = payload
+    };
+    int i;
+
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+
+    curvecpr_messager_new(&messager, &cf, 0);
+    fail_unless(messager.chicago.wr_rate_floor == CURVECPR_CHICAGO_HIGH_RATE_FLOOR);
+
+    for (i = 0; i < 20; ++i)
+        fail_unless(curvecpr_queues_sendq_put(&queues, &block) == 0);
+
+    /* Blocks are due every microsecond and it's been ages, so a whole burst goes. */
+    messager.chicago.wr_rate = 1000;
+    messager.my_sent_clock = 0;
+    fail_unless(curvecpr_messager_process_sendq(&messager) == 0);
+    fail_unless(sent == 8);
+    fail_unless(queues.sendmarkq_len == 8);
+
+    /* The send clock isn't ahead of now, so the average rate holds. */
+    fail_unless(messager.my_sent_clock <= messager.chicago.clock);
+    fail_unless(messager.my_sent_clock > 0);
+
+    /* The next burst stops once the sendmarkq is full. */
+    messager.my_sent_clock = 0;
+    fail_unless(curvecpr_messager_process_sendq(&messager) == 0);
+    fail_unless(sent == 12);
+    fail_unless(queues.sendmarkq_len == 12);
+    fail_unless(messager.my_sent_clock < messager.chicago.clock);
+
+    curvecpr_queues_destroy(&queues);
+
+    /* Without high-rate mode, it's one block at a time as before. */
+    cf.high_rate = 0;
+    sent = 0;
+
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+
+    curvecpr_messager_new(&messager, &cf, 0);
+    fail_unless(messager.chicago.wr_rate_floor == CURVECPR_CHICAGO_FLOOR);
+
+    for (i = 0; i < 20; ++i)
+        fail_unless(curvecpr_queues_sendq_put(&queues, &block) == 0);
+
+    messager.chicago.wr_rate = 1000;
+    messager.my_sent_clock = 0;
+    fail_unless(curvecpr_messager_process_sendq(&messager) == 0);
+    fail_unless(sent == 1);
+
+    curvecpr_queues_destroy(&queues);
+}
+END_TEST
+
+RUN_TEST (test_high_rate_sends_bursts)
@@ -10,7 +10,7 @@ static struct curvecpr_block static_block = {
     .clock = 0,
     .eof = CURVECPR_BLOCK_STREAM,
     .data_len = 7,
-    .data = "Hello!"
+    .data = (const unsigned char *)"Hello!"
 };
 
 static unsigned char t_q_is_full (struct curvecpr_messager *messager)
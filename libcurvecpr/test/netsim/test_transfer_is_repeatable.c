@@ -0,0 +1,93 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bbr.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/netsim.h>
+
+#define DELAY 20000000LL
+
+static void _configure_bbr (struct curvecpr_netsim *netsim, int side, struct curvecpr_messager_cf *cf)
+{
+    struct curvecpr_bbr *bbr = netsim->cf.priv;
+
+    curvecpr_bbr_new(&bbr[side]);
+    curvecpr_bbr_configure(&bbr[side], cf);
+}
+
+static void _lossy (struct curvecpr_netsim_cf *cf)
+{
+    int i;
+
+    curvecpr_bytes_zero(cf, sizeof(struct curvecpr_netsim_cf));
+
+    for (i = 0; i < 2; ++i) {
+        cf->links[i].delay = DELAY;
+        cf->links[i].jitter = 2000000;
+        cf->links[i].bandwidth = 4000000;
+        cf->links[i].queue_bytes = 65536;
+        cf->links[i].loss = 20000;
+    }
+
+    cf->bytes = 262144;
+    cf->seed = 42;
+}
+
+START_TEST (test_transfer_is_repeatable)
+{
+    struct curvecpr_netsim_cf cf;
+    struct curvecpr_netsim netsim;
+    struct curvecpr_netsim_report first;
+    struct curvecpr_bbr bbr[2];
+
+    _lossy(&cf);
+
+    fail_unless(curvecpr_netsim_new(&netsim, &cf) == 0);
+    fail_unless(curvecpr_netsim_run(&netsim) == 0);
+    curvecpr_bytes_copy(&first, &netsim.report, sizeof(struct curvecpr_netsim_report));
+    curvecpr_netsim_destroy(&netsim);
+
+    /* Everything arrived intact, despite some of it having to be sent again. */
+    fail_unless(first.completed);
+    fail_unless(first.bytes_received == cf.bytes);
+    fail_unless(first.bytes_corrupted == 0);
+    fail_unless(first.packets_lost[0] > 0);
+    fail_unless(first.blocks_resent > 0);
+    fail_unless(first.retransmit_ratio > 0 && first.retransmit_ratio < 0.5);
+
+    /* No round trip beats the speed of light. */
+    fail_unless(first.rtt_samples > 0);
+    fail_unless(first.rtt_min >= 2 * DELAY);
+    fail_unless(first.rtt_average >= first.rtt_min && first.rtt_max >= first.rtt_average);
+    fail_unless(first.goodput > 0 && first.goodput <= 4000000);
+
+    /* The same seed gives the same run, to the nanosecond. */
+    fail_unless(curvecpr_netsim_new(&netsim, &cf) == 0);
+    fail_unless(curvecpr_netsim_run(&netsim) == 0);
+    fail_unless(curvecpr_bytes_equal(&first, &netsim.report, sizeof(struct curvecpr_netsim_report)));
+    curvecpr_netsim_destroy(&netsim);
+
+    /* And a different one doesn't. */
+    cf.seed = 43;
+    fail_unless(curvecpr_netsim_new(&netsim, &cf) == 0);
+    fail_unless(curvecpr_netsim_run(&netsim) == 0);
+    fail_unless(netsim.report.completion_time != first.completion_time);
+    curvecpr_netsim_destroy(&netsim);
+
+    /* A client and server with BBR get there too, after a handshake. */
+    _lossy(&cf);
+    cf.handshake = 1;
+    cf.ops.configure = _configure_bbr;
+    cf.priv = bbr;
+
+    fail_unless(curvecpr_netsim_new(&netsim, &cf) == 0);
+    fail_unless(curvecpr_netsim_run(&netsim) == 0);
+    fail_unless(netsim.report.bytes_received == cf.bytes);
+    fail_unless(netsim.report.bytes_corrupted == 0);
+    fail_unless(netsim.report.handshake_time >= 4 * DELAY);
+    curvecpr_netsim_destroy(&netsim);
+}
+END_TEST
+
+RUN_TEST (test_transfer_is_repeatable)
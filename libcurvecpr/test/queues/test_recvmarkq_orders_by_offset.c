@@ -0,0 +1,70 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+
+static int recv_counter = 0;
+
+static void t_recv (struct curvecpr_messager *messager, const struct curvecpr_block *block)
+{
+    ++recv_counter;
+}
+
+static const unsigned char payload[100];
+
+START_TEST (test_recvmarkq_orders_by_offset)
+{
+    struct curvecpr_messager messager;
+    struct curvecpr_messager_cf cf = { .ops = { .send = NULL } };
+    struct curvecpr_queues queues;
+    struct curvecpr_queues_cf queues_cf = {
+        .send_blocks = 4,
+        .recv_blocks = 4,
+        .ops = {
+            .recv = t_recv
+        }
+    };
+    struct curvecpr_block block = {
+        .eof = CURVECPR_BLOCK_STREAM,
+        .data_len = 100,
+        .data = payload
+    };
+    struct curvecpr_block *stored = NULL;
+
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+
+    curvecpr_messager_new(&messager, &cf, 0);
+
+    block.offset = 200;
+    fail_unless(messager.cf.ops.recvmarkq_put(&messager, &block, &stored) == 0);
+    block.offset = 0;
+    fail_unless(messager.cf.ops.recvmarkq_put(&messager, &block, &stored) == 0);
+    block.offset = 100;
+    fail_unless(messager.cf.ops.recvmarkq_put(&messager, &block, &stored) == 0);
+
+    /* Duplicates aren't stored twice. */
+    fail_unless(messager.cf.ops.recvmarkq_put(&messager, &block, &stored) == 0);
+    fail_unless(recv_counter == 3);
+
+    fail_unless(messager.cf.ops.recvmarkq_get_nth_unacknowledged(&messager, 0, &stored) == 0);
+    fail_unless(stored->offset == 0);
+    fail_unless(messager.cf.ops.recvmarkq_get_nth_unacknowledged(&messager, 1, &stored) == 0);
+    fail_unless(stored->offset == 100);
+    fail_unless(messager.cf.ops.recvmarkq_get_nth_unacknowledged(&messager, 2, &stored) == 0);
+    fail_unless(stored->offset == 200);
+    fail_unless(messager.cf.ops.recvmarkq_get_nth_unacknowledged(&messager, 3, &stored) != 0);
+
+    fail_unless(messager.cf.ops.recvmarkq_remove_range(&messager, 100, 200) == 0);
+    fail_unless(messager.cf.ops.recvmarkq_get_nth_unacknowledged(&messager, 1, &stored) == 0);
+    fail_unless(stored->offset == 200);
+
+    fail_unless(messager.cf.ops.recvmarkq_remove_range(&messager, 0, 300) == 0);
+    fail_unless(messager.cf.ops.recvmarkq_is_empty(&messager));
+
+    curvecpr_queues_destroy(&queues);
+}
+END_TEST
+
+RUN_TEST (test_recvmarkq_orders_by_offset)
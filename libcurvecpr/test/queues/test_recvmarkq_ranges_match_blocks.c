@@ -0,0 +1,106 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/message.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+
+static unsigned int seed = 1;
+
+static unsigned int t_random (void)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+/* Works out what recvmarkq_get_ranges should say by walking every block. */
+static unsigned int t_expected_ranges (struct curvecpr_messager *messager, unsigned long long offset, struct curvecpr_message_range ranges[6])
+{
+    struct curvecpr_block *block;
+    unsigned int i, n = 0;
+    int open = 0;
+    struct curvecpr_message_range current = { 0, 0 };
+
+    for (i = 0; !messager->cf.ops.recvmarkq_get_nth_unacknowledged(messager, i, &block); ++i) {
+        unsigned long long end = block->offset + block->data_len;
+
+        if (open && block->offset <= current.end) {
+            if (end > current.end)
+                current.end = end;
+            continue;
+        }
+
+        if (open && current.end > offset) {
+            if (n == 6)
+                return n;
+            ranges[n++] = current;
+        }
+
+        open = 1;
+        current.start = block->offset;
+        current.end = end;
+    }
+
+    if (open && current.end > offset && n < 6)
+        ranges[n++] = current;
+
+    return n;
+}
+
+static const unsigned char payload[100];
+
+START_TEST (test_recvmarkq_ranges_match_blocks)
+{
+    struct curvecpr_messager messager;
+    struct curvecpr_messager_cf cf = { .ops = { .send = NULL } };
+    struct curvecpr_queues queues;
+    struct curvecpr_queues_cf queues_cf = {
+        .send_blocks = 4,
+        .recv_blocks = 64
+    };
+    struct curvecpr_block block = {
+        .eof = CURVECPR_BLOCK_STREAM,
+        .data = payload
+    };
+    struct curvecpr_block *stored = NULL;
+    int round;
+
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+
+    curvecpr_messager_new(&messager, &cf, 0);
+
+    fail_unless(messager.cf.ops.recvmarkq_get_ranges != NULL);
+
+    for (round = 0; round < 20000; ++round) {
+        struct curvecpr_message_range expected[6], actual[6];
+        unsigned int expected_num, actual_num, i;
+        unsigned long long offset;
+
+        if (t_random() % 3) {
+            /* Blocks of 100 bytes, with the odd empty one (like an EOF marker). */
+            block.offset = (t_random() % 200) * 100;
+            block.data_len = t_random() % 10 ? 100 : 0;
+            messager.cf.ops.recvmarkq_put(&messager, &block, &stored);
+        } else {
+            unsigned long long start = (t_random() % 200) * 100;
+
+            messager.cf.ops.recvmarkq_remove_range(&messager, t_random() % 4 ? start : 0, start + (t_random() % 20) * 100);
+        }
+
+        offset = (t_random() % 200) * 100;
+        expected_num = t_expected_ranges(&messager, offset, expected);
+        actual_num = messager.cf.ops.recvmarkq_get_ranges(&messager, offset, actual);
+
+        fail_unless(expected_num == actual_num);
+        for (i = 0; i < actual_num; ++i) {
+            fail_unless(expected[i].start == actual[i].start);
+            fail_unless(expected[i].end == actual[i].end);
+        }
+    }
+
+    curvecpr_queues_destroy(&queues);
+}
+END_TEST
+
+RUN_TEST (test_recvmarkq_ranges_match_blocks)
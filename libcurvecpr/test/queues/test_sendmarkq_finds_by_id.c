@@ -0,0 +1,108 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+
+#define BLOCKS 1000
+
+static int t_send (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
+{
+    return 0;
+}
+
+static const unsigned char payload[100];
+
+START_TEST (test_sendmarkq_finds_by_id)
+{
+    struct curvecpr_messager messager;
+    struct curvecpr_messager_cf cf = {
+        .ops = {
+            .send = t_send
+        }
+    };
+    struct curvecpr_queues queues;
+    struct curvecpr_queues_cf queues_cf = {
+        .send_blocks = BLOCKS,
+        .recv_blocks = 4
+    };
+    struct curvecpr_block block = {
+        .eof = CURVECPR_BLOCK_STREAM,
+        .data_len = 100,
+        .data = payload
+    };
+    struct curvecpr_block *found = NULL;
+    crypto_uint32 id;
+    int i, pass;
+
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+
+    curvecpr_messager_new(&messager, &cf, 0);
+
+    for (i = 0; i < BLOCKS; ++i)
+        fail_unless(curvecpr_queues_sendq_put(&queues, &block) == 0);
+
+    for (i = 0; i < BLOCKS; ++i) {
+        messager.my_sent_clock = 0;
+        fail_unless(curvecpr_messager_process_sendq(&messager) == 0);
+    }
+
+    fail_unless(messager.cf.ops.sendq_is_empty(&messager));
+
+    /* Every block can be found by the ID it was sent under. */
+    for (id = 1; id <= BLOCKS; ++id) {
+        fail_unless(messager.cf.ops.sendmarkq_get(&messager, id, &found) == 0);
+        fail_unless(found->id == id);
+        fail_unless(found->offset == (id - 1) * 100);
+    }
+    fail_unless(messager.cf.ops.sendmarkq_get(&messager, BLOCKS + 1, &found) != 0);
+
+    /* Retransmitting the oldest block files it under its new ID. */
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &found) == 0);
+    fail_unless(found->offset == 0);
+    found->id = BLOCKS + 1;
+    found->clock = messager.chicago.clock + 1000;
+    messager.cf.ops.sendq_move_to_sendmarkq(&messager, found, NULL);
+
+    fail_unless(messager.cf.ops.sendmarkq_get(&messager, 1, &found) != 0);
+    fail_unless(messager.cf.ops.sendmarkq_get(&messager, BLOCKS + 1, &found) == 0);
+    fail_unless(found->offset == 0);
+
+    /* Acknowledge every other block, over and over as a receiver would. */
+    for (pass = 0; pass < 3; ++pass) {
+        for (i = 1; i < BLOCKS; i += 2)
+            fail_unless(messager.cf.ops.sendmarkq_remove_range(&messager, (unsigned long long)i * 100, (unsigned long long)(i + 1) * 100) == 0);
+    }
+
+    for (id = 2; id <= BLOCKS; ++id) {
+        if ((id - 1) % 2)
+            fail_unless(messager.cf.ops.sendmarkq_get(&messager, id, &found) != 0);
+        else
+            fail_unless(messager.cf.ops.sendmarkq_get(&messager, id, &found) == 0);
+    }
+
+    /* The clock order is still right: the oldest is now the third block sent. */
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &found) == 0);
+    fail_unless(found->offset == 200);
+
+    /* A range over the holes takes out what's left between them, leaving only the
+       retransmitted first block. */
+    fail_unless(messager.cf.ops.sendmarkq_remove_range(&messager, 100, BLOCKS * 100) == 0);
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &found) == 0);
+    fail_unless(found->offset == 0);
+    fail_unless(queues.sendmarkq_len == 1);
+    fail_unless(queues.sendmarkq_marks_len == 1);
+    fail_unless(messager.cf.ops.sendmarkq_get(&messager, 3, &found) != 0);
+    fail_unless(messager.cf.ops.sendmarkq_get(&messager, BLOCKS + 1, &found) == 0);
+
+    fail_unless(messager.cf.ops.sendmarkq_remove_range(&messager, 0, BLOCKS * 100) == 0);
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &found) != 0);
+    fail_unless(messager.cf.ops.sendmarkq_get(&messager, BLOCKS + 1, &found) != 0);
+    fail_unless(queues.sendmarkq_marks_len == 0);
+
+    curvecpr_queues_destroy(&queues);
+}
+END_TEST
+
+RUN_TEST (test_sendmarkq_finds_by_id)
@@ -0,0 +1,75 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+
+static int t_send (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
+{
+    return 0;
+}
+
+static const unsigned char payload[100];
+
+START_TEST (test_sendmarkq_orders_by_clock)
+{
+    struct curvecpr_messager messager;
+    struct curvecpr_messager_cf cf = {
+        .ops = {
+            .send = t_send
+        }
+    };
+    struct curvecpr_queues queues;
+    struct curvecpr_queues_cf queues_cf = {
+        .send_blocks = 4,
+        .recv_blocks = 4
+    };
+    struct curvecpr_block block = {
+        .eof = CURVECPR_BLOCK_STREAM,
+        .data_len = 100,
+        .data = payload
+    };
+    struct curvecpr_block *head = NULL;
+    int i;
+
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+
+    curvecpr_messager_new(&messager, &cf, 0);
+
+    for (i = 0; i < 3; ++i)
+        fail_unless(curvecpr_queues_sendq_put(&queues, &block) == 0);
+
+    for (i = 0; i < 3; ++i) {
+        messager.my_sent_clock = 0;
+        fail_unless(curvecpr_messager_process_sendq(&messager) == 0);
+    }
+
+    fail_unless(messager.cf.ops.sendq_is_empty(&messager));
+
+    /* The first block sent is the oldest. */
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &head) == 0);
+    fail_unless(head->offset == 0);
+
+    /* Pretend it was just retransmitted; it should move to the back. */
+    head->clock = messager.chicago.clock + 1000;
+    messager.cf.ops.sendq_move_to_sendmarkq(&messager, head, NULL);
+
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &head) == 0);
+    fail_unless(head->offset == 100);
+
+    /* Acknowledge the middle block. */
+    fail_unless(messager.cf.ops.sendmarkq_remove_range(&messager, 100, 200) == 0);
+
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &head) == 0);
+    fail_unless(head->offset == 200);
+
+    /* And the rest. */
+    fail_unless(messager.cf.ops.sendmarkq_remove_range(&messager, 0, 300) == 0);
+    fail_unless(messager.cf.ops.sendmarkq_head(&messager, &head) != 0);
+
+    curvecpr_queues_destroy(&queues);
+}
+END_TEST
+
+RUN_TEST (test_sendmarkq_orders_by_clock)
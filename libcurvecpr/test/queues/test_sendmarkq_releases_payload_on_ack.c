@@ -0,0 +1,112 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <errno.h>
+
+#include <curvecpr/block.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+
+static unsigned char file[3000];
+static unsigned char header[10];
+
+static unsigned char sent[1088];
+static size_t sent_num = 0;
+
+static int released = 0;
+
+static int t_send (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(sent, buf, num);
+    sent_num = num;
+    return 0;
+}
+
+static void t_release (struct curvecpr_block_payload *payload)
+{
+    ++released;
+}
+
+START_TEST (test_sendmarkq_releases_payload_on_ack)
+{
+    struct curvecpr_messager messager;
+    struct curvecpr_messager_cf cf = {
+        .ops = {
+            .send = t_send
+        }
+    };
+    struct curvecpr_queues queues;
+    struct curvecpr_queues_cf queues_cf = {
+        .send_blocks = 8,
+        .recv_blocks = 4
+    };
+    struct curvecpr_block_payload payload = {
+        .release = t_release,
+        .refs = 1
+    };
+    struct curvecpr_block block = {
+        .eof = CURVECPR_BLOCK_STREAM,
+        .data_len = sizeof(header) + 100,
+        .pieces = 2,
+        .piece = {
+            { .data = header, .len = sizeof(header) },
+            { .data = file + 2900, .len = 100 }
+        },
+        .payload = &payload
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(file); ++i)
+        file[i] = (unsigned char)(i * 7);
+    for (i = 0; i < sizeof(header); ++i)
+        header[i] = (unsigned char)(0xa0 + i);
+
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+
+    curvecpr_messager_new(&messager, &cf, 0);
+
+    /* Lend the file in 1024-byte blocks, then a block gathered from two pieces. */
+    fail_unless(curvecpr_queues_sendq_lend(&queues, &payload, file, sizeof(file), 1024) == sizeof(file));
+    fail_unless(curvecpr_queues_sendq_put(&queues, &block) == 0);
+    fail_unless(queues.sendq_len == 4);
+    fail_unless(payload.refs == 5);
+
+    /* Pieces have to add up. */
+    block.data_len = 1;
+    fail_unless(curvecpr_queues_sendq_put(&queues, &block) == -EINVAL);
+
+    /* Each message is built straight from the payload. */
+    for (i = 0; i < 3; ++i) {
+        size_t len = i < 2 ? 1024 : sizeof(file) - 2048;
+
+        messager.my_sent_clock = 0;
+        fail_unless(curvecpr_messager_process_sendq(&messager) == 0);
+        fail_unless(curvecpr_bytes_equal(sent + sent_num - len, file + i * 1024, len));
+    }
+
+    messager.my_sent_clock = 0;
+    fail_unless(curvecpr_messager_process_sendq(&messager) == 0);
+    fail_unless(curvecpr_bytes_equal(sent + sent_num - 110, header, sizeof(header)));
+    fail_unless(curvecpr_bytes_equal(sent + sent_num - 100, file + 2900, 100));
+
+    fail_unless(messager.cf.ops.sendq_is_empty(&messager));
+    fail_unless(payload.refs == 5);
+
+    /* References are only dropped as blocks are acknowledged. */
+    fail_unless(messager.cf.ops.sendmarkq_remove_range(&messager, 0, 2048) == 0);
+    fail_unless(payload.refs == 3);
+
+    curvecpr_block_payload_unref(&payload);
+    fail_unless(released == 0);
+
+    fail_unless(messager.cf.ops.sendmarkq_remove_range(&messager, 2048, 3110) == 0);
+    fail_unless(payload.refs == 0);
+    fail_unless(released == 1);
+
+    curvecpr_queues_destroy(&queues);
+}
+END_TEST
+
+RUN_TEST (test_sendmarkq_releases_payload_on_ack)
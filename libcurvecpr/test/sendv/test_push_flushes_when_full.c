@@ -0,0 +1,99 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/packet.h>
+#include <curvecpr/sendv.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+
+#include <errno.h>
+
+static struct curvecpr_server *flush_server;
+static struct curvecpr_session *flush_session;
+
+static int sends = 0;
+static int flushes = 0;
+static size_t flushed = 0;
+
+static int t_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    ++sends;
+    return 0;
+}
+
+static int t_flush (struct curvecpr_sendv *sendv, const struct iovec *iov, void *const *privs, size_t num)
+{
+    size_t i;
+
+    for (i = 0; i < num; ++i) {
+        const unsigned char *buf = iov[i].iov_base;
+
+        fail_unless(iov[i].iov_len == sizeof(struct curvecpr_packet_server_message) + 16 + 64);
+        fail_unless(memcmp(buf, "RL3aNMXM", 8) == 0);
+        fail_unless(privs[i] == (void *)(flushed + i + 1));
+    }
+
+    /* Nothing can be added (or flushed again) until we're done with these. */
+    fail_unless(curvecpr_sendv_next(sendv) == NULL);
+    fail_unless(curvecpr_sendv_push(sendv, iov[0].iov_base, iov[0].iov_len, NULL) == -EBUSY);
+    fail_unless(curvecpr_sendv_flush(sendv) == -EBUSY);
+    fail_unless(curvecpr_server_send(flush_server, flush_session, NULL, (const unsigned char *)iov[0].iov_base + 64, 64) != 0);
+    fail_unless(memcmp(iov[0].iov_base, "RL3aNMXM", 8) == 0);
+
+    ++flushes;
+    flushed += num;
+
+    return 0;
+}
+
+START_TEST (test_push_flushes_when_full)
+{
+    struct curvecpr_sendv sendv;
+    struct curvecpr_sendv_cf sendv_cf = {
+        .packets = 3,
+        .ops = {
+            .flush = t_flush
+        }
+    };
+    struct curvecpr_server server;
+    struct curvecpr_server_cf cf = {
+        .ops = {
+            .send = t_send
+        }
+    };
+    struct curvecpr_session s;
+    unsigned char buf[64] = { 0 };
+    size_t i;
+
+    fail_unless(curvecpr_sendv_new(&sendv, &sendv_cf) == 0);
+
+    cf.sendv = &sendv;
+    curvecpr_server_new(&server, &cf);
+    curvecpr_session_new(&s);
+
+    flush_server = &server;
+    flush_session = &s;
+
+    for (i = 1; i <= 4; ++i)
+        fail_unless(curvecpr_server_send(&server, &s, (void *)i, buf, sizeof(buf)) == 0);
+
+    /* The first three went out together as soon as the vector filled. */
+    fail_unless(flushes == 1);
+    fail_unless(flushed == 3);
+    fail_unless(sendv.len == 1);
+
+    fail_unless(curvecpr_sendv_flush(&sendv) == 0);
+    fail_unless(flushes == 2);
+    fail_unless(flushed == 4);
+
+    /* Nothing left to send. */
+    fail_unless(curvecpr_sendv_flush(&sendv) == 0);
+    fail_unless(flushes == 2);
+
+    fail_unless(sends == 0);
+
+    curvecpr_sendv_destroy(&sendv);
+}
+END_TEST
+
+RUN_TEST (test_push_flushes_when_full)
@@ -0,0 +1,125 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/client.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+
+static struct curvecpr_session server_session;
+
+static unsigned char wire[1184];
+static size_t wire_num = 0;
+
+static unsigned char received[1088];
+static size_t received_num = 0;
+
+static int t_get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    if (!curvecpr_bytes_equal(server_session.their_session_pk, their_session_pk, 32))
+        return 1;
+
+    *s_stored = &server_session;
+    return 0;
+}
+
+static int t_server_send (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_server_recv (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(received, buf, num);
+    received_num = num;
+    return 0;
+}
+
+static int t_client_send (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(wire, buf, num);
+    wire_num = num;
+    return 0;
+}
+
+static int t_client_recv (struct curvecpr_client *client, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(received, buf, num);
+    received_num = num;
+    return 0;
+}
+
+START_TEST (test_inplace_round_trips)
+{
+    struct curvecpr_server server;
+    struct curvecpr_server_cf server_cf = {
+        .ops = {
+            .get_session = t_get_session,
+            .send = t_server_send,
+            .recv = t_server_recv
+        }
+    };
+    struct curvecpr_client client;
+    struct curvecpr_client_cf client_cf = {
+        .ops = {
+            .send = t_client_send,
+            .recv = t_client_recv
+        }
+    };
+    unsigned char buf[CURVECPR_CLIENT_HEADROOM + 1088];
+    unsigned char message[512];
+    size_t i;
+
+    for (i = 0; i < sizeof(message); ++i)
+        message[i] = (unsigned char)i;
+
+    curvecpr_server_new(&server, &server_cf);
+    fail_unless(curvecpr_client_new(&client, &client_cf) == 0);
+
+    /* Pretend the handshake has already happened. */
+    client.negotiated = CURVECPR_CLIENT_NEGOTIATED;
+    curvecpr_bytes_zero(client.session.my_session_pk, 32);
+    client.session.my_session_pk[0] = 1;
+    client.session.my_session_their_session_key[0] = 2;
+
+    curvecpr_session_new(&server_session);
+    curvecpr_bytes_copy(server_session.their_session_pk, client.session.my_session_pk, 32);
+    curvecpr_bytes_copy(server_session.my_session_their_session_key, client.session.my_session_their_session_key, 32);
+
+    /* Client to server, encrypted and decrypted where it sits. */
+    curvecpr_bytes_copy(buf + CURVECPR_CLIENT_HEADROOM, message, sizeof(message));
+    fail_unless(curvecpr_client_send_inplace(&client, buf + CURVECPR_CLIENT_HEADROOM, sizeof(message)) == 0);
+    fail_unless(wire_num == 96 + sizeof(message));
+
+    fail_unless(curvecpr_server_recv_inplace(&server, NULL, wire, wire_num, NULL) == 0);
+    fail_unless(received_num == sizeof(message));
+    fail_unless(curvecpr_bytes_equal(received, message, sizeof(message)));
+
+    /* Replays are still refused. */
+    fail_unless(curvecpr_client_send(&client, message, sizeof(message)) == 0);
+    fail_unless(curvecpr_server_recv(&server, NULL, wire, wire_num, NULL) == 0);
+    fail_unless(curvecpr_server_recv(&server, NULL, wire, wire_num, NULL) != 0);
+
+    /* Server to client. */
+    curvecpr_bytes_copy(buf + CURVECPR_SERVER_HEADROOM, message, sizeof(message));
+    fail_unless(curvecpr_server_send_inplace(&server, &server_session, NULL, buf + CURVECPR_SERVER_HEADROOM, sizeof(message)) == 0);
+    fail_unless(wire_num == CURVECPR_SERVER_HEADROOM + sizeof(message));
+
+    received_num = 0;
+    fail_unless(curvecpr_client_recv_inplace(&client, wire, wire_num) == 0);
+    fail_unless(received_num == sizeof(message));
+    fail_unless(curvecpr_bytes_equal(received, message, sizeof(message)));
+
+    /* And the copying versions understand each other too. */
+    fail_unless(curvecpr_server_send(&server, &server_session, NULL, message, sizeof(message)) == 0);
+    received_num = 0;
+    fail_unless(curvecpr_client_recv(&client, wire, wire_num) == 0);
+    fail_unless(curvecpr_bytes_equal(received, message, sizeof(message)));
+
+    curvecpr_client_destroy(&client);
+}
+END_TEST
+
+RUN_TEST (test_inplace_round_trips)
@@ -0,0 +1,116 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/packet.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+
+#include <sodium/crypto_box.h>
+
+static struct curvecpr_session sessions[2];
+static int get_session_calls = 0;
+static unsigned char received[8];
+static int num_received = 0;
+
+static int t_get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    int i;
+
+    ++get_session_calls;
+
+    for (i = 0; i < 2; ++i) {
+        if (curvecpr_bytes_equal(sessions[i].their_session_pk, their_session_pk, 32)) {
+            *s_stored = &sessions[i];
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int t_recv (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    received[num_received++] = buf[0];
+    return 0;
+}
+
+static void build_message (unsigned char *buf, const struct curvecpr_session *s, crypto_uint64 nonce, unsigned char tag)
+{
+    struct curvecpr_packet_client_message *p = (struct curvecpr_packet_client_message *)buf;
+    unsigned char box_nonce[24];
+    unsigned char data[32 + 16];
+
+    curvecpr_bytes_zero(buf, 128);
+    curvecpr_bytes_copy(p->id, "QvnQ5XlM", 8);
+    curvecpr_bytes_copy(p->client_session_pk, s->their_session_pk, 32);
+    curvecpr_bytes_pack_uint64(p->nonce, nonce);
+
+    curvecpr_bytes_copy(box_nonce, "CurveCP-client-M", 16);
+    curvecpr_bytes_copy(box_nonce + 16, p->nonce, 8);
+
+    curvecpr_bytes_zero(data, sizeof(data));
+    data[32] = tag;
+
+    crypto_box_afternm(data, data, sizeof(data), box_nonce, s->my_session_their_session_key);
+    curvecpr_bytes_copy(buf + sizeof(struct curvecpr_packet_client_message), data + 16, 32);
+}
+
+START_TEST (test_recv_batch_keeps_session_order)
+{
+    struct curvecpr_server server;
+    struct curvecpr_server_cf cf = {
+        .ops = {
+            .get_session = t_get_session,
+            .recv = t_recv
+        }
+    };
+    unsigned char bufs[6][128];
+    struct curvecpr_server_packet packets[6];
+    int i;
+
+    curvecpr_server_new(&server, &cf);
+
+    for (i = 0; i < 2; ++i) {
+        curvecpr_session_new(&sessions[i]);
+        curvecpr_bytes_zero(sessions[i].their_session_pk, 32);
+        sessions[i].their_session_pk[0] = (unsigned char)(2 - i);
+        sessions[i].my_session_their_session_key[0] = (unsigned char)(i + 1);
+    }
+
+    /* Interleaved packets for both sessions, with a replay and some garbage. */
+    build_message(bufs[0], &sessions[0], 1, 'a');
+    build_message(bufs[1], &sessions[1], 1, 'x');
+    build_message(bufs[2], &sessions[0], 2, 'b');
+    build_message(bufs[3], &sessions[0], 2, 'c');
+    build_message(bufs[4], &sessions[1], 2, 'y');
+    curvecpr_bytes_zero(bufs[5], 128);
+
+    for (i = 0; i < 6; ++i) {
+        packets[i].buf = bufs[i];
+        packets[i].num = 112;
+        packets[i].priv = NULL;
+    }
+
+    fail_unless(curvecpr_server_recv_batch(&server, packets, 6) == 4);
+
+    /* One lookup per session. */
+    fail_unless(get_session_calls == 2);
+
+    fail_unless(packets[0].result == 0 && packets[0].s == &sessions[0]);
+    fail_unless(packets[1].result == 0 && packets[1].s == &sessions[1]);
+    fail_unless(packets[2].result == 0 && packets[2].s == &sessions[0]);
+    fail_unless(packets[3].result != 0 && packets[3].s == NULL);
+    fail_unless(packets[4].result == 0 && packets[4].s == &sessions[1]);
+    fail_unless(packets[5].result != 0 && packets[5].s == NULL);
+
+    /* Each session's packets arrive in the order they were given. */
+    fail_unless(num_received == 4);
+    fail_unless(curvecpr_bytes_equal(received, "xyab", 4) || curvecpr_bytes_equal(received, "abxy", 4));
+
+    fail_unless(sessions[0].their_session_nonce == 2);
+    fail_unless(sessions[1].their_session_nonce == 2);
+}
+END_TEST
+
+RUN_TEST (test_recv_batch_keeps_session_order)
@@ -0,0 +1,101 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/packet.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+#include <curvecpr/sessions.h>
+
+#include <sodium/crypto_box.h>
+
+static struct curvecpr_sessions table;
+static struct curvecpr_session template;
+static int num_received = 0;
+
+static int t_recv (struct curvecpr_server *server, struct curvecpr_session *s, void *priv, const unsigned char *buf, size_t num)
+{
+    ++num_received;
+
+    /* The client closes: drop its session, and let another client take over the
+       same entry. */
+    if (buf[0] == 'q') {
+        curvecpr_sessions_remove(&table, s);
+        fail_unless(curvecpr_sessions_put(&table, &template, NULL, NULL) == 0);
+    }
+
+    return 0;
+}
+
+static void build_message (unsigned char *buf, const unsigned char *pk, crypto_uint64 nonce, unsigned char tag)
+{
+    struct curvecpr_packet_client_message *p = (struct curvecpr_packet_client_message *)buf;
+    unsigned char box_nonce[24];
+    unsigned char data[32 + 16];
+
+    curvecpr_bytes_zero(buf, 128);
+    curvecpr_bytes_copy(p->id, "QvnQ5XlM", 8);
+    curvecpr_bytes_copy(p->client_session_pk, pk, 32);
+    curvecpr_bytes_pack_uint64(p->nonce, nonce);
+
+    curvecpr_bytes_copy(box_nonce, "CurveCP-client-M", 16);
+    curvecpr_bytes_copy(box_nonce + 16, p->nonce, 8);
+
+    curvecpr_bytes_zero(data, sizeof(data));
+    data[32] = tag;
+
+    crypto_box_afternm(data, data, sizeof(data), box_nonce, template.my_session_their_session_key);
+    curvecpr_bytes_copy(buf + sizeof(struct curvecpr_packet_client_message), data + 16, 32);
+}
+
+START_TEST (test_recv_batch_revalidates_sessions)
+{
+    struct curvecpr_server server;
+    struct curvecpr_server_cf cf = {
+        .ops = {
+            .recv = t_recv
+        }
+    };
+    struct curvecpr_sessions_cf sessions_cf = {
+        .capacity = 2
+    };
+    unsigned char pk[32];
+    unsigned char bufs[2][128];
+    struct curvecpr_server_packet packets[2];
+    int i;
+
+    fail_unless(curvecpr_sessions_new(&table, &sessions_cf) == 0);
+    curvecpr_sessions_configure(&table, &cf);
+    curvecpr_server_new(&server, &cf);
+
+    /* One client, and another that will reuse its keys (so a stale pointer would
+       still decrypt). */
+    curvecpr_session_new(&template);
+    curvecpr_bytes_zero(template.their_session_pk, 32);
+    template.my_session_their_session_key[0] = 1;
+
+    curvecpr_bytes_copy(pk, template.their_session_pk, 32);
+    fail_unless(curvecpr_sessions_put(&table, &template, NULL, NULL) == 0);
+    template.their_session_pk[0] = 1;
+
+    build_message(bufs[0], pk, 1, 'q');
+    build_message(bufs[1], pk, 2, 'r');
+
+    for (i = 0; i < 2; ++i) {
+        packets[i].buf = bufs[i];
+        packets[i].num = 112;
+        packets[i].priv = NULL;
+    }
+
+    fail_unless(curvecpr_server_recv_batch(&server, packets, 2) == 1);
+
+    /* The second packet's session was gone by the time it was handled. */
+    fail_unless(packets[0].result == 0);
+    fail_unless(packets[1].result != 0 && packets[1].s == NULL);
+    fail_unless(num_received == 1);
+
+    curvecpr_sessions_destroy(&table);
+}
+END_TEST
+
+RUN_TEST (test_recv_batch_revalidates_sessions)
@@ -0,0 +1,70 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/clock.h>
+#include <curvecpr/session.h>
+#include <curvecpr/sessions.h>
+
+static int removed = 0;
+
+static void t_remove (struct curvecpr_sessions *sessions, struct curvecpr_session *s)
+{
+    ++removed;
+}
+
+#define START 1000000000000LL
+
+START_TEST (test_expire_removes_idle_sessions)
+{
+    struct curvecpr_clock clock;
+    struct curvecpr_sessions sessions;
+    struct curvecpr_sessions_cf cf = {
+        .capacity = 3,
+        .idle_timeout = 1000000000LL,
+        .clock = &clock,
+        .ops = {
+            .remove = t_remove
+        }
+    };
+    struct curvecpr_session s, *s_stored = NULL;
+    unsigned char pk[32] = { 0 };
+    int i;
+
+    curvecpr_clock_new(&clock, CURVECPR_CLOCK_INJECTED);
+    curvecpr_clock_set(&clock, START);
+
+    fail_unless(curvecpr_sessions_new(&sessions, &cf) == 0);
+
+    for (i = 0; i < 3; ++i) {
+        curvecpr_session_new(&s);
+        s.their_session_pk[0] = i;
+        fail_unless(curvecpr_sessions_put(&sessions, &s, NULL, &s_stored) == 0);
+    }
+
+    /* Using session 0 half a second later makes session 1 the least recently used,
+       and leaves only sessions 1 and 2 idle a second after they were put. Lookups
+       take the time from the last refresh, not the clock. */
+    curvecpr_clock_set(&clock, START + 500000000LL);
+    fail_unless(curvecpr_sessions_get(&sessions, pk, &s_stored) == 0);
+    fail_unless(sessions.entries[0].last_used == START);
+
+    curvecpr_sessions_refresh_clock(&sessions);
+    fail_unless(curvecpr_sessions_get(&sessions, pk, &s_stored) == 0);
+    fail_unless(sessions.entries[0].last_used == START + 500000000LL);
+
+    fail_unless(curvecpr_sessions_expire(&sessions, START + 999999999LL) == 0);
+    fail_unless(curvecpr_sessions_expire(&sessions, START + 1000000000LL) == 2);
+    fail_unless(removed == 2);
+    fail_unless(sessions.len == 1);
+
+    fail_unless(curvecpr_sessions_get(&sessions, pk, &s_stored) == 0);
+    pk[0] = 1;
+    fail_unless(curvecpr_sessions_get(&sessions, pk, &s_stored) != 0);
+
+    curvecpr_sessions_destroy(&sessions);
+    fail_unless(removed == 3);
+}
+END_TEST
+
+RUN_TEST (test_expire_removes_idle_sessions)
@@ -0,0 +1,68 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/session.h>
+#include <curvecpr/sessions.h>
+
+START_TEST (test_get_returns_put_session)
+{
+    struct curvecpr_sessions sessions;
+    struct curvecpr_sessions_cf cf = {
+        .capacity = 1000
+    };
+    struct curvecpr_session s, *s_stored = NULL;
+    unsigned int i;
+
+    fail_unless(curvecpr_sessions_new(&sessions, &cf) == 0);
+
+    /* Fill the table right up. */
+    for (i = 0; i < 1000; ++i) {
+        curvecpr_session_new(&s);
+        curvecpr_bytes_pack_uint32(s.their_session_pk, i);
+        s.their_session_nonce = i;
+
+        fail_unless(curvecpr_sessions_put(&sessions, &s, NULL, &s_stored) == 0);
+        fail_unless(s_stored->their_session_nonce == i);
+    }
+
+    fail_unless(curvecpr_sessions_put(&sessions, &s, NULL, &s_stored) != 0);
+
+    for (i = 0; i < 1000; ++i) {
+        unsigned char pk[32] = { 0 };
+        curvecpr_bytes_pack_uint32(pk, i);
+
+        fail_unless(curvecpr_sessions_get(&sessions, pk, &s_stored) == 0);
+        fail_unless(s_stored->their_session_nonce == i);
+    }
+
+    /* Remove the even ones and replace them with new ones. */
+    for (i = 0; i < 1000; i += 2) {
+        unsigned char pk[32] = { 0 };
+        curvecpr_bytes_pack_uint32(pk, i);
+
+        fail_unless(curvecpr_sessions_get(&sessions, pk, &s_stored) == 0);
+        curvecpr_sessions_remove(&sessions, s_stored);
+        fail_unless(curvecpr_sessions_get(&sessions, pk, &s_stored) != 0);
+
+        curvecpr_session_new(&s);
+        curvecpr_bytes_pack_uint32(s.their_session_pk, i + 1000);
+        s.their_session_nonce = i + 1000;
+        fail_unless(curvecpr_sessions_put(&sessions, &s, NULL, &s_stored) == 0);
+    }
+
+    for (i = 0; i < 2000; ++i) {
+        unsigned char pk[32] = { 0 };
+        int expected = i < 1000 ? i % 2 : i % 2 == 0;
+        curvecpr_bytes_pack_uint32(pk, i);
+
+        fail_unless((curvecpr_sessions_get(&sessions, pk, &s_stored) == 0) == expected);
+        if (expected)
+            fail_unless(s_stored->their_session_nonce == i);
+    }
+
+    curvecpr_sessions_destroy(&sessions);
+}
+END_TEST
+
+RUN_TEST (test_get_returns_put_session)
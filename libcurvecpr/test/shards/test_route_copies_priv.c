@@ -0,0 +1,68 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/admission.h>
+#include <curvecpr/bytes.h>
+#include <curvecpr/packet.h>
+#include <curvecpr/shards.h>
+
+static unsigned int sources;
+
+static int t_source (struct curvecpr_admission *admission, void *priv, unsigned char tag[CURVECPR_ADMISSION_TAG])
+{
+    /* The router's copy of the address, not the caller's (long since wiped). */
+    fail_unless(curvecpr_bytes_equal(priv, "192.0.2.1:12345", 16));
+
+    curvecpr_bytes_copy(tag, priv, 16);
+    ++sources;
+
+    return 0;
+}
+
+START_TEST (test_route_copies_priv)
+{
+    struct curvecpr_shards shards;
+    struct curvecpr_shards_cf cf = {
+        .shards = 2,
+        .ring_packets = 4,
+        .admission = {
+            .sources = 16,
+            .source_rate = 1,
+            .source_burst = 1,
+            .ops = {
+                .source = t_source
+            }
+        },
+        .priv_bytes = 16
+    };
+    struct curvecpr_packet_hello *p;
+    unsigned char buf[224];
+    unsigned char peer[16];
+    unsigned int i;
+
+    fail_unless(curvecpr_shards_new(&shards, &cf) == 0);
+
+    /* Offloaded initiates get their own copies too. */
+    fail_unless(shards.cf.handshakes.priv_bytes == 16);
+
+    curvecpr_bytes_zero(buf, sizeof(buf));
+    p = (struct curvecpr_packet_hello *)buf;
+    curvecpr_bytes_copy(p->id, "QvnQ5XlH", 8);
+
+    curvecpr_bytes_copy(peer, "192.0.2.1:12345", 16);
+    fail_unless(curvecpr_shards_route(&shards, buf, sizeof(buf), peer) == 0);
+    curvecpr_bytes_zero(peer, sizeof(peer));
+
+    for (i = 0; i < 2; ++i)
+        curvecpr_shards_process(&shards, i, 64);
+    fail_unless(sources == 1);
+
+    curvecpr_shards_destroy(&shards);
+
+    /* Too much to copy. */
+    cf.priv_bytes = CURVECPR_SHARDS_PRIV + 1;
+    fail_unless(curvecpr_shards_new(&shards, &cf) != 0);
+}
+END_TEST
+
+RUN_TEST (test_route_copies_priv)
@@ -0,0 +1,99 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/packet.h>
+#include <curvecpr/server.h>
+#include <curvecpr/session.h>
+#include <curvecpr/shards.h>
+
+#include <errno.h>
+
+static unsigned int lookups[4];
+
+static int t_get_session (struct curvecpr_server *server, const unsigned char their_session_pk[32], struct curvecpr_session **s_stored)
+{
+    const struct curvecpr_shards_shard *shard = (const struct curvecpr_shards_shard *)server;
+
+    /* Only the owning shard should ever see this client. */
+    fail_unless(curvecpr_shards_owner(shard->shards, their_session_pk) == shard->index);
+
+    ++lookups[shard->index];
+
+    return 1;
+}
+
+static void build_message (unsigned char *buf, unsigned char client)
+{
+    struct curvecpr_packet_client_message *p = (struct curvecpr_packet_client_message *)buf;
+
+    curvecpr_bytes_zero(buf, 128);
+    curvecpr_bytes_copy(p->id, "QvnQ5XlM", 8);
+    p->client_session_pk[0] = client;
+}
+
+START_TEST (test_route_reaches_owning_shard)
+{
+    struct curvecpr_shards shards;
+    struct curvecpr_shards_cf cf = {
+        .shards = 4,
+        .ring_packets = 3,
+        .server = {
+            .ops = {
+                .get_session = t_get_session
+            }
+        }
+    };
+    unsigned char buf[128];
+    unsigned char pk[32];
+    unsigned int owner;
+    unsigned int i;
+    unsigned int routed = 0;
+
+    fail_unless(curvecpr_shards_new(&shards, &cf) == 0);
+
+    /* Rings are rounded up to a power of two. */
+    fail_unless(shards.shards[0].ring.mask == 3);
+
+    /* Ownership is stable. */
+    curvecpr_bytes_zero(pk, 32);
+    owner = curvecpr_shards_owner(&shards, pk);
+    fail_unless(owner < 4);
+    fail_unless(curvecpr_shards_owner(&shards, pk) == owner);
+
+    /* Too short to carry a client key. */
+    fail_unless(curvecpr_shards_route(&shards, buf, 72, NULL) == -EINVAL);
+
+    /* One client fills its shard's ring. */
+    build_message(buf, 0);
+    for (i = 0; i < 4; ++i)
+        fail_unless(curvecpr_shards_route(&shards, buf, 128, NULL) == 0);
+    fail_unless(curvecpr_shards_route(&shards, buf, 128, NULL) == -ENOBUFS);
+
+    /* Other clients still go through to their own shards. */
+    for (i = 1; i < 32; ++i) {
+        build_message(buf, (unsigned char)i);
+        if (curvecpr_shards_route(&shards, buf, 128, NULL) == 0)
+            ++routed;
+    }
+    fail_unless(routed > 0);
+
+    /* Draining partially, then fully, hands every packet to the owning shard. */
+    fail_unless(curvecpr_shards_process(&shards, owner, 1) == 1);
+    fail_unless(lookups[owner] == 1);
+
+    routed += 3;
+    for (i = 0; i < 4; ++i)
+        routed -= (unsigned int)curvecpr_shards_process(&shards, i, 64);
+    fail_unless(routed == 0);
+    fail_unless(curvecpr_shards_process(&shards, owner, 64) == 0);
+
+    /* Room again. */
+    build_message(buf, 0);
+    fail_unless(curvecpr_shards_route(&shards, buf, 128, NULL) == 0);
+
+    curvecpr_shards_destroy(&shards);
+}
+END_TEST
+
+RUN_TEST (test_route_reaches_owning_shard)
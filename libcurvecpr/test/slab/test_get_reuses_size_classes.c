@@ -0,0 +1,104 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+#include <curvecpr/slab.h>
+
+#include <stdlib.h>
+
+static int allocs = 0;
+static int frees = 0;
+
+static void *t_alloc (struct curvecpr_slab *slab, size_t num)
+{
+    ++allocs;
+    return malloc(num);
+}
+
+static void t_free (struct curvecpr_slab *slab, void *page)
+{
+    ++frees;
+    free(page);
+}
+
+static const unsigned char payload[200];
+
+START_TEST (test_get_reuses_size_classes)
+{
+    struct curvecpr_slab slab;
+    struct curvecpr_slab_cf slab_cf = {
+        .page_bytes = 4096,
+        .ops = {
+            .alloc = t_alloc,
+            .free = t_free
+        }
+    };
+    struct curvecpr_queues queues;
+    struct curvecpr_queues_cf queues_cf = {
+        .send_blocks = 4,
+        .recv_blocks = 4,
+        .slab = &slab
+    };
+    struct curvecpr_messager_cf cf = { .ops = { .send = NULL } };
+    struct curvecpr_block block = {
+        .eof = CURVECPR_BLOCK_STREAM,
+        .data = payload
+    };
+    unsigned char *small, *again, *large;
+
+    fail_unless(curvecpr_slab_new(&slab, &slab_cf) == 0);
+
+    fail_unless(curvecpr_slab_chunk_bytes(1) == 64);
+    fail_unless(curvecpr_slab_chunk_bytes(64) == 64);
+    fail_unless(curvecpr_slab_chunk_bytes(65) == 128);
+    fail_unless(curvecpr_slab_chunk_bytes(1024) == 1024);
+
+    small = curvecpr_slab_get(&slab, 40);
+    fail_unless(small != NULL);
+    fail_unless(slab.bytes_used == 64);
+    fail_unless(allocs == 1);
+
+    /* Released chunks are handed out again before any new memory is taken. */
+    curvecpr_slab_put(&slab, small, 40);
+    fail_unless(slab.bytes_used == 0);
+    again = curvecpr_slab_get(&slab, 60);
+    fail_unless(again == small);
+    fail_unless(allocs == 1);
+    curvecpr_slab_put(&slab, again, 60);
+
+    large = curvecpr_slab_get(&slab, 1024);
+    fail_unless(large != NULL);
+    fail_unless(allocs == 2);
+    curvecpr_slab_put(&slab, large, 1024);
+
+    fail_unless(curvecpr_slab_get(&slab, 1025) == NULL);
+
+    /* Queues keep each block's data in a chunk sized to fit. */
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+
+    block.data_len = 40;
+    fail_unless(curvecpr_queues_sendq_put(&queues, &block) == 0);
+    block.data_len = 200;
+    fail_unless(curvecpr_queues_sendq_put(&queues, &block) == 0);
+    block.data_len = 0;
+    fail_unless(curvecpr_queues_sendq_put(&queues, &block) == 0);
+    fail_unless(slab.bytes_used == 64 + 256);
+
+    /* Topping up the last block moves it to a bigger chunk as it grows. */
+    fail_unless(curvecpr_queues_sendq_write(&queues, payload, 100, 1024) == 100);
+    fail_unless(slab.bytes_used == 64 + 256 + 128);
+    fail_unless(curvecpr_queues_sendq_write(&queues, payload, 100, 1024) == 100);
+    fail_unless(slab.bytes_used == 64 + 256 + 256);
+    fail_unless(queues.sendq_len == 3);
+
+    curvecpr_queues_destroy(&queues);
+    fail_unless(slab.bytes_used == 0);
+
+    curvecpr_slab_destroy(&slab);
+    fail_unless(frees == allocs);
+}
+END_TEST
+
+RUN_TEST (test_get_reuses_size_classes)
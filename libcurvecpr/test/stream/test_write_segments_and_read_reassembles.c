@@ -0,0 +1,109 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+#include <curvecpr/stream.h>
+
+#include <errno.h>
+
+/* Messages from the writer, kept so they can be delivered out of order. */
+static unsigned char sent[8][1088];
+static size_t sent_num[8];
+static int sent_len = 0;
+
+static int t_writer_send (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
+{
+    curvecpr_bytes_copy(sent[sent_len], buf, num);
+    sent_num[sent_len++] = num;
+    return 0;
+}
+
+/* The reader's acknowledgments aren't needed. */
+static int t_reader_send (struct curvecpr_messager *messager, const unsigned char *buf, size_t num)
+{
+    return 0;
+}
+
+START_TEST (test_write_segments_and_read_reassembles)
+{
+    struct curvecpr_messager writer, reader;
+    struct curvecpr_messager_cf writer_cf = { .ops = { .send = t_writer_send } };
+    struct curvecpr_messager_cf reader_cf = { .ops = { .send = t_reader_send } };
+    struct curvecpr_queues writer_queues, reader_queues;
+    struct curvecpr_queues_cf queues_cf = {
+        .send_blocks = 8,
+        .recv_blocks = 8
+    };
+    struct curvecpr_stream writer_stream, reader_stream;
+    struct curvecpr_stream_cf writer_stream_cf = { .recv_bytes = 4096 };
+    struct curvecpr_stream_cf reader_stream_cf = { .recv_bytes = 2048 };
+    unsigned char data[3000], received[3000];
+    size_t i, n, received_num = 0;
+
+    for (i = 0; i < sizeof(data); ++i)
+        data[i] = (unsigned char)(i * 7);
+
+    fail_unless(curvecpr_queues_new(&writer_queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&writer_queues, &writer_cf);
+    fail_unless(curvecpr_stream_new(&writer_stream, &writer_stream_cf) == 0);
+    curvecpr_stream_configure(&writer_stream, &writer_cf);
+    curvecpr_messager_new(&writer, &writer_cf, 0);
+
+    fail_unless(curvecpr_queues_new(&reader_queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&reader_queues, &reader_cf);
+    fail_unless(curvecpr_stream_new(&reader_stream, &reader_stream_cf) == 0);
+    curvecpr_stream_configure(&reader_stream, &reader_cf);
+    curvecpr_messager_new(&reader, &reader_cf, 1);
+
+    /* Small writes are packed into full blocks. */
+    for (i = 0; i < sizeof(data); i += 100) {
+        fail_unless(curvecpr_messager_write(&writer, data + i, 100, &n) == 0);
+        fail_unless(n == 100);
+    }
+    fail_unless(curvecpr_messager_shutdown(&writer) == 0);
+    fail_unless(curvecpr_messager_write(&writer, data, 1, &n) == -EPIPE);
+
+    fail_unless(writer_queues.sendq_len == 3);
+
+    while (!writer.cf.ops.sendq_is_empty(&writer)) {
+        writer.my_sent_clock = 0;
+        fail_unless(curvecpr_messager_process_sendq(&writer) == 0);
+    }
+    fail_unless(sent_len == 3);
+    fail_unless(writer.my_eof);
+
+    /* Nothing can be read until the start of the stream turns up. */
+    fail_unless(curvecpr_messager_recv(&reader, sent[1], sent_num[1]) == 0);
+    fail_unless(curvecpr_messager_read(&reader, received, sizeof(received), &n) == -EAGAIN);
+
+    /* The last block doesn't fit in the reader's ring yet, so it's refused. */
+    fail_unless(curvecpr_messager_recv(&reader, sent[2], sent_num[2]) == -EAGAIN);
+
+    fail_unless(curvecpr_messager_recv(&reader, sent[0], sent_num[0]) == 0);
+    fail_unless(curvecpr_messager_read(&reader, received, sizeof(received), &n) == 0);
+    fail_unless(n == 2048);
+    received_num += n;
+    fail_unless(curvecpr_messager_read(&reader, received, sizeof(received), &n) == -EAGAIN);
+
+    /* Once there's room, the retransmission is taken. */
+    fail_unless(curvecpr_messager_recv(&reader, sent[2], sent_num[2]) == 0);
+    fail_unless(curvecpr_messager_read(&reader, received + received_num, sizeof(received) - received_num, &n) == 0);
+    fail_unless(n == sizeof(data) - 2048);
+    received_num += n;
+
+    fail_unless(curvecpr_bytes_equal(received, data, sizeof(data)));
+
+    /* And then the end of the stream. */
+    fail_unless(curvecpr_messager_read(&reader, received, sizeof(received), &n) == 0);
+    fail_unless(n == 0);
+
+    curvecpr_stream_destroy(&writer_stream);
+    curvecpr_stream_destroy(&reader_stream);
+    curvecpr_queues_destroy(&writer_queues);
+    curvecpr_queues_destroy(&reader_queues);
+}
+END_TEST
+
+RUN_TEST (test_write_segments_and_read_reassembles)
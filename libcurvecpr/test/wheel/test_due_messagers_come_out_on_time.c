@@ -0,0 +1,160 @@
+#include <check.h>
+#include <check_extras.h>
+
+#include <curvecpr/bytes.h>
+#include <curvecpr/clock.h>
+#include <curvecpr/messager.h>
+#include <curvecpr/queues.h>
+#include <curvecpr/wheel.h>
+
+/* Messagers due anywhere from now to ten minutes from now, so every level below
+   the top gets used, checked against a 1 ms wheel advanced in uneven steps. Then a
+   few due in the top level and beyond the whole wheel's reach, so they're parked
+   and placed again, with the wheel advanced the way an event loop would. */
+#define MESSAGERS 2000
+#define TICK 1000000LL
+#define START 1000000000000LL
+
+/* 64^5 and 64^6 ticks. */
+#define TOP (1LL << 30)
+#define REACH (1LL << 36)
+
+static struct curvecpr_messager messagers[MESSAGERS];
+static long long deadlines[MESSAGERS];
+static int popped[MESSAGERS];
+
+START_TEST (test_due_messagers_come_out_on_time)
+{
+    struct curvecpr_clock clock;
+    struct curvecpr_wheel_cf wheel_cf = { .tick = TICK, .clock = &clock };
+    struct curvecpr_wheel wheel;
+    struct curvecpr_queues queues;
+    struct curvecpr_queues_cf queues_cf = { .send_blocks = 16, .recv_blocks = 16 };
+    struct curvecpr_messager_cf cf = { .clock = &clock };
+    struct curvecpr_messager *messager;
+    struct curvecpr_messager real;
+    long long now = START, last = START, step = 1;
+    unsigned long long state = 1;
+    size_t i, j, total = 0;
+    const long long far[] = {
+        TOP * TICK, TOP * TICK + 12345678901LL, 7 * TOP * TICK + 1,
+        REACH * TICK, REACH * TICK + 3 * TOP * TICK + 987654321LL, 3 * REACH * TICK + 5
+    };
+
+    curvecpr_clock_new(&clock, CURVECPR_CLOCK_INJECTED);
+    curvecpr_clock_set(&clock, START);
+    fail_unless(curvecpr_wheel_new(&wheel, &wheel_cf) == 0);
+
+    for (i = 0; i < MESSAGERS; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        deadlines[i] = START + (long long)((state >> 33) % 600000000000ULL);
+        curvecpr_wheel_schedule(&wheel, &messagers[i], deadlines[i]);
+    }
+
+    /* Move some, and take some off. */
+    for (i = 0; i < MESSAGERS; i += 10) {
+        deadlines[i] = deadlines[i] / 2 + START / 2;
+        curvecpr_wheel_schedule(&wheel, &messagers[i], deadlines[i]);
+    }
+    for (i = 5; i < MESSAGERS; i += 10) {
+        curvecpr_wheel_remove(&wheel, &messagers[i]);
+        deadlines[i] = -1;
+    }
+
+    fail_unless(curvecpr_wheel_next_expiry(&wheel) <= (deadlines[1] + TICK - 1) / TICK * TICK);
+
+    while (total < MESSAGERS - MESSAGERS / 10) {
+        long long expiry = curvecpr_wheel_next_expiry(&wheel);
+
+        fail_unless(expiry >= 0);
+
+        now += step;
+        step = step * 3 % 50000000 + 1;
+
+        curvecpr_wheel_advance(&wheel, now);
+
+        while ((messager = curvecpr_wheel_pop(&wheel))) {
+            size_t n = (size_t)(messager - messagers);
+
+            /* Never early, and no more than a tick late. */
+            fail_unless(deadlines[n] >= 0);
+            fail_unless(deadlines[n] <= now);
+            fail_unless(deadlines[n] > last - TICK);
+            fail_unless(expiry <= (deadlines[n] + TICK - 1) / TICK * TICK);
+            fail_unless(!popped[n]);
+
+            popped[n] = 1;
+            ++total;
+        }
+
+        last = now;
+    }
+
+    fail_unless(curvecpr_wheel_next_expiry(&wheel) == -1);
+    fail_unless(wheel.pending == 0 && wheel.due == 0);
+
+    /* A real messager goes on the wheel when it's created, and its timeout gets
+       it back off. */
+    curvecpr_clock_set(&clock, now);
+    fail_unless(curvecpr_queues_new(&queues, &queues_cf) == 0);
+    curvecpr_queues_configure(&queues, &cf);
+    curvecpr_wheel_configure(&wheel, &cf);
+    curvecpr_messager_new(&real, &cf, 0);
+
+    fail_unless(wheel.pending == 1);
+    fail_unless(curvecpr_wheel_advance(&wheel, now + 60000000000LL) == 0);
+    fail_unless(curvecpr_wheel_advance(&wheel, now + 62000000000LL) == 1);
+    fail_unless(curvecpr_wheel_pop(&wheel) == &real);
+
+    /* And asking again puts it back. */
+    curvecpr_clock_set(&clock, now + 62000000000LL);
+    curvecpr_messager_next_timeout(&real);
+    fail_unless(wheel.pending == 1);
+    curvecpr_wheel_remove(&wheel, &real);
+    fail_unless(wheel.pending == 0);
+
+    /* Far off. */
+    now = START;
+    fail_unless(curvecpr_wheel_new(&wheel, &wheel_cf) == 0);
+
+    for (i = 0; i < sizeof(far) / sizeof(far[0]); ++i) {
+        deadlines[i] = now + far[i];
+        popped[i] = 0;
+        curvecpr_wheel_schedule(&wheel, &messagers[i], deadlines[i]);
+    }
+
+    total = 0;
+    while (total < sizeof(far) / sizeof(far[0])) {
+        long long expiry = curvecpr_wheel_next_expiry(&wheel);
+
+        fail_unless(expiry >= 0);
+
+        /* Still a lower bound for everything left. */
+        for (j = 0; j < sizeof(far) / sizeof(far[0]); ++j)
+            fail_unless(popped[j] || expiry <= (deadlines[j] + TICK - 1) / TICK * TICK);
+
+        if (expiry > now)
+            now = expiry;
+
+        curvecpr_wheel_advance(&wheel, now);
+
+        while ((messager = curvecpr_wheel_pop(&wheel))) {
+            size_t n = (size_t)(messager - messagers);
+
+            /* Right on the tick it's due at. */
+            fail_unless(n < sizeof(far) / sizeof(far[0]));
+            fail_unless(deadlines[n] <= now && deadlines[n] > now - TICK);
+            fail_unless(!popped[n]);
+
+            popped[n] = 1;
+            ++total;
+        }
+    }
+
+    fail_unless(curvecpr_wheel_next_expiry(&wheel) == -1);
+
+    curvecpr_queues_destroy(&queues);
+}
+END_TEST
+
+RUN_TEST (test_due_messagers_come_out_on_time)